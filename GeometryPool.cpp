@@ -0,0 +1,206 @@
+#include "GeometryPool.h"
+
+GeometryPool::GeometryPool()
+{
+}
+
+void GeometryPool::init(MemoryAllocator* newAllocator, VkDevice newDevice, VkDeviceSize vertexPoolSize, VkDeviceSize indexPoolSize,
+	VkDeviceSize meshletPoolSize)
+{
+	allocator = newAllocator;
+	device = newDevice;
+
+	// All pools live on the GPU only and are filled with transfers from staging buffers
+	VkBufferCreateInfo bufferInfo = {};
+	bufferInfo.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
+	bufferInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+
+	// VERTEX POOL
+	bufferInfo.size = vertexPoolSize;
+	bufferInfo.usage = VK_BUFFER_USAGE_TRANSFER_DST_BIT | VK_BUFFER_USAGE_VERTEX_BUFFER_BIT;
+	VkResult result = vkCreateBuffer(device, &bufferInfo, nullptr, &vertexBuffer);
+	if (result != VK_SUCCESS)
+	{
+		throw std::runtime_error("Failed to create vertex pool buffer!");
+	}
+	vertexBufferMemory = allocator->allocateBufferMemory(vertexBuffer, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
+
+	// INDEX POOL
+	bufferInfo.size = indexPoolSize;
+	bufferInfo.usage = VK_BUFFER_USAGE_TRANSFER_DST_BIT | VK_BUFFER_USAGE_INDEX_BUFFER_BIT | VK_BUFFER_USAGE_STORAGE_BUFFER_BIT;
+	result = vkCreateBuffer(device, &bufferInfo, nullptr, &indexBuffer);
+	if (result != VK_SUCCESS)
+	{
+		throw std::runtime_error("Failed to create index pool buffer!");
+	}
+	indexBufferMemory = allocator->allocateBufferMemory(indexBuffer, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
+
+	// MESHLET POOL
+	bufferInfo.size = meshletPoolSize;
+	bufferInfo.usage = VK_BUFFER_USAGE_TRANSFER_DST_BIT | VK_BUFFER_USAGE_STORAGE_BUFFER_BIT;
+	result = vkCreateBuffer(device, &bufferInfo, nullptr, &meshletBuffer);
+	if (result != VK_SUCCESS)
+	{
+		throw std::runtime_error("Failed to create meshlet pool buffer!");
+	}
+	meshletBufferMemory = allocator->allocateBufferMemory(meshletBuffer, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
+
+	// Each pool starts as one big free region
+	vertexRegions.push_back({ 0, vertexPoolSize, true });
+	indexRegions.push_back({ 0, indexPoolSize, true });
+	meshletRegions.push_back({ 0, meshletPoolSize, true });
+}
+
+GeometryRange GeometryPool::allocateVertices(VkDeviceSize size, VkDeviceSize vertexStride)
+{
+	GeometryRange range;
+	if (!allocateRange(vertexRegions, size, vertexStride, &range))
+	{
+		throw std::runtime_error("Vertex pool is full! Increase VERTEX_POOL_SIZE");
+	}
+	return range;
+}
+
+GeometryRange GeometryPool::allocateIndices(VkDeviceSize size, VkDeviceSize indexSize)
+{
+	GeometryRange range;
+	if (!allocateRange(indexRegions, size, indexSize, &range))
+	{
+		throw std::runtime_error("Index pool is full! Increase INDEX_POOL_SIZE");
+	}
+	return range;
+}
+
+GeometryRange GeometryPool::allocateMeshlets(VkDeviceSize size, VkDeviceSize meshletSize)
+{
+	GeometryRange range;
+	if (!allocateRange(meshletRegions, size, meshletSize, &range))
+	{
+		throw std::runtime_error("Meshlet pool is full! Increase MESHLET_POOL_SIZE");
+	}
+	return range;
+}
+
+void GeometryPool::freeVertices(GeometryRange& range)
+{
+	freeRange(vertexRegions, range);
+}
+
+void GeometryPool::freeIndices(GeometryRange& range)
+{
+	freeRange(indexRegions, range);
+}
+
+void GeometryPool::freeMeshlets(GeometryRange& range)
+{
+	freeRange(meshletRegions, range);
+}
+
+VkBuffer GeometryPool::getVertexBuffer()
+{
+	return vertexBuffer;
+}
+
+VkBuffer GeometryPool::getIndexBuffer()
+{
+	return indexBuffer;
+}
+
+VkBuffer GeometryPool::getMeshletBuffer()
+{
+	return meshletBuffer;
+}
+
+void GeometryPool::cleanup()
+{
+	vkDestroyBuffer(device, meshletBuffer, nullptr);
+	allocator->free(meshletBufferMemory);
+	vkDestroyBuffer(device, indexBuffer, nullptr);
+	allocator->free(indexBufferMemory);
+	vkDestroyBuffer(device, vertexBuffer, nullptr);
+	allocator->free(vertexBufferMemory);
+
+	vertexRegions.clear();
+	indexRegions.clear();
+	meshletRegions.clear();
+}
+
+GeometryPool::~GeometryPool()
+{
+}
+
+bool GeometryPool::allocateRange(std::vector<PoolRegion>& regions, VkDeviceSize size, VkDeviceSize alignment, GeometryRange* range)
+{
+	// First fit over free regions
+	for (size_t i = 0; i < regions.size(); i++)
+	{
+		PoolRegion region = regions[i];
+		if (!region.free || region.size < size)
+		{
+			continue;
+		}
+
+		// Vertex strides aren't always powers of 2 (e.g. 48 bytes), so round up to a multiple instead of masking
+		VkDeviceSize offset = ((region.offset + alignment - 1) / alignment) * alignment;
+		VkDeviceSize regionEnd = region.offset + region.size;
+		VkDeviceSize end = offset + size;
+		if (end > regionEnd)
+		{
+			continue;
+		}
+
+		// Split region into [padding][allocation][rest]
+		std::vector<PoolRegion> split;
+		if (offset > region.offset)
+		{
+			split.push_back({ region.offset, offset - region.offset, true });
+		}
+		split.push_back({ offset, size, false });
+		if (end < regionEnd)
+		{
+			split.push_back({ end, regionEnd - end, true });
+		}
+		regions.erase(regions.begin() + i);
+		regions.insert(regions.begin() + i, split.begin(), split.end());
+
+		range->offset = offset;
+		range->size = size;
+		return true;
+	}
+
+	return false;
+}
+
+void GeometryPool::freeRange(std::vector<PoolRegion>& regions, GeometryRange& range)
+{
+	if (range.size == 0)
+	{
+		return;
+	}
+
+	size_t i = 0;
+	while (i < regions.size() && regions[i].offset != range.offset)
+	{
+		i++;
+	}
+	if (i == regions.size() || regions[i].free)
+	{
+		throw std::runtime_error("Attempted to free a geometry range that wasn't allocated from this pool!");
+	}
+
+	regions[i].free = true;
+
+	// Merge with free neighbours
+	if (i + 1 < regions.size() && regions[i + 1].free)
+	{
+		regions[i].size += regions[i + 1].size;
+		regions.erase(regions.begin() + i + 1);
+	}
+	if (i > 0 && regions[i - 1].free)
+	{
+		regions[i - 1].size += regions[i].size;
+		regions.erase(regions.begin() + i);
+	}
+
+	range = GeometryRange();
+}
@@ -0,0 +1,70 @@
+#pragma once
+
+#define GLFW_INCLUDE_VULKAN
+#include <GLFW/glfw3.h>
+
+#include <stdexcept>
+#include <vector>
+
+#include "MemoryAllocator.h"
+
+// Range of the shared vertex, index or meshlet buffer owned by a single mesh
+struct GeometryRange
+{
+	VkDeviceSize offset = 0;	// Offset in bytes from the start of the pool buffer
+	VkDeviceSize size = 0;		// Size in bytes
+};
+
+// One big device local vertex buffer and one big index buffer that every mesh sub-allocates from,
+// so the whole scene can be drawn with a single vertex & index buffer bind. Meshes' meshlets go in a third buffer; it and
+// the index buffer are storage buffers too, for the meshlet cull shader
+class GeometryPool
+{
+public:
+	GeometryPool();
+
+	void init(MemoryAllocator* newAllocator, VkDevice newDevice, VkDeviceSize vertexPoolSize, VkDeviceSize indexPoolSize,
+		VkDeviceSize meshletPoolSize);
+
+	// Offsets are aligned to the element size, so they can be turned into vertexOffset/firstIndex for draw calls
+	GeometryRange allocateVertices(VkDeviceSize size, VkDeviceSize vertexStride);
+	GeometryRange allocateIndices(VkDeviceSize size, VkDeviceSize indexSize);
+	GeometryRange allocateMeshlets(VkDeviceSize size, VkDeviceSize meshletSize);
+	void freeVertices(GeometryRange& range);
+	void freeIndices(GeometryRange& range);
+	void freeMeshlets(GeometryRange& range);
+
+	VkBuffer getVertexBuffer();
+	VkBuffer getIndexBuffer();
+	VkBuffer getMeshletBuffer();
+
+	void cleanup();
+
+	~GeometryPool();
+
+private:
+	struct PoolRegion
+	{
+		VkDeviceSize offset;
+		VkDeviceSize size;
+		bool free;
+	};
+
+	VkDevice device = VK_NULL_HANDLE;
+	MemoryAllocator* allocator = nullptr;
+
+	VkBuffer vertexBuffer = VK_NULL_HANDLE;
+	MemoryAllocation vertexBufferMemory;
+	std::vector<PoolRegion> vertexRegions;
+
+	VkBuffer indexBuffer = VK_NULL_HANDLE;
+	MemoryAllocation indexBufferMemory;
+	std::vector<PoolRegion> indexRegions;
+
+	VkBuffer meshletBuffer = VK_NULL_HANDLE;
+	MemoryAllocation meshletBufferMemory;
+	std::vector<PoolRegion> meshletRegions;
+
+	static bool allocateRange(std::vector<PoolRegion>& regions, VkDeviceSize size, VkDeviceSize alignment, GeometryRange* range);
+	static void freeRange(std::vector<PoolRegion>& regions, GeometryRange& range);
+};
@@ -72,7 +72,8 @@ int main()
 	float deltaTime = 0.0f;
 	float lastTime = 0.0f;
 	
-	int firstModelId = vulkanRenderer.createMeshModel("Models/Neck_Mech_Walker_by_3DHaupt-(Wavefront OBJ).obj");
+	// Loads in the background, shows up once it's on the GPU
+	int firstModelId = vulkanRenderer.createMeshModelAsync("Models/Neck_Mech_Walker_by_3DHaupt-(Wavefront OBJ).obj");
 	
 	
 	//int firstModelId = vulkanRenderer.createCube("TexturesCom_SignsNeon0046_S.jpg");
@@ -0,0 +1,126 @@
+#include "MappedFile.h"
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#endif
+
+MappedFile::MappedFile()
+{
+}
+
+bool MappedFile::open(const std::string& fileName)
+{
+	close();
+
+#ifdef _WIN32
+	HANDLE file = CreateFileA(fileName.c_str(), GENERIC_READ, FILE_SHARE_READ | FILE_SHARE_DELETE, nullptr, OPEN_EXISTING,
+		FILE_ATTRIBUTE_NORMAL | FILE_FLAG_SEQUENTIAL_SCAN, nullptr);
+	if (file == INVALID_HANDLE_VALUE)
+	{
+		return false;
+	}
+
+	LARGE_INTEGER fileSize;
+	if (!GetFileSizeEx(file, &fileSize) || fileSize.QuadPart == 0)
+	{
+		CloseHandle(file);
+		return false;
+	}
+
+	HANDLE mapping = CreateFileMappingA(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+	if (mapping == nullptr)
+	{
+		CloseHandle(file);
+		return false;
+	}
+
+	void* view = MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+	if (view == nullptr)
+	{
+		CloseHandle(mapping);
+		CloseHandle(file);
+		return false;
+	}
+
+	fileHandle = file;
+	mappingHandle = mapping;
+	data = static_cast<const unsigned char*>(view);
+	size = static_cast<uint64_t>(fileSize.QuadPart);
+#else
+	int file = ::open(fileName.c_str(), O_RDONLY);
+	if (file < 0)
+	{
+		return false;
+	}
+
+	struct stat fileStat;
+	if (fstat(file, &fileStat) != 0 || fileStat.st_size == 0)
+	{
+		::close(file);
+		return false;
+	}
+
+	// The mapping keeps the file open by itself, so the descriptor isn't needed after this
+	void* view = mmap(nullptr, static_cast<size_t>(fileStat.st_size), PROT_READ, MAP_PRIVATE, file, 0);
+	::close(file);
+	if (view == MAP_FAILED)
+	{
+		return false;
+	}
+
+	data = static_cast<const unsigned char*>(view);
+	size = static_cast<uint64_t>(fileStat.st_size);
+#endif
+
+	return true;
+}
+
+const unsigned char* MappedFile::getData()
+{
+	return data;
+}
+
+uint64_t MappedFile::getSize()
+{
+	return size;
+}
+
+void MappedFile::close()
+{
+#ifdef _WIN32
+	if (data != nullptr)
+	{
+		UnmapViewOfFile(data);
+	}
+	if (mappingHandle != nullptr)
+	{
+		CloseHandle(mappingHandle);
+	}
+	if (fileHandle != nullptr)
+	{
+		CloseHandle(fileHandle);
+	}
+	mappingHandle = nullptr;
+	fileHandle = nullptr;
+#else
+	if (data != nullptr)
+	{
+		munmap(const_cast<unsigned char*>(data), static_cast<size_t>(size));
+	}
+#endif
+
+	data = nullptr;
+	size = 0;
+}
+
+MappedFile::~MappedFile()
+{
+	close();
+}
@@ -0,0 +1,35 @@
+#pragma once
+
+#include <stdint.h>
+#include <string>
+
+// Read only memory mapping of a whole file, so it can be read straight from the OS page cache without copying it in
+// first. Unmapped when closed or destroyed
+class MappedFile
+{
+public:
+	MappedFile();
+
+	// Map fileName, returns false if it doesn't exist or can't be mapped (empty files can't be)
+	bool open(const std::string& fileName);
+
+	const unsigned char* getData();
+	uint64_t getSize();
+
+	void close();
+
+	~MappedFile();
+
+	// Owns the mapping, so it can't be copied
+	MappedFile(const MappedFile&) = delete;
+	MappedFile& operator=(const MappedFile&) = delete;
+
+private:
+	const unsigned char* data = nullptr;
+	uint64_t size = 0;
+
+#ifdef _WIN32
+	void* fileHandle = nullptr;
+	void* mappingHandle = nullptr;
+#endif
+};
@@ -0,0 +1,64 @@
+#include "MaterialTable.h"
+
+MaterialTable::MaterialTable()
+{
+}
+
+void MaterialTable::init(MemoryAllocator* newAllocator, VkDevice newDevice, uint32_t newMaxMaterials)
+{
+	allocator = newAllocator;
+	device = newDevice;
+	maxMaterials = newMaxMaterials;
+
+	// Lives on the GPU only, materials are copied in from the staging ring
+	createBuffer(device, allocator, getBufferSize(), VK_BUFFER_USAGE_TRANSFER_DST_BIT | VK_BUFFER_USAGE_STORAGE_BUFFER_BIT,
+		VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, &materialBuffer, &materialBufferMemory);
+}
+
+uint32_t MaterialTable::createMaterial(const GpuMaterial& material, UploadBatch* uploadBatch)
+{
+	uint32_t materialId;
+	if (!freeMaterialIds.empty())
+	{
+		materialId = freeMaterialIds.back();
+		freeMaterialIds.pop_back();
+	}
+	else if (materialCount < maxMaterials)
+	{
+		materialId = materialCount++;
+	}
+	else
+	{
+		throw std::runtime_error("Too many materials! Increase MAX_MATERIALS");
+	}
+
+	uploadBatch->uploadBuffer(&material, sizeof(GpuMaterial), materialBuffer, materialId * sizeof(GpuMaterial));
+	return materialId;
+}
+
+void MaterialTable::releaseMaterial(uint32_t materialId)
+{
+	freeMaterialIds.push_back(materialId);
+}
+
+VkBuffer MaterialTable::getBuffer()
+{
+	return materialBuffer;
+}
+
+VkDeviceSize MaterialTable::getBufferSize()
+{
+	return static_cast<VkDeviceSize>(maxMaterials) * sizeof(GpuMaterial);
+}
+
+void MaterialTable::cleanup()
+{
+	destroyBuffer(device, allocator, materialBuffer, &materialBufferMemory);
+	materialBuffer = VK_NULL_HANDLE;
+	materialCount = 0;
+	freeMaterialIds.clear();
+}
+
+MaterialTable::~MaterialTable()
+{
+}
@@ -0,0 +1,64 @@
+#pragma once
+
+#define GLFW_INCLUDE_VULKAN
+#include <GLFW/glfw3.h>
+#include <glm/glm.hpp>
+
+#include <stdexcept>
+#include <vector>
+
+#include "MemoryAllocator.h"
+#include "UploadBatch.h"
+
+// Which of a material's maps it has (GpuMaterial::flags), factors are used on their own for missing ones
+const uint32_t MATERIAL_NORMAL_MAP = 1 << 0;
+const uint32_t MATERIAL_ROUGHNESS_MAP = 1 << 1;		// Packed texture R channel
+const uint32_t MATERIAL_METALNESS_MAP = 1 << 2;		// Packed texture G channel
+const uint32_t MATERIAL_OCCLUSION_MAP = 1 << 3;		// Packed texture B channel
+
+// Material as the fragment shader reads it from the material buffer (std430 layout, keep in sync with shader.frag)
+struct GpuMaterial
+{
+	glm::vec4 baseColor;			// Multiplies the albedo texture (alpha is the opacity)
+	float roughness;				// Multiplies the roughness map, or the roughness if there isn't one
+	float metalness;				// Same for metalness
+	uint32_t flags;					// MATERIAL_* bits
+	uint32_t samplerId;				// Sampler used for all of the material's textures
+	uint32_t albedoTextureId;
+	uint32_t normalTextureId;		// Two channel tangent space normal (X/Y, Z is rebuilt in the shader)
+	uint32_t packedTextureId;		// Roughness/metalness/occlusion in R/G/B
+	uint32_t padding;
+};
+
+// One device local storage buffer holding every material, indexed per draw by material ID.
+// Materials are written through upload batches, so they arrive on the GPU together with the textures they use.
+// IDs of released materials are reused (only once the GPU isn't drawing with them anymore)
+class MaterialTable
+{
+public:
+	MaterialTable();
+
+	void init(MemoryAllocator* newAllocator, VkDevice newDevice, uint32_t newMaxMaterials);
+
+	// Store a new material, returns its ID (its data is uploaded when the batch is submitted)
+	uint32_t createMaterial(const GpuMaterial& material, UploadBatch* uploadBatch);
+	void releaseMaterial(uint32_t materialId);
+
+	VkBuffer getBuffer();
+	VkDeviceSize getBufferSize();
+
+	void cleanup();
+
+	~MaterialTable();
+
+private:
+	VkDevice device = VK_NULL_HANDLE;
+	MemoryAllocator* allocator = nullptr;
+	uint32_t maxMaterials = 0;
+
+	VkBuffer materialBuffer = VK_NULL_HANDLE;
+	MemoryAllocation materialBufferMemory;
+
+	uint32_t materialCount = 0;					// IDs handed out so far
+	std::vector<uint32_t> freeMaterialIds;		// Released IDs, reused before handing out new ones
+};
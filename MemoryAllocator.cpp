@@ -0,0 +1,338 @@
+#include "MemoryAllocator.h"
+
+#include <algorithm>
+
+MemoryAllocator::MemoryAllocator()
+{
+}
+
+void MemoryAllocator::init(VkPhysicalDevice newPhysicalDevice, VkDevice newDevice)
+{
+	physicalDevice = newPhysicalDevice;
+	device = newDevice;
+
+	// Memory types & heaps never change for a device, so query them once
+	vkGetPhysicalDeviceMemoryProperties(physicalDevice, &memoryProperties);
+
+	// Linear (buffers) and optimal (images) resources must not share a "page" of this size inside one block
+	VkPhysicalDeviceProperties deviceProperties;
+	vkGetPhysicalDeviceProperties(physicalDevice, &deviceProperties);
+	bufferImageGranularity = std::max<VkDeviceSize>(deviceProperties.limits.bufferImageGranularity, 1);
+
+	blocks.resize(memoryProperties.memoryTypeCount);
+}
+
+MemoryAllocation MemoryAllocator::allocate(const VkMemoryRequirements& requirements, VkMemoryPropertyFlags properties, bool linear)
+{
+	uint32_t memoryTypeIndex = findMemoryTypeIndex(requirements.memoryTypeBits, properties);
+	VkDeviceSize blockSize = getBlockSize(memoryTypeIndex);
+
+	MemoryAllocation allocation;
+
+	// Big resources get a block of their own, otherwise they'd leave most of a shared block unusable
+	if (requirements.size > blockSize / 2)
+	{
+		MemoryBlock* block = createBlock(memoryTypeIndex, requirements.size, true);
+		allocateFromBlock(*block, requirements.size, requirements.alignment, linear, &allocation);
+		return allocation;
+	}
+
+	// Try to fit into one of the existing blocks first
+	for (auto& block : blocks[memoryTypeIndex])
+	{
+		if (!block.dedicated && block.size - block.usedBytes >= requirements.size
+			&& allocateFromBlock(block, requirements.size, requirements.alignment, linear, &allocation))
+		{
+			return allocation;
+		}
+	}
+
+	// No room left - grab a new block from the driver
+	MemoryBlock* block = createBlock(memoryTypeIndex, blockSize, false);
+	if (!allocateFromBlock(*block, requirements.size, requirements.alignment, linear, &allocation))
+	{
+		throw std::runtime_error("Failed to sub-allocate from a new memory block!");
+	}
+
+	return allocation;
+}
+
+MemoryAllocation MemoryAllocator::allocateBufferMemory(VkBuffer buffer, VkMemoryPropertyFlags properties)
+{
+	VkMemoryRequirements memRequirements = {};
+	vkGetBufferMemoryRequirements(device, buffer, &memRequirements);
+
+	// Buffers are always linear resources
+	MemoryAllocation allocation = allocate(memRequirements, properties, true);
+
+	VkResult result = vkBindBufferMemory(device, buffer, allocation.memory, allocation.offset);
+	if (result != VK_SUCCESS)
+	{
+		throw std::runtime_error("Failed to bind memory to buffer!");
+	}
+
+	return allocation;
+}
+
+MemoryAllocation MemoryAllocator::allocateImageMemory(VkImage image, VkMemoryPropertyFlags properties, VkImageTiling tiling)
+{
+	VkMemoryRequirements memRequirements = {};
+	vkGetImageMemoryRequirements(device, image, &memRequirements);
+
+	MemoryAllocation allocation = allocate(memRequirements, properties, tiling == VK_IMAGE_TILING_LINEAR);
+
+	VkResult result = vkBindImageMemory(device, image, allocation.memory, allocation.offset);
+	if (result != VK_SUCCESS)
+	{
+		throw std::runtime_error("Failed to bind memory to image!");
+	}
+
+	return allocation;
+}
+
+void MemoryAllocator::free(MemoryAllocation& allocation)
+{
+	MemoryBlock* block = allocation.block;
+	if (block == nullptr)
+	{
+		return;
+	}
+
+	// Find the region by its offset and give it back
+	auto& regions = block->regions;
+	size_t i = 0;
+	while (i < regions.size() && regions[i].offset != allocation.offset)
+	{
+		i++;
+	}
+	if (i == regions.size() || regions[i].free)
+	{
+		throw std::runtime_error("Attempted to free memory that wasn't allocated from this block!");
+	}
+
+	block->usedBytes -= regions[i].size;
+	block->allocationCount--;
+	regions[i].free = true;
+
+	// Merge with free neighbours, so free regions never sit next to each other
+	if (i + 1 < regions.size() && regions[i + 1].free)
+	{
+		regions[i].size += regions[i + 1].size;
+		regions.erase(regions.begin() + i + 1);
+	}
+	if (i > 0 && regions[i - 1].free)
+	{
+		regions[i - 1].size += regions[i].size;
+		regions.erase(regions.begin() + i);
+	}
+
+	// Release empty blocks, but keep one shared block per memory type so alloc/free churn doesn't hit the driver
+	if (block->allocationCount == 0)
+	{
+		auto& typeBlocks = blocks[block->memoryTypeIndex];
+		size_t sharedBlocks = std::count_if(typeBlocks.begin(), typeBlocks.end(),
+			[](const MemoryBlock& b) { return !b.dedicated; });
+
+		if (block->dedicated || sharedBlocks > 1)
+		{
+			destroyBlock(*block);
+			typeBlocks.remove_if([block](const MemoryBlock& b) { return &b == block; });
+		}
+	}
+
+	allocation = MemoryAllocation();
+}
+
+std::vector<MemoryHeapStats> MemoryAllocator::getHeapStats()
+{
+	std::vector<MemoryHeapStats> stats(memoryProperties.memoryHeapCount);
+	for (uint32_t i = 0; i < memoryProperties.memoryHeapCount; i++)
+	{
+		stats[i].heapSize = memoryProperties.memoryHeaps[i].size;
+	}
+
+	// Sum up blocks of every memory type into the heap the type belongs to
+	for (uint32_t type = 0; type < blocks.size(); type++)
+	{
+		MemoryHeapStats& heapStats = stats[memoryProperties.memoryTypes[type].heapIndex];
+		for (const auto& block : blocks[type])
+		{
+			heapStats.blockBytes += block.size;
+			heapStats.usedBytes += block.usedBytes;
+			heapStats.blockCount++;
+			heapStats.allocationCount += block.allocationCount;
+		}
+	}
+
+	return stats;
+}
+
+void MemoryAllocator::printStats()
+{
+	std::vector<MemoryHeapStats> stats = getHeapStats();
+	for (size_t i = 0; i < stats.size(); i++)
+	{
+		bool deviceLocal = memoryProperties.memoryHeaps[i].flags & VK_MEMORY_HEAP_DEVICE_LOCAL_BIT;
+		printf("MEMORY: Heap %zu (%s): %llu KB used of %llu KB allocated in %u blocks, %u allocations, heap size %llu MB\n",
+			i, deviceLocal ? "device local" : "host",
+			(unsigned long long)(stats[i].usedBytes / 1024), (unsigned long long)(stats[i].blockBytes / 1024),
+			stats[i].blockCount, stats[i].allocationCount,
+			(unsigned long long)(stats[i].heapSize / (1024 * 1024)));
+	}
+}
+
+void MemoryAllocator::cleanup()
+{
+	for (auto& typeBlocks : blocks)
+	{
+		for (auto& block : typeBlocks)
+		{
+			if (block.allocationCount > 0)
+			{
+				printf("WARNING: Destroying memory block with %u allocations still alive!\n", block.allocationCount);
+			}
+			destroyBlock(block);
+		}
+		typeBlocks.clear();
+	}
+}
+
+MemoryAllocator::~MemoryAllocator()
+{
+}
+
+uint32_t MemoryAllocator::findMemoryTypeIndex(uint32_t allowedTypes, VkMemoryPropertyFlags properties)
+{
+	for (uint32_t i = 0; i < memoryProperties.memoryTypeCount; i++)
+	{
+		//use bit shifting to check the allowed type
+		if ((allowedTypes & (1 << i))													//Index of memory type must match corresponding bit in allowedTypes
+			&& (memoryProperties.memoryTypes[i].propertyFlags & properties) == properties)	//check if ALL properties are presented at this memory index
+		{
+			return i;
+		}
+	}
+
+	throw std::runtime_error("Failed to find a suitable memory type!");
+}
+
+VkDeviceSize MemoryAllocator::getBlockSize(uint32_t memoryTypeIndex)
+{
+	// Don't let a single block eat a big part of small heaps (e.g. 256MB host visible VRAM window)
+	VkDeviceSize heapSize = memoryProperties.memoryHeaps[memoryProperties.memoryTypes[memoryTypeIndex].heapIndex].size;
+	return std::min(MEMORY_BLOCK_SIZE, heapSize / 8);
+}
+
+MemoryBlock* MemoryAllocator::createBlock(uint32_t memoryTypeIndex, VkDeviceSize size, bool dedicated)
+{
+	MemoryBlock block;
+	block.size = size;
+	block.memoryTypeIndex = memoryTypeIndex;
+	block.dedicated = dedicated;
+
+	VkMemoryAllocateInfo memoryAllocInfo = {};
+	memoryAllocInfo.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
+	memoryAllocInfo.allocationSize = size;
+	memoryAllocInfo.memoryTypeIndex = memoryTypeIndex;
+
+	VkResult result = vkAllocateMemory(device, &memoryAllocInfo, nullptr, &block.memory);
+	if (result != VK_SUCCESS)
+	{
+		throw std::runtime_error("Failed to allocate device memory block!");
+	}
+
+	// Memory can only be mapped once, so host visible blocks stay mapped for their whole life
+	if (memoryProperties.memoryTypes[memoryTypeIndex].propertyFlags & VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT)
+	{
+		result = vkMapMemory(device, block.memory, 0, VK_WHOLE_SIZE, 0, &block.mapped);
+		if (result != VK_SUCCESS)
+		{
+			throw std::runtime_error("Failed to map device memory block!");
+		}
+	}
+
+	// Whole block starts as one free region
+	block.regions.push_back({ 0, size, true, false });
+
+	blocks[memoryTypeIndex].push_back(block);
+	return &blocks[memoryTypeIndex].back();
+}
+
+void MemoryAllocator::destroyBlock(MemoryBlock& block)
+{
+	if (block.mapped)
+	{
+		vkUnmapMemory(device, block.memory);
+		block.mapped = nullptr;
+	}
+	vkFreeMemory(device, block.memory, nullptr);
+	block.memory = VK_NULL_HANDLE;
+}
+
+bool MemoryAllocator::allocateFromBlock(MemoryBlock& block, VkDeviceSize size, VkDeviceSize alignment, bool linear, MemoryAllocation* allocation)
+{
+	auto& regions = block.regions;
+
+	// First fit over free regions
+	for (size_t i = 0; i < regions.size(); i++)
+	{
+		MemoryRegion region = regions[i];
+		if (!region.free || region.size < size)
+		{
+			continue;
+		}
+
+		VkDeviceSize regionEnd = region.offset + region.size;
+		VkDeviceSize offset = alignUp(region.offset, alignment);
+
+		// Previous resource of the other kind (linear vs optimal) on the same granularity page - move to the next page
+		// (free regions are always merged, so neighbours of a free region are used ones)
+		if (i > 0 && regions[i - 1].linear != linear)
+		{
+			VkDeviceSize previousEnd = regions[i - 1].offset + regions[i - 1].size;
+			if (alignUp(previousEnd, bufferImageGranularity) > offset)
+			{
+				offset = alignUp(offset, bufferImageGranularity);
+			}
+		}
+
+		VkDeviceSize end = offset + size;
+		if (end > regionEnd)
+		{
+			continue;
+		}
+
+		// Same check against the next resource: we can't move it, so just skip this region
+		if (i + 1 < regions.size() && regions[i + 1].linear != linear
+			&& alignUp(end, bufferImageGranularity) > regions[i + 1].offset)
+		{
+			continue;
+		}
+
+		// Split region into [padding][allocation][rest]
+		std::vector<MemoryRegion> split;
+		if (offset > region.offset)
+		{
+			split.push_back({ region.offset, offset - region.offset, true, false });
+		}
+		split.push_back({ offset, size, false, linear });
+		if (end < regionEnd)
+		{
+			split.push_back({ end, regionEnd - end, true, false });
+		}
+		regions.erase(regions.begin() + i);
+		regions.insert(regions.begin() + i, split.begin(), split.end());
+
+		block.usedBytes += size;
+		block.allocationCount++;
+
+		allocation->memory = block.memory;
+		allocation->offset = offset;
+		allocation->size = size;
+		allocation->mapped = block.mapped ? static_cast<char*>(block.mapped) + offset : nullptr;
+		allocation->block = &block;
+		return true;
+	}
+
+	return false;
+}
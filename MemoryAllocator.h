@@ -0,0 +1,99 @@
+#pragma once
+
+#define GLFW_INCLUDE_VULKAN
+#include <GLFW/glfw3.h>
+
+#include <stdexcept>
+#include <vector>
+#include <list>
+
+// Size of a single VkDeviceMemory block resources are sub-allocated from (smaller heaps use 1/8 of the heap)
+const VkDeviceSize MEMORY_BLOCK_SIZE = 64 * 1024 * 1024;
+
+struct MemoryBlock;
+
+// Round value up to the next multiple of alignment (Vulkan alignments are always powers of 2)
+static VkDeviceSize alignUp(VkDeviceSize value, VkDeviceSize alignment)
+{
+	return (value + alignment - 1) & ~(alignment - 1);
+}
+
+// Range of device memory handed out by the allocator. Bind resources with (memory, offset)
+struct MemoryAllocation
+{
+	VkDeviceMemory memory = VK_NULL_HANDLE;	// Block memory the range lives in
+	VkDeviceSize offset = 0;				// Offset of the range inside the block
+	VkDeviceSize size = 0;					// Size of the range
+	void* mapped = nullptr;					// Host pointer to the start of the range (HOST_VISIBLE memory only)
+	MemoryBlock* block = nullptr;			// Owning block, used to return the range on free
+};
+
+// Per-heap usage, so we can keep an eye on how close we are to the budget
+struct MemoryHeapStats
+{
+	VkDeviceSize heapSize = 0;			// Size of the heap reported by the device
+	VkDeviceSize blockBytes = 0;		// Memory actually allocated from the driver (vkAllocateMemory)
+	VkDeviceSize usedBytes = 0;			// Memory handed out to buffers and images
+	uint32_t blockCount = 0;			// Number of vkAllocateMemory calls alive
+	uint32_t allocationCount = 0;		// Number of sub-allocations alive
+};
+
+// Part of a block: either free or used by a single resource
+struct MemoryRegion
+{
+	VkDeviceSize offset;
+	VkDeviceSize size;
+	bool free;
+	bool linear;	// Buffers and linear images vs optimal images (matters for bufferImageGranularity)
+};
+
+struct MemoryBlock
+{
+	VkDeviceMemory memory = VK_NULL_HANDLE;
+	VkDeviceSize size = 0;
+	uint32_t memoryTypeIndex = 0;
+	void* mapped = nullptr;				// Whole block is mapped once if it's HOST_VISIBLE
+	bool dedicated = false;				// Block created for a single big resource
+	VkDeviceSize usedBytes = 0;
+	uint32_t allocationCount = 0;
+	std::vector<MemoryRegion> regions;	// Sorted by offset, covering the whole block
+};
+
+// Grabs big VkDeviceMemory blocks per memory type and sub-allocates buffers and images from them,
+// instead of calling vkAllocateMemory for every single resource
+class MemoryAllocator
+{
+public:
+	MemoryAllocator();
+
+	void init(VkPhysicalDevice newPhysicalDevice, VkDevice newDevice);
+
+	MemoryAllocation allocate(const VkMemoryRequirements& requirements, VkMemoryPropertyFlags properties, bool linear);
+	MemoryAllocation allocateBufferMemory(VkBuffer buffer, VkMemoryPropertyFlags properties);
+	MemoryAllocation allocateImageMemory(VkImage image, VkMemoryPropertyFlags properties, VkImageTiling tiling);
+	void free(MemoryAllocation& allocation);
+
+	std::vector<MemoryHeapStats> getHeapStats();
+	void printStats();
+
+	void cleanup();
+
+	~MemoryAllocator();
+
+private:
+	VkPhysicalDevice physicalDevice = VK_NULL_HANDLE;
+	VkDevice device = VK_NULL_HANDLE;
+
+	VkPhysicalDeviceMemoryProperties memoryProperties = {};
+	VkDeviceSize bufferImageGranularity = 1;
+
+	// Blocks for each memory type (list keeps block addresses stable for MemoryAllocation::block)
+	std::vector<std::list<MemoryBlock>> blocks;
+
+	uint32_t findMemoryTypeIndex(uint32_t allowedTypes, VkMemoryPropertyFlags properties);
+	VkDeviceSize getBlockSize(uint32_t memoryTypeIndex);
+
+	MemoryBlock* createBlock(uint32_t memoryTypeIndex, VkDeviceSize size, bool dedicated);
+	void destroyBlock(MemoryBlock& block);
+	bool allocateFromBlock(MemoryBlock& block, VkDeviceSize size, VkDeviceSize alignment, bool linear, MemoryAllocation* allocation);
+};
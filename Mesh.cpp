@@ -6,20 +6,40 @@ Mesh::Mesh()
 {
 }
 
-Mesh::Mesh(VkPhysicalDevice newPhysicalDevice, VkDevice newLogicalDevice, 
-	VkQueue transferQueue, VkCommandPool transferCommandPool, 
-	std::vector<Vertex>* vertices, std::vector<uint32_t> * indices, int newTextureId)
+Mesh::Mesh(GeometryPool* newGeometryPool, UploadBatch* uploadBatch,
+	const Vertex* vertices, const uint32_t* colors, uint32_t newVertexCount, const uint32_t* indices, uint32_t newIndexCount,
+	const MeshLod* newLods, uint32_t newLodCount, const Meshlet* meshlets, uint32_t newMeshletCount,
+	glm::vec3 newBoundsMin, glm::vec3 newBoundsMax, bool newClosed, uint32_t newMaterialId)
 {
-	vertexCount = static_cast<uint32_t>(vertices->size());
-	indexCount = static_cast<uint32_t>(indices->size());
-	physicalDevice = newPhysicalDevice;
-	device = newLogicalDevice;
-	createVertexBuffer(transferQueue, transferCommandPool, vertices);
-	createIndexBuffer(transferQueue, transferCommandPool, indices);
+	vertexCount = newVertexCount;
+	indexCount = newIndexCount;
+	meshletCount = newMeshletCount;
+	geometryPool = newGeometryPool;
+	boundsMin = newBoundsMin;
+	boundsMax = newBoundsMax;
+	closed = newClosed;
+	lods.assign(newLods, newLods + newLodCount);
+	if (lods.empty())
+	{
+		lods.push_back({ 0, newIndexCount, 0.0f, 0, 0 });
+	}
+	currentLod = 0;
+	// A full pool throws, give back the ranges taken before it
+	try
+	{
+		createVertexBuffer(uploadBatch, vertices, colors);
+		createIndexBuffer(uploadBatch, indices);
+		createMeshletBuffer(uploadBatch, meshlets);
+	}
+	catch (...)
+	{
+		cleanup();
+		throw;
+	}
 
 	model.modelMatrix = glm::mat4(1.0f);
 
-	textureId = newTextureId;
+	materialId = newMaterialId;
 	// Check for vertex normals. It we have a normal vec3::zero (0.0f, 0.0f, 0.0f) - calculate normals manually
 	//dut to the plane that we use, we can only calculate normals for 3+ vertices
 	//if (vertices->size() >= 3)
@@ -77,9 +97,18 @@ Model Mesh::getModel()
 	return model;
 }
 
-int Mesh::getTextureId()
+uint32_t Mesh::getMaterialId()
 {
-	return textureId;
+	return materialId;
+}
+
+PushMeshBounds Mesh::getBounds()
+{
+	// Quantized positions are 0..1 across the bounding box
+	PushMeshBounds bounds;
+	bounds.positionScale = glm::vec4(boundsMax - boundsMin, 0.0f);
+	bounds.positionOffset = glm::vec4(boundsMin, 1.0f);
+	return bounds;
 }
 
 
@@ -93,109 +122,151 @@ uint32_t Mesh::getIndexCount()
 	return indexCount;
 }
 
-VkBuffer Mesh::getVertexBuffer()
+int32_t Mesh::getVertexOffset()
 {
-	return vertexBuffer;
+	// Draw calls want the offset in vertices, not bytes
+	return static_cast<int32_t>(vertexRange.offset / sizeof(Vertex));
 }
 
-VkBuffer Mesh::getIndexBuffer()
+uint32_t Mesh::getFirstIndex()
 {
-	return indexBuffer;
+	// In indices of the mesh's own type (ranges are aligned to it)
+	return static_cast<uint32_t>(indexRange.offset / (indexType == VK_INDEX_TYPE_UINT16 ? sizeof(uint16_t) : sizeof(uint32_t)));
 }
 
-void Mesh::cleanup()
+uint32_t Mesh::getFirstMeshlet()
 {
-	//Index buffer destroy
-	vkDestroyBuffer(device, indexBuffer, nullptr);
-	vkFreeMemory(device, indexBufferMemory, nullptr);
-
-	//Vertex buffer destroy
-	vkDestroyBuffer(device, vertexBuffer, nullptr);
-	vkFreeMemory(device, vertexBufferMemory, nullptr);
+	return static_cast<uint32_t>(meshletRange.offset / sizeof(Meshlet));
 }
 
+VkIndexType Mesh::getIndexType()
+{
+	return indexType;
+}
 
-Mesh::~Mesh()
+glm::vec4 Mesh::getBoundingSphere()
 {
+	return glm::vec4((boundsMin + boundsMax) * 0.5f, glm::length(boundsMax - boundsMin) * 0.5f);
 }
 
-void Mesh::createVertexBuffer(VkQueue transferQueue, VkCommandPool transferCommandPool, std::vector<Vertex>* vertices)
+uint32_t Mesh::getLodCount()
 {
-	//Get size of buffer needed for vertices
-	VkDeviceSize bufferSize = sizeof(Vertex) * vertices->size();
+	return static_cast<uint32_t>(lods.size());
+}
 
-	//Temporary buffer to "stage" vertex data before transferring to GPU
-	VkBuffer stagingBuffer;
-	VkDeviceMemory stagingBufferMemory;
+MeshLod Mesh::getLod(uint32_t lod)
+{
+	return lods.at(lod);
+}
 
-	//CREATE STAGING BUFFER AND ALLOCATE MEMORY TO IT
-	createBuffer(physicalDevice, device, bufferSize,
-		VK_BUFFER_USAGE_TRANSFER_SRC_BIT, 
-		VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, 
-		&stagingBuffer, &stagingBufferMemory);
-	//MAP MEMORY TO VERTEX BUFFER
-	void * data;																		// 1. Create pointer to a point in normal memory
-	VkResult result = vkMapMemory(device, stagingBufferMemory, 0, bufferSize, 0, &data);	// 2. "Map" the vertex buffer memory to that pointer
-	if (result != VK_SUCCESS)
+uint32_t Mesh::selectLod(float projectedRadius)
+{
+	// Coarsest level whose error stays small enough on screen (errors only grow from level to level). Levels coarser than
+	// the current one need some margin, so meshes right at a threshold don't switch back & forth every frame
+	uint32_t lod = 0;
+	for (uint32_t i = 1; i < lods.size(); i++)
 	{
-		throw std::runtime_error("Failed to map memory for vertex buffer!");
+		float limit = i > currentLod ? MESH_LOD_ERROR_PIXELS * MESH_LOD_HYSTERESIS : MESH_LOD_ERROR_PIXELS;
+		if (lods[i].error * projectedRadius > limit)
+		{
+			break;
+		}
+		lod = i;
 	}
-	memcpy(data, vertices->data(), (size_t)bufferSize);									// 3. Copy the data
-	vkUnmapMemory(device, stagingBufferMemory);											// 4. Unmap the VertexBUfferMemory
+	currentLod = lod;
+	return lod;
+}
 
-	//Create buffer with TRANSFERR_DST_BIT to mark as recipient of transfer data (also VERTEX_BUFFER)
-	//Buffer memory is to be DEVICE_LOCAL_BIT meaning memory is on the GPU and only  accessible by it and not CPU (host)
-	createBuffer(physicalDevice, device, bufferSize,
-		VK_BUFFER_USAGE_TRANSFER_DST_BIT | VK_BUFFER_USAGE_VERTEX_BUFFER_BIT,
-		VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
-		&vertexBuffer, &vertexBufferMemory);
+bool Mesh::hasVertexColors()
+{
+	return vertexColors;
+}
 
-	//Copy staging buffer to vertex buffer on GPU
-	copyBuffer(device, transferQueue, transferCommandPool, stagingBuffer, vertexBuffer, bufferSize);
+bool Mesh::isClosed()
+{
+	return closed;
+}
 
-	//Clean up stagin buffer parts
-	vkDestroyBuffer(device, stagingBuffer, nullptr);
-	vkFreeMemory(device, stagingBufferMemory, nullptr);
+VkDeviceSize Mesh::getColorBindingOffset()
+{
+	// Draws index colours with the same vertex offset as vertices (but a 4 byte stride), so the binding starts that many
+	// colours before the mesh's first one
+	VkDeviceSize firstColor = vertexRange.offset + sizeof(Vertex) * vertexCount;
+	return firstColor - static_cast<VkDeviceSize>(getVertexOffset()) * sizeof(uint32_t);
 }
 
-void Mesh::createIndexBuffer(VkQueue transferQueue, VkCommandPool transferCommandPool, std::vector<uint32_t>* indices)
+void Mesh::cleanup()
 {
-	//Get size of buffer needed for indics
-	VkDeviceSize bufferSize = sizeof(uint32_t) * indices->size();
+	//Give meshlet range back to the pool
+	geometryPool->freeMeshlets(meshletRange);
+
+	//Give index range back to the pool
+	geometryPool->freeIndices(indexRange);
+
+	//Give vertex range back to the pool
+	geometryPool->freeVertices(vertexRange);
+}
+
+
+Mesh::~Mesh()
+{
+}
 
+void Mesh::createVertexBuffer(UploadBatch* uploadBatch, const Vertex* vertices, const uint32_t* colors)
+{
+	//Get size of buffer needed for vertices (and their colours, if they have them)
+	vertexColors = colors != nullptr;
+	VkDeviceSize bufferSize = sizeof(Vertex) * vertexCount;
+	VkDeviceSize colorSize = vertexColors ? sizeof(uint32_t) * vertexCount : 0;
 
-	//Temporary buffer to "stage" index data before transferring to GPU
-	VkBuffer stagingBuffer;
-	VkDeviceMemory stagingBufferMemory;
+	//Reserve a range of the shared vertex buffer (DEVICE_LOCAL, only accessible by GPU)
+	vertexRange = geometryPool->allocateVertices(bufferSize + colorSize, sizeof(Vertex));
 
-	//CREATE STAGING BUFFER AND ALLOCATE MEMORY TO IT
-	createBuffer(physicalDevice, device, bufferSize,
-		VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
-		VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
-		&stagingBuffer, &stagingBufferMemory);
+	//Stage vertex data and record the copy to our range of the vertex buffer (happens when the batch is submitted)
+	uploadBatch->uploadBuffer(vertices, bufferSize, geometryPool->getVertexBuffer(), vertexRange.offset);
+	if (vertexColors)
+	{
+		uploadBatch->uploadBuffer(colors, colorSize, geometryPool->getVertexBuffer(), vertexRange.offset + bufferSize);
+	}
+}
 
-	//MAP MEMORY TO INDEX BUFFER
-	void * data;																		
-	VkResult result = vkMapMemory(device, stagingBufferMemory, 0, bufferSize, 0, &data);
-	if (result != VK_SUCCESS)
+void Mesh::createIndexBuffer(UploadBatch* uploadBatch, const uint32_t* indices)
+{
+	//Indices are 16-bit whenever the mesh's vertices fit (half the memory & bandwidth)
+	indexType = static_cast<uint32_t>(vertexCount) <= MAX_16BIT_INDEXED_VERTICES ? VK_INDEX_TYPE_UINT16 : VK_INDEX_TYPE_UINT32;
+	std::vector<uint16_t> shortIndices;
+	const void* indexData = indices;
+	VkDeviceSize indexSize = sizeof(uint32_t);
+	if (indexType == VK_INDEX_TYPE_UINT16)
 	{
-		throw std::runtime_error("Failed to map memory for vertex buffer!");
+		shortIndices.assign(indices, indices + indexCount);
+		indexData = shortIndices.data();
+		indexSize = sizeof(uint16_t);
 	}
-	memcpy(data, indices->data(), (size_t)bufferSize);									
-	vkUnmapMemory(device, stagingBufferMemory);											
 
-	//Create buffer for index data on GPU access only area
-	createBuffer(physicalDevice, device, bufferSize, 
-		VK_BUFFER_USAGE_TRANSFER_DST_BIT | VK_BUFFER_USAGE_INDEX_BUFFER_BIT,
-		VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
-		&indexBuffer, &indexBufferMemory);
+	//Get size of buffer needed for indics
+	VkDeviceSize bufferSize = indexSize * indexCount;
 
-	//Copy from staging buffer to GPU access buffer
-	copyBuffer(device, transferQueue, transferCommandPool, stagingBuffer, indexBuffer, bufferSize);
+	//Reserve a range of the shared index buffer (aligned to the index size, so firstIndex is a whole index)
+	indexRange = geometryPool->allocateIndices(bufferSize, indexSize);
 
-	//Clean up staging buffer parts
-	vkDestroyBuffer(device, stagingBuffer, nullptr);
-	vkFreeMemory(device, stagingBufferMemory, nullptr);
+	//Stage index data and record the copy to our range of the index buffer
+	uploadBatch->uploadBuffer(indexData, bufferSize, geometryPool->getIndexBuffer(), indexRange.offset);
 }
 
+void Mesh::createMeshletBuffer(UploadBatch* uploadBatch, const Meshlet* meshlets)
+{
+	//Meshes without meshlets don't take any of the pool
+	meshletRange = GeometryRange();
+	if (meshletCount == 0)
+	{
+		return;
+	}
 
+	//Reserve a range of the shared meshlet buffer (aligned to the meshlet size, so it's a whole meshlet index)
+	VkDeviceSize bufferSize = sizeof(Meshlet) * meshletCount;
+	meshletRange = geometryPool->allocateMeshlets(bufferSize, sizeof(Meshlet));
+
+	//Stage meshlet data and record the copy to our range of the meshlet buffer
+	uploadBatch->uploadBuffer(meshlets, bufferSize, geometryPool->getMeshletBuffer(), meshletRange.offset);
+}
@@ -6,29 +6,91 @@
 #include <vector>
 
 #include "Utilities.h"
+#include "GeometryPool.h"
+#include "UploadBatch.h"
+
+// Meshes with at most this many vertices get 16-bit indices (primitive restart is off, so 0xFFFF is a normal index)
+const uint32_t MAX_16BIT_INDEXED_VERTICES = 65536;
+
+// Level of detail of a mesh: a range of its indices (the levels share its vertices) and of its meshlets
+struct MeshLod
+{
+	uint32_t firstIndex;	// From the start of the mesh's indices
+	uint32_t indexCount;
+	float error;			// Relative to the radius of the mesh's bounding sphere (0 for the full mesh)
+	uint32_t firstMeshlet;	// From the start of the mesh's meshlets
+	uint32_t meshletCount;	// 0 if the level has none (it's always drawn in full)
+};
+
+// Run of a mesh's triangles the cull shader keeps or drops as a whole (std430 layout, keep in sync with meshlet_cull.comp)
+struct Meshlet
+{
+	glm::vec4 sphere;			// Object space bounding sphere (centre & radius)
+	glm::vec4 cone;				// Object space axis the triangles face around, and the cone's cutoff (1 never culls)
+	uint32_t firstIndex;		// From the start of the mesh's indices
+	uint32_t triangleCount;
+	uint32_t padding[2];
+};
 
 struct Model
 {
 	glm::mat4 modelMatrix;
 };
 
+// Dequantization of each draw's positions (position = quantized * scale + offset), pushed to the vertex shader after Model
+struct PushMeshBounds
+{
+	glm::vec4 positionScale;
+	glm::vec4 positionOffset;
+};
+
+// Material of each draw, pushed to the fragment shader after PushMeshBounds
+struct PushMaterial
+{
+	uint32_t materialId;		// Element of the material buffer
+	uint32_t streamingOffset;	// First texture streaming entry of the frame being drawn
+};
+
 class Mesh
 {
 public:
 	Mesh();
-	Mesh(VkPhysicalDevice newPhysicalDevice, VkDevice newLogicalDevice, 
-		VkQueue transferQueue, VkCommandPool transferCommandPool, 
-		std::vector<Vertex> * vertices, std::vector<uint32_t> * indices, int newTextureId);
+	// Vertices are packed against the bounds, colors (one per vertex) is nullptr if the mesh has no vertex colours.
+	// Indices hold every level of detail, without levels (newLodCount 0) they're all one level. Meshlets are the levels'
+	// (MeshLod::firstMeshlet), meshes without them can't be culled by the meshlet pass. Closed meshes are drawn with back
+	// faces culled
+	Mesh(GeometryPool* newGeometryPool, UploadBatch* uploadBatch,
+		const Vertex* vertices, const uint32_t* colors, uint32_t newVertexCount, const uint32_t* indices, uint32_t newIndexCount,
+		const MeshLod* newLods, uint32_t newLodCount, const Meshlet* meshlets, uint32_t newMeshletCount,
+		glm::vec3 newBoundsMin, glm::vec3 newBoundsMax, bool newClosed, uint32_t newMaterialId);
 
 	void setModel(glm::mat4 model);
 	Model getModel();
 	
-	int getTextureId();
+	uint32_t getMaterialId();
+	PushMeshBounds getBounds();
+	// Object space bounding sphere (centre & radius)
+	glm::vec4 getBoundingSphere();
+
+	uint32_t getLodCount();
+	MeshLod getLod(uint32_t lod);
+	// Level to draw, from the radius of the bounding sphere on screen (in pixels). Keeps the level picked last time, so
+	// the hysteresis can tell which way it's going
+	uint32_t selectLod(float projectedRadius);
 
 	uint32_t getVertexCount();
 	uint32_t getIndexCount();
-	VkBuffer getVertexBuffer();
-	VkBuffer getIndexBuffer();
+	int32_t getVertexOffset();
+	uint32_t getFirstIndex();
+	// First of the mesh's meshlets in the shared meshlet buffer
+	uint32_t getFirstMeshlet();
+	// 16-bit if the mesh's vertices fit, otherwise 32-bit (the index buffer is bound again when it changes between draws)
+	VkIndexType getIndexType();
+	// Vertex colours are bound to binding 1 at this offset of the vertex buffer (lines them up with getVertexOffset)
+	bool hasVertexColors();
+	// Closed & consistently wound (drawn by the pipelines that cull back faces, and its meshlets' cones are tested)
+	bool isClosed();
+	VkDeviceSize getColorBindingOffset();
 
 	void cleanup();
 
@@ -36,23 +98,31 @@ public:
 private:
 	Model model;
 
-	int textureId;
+	uint32_t materialId;
+	glm::vec3 boundsMin;
+	glm::vec3 boundsMax;
+	bool closed;
+	std::vector<MeshLod> lods;
+	uint32_t currentLod;
 
-	//vertex buffer
+	//vertex range in the shared vertex buffer (vertex colours follow the vertices in the same range)
 	int vertexCount;
-	VkBuffer vertexBuffer;
-	VkDeviceMemory vertexBufferMemory;
-	//index buffer
+	bool vertexColors;
+	GeometryRange vertexRange;
+	//index range in the shared index buffer (16 or 32-bit indices)
 	int indexCount;
-	VkBuffer indexBuffer;
-	VkDeviceMemory indexBufferMemory;
+	VkIndexType indexType;
+	GeometryRange indexRange;
+	//meshlet range in the shared meshlet buffer
+	uint32_t meshletCount;
+	GeometryRange meshletRange;
 
 
-	VkPhysicalDevice physicalDevice;
-	VkDevice device;
+	GeometryPool* geometryPool;
 
-	void createVertexBuffer(VkQueue transferQueue, VkCommandPool transferCommandPool, std::vector<Vertex>* vertices);
-	void createIndexBuffer(VkQueue transferQueue, VkCommandPool transferCommandPool, std::vector<uint32_t> * indices);
+	void createVertexBuffer(UploadBatch* uploadBatch, const Vertex* vertices, const uint32_t* colors);
+	void createIndexBuffer(UploadBatch* uploadBatch, const uint32_t* indices);
+	void createMeshletBuffer(UploadBatch* uploadBatch, const Meshlet* meshlets);
 
 	void DestroyVertexBuffer();
 	void destroyIndexBuffer();
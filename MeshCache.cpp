@@ -0,0 +1,448 @@
+#include "MeshCache.h"
+
+#include <stdio.h>
+#include <cstring>
+#include <fstream>
+#include <stdexcept>
+
+#include "TextureCache.h"
+#include "TextureRegistry.h"
+
+#ifdef _WIN32
+#include <direct.h>
+#else
+#include <sys/stat.h>
+#endif
+
+// Bump whenever the entry layout (or what goes into it) changes, so old entries are rebuilt
+const uint32_t MESH_CACHE_VERSION = 5;
+
+// "VPMC" as a little endian uint32
+const uint32_t MESH_CACHE_MAGIC = 0x434D5056;
+
+// Vertex & index streams start on this alignment, so they can be read in place
+const uint64_t MESH_CACHE_STREAM_ALIGNMENT = 16;
+
+// Appends values to an entry being written
+class EntryWriter
+{
+public:
+	std::vector<unsigned char> bytes;
+
+	void write(const void* data, size_t size)
+	{
+		const unsigned char* begin = static_cast<const unsigned char*>(data);
+		bytes.insert(bytes.end(), begin, begin + size);
+	}
+	template <typename T> void write(const T& value)
+	{
+		write(&value, sizeof(T));
+	}
+	void writeString(const std::string& value)
+	{
+		write(static_cast<uint32_t>(value.size()));
+		write(value.data(), value.size());
+	}
+};
+
+// Reads values out of a mapped entry, any read past the end fails the whole entry
+class EntryReader
+{
+public:
+	EntryReader(const unsigned char* newData, uint64_t newSize) : data(newData), size(newSize)
+	{
+	}
+
+	bool read(void* dst, uint64_t readSize)
+	{
+		if (!ok || readSize > size - position)
+		{
+			ok = false;
+			return false;
+		}
+		memcpy(dst, data + position, static_cast<size_t>(readSize));
+		position += readSize;
+		return true;
+	}
+	template <typename T> T read()
+	{
+		T value = T();
+		read(&value, sizeof(T));
+		return value;
+	}
+	std::string readString()
+	{
+		uint32_t length = read<uint32_t>();
+		if (!ok || length > size - position)
+		{
+			ok = false;
+			return "";
+		}
+		std::string value(reinterpret_cast<const char*>(data + position), length);
+		position += length;
+		return value;
+	}
+
+	const unsigned char* data;
+	uint64_t size;
+	uint64_t position = 0;
+	bool ok = true;
+};
+
+Assimp::IOStream* RecordingIOSystem::Open(const char* pFile, const char* pMode)
+{
+	Assimp::IOStream* stream = Assimp::DefaultIOSystem::Open(pFile, pMode);
+	if (stream)
+	{
+		openedFiles.push_back(pFile);
+	}
+	return stream;
+}
+
+const std::vector<std::string>& RecordingIOSystem::getOpenedFiles()
+{
+	return openedFiles;
+}
+
+MeshCache::MeshCache()
+{
+}
+
+void MeshCache::init(const std::string& newDirectory, unsigned int newImportFlags)
+{
+	directory = newDirectory;
+	importFlags = newImportFlags;
+
+	// Fails if it's already there, which is fine (stores report it if it really couldn't be made)
+#ifdef _WIN32
+	_mkdir(directory.c_str());
+#else
+	mkdir(directory.c_str(), 0755);
+#endif
+}
+
+bool MeshCache::load(const std::string& modelFile, ModelFileData* modelData, std::shared_ptr<MappedFile>* mapping)
+{
+	if (directory.empty())
+	{
+		return false;
+	}
+
+	std::string key = TextureRegistry::makePathKey(modelFile);
+	std::shared_ptr<MappedFile> entry = std::make_shared<MappedFile>();
+	if (!entry->open(getEntryFileName(key)))
+	{
+		return false;
+	}
+
+	// Entry must be for this model, made with the same settings from files that haven't changed since (files are hashed
+	// the same way as texture cache sources)
+	EntryReader reader(entry->getData(), entry->getSize());
+	if (reader.read<uint32_t>() != MESH_CACHE_MAGIC || reader.readString() != key || reader.readString() != getSettings())
+	{
+		return false;
+	}
+	uint32_t sourceCount = reader.read<uint32_t>();
+	for (uint32_t i = 0; i < sourceCount && reader.ok; i++)
+	{
+		std::string fileName = reader.readString();
+		std::string hash = reader.readString();
+		if (!reader.ok || TextureCache::hashFile(fileName) != hash)
+		{
+			return false;
+		}
+	}
+
+	ModelFileData entryData;
+	uint32_t materialCount = reader.read<uint32_t>();
+	for (uint32_t i = 0; i < materialCount && reader.ok; i++)
+	{
+		MaterialData material;
+		material.albedoMap = reader.readString();
+		material.normalMap = reader.readString();
+		material.roughnessMap = reader.readString();
+		material.metalnessMap = reader.readString();
+		material.occlusionMap = reader.readString();
+		material.baseColor = reader.read<glm::vec4>();
+		material.roughness = reader.read<float>();
+		material.metalness = reader.read<float>();
+		material.addressing.modeU = static_cast<aiTextureMapMode>(reader.read<uint32_t>());
+		material.addressing.modeV = static_cast<aiTextureMapMode>(reader.read<uint32_t>());
+		entryData.materials.push_back(material);
+	}
+
+	uint32_t embeddedCount = reader.read<uint32_t>();
+	for (uint32_t i = 0; i < embeddedCount && reader.ok; i++)
+	{
+		EmbeddedTextureData texture;
+		texture.width = reader.read<uint32_t>();
+		texture.height = reader.read<uint32_t>();
+		uint64_t dataSize = reader.read<uint64_t>();
+		if (!reader.ok || dataSize > reader.size - reader.position)
+		{
+			return false;
+		}
+		texture.data.resize(static_cast<size_t>(dataSize));
+		reader.read(texture.data.data(), dataSize);
+		entryData.embeddedTextures.push_back(std::move(texture));
+	}
+
+	// Mesh table, then the streams it points into
+	struct MeshRecord
+	{
+		uint64_t vertexOffset;
+		uint64_t colorOffset;		// UINT64_MAX if the mesh has no vertex colours
+		uint64_t indexOffset;
+	};
+	std::vector<MeshRecord> records;
+	uint32_t meshCount = reader.read<uint32_t>();
+	for (uint32_t i = 0; i < meshCount && reader.ok; i++)
+	{
+		MeshData mesh;
+		mesh.materialIndex = reader.read<uint32_t>();
+		mesh.boundsMin = reader.read<glm::vec3>();
+		mesh.boundsMax = reader.read<glm::vec3>();
+		mesh.closed = reader.read<uint32_t>() != 0;
+		mesh.externalVertexCount = reader.read<uint32_t>();
+		mesh.externalIndexCount = reader.read<uint32_t>();
+		MeshRecord record;
+		record.vertexOffset = reader.read<uint64_t>();
+		record.colorOffset = reader.read<uint64_t>();
+		record.indexOffset = reader.read<uint64_t>();
+		uint32_t lodCount = reader.read<uint32_t>();
+		for (uint32_t j = 0; j < lodCount && reader.ok; j++)
+		{
+			MeshLod lod;
+			lod.firstIndex = reader.read<uint32_t>();
+			lod.indexCount = reader.read<uint32_t>();
+			lod.error = reader.read<float>();
+			lod.firstMeshlet = reader.read<uint32_t>();
+			lod.meshletCount = reader.read<uint32_t>();
+			if (lod.firstIndex > mesh.externalIndexCount || lod.indexCount > mesh.externalIndexCount - lod.firstIndex)
+			{
+				return false;
+			}
+			mesh.lods.push_back(lod);
+		}
+		// Meshlets are small next to the streams, so they're read into the mesh instead of used in place
+		uint32_t meshletCount = reader.read<uint32_t>();
+		if (!reader.ok || static_cast<uint64_t>(meshletCount) * sizeof(Meshlet) > reader.size - reader.position)
+		{
+			return false;
+		}
+		mesh.meshlets.resize(meshletCount);
+		reader.read(mesh.meshlets.data(), static_cast<uint64_t>(meshletCount) * sizeof(Meshlet));
+		for (auto& lod : mesh.lods)
+		{
+			if (lod.firstMeshlet > meshletCount || lod.meshletCount > meshletCount - lod.firstMeshlet)
+			{
+				return false;
+			}
+		}
+		for (auto& meshlet : mesh.meshlets)
+		{
+			// The cull shader reads the meshlet's indices without checking them
+			if (meshlet.firstIndex > mesh.externalIndexCount ||
+				static_cast<uint64_t>(meshlet.triangleCount) * 3 > mesh.externalIndexCount - meshlet.firstIndex)
+			{
+				return false;
+			}
+		}
+		records.push_back(record);
+		entryData.meshes.push_back(std::move(mesh));
+	}
+	if (!reader.ok)
+	{
+		return false;
+	}
+
+	uint64_t streamStart = (reader.position + MESH_CACHE_STREAM_ALIGNMENT - 1) / MESH_CACHE_STREAM_ALIGNMENT * MESH_CACHE_STREAM_ALIGNMENT;
+	for (size_t i = 0; i < entryData.meshes.size(); i++)
+	{
+		MeshData& mesh = entryData.meshes[i];
+		uint64_t vertexBytes = static_cast<uint64_t>(mesh.externalVertexCount) * sizeof(Vertex);
+		uint64_t colorBytes = static_cast<uint64_t>(mesh.externalVertexCount) * sizeof(uint32_t);
+		uint64_t indexBytes = static_cast<uint64_t>(mesh.externalIndexCount) * sizeof(uint32_t);
+		bool hasColors = records[i].colorOffset != UINT64_MAX;
+		if (streamStart > entry->getSize() ||
+			records[i].vertexOffset > entry->getSize() - streamStart ||
+			vertexBytes > entry->getSize() - streamStart - records[i].vertexOffset ||
+			(hasColors && (records[i].colorOffset > entry->getSize() - streamStart ||
+				colorBytes > entry->getSize() - streamStart - records[i].colorOffset)) ||
+			records[i].indexOffset > entry->getSize() - streamStart ||
+			indexBytes > entry->getSize() - streamStart - records[i].indexOffset)
+		{
+			return false;
+		}
+		mesh.externalVertices = reinterpret_cast<const Vertex*>(entry->getData() + streamStart + records[i].vertexOffset);
+		mesh.externalColors = hasColors ?
+			reinterpret_cast<const uint32_t*>(entry->getData() + streamStart + records[i].colorOffset) : nullptr;
+		mesh.externalIndices = reinterpret_cast<const uint32_t*>(entry->getData() + streamStart + records[i].indexOffset);
+	}
+
+	*modelData = std::move(entryData);
+	*mapping = entry;
+	return true;
+}
+
+void MeshCache::store(const std::string& modelFile, const std::vector<std::string>& sourceFiles,
+	const ModelFileData& modelData)
+{
+	if (directory.empty())
+	{
+		return;
+	}
+
+	std::string key = TextureRegistry::makePathKey(modelFile);
+	EntryWriter writer;
+	writer.write(MESH_CACHE_MAGIC);
+	writer.writeString(key);
+	writer.writeString(getSettings());
+
+	// Without the hash of every source, the entry could never be checked
+	writer.write(static_cast<uint32_t>(sourceFiles.size()));
+	for (auto& fileName : sourceFiles)
+	{
+		std::string hash = TextureCache::hashFile(fileName);
+		if (hash.empty())
+		{
+			printf("ERROR: %s \n", ("Can't cache " + modelFile + ", failed to read " + fileName + "!").c_str());
+			return;
+		}
+		writer.writeString(fileName);
+		writer.writeString(hash);
+	}
+
+	writer.write(static_cast<uint32_t>(modelData.materials.size()));
+	for (auto& material : modelData.materials)
+	{
+		writer.writeString(material.albedoMap);
+		writer.writeString(material.normalMap);
+		writer.writeString(material.roughnessMap);
+		writer.writeString(material.metalnessMap);
+		writer.writeString(material.occlusionMap);
+		writer.write(material.baseColor);
+		writer.write(material.roughness);
+		writer.write(material.metalness);
+		writer.write(static_cast<uint32_t>(material.addressing.modeU));
+		writer.write(static_cast<uint32_t>(material.addressing.modeV));
+	}
+
+	writer.write(static_cast<uint32_t>(modelData.embeddedTextures.size()));
+	for (auto& texture : modelData.embeddedTextures)
+	{
+		writer.write(static_cast<uint32_t>(texture.width));
+		writer.write(static_cast<uint32_t>(texture.height));
+		writer.write(static_cast<uint64_t>(texture.data.size()));
+		writer.write(texture.data.data(), texture.data.size());
+	}
+
+	// Streams are laid out one mesh after another, offsets are from the start of the first one
+	writer.write(static_cast<uint32_t>(modelData.meshes.size()));
+	uint64_t streamOffset = 0;
+	for (auto& mesh : modelData.meshes)
+	{
+		uint32_t vertexCount = getMeshVertexCount(mesh);
+		uint32_t indexCount = getMeshIndexCount(mesh);
+		writer.write(static_cast<uint32_t>(mesh.materialIndex));
+		writer.write(mesh.boundsMin);
+		writer.write(mesh.boundsMax);
+		writer.write(static_cast<uint32_t>(mesh.closed ? 1 : 0));
+		writer.write(vertexCount);
+		writer.write(indexCount);
+		writer.write(streamOffset);
+		streamOffset += static_cast<uint64_t>(vertexCount) * sizeof(Vertex);
+		if (getMeshColors(mesh))
+		{
+			writer.write(streamOffset);
+			streamOffset += static_cast<uint64_t>(vertexCount) * sizeof(uint32_t);
+		}
+		else
+		{
+			writer.write(static_cast<uint64_t>(UINT64_MAX));
+		}
+		writer.write(streamOffset);
+		streamOffset += static_cast<uint64_t>(indexCount) * sizeof(uint32_t);
+		writer.write(static_cast<uint32_t>(mesh.lods.size()));
+		for (auto& lod : mesh.lods)
+		{
+			writer.write(lod.firstIndex);
+			writer.write(lod.indexCount);
+			writer.write(lod.error);
+			writer.write(lod.firstMeshlet);
+			writer.write(lod.meshletCount);
+		}
+		writer.write(static_cast<uint32_t>(mesh.meshlets.size()));
+		writer.write(mesh.meshlets.data(), mesh.meshlets.size() * sizeof(Meshlet));
+		streamOffset = (streamOffset + MESH_CACHE_STREAM_ALIGNMENT - 1) / MESH_CACHE_STREAM_ALIGNMENT * MESH_CACHE_STREAM_ALIGNMENT;
+	}
+	writer.bytes.resize((writer.bytes.size() + MESH_CACHE_STREAM_ALIGNMENT - 1) / MESH_CACHE_STREAM_ALIGNMENT * MESH_CACHE_STREAM_ALIGNMENT, 0);
+	for (auto& mesh : modelData.meshes)
+	{
+		writer.write(getMeshVertices(mesh), static_cast<size_t>(getMeshVertexCount(mesh)) * sizeof(Vertex));
+		if (getMeshColors(mesh))
+		{
+			writer.write(getMeshColors(mesh), static_cast<size_t>(getMeshVertexCount(mesh)) * sizeof(uint32_t));
+		}
+		writer.write(getMeshIndices(mesh), static_cast<size_t>(getMeshIndexCount(mesh)) * sizeof(uint32_t));
+		writer.bytes.resize((writer.bytes.size() + MESH_CACHE_STREAM_ALIGNMENT - 1) / MESH_CACHE_STREAM_ALIGNMENT * MESH_CACHE_STREAM_ALIGNMENT, 0);
+	}
+
+	// Written under a temporary name first and then moved into place, so a crash (or a run reading it at the same time)
+	// never sees half an entry
+	std::string entryFileName = getEntryFileName(key);
+	std::string tempFileName = entryFileName + "." + std::to_string(tempFileCount++) + ".tmp";
+	try
+	{
+		std::ofstream file(tempFileName, std::ios::binary | std::ios::trunc);
+		if (!file.is_open())
+		{
+			throw std::runtime_error("Failed to create " + tempFileName + "!");
+		}
+		file.write(reinterpret_cast<const char*>(writer.bytes.data()), writer.bytes.size());
+		file.close();
+		if (!file)
+		{
+			throw std::runtime_error("Failed to write " + tempFileName + "!");
+		}
+
+		// rename doesn't replace existing files on Windows
+		remove(entryFileName.c_str());
+		if (rename(tempFileName.c_str(), entryFileName.c_str()) != 0)
+		{
+			throw std::runtime_error("Failed to move " + tempFileName + " to " + entryFileName + "!");
+		}
+	}
+	catch (const std::exception& e)
+	{
+		remove(tempFileName.c_str());
+		printf("ERROR: %s \n", e.what());
+	}
+}
+
+void MeshCache::cleanup()
+{
+	directory.clear();
+}
+
+MeshCache::~MeshCache()
+{
+}
+
+std::string MeshCache::getSettings()
+{
+	return "version=" + std::to_string(MESH_CACHE_VERSION) + ";vertex=" + std::to_string(sizeof(Vertex)) +
+		";index=" + std::to_string(sizeof(uint32_t)) + ";flags=" + std::to_string(importFlags) +
+		";optimize=" + (MESH_OPTIMIZATION ? std::to_string(MESH_OVERDRAW_THRESHOLD) : std::string("0")) +
+		";lods=" + std::to_string(MESH_LOD_COUNT) + "," + std::to_string(MESH_LOD_REDUCTION) + "," +
+		std::to_string(MESH_LOD_MIN_REDUCTION) + "," + std::to_string(MESH_LOD_MAX_ERROR) +
+		";meshlets=" + std::to_string(MESHLET_MAX_VERTICES) + "," + std::to_string(MESHLET_MAX_TRIANGLES);
+}
+
+std::string MeshCache::getEntryFileName(const std::string& key)
+{
+	// Named by the key's hash, like texture cache entries (the key itself is in the entry, to tell apart keys with the
+	// same hash)
+	std::string keyHash = TextureCache::hashData(key.data(), key.size());
+	return directory + keyHash.substr(0, keyHash.find(':')) + ".mesh";
+}
@@ -0,0 +1,60 @@
+#pragma once
+
+#include <stdint.h>
+#include <string>
+#include <vector>
+#include <memory>
+#include <atomic>
+
+#include <assimp/DefaultIOSystem.h>
+
+#include "MeshModel.h"
+#include "MappedFile.h"
+
+// Assimp file system that keeps track of every file an import opens (the model file, and e.g. an OBJ's .mtl), so the
+// cache entry can be checked against all of them
+class RecordingIOSystem : public Assimp::DefaultIOSystem
+{
+public:
+	Assimp::IOStream* Open(const char* pFile, const char* pMode = "rb") override;
+
+	const std::vector<std::string>& getOpenedFiles();
+
+private:
+	std::vector<std::string> openedFiles;
+};
+
+// Directory of models already imported by an earlier run, so warm starts skip Assimp. Each entry is a binary file named
+// after the model's path, with its materials, embedded textures and the final vertex, colour & index streams of its
+// meshes (with their bounds, levels of detail & meshlets). The streams are memory mapped and used in place, so they're
+// copied straight from the file into the staging ring. Entries hold the hashes of every file the import read and the
+// settings it was made with (format version, vertex layout, import flags, mesh optimization, LODs & meshlets); an entry
+// that doesn't match them is stale and is treated as missing (and overwritten by the next store). Thread safe, loader
+// threads use it directly
+class MeshCache
+{
+public:
+	MeshCache();
+
+	void init(const std::string& newDirectory, unsigned int newImportFlags);
+
+	// Find the entry for modelFile, returns false if there isn't an up to date one. Meshes' vertices & indices point
+	// into mapping, which must be kept until they're uploaded
+	bool load(const std::string& modelFile, ModelFileData* modelData, std::shared_ptr<MappedFile>* mapping);
+	// Write (or replace) the entry for modelFile, imported from sourceFiles. Best effort, failures are printed and
+	// otherwise ignored
+	void store(const std::string& modelFile, const std::vector<std::string>& sourceFiles, const ModelFileData& modelData);
+
+	void cleanup();
+
+	~MeshCache();
+
+private:
+	std::string directory;
+	unsigned int importFlags = 0;
+	std::atomic<uint32_t> tempFileCount{ 0 };		// Keeps temporary file names of stores running at once apart
+
+	// Everything that changes an entry's data other than its sources
+	std::string getSettings();
+	std::string getEntryFileName(const std::string& key);
+};
@@ -1,13 +1,89 @@
 #include "MeshModel.h"
 
+#include <algorithm>
+#include <cctype>
+#include <cmath>
+
+#include "VertexFormat.h"
+#include "MeshSimplifier.h"
+#include "MeshletBuilder.h"
+
+const Vertex* getMeshVertices(const MeshData& meshData)
+{
+	return meshData.externalVertices ? meshData.externalVertices : meshData.vertices.data();
+}
+
+uint32_t getMeshVertexCount(const MeshData& meshData)
+{
+	return meshData.externalVertices ? meshData.externalVertexCount : static_cast<uint32_t>(meshData.vertices.size());
+}
+
+const uint32_t* getMeshColors(const MeshData& meshData)
+{
+	if (meshData.externalVertices)
+	{
+		return meshData.externalColors;
+	}
+	return meshData.colors.empty() ? nullptr : meshData.colors.data();
+}
+
+const uint32_t* getMeshIndices(const MeshData& meshData)
+{
+	return meshData.externalIndices ? meshData.externalIndices : meshData.indices.data();
+}
+
+uint32_t getMeshIndexCount(const MeshData& meshData)
+{
+	return meshData.externalIndices ? meshData.externalIndexCount : static_cast<uint32_t>(meshData.indices.size());
+}
+
+void makeMeshDataLocal(MeshData* meshData)
+{
+	if (meshData->externalVertices)
+	{
+		meshData->vertices.assign(meshData->externalVertices, meshData->externalVertices + meshData->externalVertexCount);
+		if (meshData->externalColors)
+		{
+			meshData->colors.assign(meshData->externalColors, meshData->externalColors + meshData->externalVertexCount);
+		}
+		meshData->externalVertices = nullptr;
+		meshData->externalColors = nullptr;
+		meshData->externalVertexCount = 0;
+	}
+	if (meshData->externalIndices)
+	{
+		meshData->indices.assign(meshData->externalIndices, meshData->externalIndices + meshData->externalIndexCount);
+		meshData->externalIndices = nullptr;
+		meshData->externalIndexCount = 0;
+	}
+}
+
 MeshModel::MeshModel()
 {
+	model = glm::mat4(1.0f);
+	state = MeshModelState::Pending;
 }
 
 MeshModel::MeshModel(std::vector<Mesh> newMeshList)
 {
 	meshList = newMeshList;
 	model = glm::mat4(1.0f);
+	state = MeshModelState::Ready;
+}
+
+MeshModelState MeshModel::getState()
+{
+	return state;
+}
+
+void MeshModel::setState(MeshModelState newState)
+{
+	state = newState;
+}
+
+bool MeshModel::isReady()
+{
+	return state == MeshModelState::Ready;
 }
 
 size_t MeshModel::getMeshCount()
@@ -35,6 +111,26 @@ void MeshModel::setModel(glm::mat4 newModel)
 	model = newModel;
 }
 
+const std::vector<uint32_t>& MeshModel::getMaterialIds()
+{
+	return materialIds;
+}
+
+void MeshModel::setMaterialIds(std::vector<uint32_t> newMaterialIds)
+{
+	materialIds = newMaterialIds;
+}
+
+const std::vector<int>& MeshModel::getTextureIds()
+{
+	return textureIds;
+}
+
+void MeshModel::setTextureIds(std::vector<int> newTextureIds)
+{
+	textureIds = newTextureIds;
+}
+
 void MeshModel::destroyMeshModel()
 {
 	for (auto& mesh : meshList)
@@ -42,69 +138,153 @@ void MeshModel::destroyMeshModel()
 		mesh.cleanup();
 	}
 	meshList.clear();
+	textureIds.clear();
+	materialIds.clear();
+}
+
+ModelFileData MeshModel::LoadScene(const aiScene* scene, MeshOptimizationReport* report)
+{
+	ModelFileData modelData;
+
+	// Get vector of all materials with 1:1 ID placement
+	modelData.materials = LoadMaterials(scene);
+
+	// Copies of the embedded textures (the scene is gone once the import is done)
+	modelData.embeddedTextures.resize(scene->mNumTextures);
+	for (unsigned int i = 0; i < scene->mNumTextures; i++)
+	{
+		const aiTexture* texture = scene->mTextures[i];
+		const unsigned char* bytes = reinterpret_cast<const unsigned char*>(texture->pcData);
+		size_t dataSize = texture->mHeight == 0 ? texture->mWidth : texture->mWidth * texture->mHeight * sizeof(aiTexel);
+		modelData.embeddedTextures[i].width = texture->mWidth;
+		modelData.embeddedTextures[i].height = texture->mHeight;
+		modelData.embeddedTextures[i].data.assign(bytes, bytes + dataSize);
+	}
+
+	// Load in all out meshes
+	modelData.meshes = LoadNode(scene->mRootNode, scene, report);
+
+	return modelData;
 }
 
-std::vector<std::string> MeshModel::LoadMaterials(const aiScene* scene)
+std::vector<MaterialData> MeshModel::LoadMaterials(const aiScene* scene)
 {
-	// Create 1:1 sized list of textures
-	std::vector<std::string> textureList(scene->mNumMaterials);
+	// Create 1:1 sized list of materials
+	std::vector<MaterialData> materialList(scene->mNumMaterials);
 
-	// Go through each material and copy its texture file name (if it exists)
+	// Go through each material and copy its texture file names & factors
 	for (size_t i = 0; i < scene->mNumMaterials; i++)
 	{
 		// Get the material
 		aiMaterial* material = scene->mMaterials[i];
+		MaterialData& data = materialList[i];
 
-		// Initialize the texture to empty string (will be replaced if texture exists)
-		textureList[i] = "";
+		// Diffuse Texture (standard detail texture), its addressing is used for the other maps too
+		data.albedoMap = LoadTexturePath(material, aiTextureType_DIFFUSE, &data.addressing);
 
-		// Check for a Diffuse Texture (standard detail texture)
-		if (material->GetTextureCount(aiTextureType_DIFFUSE))
+		// OBJ files put normal maps in map_Bump, which Assimp loads as a height map
+		data.normalMap = LoadTexturePath(material, aiTextureType_NORMALS, nullptr);
+		if (data.normalMap.empty())
 		{
-			// Get the path of the texture file
-			aiString path;
-			if (material->GetTexture(aiTextureType_DIFFUSE, 0, &path) == AI_SUCCESS)
-			{
-				// Cut off any directory information already present
-				int idx = std::string(path.data).rfind("\\");
-				std::string fileName = std::string(path.data).substr(idx + 1);
+			data.normalMap = LoadTexturePath(material, aiTextureType_HEIGHT, nullptr);
+		}
 
-				textureList[i] = fileName;
+		// OBJ files have no roughness slot either, so exporters (e.g. Blender) put roughness maps in map_Ks.
+		// Only take specular maps that are named as roughness maps (same naming the TextureEncoder goes by)
+		data.roughnessMap = LoadTexturePath(material, aiTextureType_DIFFUSE_ROUGHNESS, nullptr);
+		if (data.roughnessMap.empty())
+		{
+			std::string specularMap = LoadTexturePath(material, aiTextureType_SPECULAR, nullptr);
+			std::string lowerName = specularMap;
+			std::transform(lowerName.begin(), lowerName.end(), lowerName.begin(), ::tolower);
+			if (lowerName.find("rough") != std::string::npos)
+			{
+				data.roughnessMap = specularMap;
 			}
 		}
+		data.metalnessMap = LoadTexturePath(material, aiTextureType_METALNESS, nullptr);
+		data.occlusionMap = LoadTexturePath(material, aiTextureType_AMBIENT_OCCLUSION, nullptr);
+		if (data.occlusionMap.empty())
+		{
+			data.occlusionMap = LoadTexturePath(material, aiTextureType_LIGHTMAP, nullptr);
+		}
+
+		// Colour & opacity multiply the albedo map
+		aiColor3D diffuseColor(1.0f, 1.0f, 1.0f);
+		float opacity = 1.0f;
+		material->Get(AI_MATKEY_COLOR_DIFFUSE, diffuseColor);
+		material->Get(AI_MATKEY_OPACITY, opacity);
+		data.baseColor = glm::vec4(diffuseColor.r, diffuseColor.g, diffuseColor.b, opacity);
+
+		// Maps are used as they are, without them roughness comes from the Phong shininess (Ns)
+		float shininess = 0.0f;
+		if (data.roughnessMap.empty() && material->Get(AI_MATKEY_SHININESS, shininess) == AI_SUCCESS)
+		{
+			data.roughness = std::sqrt(2.0f / (std::max(shininess, 0.0f) + 2.0f));
+		}
+		data.metalness = data.metalnessMap.empty() ? 0.0f : 1.0f;
 	}
-	return textureList;
+	return materialList;
 }
 
-std::vector<Mesh> MeshModel::LoadNode(VkPhysicalDevice newPhysicalDevice, VkDevice newDevice, VkQueue transferQueue, VkCommandPool commandPool, aiNode* node, const aiScene* scene, std::vector<int> matToTex)
+std::string MeshModel::LoadTexturePath(aiMaterial* material, aiTextureType type, TextureAddressing* addressing)
 {
-	std::vector<Mesh> meshList;
+	if (!material->GetTextureCount(type))
+	{
+		return "";
+	}
+
+	// Get the path of the texture file and its map modes (U, V & W)
+	aiString path;
+	aiTextureMapMode mapModes[3] = { aiTextureMapMode_Wrap, aiTextureMapMode_Wrap, aiTextureMapMode_Wrap };
+	if (material->GetTexture(type, 0, &path, nullptr, nullptr, nullptr, nullptr, mapModes) != AI_SUCCESS)
+	{
+		return "";
+	}
+
+	if (addressing)
+	{
+		addressing->modeU = mapModes[0];
+		addressing->modeV = mapModes[1];
+	}
+
+	// Cut off any directory information already present
+	std::string fullPath = std::string(path.data);
+	return fullPath.substr(fullPath.find_last_of("\\/") + 1);
+}
+
+std::vector<MeshData> MeshModel::LoadNode(aiNode* node, const aiScene* scene, MeshOptimizationReport* report)
+{
+	std::vector<MeshData> meshList;
 
 	// Go through each mesh at this node and create it, then add it to our meshLish
 	for (size_t i = 0; i < node->mNumMeshes; i++)
 	{
-		// Load mesh
-		meshList.push_back(LoadMesh(newPhysicalDevice, newDevice, transferQueue,
-			commandPool, scene->mMeshes[node->mMeshes[i]], scene, matToTex));
+		// Load mesh (in chunks small enough for 16-bit indices, if it's big)
+		std::vector<MeshData> chunks = SplitForShortIndices(LoadMesh(scene->mMeshes[node->mMeshes[i]], report));
+		for (auto& chunk : chunks)
+		{
+			GenerateLods(&chunk);
+			BuildMeshlets(&chunk);
+		}
+		meshList.insert(meshList.end(), chunks.begin(), chunks.end());
 	}
 
 	// Go throught each node attached to this node and load it, then append their meshes to this node's mesh list
 	for (size_t i = 0; i < node->mNumChildren; i++)
 	{
-		std::vector<Mesh>newList = LoadNode(newPhysicalDevice, newDevice, transferQueue, commandPool, node->mChildren[i], scene, matToTex);
+		std::vector<MeshData>newList = LoadNode(node->mChildren[i], scene, report);
 		meshList.insert(meshList.end(), newList.begin(), newList.end());
 	}
 
 	return meshList;
 }
 
-Mesh MeshModel::LoadMesh(
-	VkPhysicalDevice newPhysicalDevice, VkDevice newDevice, VkQueue transferQueue, 
-	VkCommandPool commandPool, aiMesh * mesh, const aiScene* scene,
-	std::vector<int> matToTex)
+MeshData MeshModel::LoadMesh(aiMesh * mesh, MeshOptimizationReport* report)
 {
-	std::vector<Vertex> vertices;
-	std::vector<uint32_t> indices;
+	MeshData meshData;
+	std::vector<SourceVertex> vertices;
+	std::vector<uint32_t>& indices = meshData.indices;
 
 	// Resize vertex list to hold all vertices for mesh
 	vertices.resize(mesh->mNumVertices);
@@ -130,9 +310,33 @@ Mesh MeshModel::LoadMesh(
 		{
 			vertices[i].normal = { mesh->mNormals[i].x, mesh->mNormals[i].y, mesh->mNormals[i].z };
 		}
+		else
+		{
+			vertices[i].normal = glm::vec3(0.0f);
+		}
+
+		// Set tangents (if they exist), the bitangent is rebuilt in the shader from the normal, tangent & its sign
+		if (mesh->mNormals && mesh->mTangents && mesh->mBitangents)
+		{
+			glm::vec3 tangent = { mesh->mTangents[i].x, mesh->mTangents[i].y, mesh->mTangents[i].z };
+			glm::vec3 bitangent = { mesh->mBitangents[i].x, mesh->mBitangents[i].y, mesh->mBitangents[i].z };
+			float handedness = glm::dot(glm::cross(vertices[i].normal, tangent), bitangent) < 0.0f ? -1.0f : 1.0f;
+			vertices[i].tangent = glm::vec4(tangent, handedness);
+		}
+		else
+		{
+			vertices[i].tangent = glm::vec4(0.0f);
+		}
 
-		//Set colors (just use white for now)
-		vertices[i].col = { 1.0f, 1.0f, 1.0f, 1.0f };
+		// Set colors (if they exist, meshes without them don't get a colour stream at all)
+		if (mesh->HasVertexColors(0))
+		{
+			vertices[i].col = { mesh->mColors[0][i].r, mesh->mColors[0][i].g, mesh->mColors[0][i].b, mesh->mColors[0][i].a };
+		}
+		else
+		{
+			vertices[i].col = { 1.0f, 1.0f, 1.0f, 1.0f };
+		}
 	}
 
 	// iterate over indices though faces and copy across
@@ -147,10 +351,248 @@ Mesh MeshModel::LoadMesh(
 		}
 	}
 
-	// Create new mesh with details and return it
-	Mesh newMesh = Mesh(newPhysicalDevice, newDevice, transferQueue, commandPool, &vertices, &indices, matToTex[mesh->mMaterialIndex]);
+	// Remember the material, it's turned into a material ID once the textures are created
+	meshData.materialIndex = mesh->mMaterialIndex;
+
+	// Back faces of a closed mesh are always behind its front faces, so it can skip them (chunks of a split mesh too, the
+	// rest of the mesh still covers them)
+	meshData.closed = isClosedMesh(vertices, indices);
+
+	// Reorder triangles & vertices into a GPU friendly order (while they're still full precision)
+	if (MESH_OPTIMIZATION)
+	{
+		optimizeMesh(&vertices, &indices, MESH_OVERDRAW_THRESHOLD, report);
+	}
+
+	PackVertices(vertices, mesh->HasVertexColors(0), &meshData);
+
+	return meshData;
+}
+
+std::vector<MeshData> MeshModel::SplitForShortIndices(const MeshData& meshData)
+{
+	uint32_t vertexCount = getMeshVertexCount(meshData);
+	uint32_t indexCount = getMeshIndexCount(meshData);
+	if (vertexCount <= MAX_16BIT_INDEXED_VERTICES || indexCount % 3 != 0)
+	{
+		return { meshData };
+	}
+
+	const Vertex* vertices = getMeshVertices(meshData);
+	const uint32_t* colors = getMeshColors(meshData);
+	const uint32_t* indices = getMeshIndices(meshData);
+
+	// Triangles go into the current chunk in order (keeping the optimized order), until one would take it past the limit.
+	// Chunks keep the whole mesh's bounds, so the packed vertices are copied as they are
+	std::vector<MeshData> chunks;
+	std::vector<uint32_t> remap(vertexCount, UINT32_MAX);		// Mesh vertex -> current chunk's vertex
+	std::vector<uint32_t> chunkVertices;						// Mesh vertices in the current chunk
+	size_t chunkVertexTotal = 0;
+	for (uint32_t i = 0; i < indexCount; i += 3)
+	{
+		uint32_t newVertices = 0;
+		for (uint32_t k = 0; k < 3; k++)
+		{
+			bool repeated = (k > 0 && indices[i + k] == indices[i]) || (k > 1 && indices[i + k] == indices[i + 1]);
+			newVertices += remap[indices[i + k]] == UINT32_MAX && !repeated ? 1 : 0;
+		}
+		if (chunks.empty() || chunkVertices.size() + newVertices > MAX_16BIT_INDEXED_VERTICES)
+		{
+			for (uint32_t v : chunkVertices)
+			{
+				remap[v] = UINT32_MAX;
+			}
+			chunkVertices.clear();
+
+			MeshData chunk;
+			chunk.materialIndex = meshData.materialIndex;
+			chunk.boundsMin = meshData.boundsMin;
+			chunk.boundsMax = meshData.boundsMax;
+			chunk.closed = meshData.closed;
+			chunks.push_back(chunk);
+		}
+
+		MeshData& chunk = chunks.back();
+		for (uint32_t k = 0; k < 3; k++)
+		{
+			uint32_t v = indices[i + k];
+			if (remap[v] == UINT32_MAX)
+			{
+				remap[v] = static_cast<uint32_t>(chunkVertices.size());
+				chunkVertices.push_back(v);
+				chunk.vertices.push_back(vertices[v]);
+				if (colors)
+				{
+					chunk.colors.push_back(colors[v]);
+				}
+				chunkVertexTotal++;
+			}
+			chunk.indices.push_back(remap[v]);
+		}
+	}
+
+	// Each index saves 2 bytes, each duplicated vertex costs a vertex (and its colour)
+	uint64_t savedBytes = static_cast<uint64_t>(indexCount) * (sizeof(uint32_t) - sizeof(uint16_t));
+	uint64_t duplicateBytes = chunkVertexTotal > vertexCount ?
+		(chunkVertexTotal - vertexCount) * (sizeof(Vertex) + (colors ? sizeof(uint32_t) : 0)) : 0;
+	if (duplicateBytes >= savedBytes)
+	{
+		return { meshData };
+	}
+	return chunks;
+}
+
+void MeshModel::GenerateLods(MeshData* meshData)
+{
+	makeMeshDataLocal(meshData);
+	std::vector<uint32_t>& indices = meshData->indices;
+	if (MESH_LOD_COUNT <= 1 || indices.empty() || indices.size() % 3 != 0)
+	{
+		return;
+	}
+
+	// Simplified at full precision (positions only lose their quantization)
+	std::vector<SourceVertex> vertices(meshData->vertices.size());
+	for (size_t i = 0; i < vertices.size(); i++)
+	{
+		vertices[i] = unpackVertex(meshData->vertices[i], meshData->boundsMin, meshData->boundsMax);
+	}
+
+	// Every level is simplified from the full mesh (not the level before, so errors don't pile up), and appended to its
+	// indices
+	std::vector<uint32_t> fullIndices = indices;
+	std::vector<MeshLod> lods = { { 0, static_cast<uint32_t>(indices.size()), 0.0f, 0, 0 } };
+	for (uint32_t level = 1; level < MESH_LOD_COUNT; level++)
+	{
+		size_t previousCount = lods.back().indexCount;
+		size_t targetCount = static_cast<size_t>(static_cast<float>(previousCount) * MESH_LOD_REDUCTION) / 3 * 3;
+		float error;
+		std::vector<uint32_t> lodIndices = simplifyMesh(vertices, fullIndices, targetCount, MESH_LOD_MAX_ERROR, &error);
+
+		// Levels that hardly simplify (locked borders & seams, or the error limit) aren't worth their memory
+		if (lodIndices.empty() || static_cast<float>(lodIndices.size()) > static_cast<float>(previousCount) * MESH_LOD_MIN_REDUCTION)
+		{
+			break;
+		}
+
+		optimizeVertexCache(lodIndices.data(), lodIndices.size(), static_cast<uint32_t>(vertices.size()));
+		lods.push_back({ static_cast<uint32_t>(indices.size()), static_cast<uint32_t>(lodIndices.size()),
+			std::max(error, lods.back().error), 0, 0 });
+		indices.insert(indices.end(), lodIndices.begin(), lodIndices.end());
+	}
+
+	if (lods.size() > 1)
+	{
+		meshData->lods = lods;
+	}
+}
+
+void MeshModel::BuildMeshlets(MeshData* meshData)
+{
+	uint32_t indexCount = getMeshIndexCount(*meshData);
+	if (indexCount == 0 || indexCount % 3 != 0)
+	{
+		return;
+	}
+	if (meshData->lods.empty())
+	{
+		meshData->lods.push_back({ 0, indexCount, 0.0f, 0, 0 });
+	}
+
+	// Bounds are taken from the positions as they're drawn (quantized)
+	uint32_t vertexCount = getMeshVertexCount(*meshData);
+	const Vertex* packedVertices = getMeshVertices(*meshData);
+	std::vector<SourceVertex> vertices(vertexCount);
+	for (uint32_t i = 0; i < vertexCount; i++)
+	{
+		vertices[i] = unpackVertex(packedVertices[i], meshData->boundsMin, meshData->boundsMax);
+	}
+
+	const uint32_t* indices = getMeshIndices(*meshData);
+	meshData->meshlets.clear();
+	for (auto& lod : meshData->lods)
+	{
+		lod.firstMeshlet = static_cast<uint32_t>(meshData->meshlets.size());
+		buildMeshlets(vertices, indices + lod.firstIndex, lod.indexCount, lod.firstIndex,
+			MESHLET_MAX_VERTICES, MESHLET_MAX_TRIANGLES, &meshData->meshlets);
+		lod.meshletCount = static_cast<uint32_t>(meshData->meshlets.size()) - lod.firstMeshlet;
+	}
+}
+
+void MeshModel::PackVertices(const std::vector<SourceVertex>& vertices, bool vertexColors, MeshData* meshData)
+{
+	// Positions are quantized to the bounding box, so it's needed first
+	meshData->boundsMin = vertices.empty() ? glm::vec3(0.0f) : vertices[0].pos;
+	meshData->boundsMax = meshData->boundsMin;
+	for (auto& vertex : vertices)
+	{
+		meshData->boundsMin = glm::min(meshData->boundsMin, vertex.pos);
+		meshData->boundsMax = glm::max(meshData->boundsMax, vertex.pos);
+	}
+
+	meshData->vertices.resize(vertices.size());
+	meshData->colors.resize(vertexColors ? vertices.size() : 0);
+	for (size_t i = 0; i < vertices.size(); i++)
+	{
+		meshData->vertices[i] = packVertex(vertices[i], meshData->boundsMin, meshData->boundsMax);
+		if (vertexColors)
+		{
+			meshData->colors[i] = packVertexColor(vertices[i].col);
+		}
+	}
+}
+
+bool MeshModel::HasUnitUVs(const MeshData& meshData)
+{
+	// A little past the edges still counts, exporters often leave UVs just outside
+	const float tolerance = 0.001f;
+	const Vertex* vertices = getMeshVertices(meshData);
+	for (uint32_t i = 0; i < getMeshVertexCount(meshData); i++)
+	{
+		glm::vec2 uv = getVertexUVs(vertices[i]);
+		if (uv.x < -tolerance || uv.x > 1.0f + tolerance || uv.y < -tolerance || uv.y > 1.0f + tolerance)
+		{
+			return false;
+		}
+	}
+	return true;
+}
+
+void MeshModel::RemapUVs(MeshData* meshData, glm::vec2 scale, glm::vec2 offset)
+{
+	makeMeshDataLocal(meshData);
+	for (auto& vertex : meshData->vertices)
+	{
+		setVertexUVs(&vertex, glm::clamp(getVertexUVs(vertex), 0.0f, 1.0f) * scale + offset);
+	}
+}
 
-	return newMesh;
+std::vector<Mesh> MeshModel::UploadMeshes(
+	GeometryPool* geometryPool, UploadBatch* uploadBatch,
+	std::vector<MeshData>* meshData, const std::vector<uint32_t>& matToMaterial)
+{
+	std::vector<Mesh> meshList;
+	try
+	{
+		for (auto& data : *meshData)
+		{
+			// Create new mesh with details (its data is copied to staging right away, and uploaded when the batch is submitted)
+			meshList.push_back(Mesh(geometryPool, uploadBatch, getMeshVertices(data), getMeshColors(data), getMeshVertexCount(data),
+				getMeshIndices(data), getMeshIndexCount(data), data.lods.data(), static_cast<uint32_t>(data.lods.size()),
+				data.meshlets.data(), static_cast<uint32_t>(data.meshlets.size()),
+				data.boundsMin, data.boundsMax, data.closed, matToMaterial[data.materialIndex]));
+		}
+	}
+	catch (...)
+	{
+		// Model won't be finished (a pool ran full), so the meshes already made give their ranges back
+		for (auto& mesh : meshList)
+		{
+			mesh.cleanup();
+		}
+		throw;
+	}
+	return meshList;
 }
 
 MeshModel::~MeshModel()
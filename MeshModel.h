@@ -1,11 +1,96 @@
 #pragma once
 
 #include <vector>
+#include <string>
 
 #include <glm/glm.hpp>
 #include <assimp/scene.h>
+#include <assimp/postprocess.h>
 
 #include "Mesh.h"
+#include "MeshOptimizer.h"
+
+// Post processing models are imported with (part of the mesh cache's settings, entries made with others are rebuilt)
+const unsigned int MODEL_IMPORT_FLAGS = aiProcess_Triangulate | aiProcess_FlipUVs | aiProcess_JoinIdenticalVertices |
+	aiProcess_CalcTangentSpace /*| aiProcess_GenSmoothNormals*/;
+
+// CPU side mesh data, as loaded from the model file (before it's uploaded to the GPU). Vertices are packed (Vertex),
+// their positions are quantized to the bounds
+struct MeshData
+{
+	std::vector<Vertex> vertices;
+	std::vector<uint32_t> colors;				// RGBA8, one per vertex if the model file has vertex colours, otherwise empty
+	std::vector<uint32_t> indices;
+	std::vector<MeshLod> lods;					// Index ranges of the levels of detail (empty if the indices are one level)
+	std::vector<Meshlet> meshlets;				// Of every level, in order (empty if the mesh can't be culled by meshlet)
+	unsigned int materialIndex;
+	glm::vec3 boundsMin = glm::vec3(0.0f);		// Object space bounding box of the vertices
+	glm::vec3 boundsMax = glm::vec3(0.0f);
+	bool closed = false;						// Closed & consistently wound, so it's drawn with back faces culled
+
+	// Used instead of vertices, colors & indices if set (e.g. a memory mapped mesh cache entry, which must outlive them)
+	const Vertex* externalVertices = nullptr;
+	const uint32_t* externalColors = nullptr;
+	const uint32_t* externalIndices = nullptr;
+	uint32_t externalVertexCount = 0;
+	uint32_t externalIndexCount = 0;
+};
+
+// Vertices, colours (nullptr if the mesh has none) & indices of a mesh, wherever they are
+const Vertex* getMeshVertices(const MeshData& meshData);
+uint32_t getMeshVertexCount(const MeshData& meshData);
+const uint32_t* getMeshColors(const MeshData& meshData);
+const uint32_t* getMeshIndices(const MeshData& meshData);
+uint32_t getMeshIndexCount(const MeshData& meshData);
+// Copy external vertices, colours & indices into the mesh's own vectors, so they can be changed
+void makeMeshDataLocal(MeshData* meshData);
+
+// How a material's texture is addressed outside of 0..1, as the model file asks for it
+struct TextureAddressing
+{
+	aiTextureMapMode modeU = aiTextureMapMode_Wrap;
+	aiTextureMapMode modeV = aiTextureMapMode_Wrap;
+};
+
+// Material as the model file describes it. Maps are texture file names ("*<index>" for textures embedded in the
+// model file), empty if the material doesn't have one
+struct MaterialData
+{
+	std::string albedoMap;
+	std::string normalMap;
+	std::string roughnessMap;
+	std::string metalnessMap;
+	std::string occlusionMap;
+	glm::vec4 baseColor = glm::vec4(1.0f);	// Diffuse colour & opacity
+	float roughness = 1.0f;					// Roughness/metalness the maps are scaled by (or used as they are, without maps)
+	float metalness = 0.0f;
+	TextureAddressing addressing;			// Of the albedo map, used for all of the material's maps
+};
+
+// Texture embedded in a model file, as Assimp has it (aiTexture): a compressed image file (width bytes) if height is 0,
+// otherwise width x height BGRA texels
+struct EmbeddedTextureData
+{
+	unsigned int width = 0;
+	unsigned int height = 0;
+	std::vector<unsigned char> data;
+};
+
+// Everything a model load takes from the model file
+struct ModelFileData
+{
+	std::vector<MaterialData> materials;
+	std::vector<MeshData> meshes;
+	std::vector<EmbeddedTextureData> embeddedTextures;		// Referenced by materials as "*<index>"
+};
+
+enum class MeshModelState
+{
+	Pending,	// Still loading in the background, not drawn yet
+	Ready,		// Uploaded and drawable
+	Failed,		// Loading failed, never drawn
+	Destroyed	// Removed with VulkanRenderer::destroyMeshModel
+};
 
 class MeshModel
 {
@@ -13,26 +98,55 @@ public:
 	MeshModel();
 	MeshModel(std::vector<Mesh> newMeshList);
 
+	MeshModelState getState();
+	void setState(MeshModelState newState);
+	bool isReady();
+
 	size_t getMeshCount();
 	Mesh* getMesh(size_t index);
 
 	glm::mat4 getModel();
 	void setModel(glm::mat4 model);
 
+	// Texture IDs the model holds a reference to (one per material using it)
+	const std::vector<int>& getTextureIds();
+	void setTextureIds(std::vector<int> newTextureIds);
+	// Material IDs the model owns (one per material of the model file)
+	const std::vector<uint32_t>& getMaterialIds();
+	void setMaterialIds(std::vector<uint32_t> newMaterialIds);
+
 	void destroyMeshModel();
 
-	static std::vector<std::string> LoadMaterials(const aiScene * scene);
-	static std::vector<Mesh> LoadNode(
-		VkPhysicalDevice newPhysicalDevice, VkDevice newDevice, VkQueue transferQueue, 
-		VkCommandPool commandPool, aiNode* node, const aiScene* scene, 
-		std::vector<int> matToTex);
-	static Mesh LoadMesh(
-		VkPhysicalDevice newPhysicalDevice, VkDevice newDevice, VkQueue transferQueue,
-		VkCommandPool commandPool, aiMesh * mesh, const aiScene* scene,
-		std::vector<int> matToTex);
+	// Copy everything needed out of an imported scene, meshes are optimized with MESH_OPTIMIZATION (their statistics are
+	// added to report, if it isn't nullptr)
+	static ModelFileData LoadScene(const aiScene* scene, MeshOptimizationReport* report);
+	static std::vector<MaterialData> LoadMaterials(const aiScene * scene);
+	static std::vector<MeshData> LoadNode(aiNode* node, const aiScene* scene, MeshOptimizationReport* report);
+	static MeshData LoadMesh(aiMesh * mesh, MeshOptimizationReport* report);
+	// Split a mesh with too many vertices for 16-bit indices into chunks that each fit (vertices on the cuts are
+	// duplicated), if that saves more index memory than the duplicates cost. Otherwise it stays one (32-bit) mesh
+	static std::vector<MeshData> SplitForShortIndices(const MeshData& meshData);
+	// Add simplified levels of detail to the mesh's indices (MESH_LOD_COUNT), each vertex cache optimized
+	static void GenerateLods(MeshData* meshData);
+	// Cut each level of detail into meshlets (a mesh without levels gets one level), after GenerateLods
+	static void BuildMeshlets(MeshData* meshData);
+	// Pack vertices into meshData (with their bounds), colours are only kept with vertexColors
+	static void PackVertices(const std::vector<SourceVertex>& vertices, bool vertexColors, MeshData* meshData);
+	// Whether all UVs are inside 0..1 (nothing repeats, so the texture can be moved into an atlas)
+	static bool HasUnitUVs(const MeshData& meshData);
+	// Move UVs to uv * scale + offset (e.g. into the texture's rect of an atlas)
+	static void RemapUVs(MeshData* meshData, glm::vec2 scale, glm::vec2 offset);
+	static std::vector<Mesh> UploadMeshes(
+		GeometryPool* geometryPool, UploadBatch* uploadBatch, 
+		std::vector<MeshData>* meshData, const std::vector<uint32_t>& matToMaterial);
 	~MeshModel();
 private:
 	std::vector<Mesh>meshList;
 	glm::mat4 model;
+	MeshModelState state;
+	std::vector<int> textureIds;
+	std::vector<uint32_t> materialIds;
+
+	static std::string LoadTexturePath(aiMaterial* material, aiTextureType type, TextureAddressing* addressing);
 };
 
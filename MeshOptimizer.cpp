@@ -0,0 +1,400 @@
+#include "MeshOptimizer.h"
+
+#include <algorithm>
+#include <cmath>
+
+// Size of the FIFO cache the statistics (and overdraw clusters) are measured with, a typical hardware size
+const uint32_t VERTEX_CACHE_FIFO_SIZE = 16;
+
+// Size of the LRU cache Forsyth's algorithm models, and its scoring constants (from the paper)
+const uint32_t FORSYTH_CACHE_SIZE = 32;
+const float FORSYTH_CACHE_DECAY_POWER = 1.5f;
+const float FORSYTH_LAST_TRIANGLE_SCORE = 0.75f;
+const float FORSYTH_VALENCE_BOOST_SCALE = 2.0f;
+const float FORSYTH_VALENCE_BOOST_POWER = 0.5f;
+
+// FIFO post-transform cache: a vertex is still cached if fewer than size other vertices were transformed since it was
+class FifoCacheSimulation
+{
+public:
+	FifoCacheSimulation(uint32_t vertexCount, uint32_t newSize) : timestamps(vertexCount, 0), size(newSize), time(newSize + 1)
+	{
+	}
+
+	// Returns whether the vertex had to be transformed
+	bool access(uint32_t vertex)
+	{
+		if (time - timestamps[vertex] > size)
+		{
+			timestamps[vertex] = time++;
+			return true;
+		}
+		return false;
+	}
+
+	uint32_t accessTriangle(const uint32_t* triangle)
+	{
+		return (access(triangle[0]) ? 1 : 0) + (access(triangle[1]) ? 1 : 0) + (access(triangle[2]) ? 1 : 0);
+	}
+
+	// Everything falls out of the cache
+	void flush()
+	{
+		time += size + 1;
+	}
+
+private:
+	std::vector<uint32_t> timestamps;
+	uint32_t size;
+	uint32_t time;
+};
+
+void VertexCacheStats::add(const VertexCacheStats& other)
+{
+	triangleCount += other.triangleCount;
+	vertexCount += other.vertexCount;
+	transformCount += other.transformCount;
+}
+
+float VertexCacheStats::getACMR()
+{
+	return triangleCount ? static_cast<float>(transformCount) / static_cast<float>(triangleCount) : 0.0f;
+}
+
+float VertexCacheStats::getATVR()
+{
+	return vertexCount ? static_cast<float>(transformCount) / static_cast<float>(vertexCount) : 0.0f;
+}
+
+VertexCacheStats analyzeVertexCache(const uint32_t* indices, size_t indexCount, uint32_t vertexCount)
+{
+	VertexCacheStats stats;
+	stats.triangleCount = indexCount / 3;
+
+	// Only vertices the triangles use count (unused ones are never transformed)
+	std::vector<bool> used(vertexCount, false);
+	FifoCacheSimulation cache(vertexCount, VERTEX_CACHE_FIFO_SIZE);
+	for (size_t i = 0; i + 2 < indexCount; i += 3)
+	{
+		stats.transformCount += cache.accessTriangle(indices + i);
+		for (size_t j = i; j < i + 3; j++)
+		{
+			if (!used[indices[j]])
+			{
+				used[indices[j]] = true;
+				stats.vertexCount++;
+			}
+		}
+	}
+	return stats;
+}
+
+static float forsythVertexScore(int cachePosition, uint32_t liveTriangles)
+{
+	// Vertices without triangles left are never picked again
+	if (liveTriangles == 0)
+	{
+		return -1.0f;
+	}
+
+	float score = 0.0f;
+	if (cachePosition >= 0)
+	{
+		// The last triangle's vertices get a fixed score, so it doesn't matter which order they went in
+		if (cachePosition < 3)
+		{
+			score = FORSYTH_LAST_TRIANGLE_SCORE;
+		}
+		else
+		{
+			float scale = 1.0f / static_cast<float>(FORSYTH_CACHE_SIZE - 3);
+			score = std::pow(1.0f - static_cast<float>(cachePosition - 3) * scale, FORSYTH_CACHE_DECAY_POWER);
+		}
+	}
+
+	// Vertices with few triangles left are finished off first, so they don't leave lone triangles behind
+	score += FORSYTH_VALENCE_BOOST_SCALE * std::pow(static_cast<float>(liveTriangles), -FORSYTH_VALENCE_BOOST_POWER);
+	return score;
+}
+
+void optimizeVertexCache(uint32_t* indices, size_t indexCount, uint32_t vertexCount)
+{
+	size_t triangleCount = indexCount / 3;
+	if (triangleCount == 0)
+	{
+		return;
+	}
+
+	// Triangles using each vertex (one array, each vertex's list starts at its offset). The first liveTriangles of a
+	// list are the ones not emitted yet
+	std::vector<uint32_t> liveTriangles(vertexCount, 0);
+	for (size_t i = 0; i < triangleCount * 3; i++)
+	{
+		liveTriangles[indices[i]]++;
+	}
+	std::vector<uint32_t> adjacencyOffsets(vertexCount + 1, 0);
+	for (uint32_t v = 0; v < vertexCount; v++)
+	{
+		adjacencyOffsets[v + 1] = adjacencyOffsets[v] + liveTriangles[v];
+	}
+	std::vector<uint32_t> adjacency(triangleCount * 3);
+	std::vector<uint32_t> adjacencyFill(adjacencyOffsets.begin(), adjacencyOffsets.end() - 1);
+	for (size_t i = 0; i < triangleCount * 3; i++)
+	{
+		adjacency[adjacencyFill[indices[i]]++] = static_cast<uint32_t>(i / 3);
+	}
+
+	std::vector<int> cachePositions(vertexCount, -1);
+	std::vector<float> vertexScores(vertexCount);
+	for (uint32_t v = 0; v < vertexCount; v++)
+	{
+		vertexScores[v] = forsythVertexScore(-1, liveTriangles[v]);
+	}
+
+	std::vector<float> triangleScores(triangleCount);
+	std::vector<bool> emitted(triangleCount, false);
+	size_t bestTriangle = 0;
+	for (size_t t = 0; t < triangleCount; t++)
+	{
+		const uint32_t* triangle = indices + t * 3;
+		triangleScores[t] = vertexScores[triangle[0]] + vertexScores[triangle[1]] + vertexScores[triangle[2]];
+		if (triangleScores[t] > triangleScores[bestTriangle])
+		{
+			bestTriangle = t;
+		}
+	}
+
+	std::vector<uint32_t> output;
+	output.reserve(triangleCount * 3);
+	std::vector<uint32_t> cache;		// Most recently used first
+	std::vector<uint32_t> newCache;
+	size_t scanCursor = 0;
+	for (size_t emittedCount = 0; emittedCount < triangleCount; emittedCount++)
+	{
+		// Nothing in the cache has triangles left, carry on with the next triangle that's left in the original order
+		if (bestTriangle == SIZE_MAX)
+		{
+			while (emitted[scanCursor])
+			{
+				scanCursor++;
+			}
+			bestTriangle = scanCursor;
+		}
+
+		emitted[bestTriangle] = true;
+		const uint32_t* triangle = indices + bestTriangle * 3;
+		newCache.clear();
+		for (int k = 0; k < 3; k++)
+		{
+			uint32_t v = triangle[k];
+			output.push_back(v);
+			if (std::find(newCache.begin(), newCache.end(), v) == newCache.end())
+			{
+				newCache.push_back(v);
+			}
+
+			// Take the triangle out of the vertex's live triangles
+			uint32_t* list = adjacency.data() + adjacencyOffsets[v];
+			for (uint32_t j = 0; j < liveTriangles[v]; j++)
+			{
+				if (list[j] == bestTriangle)
+				{
+					std::swap(list[j], list[liveTriangles[v] - 1]);
+					liveTriangles[v]--;
+					break;
+				}
+			}
+		}
+
+		// The triangle's vertices move to the front of the cache, the rest move back (and the last ones fall out)
+		for (uint32_t v : cache)
+		{
+			if (v != triangle[0] && v != triangle[1] && v != triangle[2])
+			{
+				newCache.push_back(v);
+			}
+		}
+		for (size_t i = 0; i < newCache.size(); i++)
+		{
+			uint32_t v = newCache[i];
+			cachePositions[v] = i < FORSYTH_CACHE_SIZE ? static_cast<int>(i) : -1;
+			vertexScores[v] = forsythVertexScore(cachePositions[v], liveTriangles[v]);
+		}
+
+		// Only triangles of vertices whose score changed can change, the best of them goes next
+		bestTriangle = SIZE_MAX;
+		float bestScore = -1.0f;
+		for (uint32_t v : newCache)
+		{
+			const uint32_t* list = adjacency.data() + adjacencyOffsets[v];
+			for (uint32_t j = 0; j < liveTriangles[v]; j++)
+			{
+				uint32_t t = list[j];
+				const uint32_t* liveTriangle = indices + static_cast<size_t>(t) * 3;
+				triangleScores[t] = vertexScores[liveTriangle[0]] + vertexScores[liveTriangle[1]] + vertexScores[liveTriangle[2]];
+				if (triangleScores[t] > bestScore)
+				{
+					bestScore = triangleScores[t];
+					bestTriangle = t;
+				}
+			}
+		}
+
+		if (newCache.size() > FORSYTH_CACHE_SIZE)
+		{
+			newCache.resize(FORSYTH_CACHE_SIZE);
+		}
+		std::swap(cache, newCache);
+	}
+
+	std::copy(output.begin(), output.end(), indices);
+}
+
+void optimizeOverdraw(uint32_t* indices, size_t indexCount, const SourceVertex* vertices, uint32_t vertexCount, float threshold)
+{
+	size_t triangleCount = indexCount / 3;
+	if (triangleCount == 0)
+	{
+		return;
+	}
+
+	// Hard boundaries: triangles that miss the cache with all 3 vertices start over anyway, so cutting there is free
+	std::vector<size_t> hardBoundaries = { 0 };
+	FifoCacheSimulation cache(vertexCount, VERTEX_CACHE_FIFO_SIZE);
+	for (size_t t = 0; t < triangleCount; t++)
+	{
+		if (cache.accessTriangle(indices + t * 3) == 3 && t > 0)
+		{
+			hardBoundaries.push_back(t);
+		}
+	}
+	hardBoundaries.push_back(triangleCount);
+
+	// Soft boundaries: inside each hard cluster, cut (with a flushed cache) as soon as the triangles since the last cut
+	// reach the cluster's ACMR times the threshold
+	std::vector<size_t> clusterStarts;
+	for (size_t i = 0; i + 1 < hardBoundaries.size(); i++)
+	{
+		size_t start = hardBoundaries[i];
+		size_t end = hardBoundaries[i + 1];
+
+		cache.flush();
+		uint32_t clusterTransforms = 0;
+		for (size_t t = start; t < end; t++)
+		{
+			clusterTransforms += cache.accessTriangle(indices + t * 3);
+		}
+		float clusterThreshold = threshold * static_cast<float>(clusterTransforms) / static_cast<float>(end - start);
+
+		clusterStarts.push_back(start);
+		cache.flush();
+		uint32_t runningTransforms = 0;
+		uint32_t runningTriangles = 0;
+		for (size_t t = start; t < end; t++)
+		{
+			runningTransforms += cache.accessTriangle(indices + t * 3);
+			runningTriangles++;
+			if (t + 1 < end && static_cast<float>(runningTransforms) <= clusterThreshold * static_cast<float>(runningTriangles))
+			{
+				clusterStarts.push_back(t + 1);
+				cache.flush();
+				runningTransforms = 0;
+				runningTriangles = 0;
+			}
+		}
+	}
+	clusterStarts.push_back(triangleCount);
+
+	// Area weighted centroid & normal of every cluster (and the centroid of the whole mesh)
+	size_t clusterCount = clusterStarts.size() - 1;
+	std::vector<glm::vec3> clusterCentroids(clusterCount, glm::vec3(0.0f));
+	std::vector<glm::vec3> clusterNormals(clusterCount, glm::vec3(0.0f));
+	glm::vec3 meshCentroid = glm::vec3(0.0f);
+	float meshArea = 0.0f;
+	for (size_t c = 0; c < clusterCount; c++)
+	{
+		float clusterArea = 0.0f;
+		for (size_t t = clusterStarts[c]; t < clusterStarts[c + 1]; t++)
+		{
+			const glm::vec3& p0 = vertices[indices[t * 3 + 0]].pos;
+			const glm::vec3& p1 = vertices[indices[t * 3 + 1]].pos;
+			const glm::vec3& p2 = vertices[indices[t * 3 + 2]].pos;
+			glm::vec3 normal = glm::cross(p1 - p0, p2 - p0);
+			float area = glm::length(normal);
+			glm::vec3 centroid = (p0 + p1 + p2) / 3.0f;
+
+			clusterCentroids[c] += centroid * area;
+			clusterNormals[c] += normal;
+			clusterArea += area;
+			meshCentroid += centroid * area;
+			meshArea += area;
+		}
+		clusterCentroids[c] = clusterArea > 0.0f ? clusterCentroids[c] / clusterArea : glm::vec3(0.0f);
+	}
+	meshCentroid = meshArea > 0.0f ? meshCentroid / meshArea : glm::vec3(0.0f);
+
+	// Clusters facing away from the middle of the mesh go first: they're on the outside, so they tend to cover the rest
+	std::vector<float> sortKeys(clusterCount);
+	std::vector<size_t> clusterOrder(clusterCount);
+	for (size_t c = 0; c < clusterCount; c++)
+	{
+		float normalLength = glm::length(clusterNormals[c]);
+		glm::vec3 direction = normalLength > 0.0f ? clusterNormals[c] / normalLength : glm::vec3(0.0f);
+		sortKeys[c] = glm::dot(clusterCentroids[c] - meshCentroid, direction);
+		clusterOrder[c] = c;
+	}
+	std::stable_sort(clusterOrder.begin(), clusterOrder.end(), [&](size_t a, size_t b)
+	{
+		return sortKeys[a] > sortKeys[b];
+	});
+
+	std::vector<uint32_t> output;
+	output.reserve(triangleCount * 3);
+	for (size_t c : clusterOrder)
+	{
+		output.insert(output.end(), indices + clusterStarts[c] * 3, indices + clusterStarts[c + 1] * 3);
+	}
+	std::copy(output.begin(), output.end(), indices);
+}
+
+void optimizeVertexFetch(std::vector<SourceVertex>* vertices, std::vector<uint32_t>* indices)
+{
+	std::vector<uint32_t> remap(vertices->size(), UINT32_MAX);
+	std::vector<SourceVertex> reordered;
+	reordered.reserve(vertices->size());
+	for (auto& index : *indices)
+	{
+		if (remap[index] == UINT32_MAX)
+		{
+			remap[index] = static_cast<uint32_t>(reordered.size());
+			reordered.push_back((*vertices)[index]);
+		}
+		index = remap[index];
+	}
+	*vertices = std::move(reordered);
+}
+
+void optimizeMesh(std::vector<SourceVertex>* vertices, std::vector<uint32_t>* indices, float overdrawThreshold,
+	MeshOptimizationReport* report)
+{
+	// Lines & points (left over after triangulation) aren't triangle lists
+	if (indices->empty() || indices->size() % 3 != 0)
+	{
+		return;
+	}
+
+	uint32_t vertexCount = static_cast<uint32_t>(vertices->size());
+	if (report)
+	{
+		report->before.add(analyzeVertexCache(indices->data(), indices->size(), vertexCount));
+	}
+
+	optimizeVertexCache(indices->data(), indices->size(), vertexCount);
+	optimizeOverdraw(indices->data(), indices->size(), vertices->data(), vertexCount, overdrawThreshold);
+	optimizeVertexFetch(vertices, indices);
+
+	if (report)
+	{
+		report->after.add(analyzeVertexCache(indices->data(), indices->size(), static_cast<uint32_t>(vertices->size())));
+	}
+}
@@ -0,0 +1,48 @@
+#pragma once
+
+#include <stdint.h>
+#include <vector>
+
+#include "Utilities.h"
+
+// Import time mesh optimization (triangle lists only), so meshes are drawn in a GPU friendly order:
+// 1. Triangles are reordered for the post-transform vertex cache (Forsyth's linear-speed algorithm)
+// 2. The reordered triangles are cut into clusters wherever that costs little cache efficiency, and the clusters are
+//    sorted so the ones facing outwards are drawn first (they're likely to hide the rest, so less overdraw)
+// 3. Vertices are reordered to the order the triangles first use them (vertex fetch locality), unused ones are dropped
+// Nothing in here touches Vulkan, it runs on the loader threads
+
+// Post-transform vertex cache statistics (simulated FIFO cache), can be summed over several meshes
+struct VertexCacheStats
+{
+	uint64_t triangleCount = 0;
+	uint64_t vertexCount = 0;
+	uint64_t transformCount = 0;	// Vertex shader invocations (cache misses)
+
+	void add(const VertexCacheStats& other);
+	// Transforms per triangle (3 is no reuse at all, about 0.5 is the best a regular grid gets)
+	float getACMR();
+	// Transforms per vertex (1 is ideal, every vertex transformed once)
+	float getATVR();
+};
+
+// Statistics of meshes before & after optimizeMesh
+struct MeshOptimizationReport
+{
+	VertexCacheStats before;
+	VertexCacheStats after;
+};
+
+VertexCacheStats analyzeVertexCache(const uint32_t* indices, size_t indexCount, uint32_t vertexCount);
+
+// Reorder triangles for the vertex cache
+void optimizeVertexCache(uint32_t* indices, size_t indexCount, uint32_t vertexCount);
+// Reorder clusters of vertex cache optimized triangles to cut overdraw. Clusters are only cut where their ACMR stays
+// within threshold times the ACMR they'd have otherwise (e.g. 1.05 gives up at most 5%)
+void optimizeOverdraw(uint32_t* indices, size_t indexCount, const SourceVertex* vertices, uint32_t vertexCount, float threshold);
+// Reorder vertices to the order indices use them, indices are remapped and unused vertices dropped
+void optimizeVertexFetch(std::vector<SourceVertex>* vertices, std::vector<uint32_t>* indices);
+
+// All of the above, the mesh's statistics are added to report (if it isn't nullptr)
+void optimizeMesh(std::vector<SourceVertex>* vertices, std::vector<uint32_t>* indices, float overdrawThreshold,
+	MeshOptimizationReport* report);
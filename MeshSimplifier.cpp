@@ -0,0 +1,331 @@
+#include "MeshSimplifier.h"
+
+#include <algorithm>
+#include <cmath>
+#include <unordered_map>
+
+// Penalties for a collapse changing the normal & UVs of a vertex, in the same units as the squared (radius relative)
+// distance: turning a normal by 90 degrees costs about as much as moving 3% of the radius
+const float SIMPLIFY_NORMAL_WEIGHT = 0.0005f;
+const float SIMPLIFY_UV_WEIGHT = 0.01f;
+
+// Sum of squared distances to planes: p^T A p + 2 b.p + c, over the planes' total weight (their area)
+struct Quadric
+{
+	double a00, a01, a02, a11, a12, a22;
+	double b0, b1, b2;
+	double c;
+	double weight;
+};
+
+static Quadric makePlaneQuadric(glm::vec3 normal, float d, float weight)
+{
+	Quadric q;
+	q.a00 = weight * normal.x * normal.x;
+	q.a01 = weight * normal.x * normal.y;
+	q.a02 = weight * normal.x * normal.z;
+	q.a11 = weight * normal.y * normal.y;
+	q.a12 = weight * normal.y * normal.z;
+	q.a22 = weight * normal.z * normal.z;
+	q.b0 = weight * normal.x * d;
+	q.b1 = weight * normal.y * d;
+	q.b2 = weight * normal.z * d;
+	q.c = weight * d * d;
+	q.weight = weight;
+	return q;
+}
+
+static void addQuadric(Quadric* q, const Quadric& other)
+{
+	q->a00 += other.a00;
+	q->a01 += other.a01;
+	q->a02 += other.a02;
+	q->a11 += other.a11;
+	q->a12 += other.a12;
+	q->a22 += other.a22;
+	q->b0 += other.b0;
+	q->b1 += other.b1;
+	q->b2 += other.b2;
+	q->c += other.c;
+	q->weight += other.weight;
+}
+
+// Mean squared distance of p to the quadric's planes
+static double evaluateQuadric(const Quadric& q, glm::vec3 p)
+{
+	if (q.weight <= 0.0)
+	{
+		return 0.0;
+	}
+	double x = p.x;
+	double y = p.y;
+	double z = p.z;
+	double value = q.a00 * x * x + q.a11 * y * y + q.a22 * z * z + 2.0 * (q.a01 * x * y + q.a02 * x * z + q.a12 * y * z) +
+		2.0 * (q.b0 * x + q.b1 * y + q.b2 * z) + q.c;
+	return std::max(value, 0.0) / q.weight;
+}
+
+// Vertex "from" moved onto vertex "to"
+struct Collapse
+{
+	uint32_t from;
+	uint32_t to;
+	float cost;			// Distance & attribute penalties
+	float distance;		// Just the (squared) distance
+};
+
+std::vector<uint32_t> simplifyMesh(const std::vector<SourceVertex>& vertices, const std::vector<uint32_t>& indices,
+	size_t targetIndexCount, float maxError, float* error)
+{
+	*error = 0.0f;
+	std::vector<uint32_t> result = indices;
+	if (result.size() % 3 != 0 || result.size() <= targetIndexCount || vertices.empty())
+	{
+		return result;
+	}
+	uint32_t vertexCount = static_cast<uint32_t>(vertices.size());
+
+	// Positions relative to the bounding sphere, so errors don't depend on the mesh's size
+	glm::vec3 boundsMin = vertices[0].pos;
+	glm::vec3 boundsMax = vertices[0].pos;
+	for (auto& vertex : vertices)
+	{
+		boundsMin = glm::min(boundsMin, vertex.pos);
+		boundsMax = glm::max(boundsMax, vertex.pos);
+	}
+	glm::vec3 center = (boundsMin + boundsMax) * 0.5f;
+	float radius = glm::length(boundsMax - boundsMin) * 0.5f;
+	float scale = radius > 0.0f ? 1.0f / radius : 1.0f;
+	std::vector<glm::vec3> positions(vertexCount);
+	for (uint32_t v = 0; v < vertexCount; v++)
+	{
+		positions[v] = (vertices[v].pos - center) * scale;
+	}
+
+	// Vertices at the same position are one point of the surface with different attributes (a seam). Points are
+	// numbered in position order
+	std::vector<uint32_t> sortedVertices(vertexCount);
+	for (uint32_t v = 0; v < vertexCount; v++)
+	{
+		sortedVertices[v] = v;
+	}
+	auto positionLess = [&](uint32_t a, uint32_t b)
+	{
+		const glm::vec3& pa = vertices[a].pos;
+		const glm::vec3& pb = vertices[b].pos;
+		return pa.x != pb.x ? pa.x < pb.x : (pa.y != pb.y ? pa.y < pb.y : pa.z < pb.z);
+	};
+	std::sort(sortedVertices.begin(), sortedVertices.end(), positionLess);
+	std::vector<uint32_t> pointIds(vertexCount);
+	std::vector<uint32_t> pointVertexCounts;
+	for (uint32_t i = 0; i < vertexCount; i++)
+	{
+		if (i == 0 || vertices[sortedVertices[i]].pos != vertices[sortedVertices[i - 1]].pos)
+		{
+			pointVertexCounts.push_back(0);
+		}
+		pointIds[sortedVertices[i]] = static_cast<uint32_t>(pointVertexCounts.size() - 1);
+		pointVertexCounts.back()++;
+	}
+
+	std::vector<bool> locked(vertexCount, false);
+	for (uint32_t v = 0; v < vertexCount; v++)
+	{
+		locked[v] = pointVertexCounts[pointIds[v]] > 1;
+	}
+
+	// Edges between points that don't have exactly 2 triangles are borders (1) or non-manifold (more)
+	std::unordered_map<uint64_t, uint32_t> edgeTriangleCounts;
+	auto edgeKey = [&](uint32_t a, uint32_t b)
+	{
+		uint64_t pa = pointIds[a];
+		uint64_t pb = pointIds[b];
+		return pa < pb ? (pa << 32) | pb : (pb << 32) | pa;
+	};
+	for (size_t i = 0; i < result.size(); i += 3)
+	{
+		for (int e = 0; e < 3; e++)
+		{
+			edgeTriangleCounts[edgeKey(result[i + e], result[i + (e + 1) % 3])]++;
+		}
+	}
+	for (size_t i = 0; i < result.size(); i += 3)
+	{
+		for (int e = 0; e < 3; e++)
+		{
+			uint32_t a = result[i + e];
+			uint32_t b = result[i + (e + 1) % 3];
+			if (edgeTriangleCounts[edgeKey(a, b)] != 2)
+			{
+				locked[a] = true;
+				locked[b] = true;
+			}
+		}
+	}
+
+	// Planes of the triangles around each vertex, weighted by their area
+	std::vector<Quadric> quadrics(vertexCount, makePlaneQuadric(glm::vec3(0.0f), 0.0f, 0.0f));
+	for (size_t i = 0; i < result.size(); i += 3)
+	{
+		glm::vec3 p0 = positions[result[i]];
+		glm::vec3 normal = glm::cross(positions[result[i + 1]] - p0, positions[result[i + 2]] - p0);
+		float length = glm::length(normal);
+		if (length <= 0.0f)
+		{
+			continue;
+		}
+		normal /= length;
+		Quadric plane = makePlaneQuadric(normal, -glm::dot(normal, p0), length * 0.5f);
+		for (int k = 0; k < 3; k++)
+		{
+			addQuadric(&quadrics[result[i + k]], plane);
+		}
+	}
+
+	// Passes of collapses that don't touch each other (cheapest first), until the target or the error limit is reached
+	// or nothing can collapse any more. Quadrics & triangles are updated between passes
+	double maxCost = static_cast<double>(maxError) * maxError;
+	float maxDistance = 0.0f;
+	std::vector<uint32_t> remap(vertexCount);
+	std::vector<bool> touched(vertexCount);
+	std::vector<uint32_t> adjacencyOffsets(vertexCount + 1);
+	std::vector<uint32_t> adjacency;
+	std::vector<Collapse> collapses;
+	while (result.size() > targetIndexCount)
+	{
+		// Triangles around each vertex
+		std::fill(adjacencyOffsets.begin(), adjacencyOffsets.end(), 0);
+		for (uint32_t v : result)
+		{
+			adjacencyOffsets[v + 1]++;
+		}
+		for (uint32_t v = 0; v < vertexCount; v++)
+		{
+			adjacencyOffsets[v + 1] += adjacencyOffsets[v];
+		}
+		adjacency.resize(result.size());
+		std::vector<uint32_t> adjacencyFill(adjacencyOffsets.begin(), adjacencyOffsets.end() - 1);
+		for (size_t i = 0; i < result.size(); i++)
+		{
+			adjacency[adjacencyFill[result[i]]++] = static_cast<uint32_t>(i / 3);
+		}
+
+		collapses.clear();
+		for (size_t i = 0; i < result.size(); i += 3)
+		{
+			for (int e = 0; e < 3; e++)
+			{
+				uint32_t ends[2] = { result[i + e], result[i + (e + 1) % 3] };
+				for (int direction = 0; direction < 2; direction++)
+				{
+					uint32_t from = ends[direction];
+					uint32_t to = ends[1 - direction];
+					if (locked[from])
+					{
+						continue;
+					}
+					Quadric merged = quadrics[from];
+					addQuadric(&merged, quadrics[to]);
+					float distance = static_cast<float>(evaluateQuadric(merged, positions[to]));
+					glm::vec3 normalChange = vertices[from].normal - vertices[to].normal;
+					glm::vec2 uvChange = vertices[from].UVs - vertices[to].UVs;
+					float cost = distance + SIMPLIFY_NORMAL_WEIGHT * glm::dot(normalChange, normalChange) +
+						SIMPLIFY_UV_WEIGHT * glm::dot(uvChange, uvChange);
+					collapses.push_back({ from, to, cost, distance });
+				}
+			}
+		}
+		std::sort(collapses.begin(), collapses.end(), [](const Collapse& a, const Collapse& b)
+		{
+			return a.cost < b.cost;
+		});
+
+		for (uint32_t v = 0; v < vertexCount; v++)
+		{
+			remap[v] = v;
+		}
+		std::fill(touched.begin(), touched.end(), false);
+		size_t trianglesLeft = result.size() / 3;
+		size_t targetTriangles = targetIndexCount / 3;
+		size_t collapseCount = 0;
+		for (auto& collapse : collapses)
+		{
+			if (collapse.cost > maxCost || trianglesLeft <= targetTriangles)
+			{
+				break;
+			}
+			if (touched[collapse.from] || touched[collapse.to])
+			{
+				continue;
+			}
+
+			// The triangles that stay mustn't flip over (or the surface folds onto itself)
+			bool flips = false;
+			uint32_t removed = 0;
+			for (uint32_t j = adjacencyOffsets[collapse.from]; j < adjacencyOffsets[collapse.from + 1] && !flips; j++)
+			{
+				const uint32_t* triangle = result.data() + static_cast<size_t>(adjacency[j]) * 3;
+				if (triangle[0] == collapse.to || triangle[1] == collapse.to || triangle[2] == collapse.to)
+				{
+					removed++;
+					continue;
+				}
+				glm::vec3 before[3];
+				glm::vec3 after[3];
+				for (int k = 0; k < 3; k++)
+				{
+					before[k] = positions[triangle[k]];
+					after[k] = triangle[k] == collapse.from ? positions[collapse.to] : before[k];
+				}
+				glm::vec3 normalBefore = glm::cross(before[1] - before[0], before[2] - before[0]);
+				glm::vec3 normalAfter = glm::cross(after[1] - after[0], after[2] - after[0]);
+				flips = glm::dot(normalBefore, normalAfter) <= 0.0f;
+			}
+			if (flips)
+			{
+				continue;
+			}
+
+			remap[collapse.from] = collapse.to;
+			addQuadric(&quadrics[collapse.to], quadrics[collapse.from]);
+			maxDistance = std::max(maxDistance, collapse.distance);
+			trianglesLeft -= std::min<size_t>(removed, trianglesLeft);
+			collapseCount++;
+
+			// Everything around the collapse waits for the next pass, its triangles are out of date
+			touched[collapse.from] = true;
+			touched[collapse.to] = true;
+			for (uint32_t j = adjacencyOffsets[collapse.from]; j < adjacencyOffsets[collapse.from + 1]; j++)
+			{
+				const uint32_t* triangle = result.data() + static_cast<size_t>(adjacency[j]) * 3;
+				touched[triangle[0]] = true;
+				touched[triangle[1]] = true;
+				touched[triangle[2]] = true;
+			}
+		}
+		if (collapseCount == 0)
+		{
+			break;
+		}
+
+		// Apply the pass, triangles that lost an edge are gone
+		size_t writeIndex = 0;
+		for (size_t i = 0; i < result.size(); i += 3)
+		{
+			uint32_t a = remap[result[i]];
+			uint32_t b = remap[result[i + 1]];
+			uint32_t c = remap[result[i + 2]];
+			if (a == b || b == c || a == c)
+			{
+				continue;
+			}
+			result[writeIndex++] = a;
+			result[writeIndex++] = b;
+			result[writeIndex++] = c;
+		}
+		result.resize(writeIndex);
+	}
+
+	*error = std::sqrt(maxDistance);
+	return result;
+}
@@ -0,0 +1,20 @@
+#pragma once
+
+#include <stdint.h>
+#include <vector>
+
+#include "Utilities.h"
+
+// Import time mesh simplification (triangle lists only) for levels of detail: edges are collapsed in order of their
+// quadric error (Garland & Heckbert), plus a penalty for how much the normal & UVs change, so shading holds up too.
+// Collapses only move a vertex onto one of its neighbours, so the simplified indices use the same vertices as the full
+// mesh (levels share its vertex buffer). What the result can't keep is locked:
+// - Border vertices (on edges with one triangle), so a mesh's outline & the cuts between its chunks stay closed
+// - Seam vertices (positions shared by several vertices, e.g. UV or normal seams), so attribute seams don't tear
+// - Vertices on non-manifold edges
+// Nothing in here touches Vulkan, it runs on the loader threads
+
+// Simplify indices towards targetIndexCount, stopping early if the error would go past maxError. Errors are distances
+// relative to the radius of the vertices' bounding sphere, error gets the largest one the result has
+std::vector<uint32_t> simplifyMesh(const std::vector<SourceVertex>& vertices, const std::vector<uint32_t>& indices,
+	size_t targetIndexCount, float maxError, float* error);
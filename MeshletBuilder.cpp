@@ -0,0 +1,217 @@
+#include "MeshletBuilder.h"
+
+#include <algorithm>
+#include <cmath>
+
+// Triangles that face further than this from the cone's axis (cosine) leave it open: a cone that wide would hardly ever
+// cull anything
+const float MESHLET_CONE_MIN_DOT = 0.1f;
+
+void buildMeshlets(const std::vector<SourceVertex>& vertices, const uint32_t* indices, size_t indexCount, uint32_t firstIndex,
+	size_t maxVertices, size_t maxTriangles, std::vector<Meshlet>* meshlets)
+{
+	// Meshlet each vertex was last counted for, so its unique vertices are counted without a set
+	std::vector<uint32_t> vertexStamps(vertices.size(), 0);
+	uint32_t stamp = 1;
+
+	size_t meshletStart = 0;
+	size_t meshletVertices = 0;
+	size_t triangleCount = indexCount / 3;
+	for (size_t i = 0; i < triangleCount; i++)
+	{
+		const uint32_t* triangle = &indices[i * 3];
+		size_t newVertices = 0;
+		for (int j = 0; j < 3; j++)
+		{
+			// Repeated vertices of a degenerate triangle only count once
+			bool repeated = (j > 0 && triangle[j] == triangle[0]) || (j > 1 && triangle[j] == triangle[1]);
+			if (vertexStamps[triangle[j]] != stamp && !repeated)
+			{
+				newVertices++;
+			}
+		}
+
+		// Start a new meshlet if the triangle doesn't fit the current one
+		if (i > meshletStart && (meshletVertices + newVertices > maxVertices || i - meshletStart >= maxTriangles))
+		{
+			Meshlet meshlet = computeMeshletBounds(vertices, &indices[meshletStart * 3], i - meshletStart);
+			meshlet.firstIndex = firstIndex + static_cast<uint32_t>(meshletStart * 3);
+			meshlet.triangleCount = static_cast<uint32_t>(i - meshletStart);
+			meshlets->push_back(meshlet);
+
+			meshletStart = i;
+			meshletVertices = 0;
+			stamp++;
+		}
+
+		for (int j = 0; j < 3; j++)
+		{
+			if (vertexStamps[triangle[j]] != stamp)
+			{
+				vertexStamps[triangle[j]] = stamp;
+				meshletVertices++;
+			}
+		}
+	}
+
+	if (triangleCount > meshletStart)
+	{
+		Meshlet meshlet = computeMeshletBounds(vertices, &indices[meshletStart * 3], triangleCount - meshletStart);
+		meshlet.firstIndex = firstIndex + static_cast<uint32_t>(meshletStart * 3);
+		meshlet.triangleCount = static_cast<uint32_t>(triangleCount - meshletStart);
+		meshlets->push_back(meshlet);
+	}
+}
+
+Meshlet computeMeshletBounds(const std::vector<SourceVertex>& vertices, const uint32_t* indices, size_t triangleCount)
+{
+	Meshlet meshlet = {};
+	size_t indexCount = triangleCount * 3;
+
+	// Ritter's bounding sphere: start from the most distant pair of the points furthest along each axis...
+	glm::vec3 minPoints[3];
+	glm::vec3 maxPoints[3];
+	for (int axis = 0; axis < 3; axis++)
+	{
+		minPoints[axis] = vertices[indices[0]].pos;
+		maxPoints[axis] = vertices[indices[0]].pos;
+	}
+	for (size_t i = 0; i < indexCount; i++)
+	{
+		glm::vec3 point = vertices[indices[i]].pos;
+		for (int axis = 0; axis < 3; axis++)
+		{
+			if (point[axis] < minPoints[axis][axis]) minPoints[axis] = point;
+			if (point[axis] > maxPoints[axis][axis]) maxPoints[axis] = point;
+		}
+	}
+	int widestAxis = 0;
+	for (int axis = 1; axis < 3; axis++)
+	{
+		if (glm::length(maxPoints[axis] - minPoints[axis]) > glm::length(maxPoints[widestAxis] - minPoints[widestAxis]))
+		{
+			widestAxis = axis;
+		}
+	}
+	glm::vec3 center = (minPoints[widestAxis] + maxPoints[widestAxis]) * 0.5f;
+	float radius = glm::length(maxPoints[widestAxis] - minPoints[widestAxis]) * 0.5f;
+
+	// ...then grow it to take in every point outside it
+	for (size_t i = 0; i < indexCount; i++)
+	{
+		glm::vec3 point = vertices[indices[i]].pos;
+		float distance = glm::length(point - center);
+		if (distance > radius)
+		{
+			float newRadius = (radius + distance) * 0.5f;
+			center += (point - center) * ((newRadius - radius) / distance);
+			radius = newRadius;
+		}
+	}
+	meshlet.sphere = glm::vec4(center, radius);
+
+	// Normal cone: around the average of the triangles' normals, as wide as the triangle furthest from it (degenerate
+	// triangles don't face anywhere, so they're left out)
+	std::vector<glm::vec3> normals;
+	normals.reserve(triangleCount);
+	glm::vec3 normalSum = glm::vec3(0.0f);
+	for (size_t i = 0; i < triangleCount; i++)
+	{
+		glm::vec3 p0 = vertices[indices[i * 3 + 0]].pos;
+		glm::vec3 p1 = vertices[indices[i * 3 + 1]].pos;
+		glm::vec3 p2 = vertices[indices[i * 3 + 2]].pos;
+		glm::vec3 normal = glm::cross(p1 - p0, p2 - p0);
+		float length = glm::length(normal);
+		if (length > 0.0f)
+		{
+			normals.push_back(normal / length);
+			normalSum += normal / length;
+		}
+	}
+
+	meshlet.cone = glm::vec4(0.0f, 0.0f, 1.0f, 1.0f);
+	float axisLength = glm::length(normalSum);
+	if (normals.empty() || axisLength <= 0.0f)
+	{
+		return meshlet;
+	}
+	glm::vec3 axis = normalSum / axisLength;
+	float minDot = 1.0f;
+	for (auto& normal : normals)
+	{
+		minDot = std::min(minDot, glm::dot(normal, axis));
+	}
+
+	// Cutoff is the cosine of the cone of view directions that see every triangle from behind (the sine of the normals'
+	// spread)
+	if (minDot > MESHLET_CONE_MIN_DOT)
+	{
+		meshlet.cone = glm::vec4(axis, std::sqrt(1.0f - minDot * minDot));
+	}
+	return meshlet;
+}
+
+bool isClosedMesh(const std::vector<SourceVertex>& vertices, const std::vector<uint32_t>& indices)
+{
+	if (indices.empty() || indices.size() % 3 != 0)
+	{
+		return false;
+	}
+
+	// Vertices split at UV & normal seams still share their edges, so they're welded by position first
+	std::vector<uint32_t> order(vertices.size());
+	for (uint32_t i = 0; i < order.size(); i++)
+	{
+		order[i] = i;
+	}
+	auto lessPosition = [&vertices](uint32_t a, uint32_t b)
+	{
+		const glm::vec3& pa = vertices[a].pos;
+		const glm::vec3& pb = vertices[b].pos;
+		return pa.x != pb.x ? pa.x < pb.x : pa.y != pb.y ? pa.y < pb.y : pa.z < pb.z;
+	};
+	std::sort(order.begin(), order.end(), lessPosition);
+	std::vector<uint32_t> welded(vertices.size());
+	for (size_t i = 0; i < order.size(); i++)
+	{
+		welded[order[i]] = i > 0 && vertices[order[i]].pos == vertices[order[i - 1]].pos ? welded[order[i - 1]] : order[i];
+	}
+
+	// Directed edges of every (non degenerate) triangle, as (from << 32 | to)
+	std::vector<uint64_t> edges;
+	edges.reserve(indices.size());
+	for (size_t i = 0; i < indices.size(); i += 3)
+	{
+		uint32_t a = welded[indices[i + 0]];
+		uint32_t b = welded[indices[i + 1]];
+		uint32_t c = welded[indices[i + 2]];
+		if (a == b || b == c || c == a)
+		{
+			continue;
+		}
+		edges.push_back(static_cast<uint64_t>(a) << 32 | b);
+		edges.push_back(static_cast<uint64_t>(b) << 32 | c);
+		edges.push_back(static_cast<uint64_t>(c) << 32 | a);
+	}
+	if (edges.empty())
+	{
+		return false;
+	}
+	std::sort(edges.begin(), edges.end());
+
+	// Closed & consistently wound: each edge is walked once each way (an edge walked twice the same way is a flipped
+	// triangle or a non-manifold fin, one walked once is on a hole's border)
+	for (size_t i = 0; i < edges.size(); i++)
+	{
+		if (i > 0 && edges[i] == edges[i - 1])
+		{
+			return false;
+		}
+		uint64_t reversed = (edges[i] << 32) | (edges[i] >> 32);
+		if (!std::binary_search(edges.begin(), edges.end(), reversed))
+		{
+			return false;
+		}
+	}
+	return true;
+}
@@ -0,0 +1,26 @@
+#pragma once
+
+#include <stdint.h>
+#include <vector>
+
+#include "Utilities.h"
+#include "Mesh.h"
+
+// Import time meshlet building (triangle lists only) for the meshlet cull pass. A meshlet is a run of consecutive
+// triangles, so it's just a range of the mesh's indices and the draw that follows culling can use them as they are.
+// Runs are cut greedily in the triangles' order (vertex cache optimized levels keep their order, and their runs stay
+// local), each one as long as it fits the vertex & triangle limits.
+// Every meshlet gets a bounding sphere (Ritter's) and a cone around the way its triangles face, wide open (never culled)
+// if they face too many ways. The cone only holds for draws that cull back faces, which closed meshes are drawn with.
+// Nothing in here touches Vulkan, it runs on the loader threads
+
+// Append the meshlets of indices[0, indexCount) to meshlets, their first indices offset by firstIndex
+void buildMeshlets(const std::vector<SourceVertex>& vertices, const uint32_t* indices, size_t indexCount, uint32_t firstIndex,
+	size_t maxVertices, size_t maxTriangles, std::vector<Meshlet>* meshlets);
+
+// Bounding sphere & normal cone of a run of triangles (firstIndex & triangleCount are left for the caller)
+Meshlet computeMeshletBounds(const std::vector<SourceVertex>& vertices, const uint32_t* indices, size_t triangleCount);
+
+// Whether every edge of the (triangle list) mesh is shared by exactly two triangles wound the same way, so its back faces
+// are never seen from outside and it can be drawn with back faces culled
+bool isClosedMesh(const std::vector<SourceVertex>& vertices, const std::vector<uint32_t>& indices);
@@ -0,0 +1,119 @@
+#include "MeshletCuller.h"
+
+#include <algorithm>
+
+#include "Utilities.h"
+
+MeshletCuller::MeshletCuller()
+{
+}
+
+void MeshletCuller::init(MemoryAllocator* newAllocator, VkDevice newDevice, uint32_t newFrameCount, uint32_t newMaxDraws,
+	uint32_t newMaxIndices)
+{
+	allocator = newAllocator;
+	device = newDevice;
+	frameCount = newFrameCount;
+	maxDraws = newMaxDraws;
+	maxIndices = newMaxIndices;
+
+	// Written by the CPU every frame, only ever read by the copy to the draw buffer
+	createBuffer(device, allocator, sizeof(GpuCullDraw) * maxDraws * frameCount, VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
+		VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, &uploadBuffer, &uploadBufferMemory);
+
+	// Written (and counted into with atomics) by the cull shader, then read by the draws
+	createBuffer(device, allocator, getDrawBufferSize(),
+		VK_BUFFER_USAGE_TRANSFER_DST_BIT | VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_INDIRECT_BUFFER_BIT,
+		VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, &drawBuffer, &drawBufferMemory);
+	createBuffer(device, allocator, getIndexBufferSize(),
+		VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_INDEX_BUFFER_BIT,
+		VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, &indexBuffer, &indexBufferMemory);
+}
+
+void MeshletCuller::beginFrame(uint32_t frame)
+{
+	currentFrame = frame;
+	drawCount = 0;
+	indexCount = 0;
+	maxMeshletCount = 0;
+}
+
+int32_t MeshletCuller::addDraw(const glm::mat4& model, Mesh* mesh, const MeshLod& lod)
+{
+	if (lod.meshletCount == 0 || drawCount == maxDraws || lod.indexCount > maxIndices - indexCount)
+	{
+		return -1;
+	}
+
+	// Culled indices are copied as they are, so the draw keeps the mesh's vertex offset
+	GpuCullDraw draw = {};
+	draw.indexCount = 0;
+	draw.instanceCount = 1;
+	draw.firstIndex = indexCount;
+	draw.vertexOffset = mesh->getVertexOffset();
+	draw.firstInstance = 0;
+	draw.firstMeshlet = mesh->getFirstMeshlet() + lod.firstMeshlet;
+	draw.meshletCount = lod.meshletCount;
+	draw.meshFirstIndex = mesh->getFirstIndex();
+	draw.shortIndices = mesh->getIndexType() == VK_INDEX_TYPE_UINT16 ? 1 : 0;
+	draw.backfaceCulling = mesh->isClosed() ? 1 : 0;
+	draw.model = model;
+
+	GpuCullDraw* draws = reinterpret_cast<GpuCullDraw*>(static_cast<char*>(uploadBufferMemory.mapped) + getUploadOffset());
+	draws[drawCount] = draw;
+
+	indexCount += lod.indexCount;
+	maxMeshletCount = std::max(maxMeshletCount, lod.meshletCount);
+	return static_cast<int32_t>(drawCount++);
+}
+
+uint32_t MeshletCuller::getDrawCount()
+{
+	return drawCount;
+}
+
+uint32_t MeshletCuller::getMaxMeshletCount()
+{
+	return maxMeshletCount;
+}
+
+VkBuffer MeshletCuller::getUploadBuffer()
+{
+	return uploadBuffer;
+}
+
+VkDeviceSize MeshletCuller::getUploadOffset()
+{
+	return sizeof(GpuCullDraw) * maxDraws * currentFrame;
+}
+
+VkBuffer MeshletCuller::getDrawBuffer()
+{
+	return drawBuffer;
+}
+
+VkDeviceSize MeshletCuller::getDrawBufferSize()
+{
+	return sizeof(GpuCullDraw) * maxDraws;
+}
+
+VkBuffer MeshletCuller::getIndexBuffer()
+{
+	return indexBuffer;
+}
+
+VkDeviceSize MeshletCuller::getIndexBufferSize()
+{
+	return sizeof(uint32_t) * static_cast<VkDeviceSize>(maxIndices);
+}
+
+void MeshletCuller::cleanup()
+{
+	destroyBuffer(device, allocator, indexBuffer, &indexBufferMemory);
+	destroyBuffer(device, allocator, drawBuffer, &drawBufferMemory);
+	destroyBuffer(device, allocator, uploadBuffer, &uploadBufferMemory);
+}
+
+MeshletCuller::~MeshletCuller()
+{
+}
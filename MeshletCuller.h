@@ -0,0 +1,102 @@
+#pragma once
+
+#define GLFW_INCLUDE_VULKAN
+#include <GLFW/glfw3.h>
+#include <glm/glm.hpp>
+
+#include <stdexcept>
+#include <vector>
+
+#include "MemoryAllocator.h"
+#include "Mesh.h"
+
+// Draw culled by meshlet (std430 layout, keep in sync with meshlet_cull.comp). It starts with the indirect command the
+// draw is made with, so the draw buffer is also the indirect buffer (stride sizeof(GpuCullDraw))
+struct GpuCullDraw
+{
+	uint32_t indexCount;		// VkDrawIndexedIndirectCommand, the cull shader adds the indices of the meshlets it keeps
+	uint32_t instanceCount;
+	uint32_t firstIndex;		// In the culled index buffer
+	int32_t vertexOffset;
+	uint32_t firstInstance;
+	uint32_t firstMeshlet;		// In the meshlet buffer
+	uint32_t meshletCount;
+	uint32_t meshFirstIndex;	// Mesh's first index in the index buffer (in its own index type)
+	uint32_t shortIndices;		// 1 if the mesh's indices are 16-bit
+	uint32_t backfaceCulling;	// 1 if the draw's pipeline culls back faces (the shader only runs the cone test for those)
+	uint32_t padding[2];
+	glm::mat4 model;
+};
+
+// Camera the cull pass tests meshlets against, pushed to meshlet_cull.comp
+struct PushCullParams
+{
+	glm::mat4 view;
+	glm::vec4 frustum;			// Side planes through the camera: x & z of the left/right normal, y & z of the top/bottom one
+	glm::vec4 projection;		// projection[0][0], |projection[1][1]|, projection[2][2] & projection[3][2]
+	glm::vec4 pyramid;			// Depth buffer size, depth pyramid levels (0 turns occlusion culling off), near plane
+};
+
+// Level of the depth pyramid being built, pushed to depth_pyramid.comp
+struct PushDepthPyramidLevel
+{
+	glm::ivec2 sourceSize;
+	glm::ivec2 destinationSize;
+};
+
+// Per frame list of the draws the meshlet cull pass works on, and the buffers it fills in for them: each draw's indirect
+// command and the indices of the meshlets it keeps (always 32-bit, in one culled index buffer the draws are made from).
+// Each draw gets room for all of its level's indices, draws that don't fit in a frame's budget aren't culled.
+// The list is written by the CPU into the frame's part of a host visible buffer and copied to the device local draw
+// buffer before the cull pass, so only one copy of the draw & index buffers is needed (frames are culled in order)
+class MeshletCuller
+{
+public:
+	MeshletCuller();
+
+	void init(MemoryAllocator* newAllocator, VkDevice newDevice, uint32_t newFrameCount, uint32_t newMaxDraws,
+		uint32_t newMaxIndices);
+
+	// Start the frame's draw list (its fence has signalled, so its part of the upload buffer is free)
+	void beginFrame(uint32_t frame);
+	// Cull a level of a mesh, returns the draw's index (in the draw buffer), or -1 if it has no meshlets or the frame's
+	// draws or indices ran out
+	int32_t addDraw(const glm::mat4& model, Mesh* mesh, const MeshLod& lod);
+
+	uint32_t getDrawCount();
+	// Most meshlets of any of the frame's draws (the cull dispatch's width)
+	uint32_t getMaxMeshletCount();
+
+	// Frame's draws are at getUploadOffset() of the upload buffer, for a copy to the start of the draw buffer
+	VkBuffer getUploadBuffer();
+	VkDeviceSize getUploadOffset();
+	VkBuffer getDrawBuffer();
+	VkDeviceSize getDrawBufferSize();
+	VkBuffer getIndexBuffer();
+	VkDeviceSize getIndexBufferSize();
+
+	void cleanup();
+
+	~MeshletCuller();
+
+private:
+	VkDevice device = VK_NULL_HANDLE;
+	MemoryAllocator* allocator = nullptr;
+	uint32_t frameCount = 0;
+	uint32_t maxDraws = 0;
+	uint32_t maxIndices = 0;
+
+	// Host visible (persistently mapped) draw lists of every frame, frameCount copies of maxDraws draws
+	VkBuffer uploadBuffer = VK_NULL_HANDLE;
+	MemoryAllocation uploadBufferMemory;
+	// Device local draws (indirect commands) and culled indices, written by the cull shader
+	VkBuffer drawBuffer = VK_NULL_HANDLE;
+	MemoryAllocation drawBufferMemory;
+	VkBuffer indexBuffer = VK_NULL_HANDLE;
+	MemoryAllocation indexBufferMemory;
+
+	uint32_t currentFrame = 0;
+	uint32_t drawCount = 0;
+	uint32_t indexCount = 0;			// Culled indices handed out to the frame's draws
+	uint32_t maxMeshletCount = 0;
+};
@@ -0,0 +1,116 @@
+#include "SamplerCache.h"
+
+#include <cstring>
+
+SamplerCache::SamplerCache()
+{
+}
+
+void SamplerCache::init(VkDevice newDevice, uint32_t newMaxSamplers)
+{
+	device = newDevice;
+	maxSamplers = newMaxSamplers;
+}
+
+uint32_t SamplerCache::getSamplerId(const VkSamplerCreateInfo& createInfo, bool* created)
+{
+	if (createInfo.pNext != nullptr)
+	{
+		throw std::runtime_error("Sampler create info chains aren't supported by the sampler cache!");
+	}
+
+	SamplerKey key = { createInfo };
+	auto existing = samplerIds.find(key);
+	if (existing != samplerIds.end())
+	{
+		if (created) *created = false;
+		return existing->second;
+	}
+
+	if (samplers.size() >= maxSamplers)
+	{
+		throw std::runtime_error("Too many different samplers!");
+	}
+
+	VkSampler sampler;
+	VkResult result = vkCreateSampler(device, &createInfo, nullptr, &sampler);
+	if (result != VK_SUCCESS)
+	{
+		throw std::runtime_error("Failed to create sampler!");
+	}
+
+	uint32_t samplerId = static_cast<uint32_t>(samplers.size());
+	samplers.push_back(sampler);
+	samplerIds[key] = samplerId;
+
+	if (created) *created = true;
+	return samplerId;
+}
+
+VkSampler SamplerCache::getSampler(uint32_t samplerId)
+{
+	if (samplerId >= samplers.size())
+	{
+		throw std::runtime_error("Attempted to access invalid sampler ID!");
+	}
+
+	return samplers[samplerId];
+}
+
+uint32_t SamplerCache::getSamplerCount()
+{
+	return static_cast<uint32_t>(samplers.size());
+}
+
+void SamplerCache::cleanup()
+{
+	for (VkSampler sampler : samplers)
+	{
+		vkDestroySampler(device, sampler, nullptr);
+	}
+	samplers.clear();
+	samplerIds.clear();
+}
+
+SamplerCache::~SamplerCache()
+{
+}
+
+bool SamplerCache::SamplerKey::operator==(const SamplerKey& other) const
+{
+	const VkSamplerCreateInfo& a = createInfo;
+	const VkSamplerCreateInfo& b = other.createInfo;
+	return a.flags == b.flags && a.magFilter == b.magFilter && a.minFilter == b.minFilter && a.mipmapMode == b.mipmapMode &&
+		a.addressModeU == b.addressModeU && a.addressModeV == b.addressModeV && a.addressModeW == b.addressModeW &&
+		a.mipLodBias == b.mipLodBias && a.anisotropyEnable == b.anisotropyEnable && a.maxAnisotropy == b.maxAnisotropy &&
+		a.compareEnable == b.compareEnable && a.compareOp == b.compareOp && a.minLod == b.minLod && a.maxLod == b.maxLod &&
+		a.borderColor == b.borderColor && a.unnormalizedCoordinates == b.unnormalizedCoordinates;
+}
+
+size_t SamplerCache::SamplerKeyHash::operator()(const SamplerKey& key) const
+{
+	const VkSamplerCreateInfo& info = key.createInfo;
+
+	// Combine the fields the same way boost::hash_combine does
+	size_t hash = 0;
+	auto combine = [&hash](uint32_t value) { hash ^= std::hash<uint32_t>()(value) + 0x9e3779b9 + (hash << 6) + (hash >> 2); };
+	auto bits = [](float value) { uint32_t result; value = value == 0.0f ? 0.0f : value; memcpy(&result, &value, sizeof(result)); return result; };
+
+	combine(info.flags);
+	combine(info.magFilter);
+	combine(info.minFilter);
+	combine(info.mipmapMode);
+	combine(info.addressModeU);
+	combine(info.addressModeV);
+	combine(info.addressModeW);
+	combine(bits(info.mipLodBias));
+	combine(info.anisotropyEnable);
+	combine(bits(info.maxAnisotropy));
+	combine(info.compareEnable);
+	combine(info.compareOp);
+	combine(bits(info.minLod));
+	combine(bits(info.maxLod));
+	combine(info.borderColor);
+	combine(info.unnormalizedCoordinates);
+	return hash;
+}
@@ -0,0 +1,48 @@
+#pragma once
+
+#define GLFW_INCLUDE_VULKAN
+#include <GLFW/glfw3.h>
+
+#include <stdexcept>
+#include <vector>
+#include <unordered_map>
+
+// Creates each distinct sampler once and hands out shared copies. Samplers are identified by their create info (pNext
+// chains aren't part of it, so they're not supported) and numbered in creation order, which is their element of the
+// renderer's sampler descriptor array. Devices only allow so many samplers (maxSamplerAllocationCount), so materials
+// must always get them through here
+class SamplerCache
+{
+public:
+	SamplerCache();
+
+	void init(VkDevice newDevice, uint32_t newMaxSamplers);
+
+	// ID of the sampler matching createInfo, creating it first if needed (created is set to say which)
+	uint32_t getSamplerId(const VkSamplerCreateInfo& createInfo, bool* created = nullptr);
+	VkSampler getSampler(uint32_t samplerId);
+	uint32_t getSamplerCount();
+
+	void cleanup();
+
+	~SamplerCache();
+
+private:
+	// Every field of VkSamplerCreateInfo that changes how the sampler works
+	struct SamplerKey
+	{
+		VkSamplerCreateInfo createInfo;
+
+		bool operator==(const SamplerKey& other) const;
+	};
+	struct SamplerKeyHash
+	{
+		size_t operator()(const SamplerKey& key) const;
+	};
+
+	VkDevice device = VK_NULL_HANDLE;
+	uint32_t maxSamplers = 0;
+
+	std::vector<VkSampler> samplers;
+	std::unordered_map<SamplerKey, uint32_t, SamplerKeyHash> samplerIds;
+};
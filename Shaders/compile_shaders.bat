@@ -1,5 +1,8 @@
 C:\VulkanSDK\1.2.148.0\Bin32\glslangValidator.exe -V shader.vert
+C:\VulkanSDK\1.2.148.0\Bin32\glslangValidator.exe -o vert_color.spv -DVERTEX_COLORS -V shader.vert
 C:\VulkanSDK\1.2.148.0\Bin32\glslangValidator.exe -V shader.frag
 C:\VulkanSDK\1.2.148.0\Bin32\glslangValidator.exe -o second_vert.spv -V secondShader.vert
 C:\VulkanSDK\1.2.148.0\Bin32\glslangValidator.exe -o second_frag.spv -V secondShader.frag
+C:\VulkanSDK\1.2.148.0\Bin32\glslangValidator.exe -o meshlet_cull.spv -V meshlet_cull.comp
+C:\VulkanSDK\1.2.148.0\Bin32\glslangValidator.exe -o depth_pyramid.spv -V depth_pyramid.comp
 pause 
\ No newline at end of file
@@ -1,13 +1,63 @@
 #version 450
+#extension GL_EXT_nonuniform_qualifier : require
 
 layout(location = 0) in vec4 FragCol;
 layout(location = 1) in vec3 FragPos;
 layout(location = 2) in vec3 Normal;
 layout(location = 3) in vec2 UVs;
+layout(location = 4) in vec4 Tangent;
 
 layout(location = 0) out vec4 outColor;
 
-layout(set = 1, binding = 0) uniform sampler2D textureSampler;
+// Material flags (MATERIAL_* in MaterialTable.h)
+const uint MATERIAL_NORMAL_MAP = 1;
+const uint MATERIAL_ROUGHNESS_MAP = 2;
+const uint MATERIAL_METALNESS_MAP = 4;
+const uint MATERIAL_OCCLUSION_MAP = 8;
+
+const float PI = 3.14159265359;
+
+// Same layout as GpuMaterial
+struct Material
+{
+	vec4 baseColor;
+	float roughness;
+	float metalness;
+	uint flags;
+	uint samplerId;
+	uint albedoTextureId;
+	uint normalTextureId;
+	uint packedTextureId;		// Roughness/metalness/occlusion in R/G/B
+	uint padding;
+};
+
+// Where each texture ID's image currently is & which mip level it starts at (TextureStreamer, one copy per frame).
+// feedback gets the finest level any pixel wanted this frame, the renderer streams levels in & out from it
+struct TextureStreaming
+{
+	uint slot;
+	uint baseLevel;
+	uint feedback;
+	uint padding;
+};
+
+// Every texture & every distinct sampler (bindless), and every material picking out of them
+layout(set = 1, binding = 0) uniform texture2D textures[];
+layout(set = 1, binding = 1) uniform sampler samplers[];
+layout(set = 1, binding = 2) readonly buffer Materials
+{
+	Material materials[];
+};
+layout(set = 1, binding = 3) buffer TextureStreamingBuffer
+{
+	TextureStreaming streaming[];
+};
+
+layout(push_constant) uniform PushMaterial
+{
+	layout(offset = 96) uint materialId;	// After the vertex shader's model matrix & mesh bounds
+	uint streamingOffset;					// This frame's entries in the streaming buffer
+} pushMaterial;
 
 /*layout(push_constant) uniform LightingModel
 {
@@ -19,28 +69,106 @@ layout(set = 1, binding = 0) uniform sampler2D textureSampler;
 	vec3 reflectionShininess;
 } lightingModel;*/
 
+vec4 sampleTexture(uint textureId, uint samplerId)
+{
+	uint entryId = pushMaterial.streamingOffset + textureId;
+	uint slot = streaming[entryId].slot;
+
+	// Level the pixel wants, in the full texture's mip chain (the image starts at baseLevel). Queried by every pixel, as
+	// it needs the derivatives of the whole 2x2 quad
+	uint level = uint(max(float(streaming[entryId].baseLevel) + floor(textureQueryLod(sampler2D(textures[slot], samplers[samplerId]), UVs).y), 0.0));
+
+	// Only 1 pixel in 8 reports it, that's plenty to find the levels in use & keeps the atomics down
+	if ((uint(gl_FragCoord.x) & 3) == 0 && (uint(gl_FragCoord.y) & 1) == 0)
+	{
+		if (level < streaming[entryId].feedback)
+		{
+			atomicMin(streaming[entryId].feedback, level);
+		}
+	}
+
+	return texture(sampler2D(textures[slot], samplers[samplerId]), UVs);
+}
+
+// GGX normal distribution
+float distributionGGX(float NdotH, float roughness)
+{
+	float a = roughness * roughness;
+	float a2 = a * a;
+	float d = NdotH * NdotH * (a2 - 1.0) + 1.0;
+	return a2 / (PI * d * d);
+}
+
+// Smith geometry term with Schlick-GGX for both the light & view directions
+float geometrySmith(float NdotV, float NdotL, float roughness)
+{
+	float k = (roughness + 1.0) * (roughness + 1.0) / 8.0;
+	return (NdotV / (NdotV * (1.0 - k) + k)) * (NdotL / (NdotL * (1.0 - k) + k));
+}
+
+vec3 fresnelSchlick(float cosTheta, vec3 F0)
+{
+	return F0 + (1.0 - F0) * pow(1.0 - cosTheta, 5.0);
+}
+
 void main()
 {
+	Material material = materials[pushMaterial.materialId];
+
+	vec4 albedo = sampleTexture(material.albedoTextureId, material.samplerId) * material.baseColor * FragCol;
+
+	// Roughness/metalness/occlusion maps scale the material's values (only the channels the material has are read)
+	float roughness = material.roughness;
+	float metalness = material.metalness;
+	float occlusion = 1.0;
+	if ((material.flags & (MATERIAL_ROUGHNESS_MAP | MATERIAL_METALNESS_MAP | MATERIAL_OCCLUSION_MAP)) != 0)
+	{
+		vec3 packedMaps = sampleTexture(material.packedTextureId, material.samplerId).rgb;
+		if ((material.flags & MATERIAL_ROUGHNESS_MAP) != 0) roughness *= packedMaps.r;
+		if ((material.flags & MATERIAL_METALNESS_MAP) != 0) metalness *= packedMaps.g;
+		if ((material.flags & MATERIAL_OCCLUSION_MAP) != 0) occlusion = packedMaps.b;
+	}
+	roughness = clamp(roughness, 0.04, 1.0);
+
+	// Normal map only stores X/Y (e.g. BC5), Z is rebuilt from them as the normal is unit length.
+	// Meshes without tangents can't use it
+	vec3 norm = normalize(Normal);
+	if ((material.flags & MATERIAL_NORMAL_MAP) != 0 && dot(Tangent.xyz, Tangent.xyz) > 0.0)
+	{
+		vec2 xy = sampleTexture(material.normalTextureId, material.samplerId).rg * 2.0 - 1.0;
+		vec3 tangentNormal = vec3(xy, sqrt(max(1.0 - dot(xy, xy), 0.0)));
+
+		// Cotangent frame from the interpolated vectors (re-orthogonalized, they aren't after interpolation)
+		vec3 tangent = normalize(Tangent.xyz - norm * dot(norm, Tangent.xyz));
+		vec3 bitangent = cross(norm, tangent) * Tangent.w;
+		norm = normalize(mat3(tangent, bitangent, norm) * tangentNormal);
+	}
+
 	//TODO: put into fragment shader push constant
 	vec3 lightColor = vec3(1.0, 1.0, 1.0);
 	vec3 lightPos = vec3(0.0, 0.0, -3.5);
 	vec3 viewPos = vec3(0.0, 0.0, 1.0);
+
+	vec3 lightDir = normalize(lightPos - FragPos);
+	vec3 viewDir = normalize(viewPos - FragPos);
+	vec3 halfDir = normalize(lightDir + viewDir);
+	float NdotL = max(dot(norm, lightDir), 0.0);
+	float NdotV = max(dot(norm, viewDir), 0.0001);
+	float NdotH = max(dot(norm, halfDir), 0.0);
+
+	// Cook-Torrance specular, metals tint their reflections & have no diffuse
+	vec3 F0 = mix(vec3(0.04), albedo.rgb, metalness);
+	vec3 F = fresnelSchlick(max(dot(halfDir, viewDir), 0.0), F0);
+	float D = distributionGGX(NdotH, roughness);
+	float G = geometrySmith(NdotV, NdotL, roughness);
+	vec3 specular = D * G * F / (4.0 * NdotV * max(NdotL, 0.0001));
+	vec3 diffuse = (1.0 - F) * (1.0 - metalness) * albedo.rgb / PI;
+
 	// ambient lighting
 	float ambientStrength = 0.15;
-	vec3 ambient = ambientStrength * lightColor;
-	// diffuse lighting
-	vec3 norm = normalize(Normal);
-	vec3 lightDir = normalize(lightPos - vec3(FragPos));
-	float diff = max(dot(norm, lightDir), 0.0);
-	vec3 diffuse = diff * lightColor;
-
-	// specular lighting
-	float specularStrength = 0.5;
-	vec3 viewDir = normalize(viewPos - vec3(FragPos));
-	vec3 reflectDir = reflect(-lightDir, Normal);
-	float spec = pow(max(dot(viewDir, reflectDir), 0.0), 64);
-	vec3 specular = specularStrength * spec * lightColor;
-
-	vec4 resultingColor = vec4(ambient + diffuse + specular, 1.0) * FragCol;
-	outColor = texture(textureSampler, UVs) * resultingColor;
+	vec3 ambient = ambientStrength * lightColor * albedo.rgb * occlusion;
+
+	// Light is scaled by PI so a white diffuse surface facing it is as bright as it was with the Phong model
+	vec3 resultingColor = ambient + (diffuse + specular) * lightColor * NdotL * PI;
+	outColor = vec4(resultingColor, albedo.a);
 }
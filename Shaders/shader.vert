@@ -1,9 +1,13 @@
 #version 450 // Use GLSL 4.5
 
-layout(location = 0) in vec3 pos;
-layout(location = 1) in vec4 color;
-layout(location = 2) in vec3 normal;
+// Packed vertex (Vertex in Utilities.h), the formats turn it into floats
+layout(location = 0) in vec4 pos;		// xyz 0..1 across the mesh's bounds, w is the tangent's handedness (0 = no tangent, 0.5 = -1, 1 = +1)
+layout(location = 1) in vec2 normal;	// Octahedral
+layout(location = 2) in vec2 tangent;	// Octahedral
 layout(location = 3) in vec2 uvs;
+#ifdef VERTEX_COLORS
+layout(location = 4) in vec4 color;		// Second stream, only bound for meshes that have vertex colours (vert_color.spv)
+#endif
 
 layout(set = 0, binding = 0) uniform UboViewProjection
 {
@@ -20,21 +24,48 @@ layout(push_constant) uniform PushModel
 {
 	mat4 model;
 	// TODO::calculate normal matrix on the CPU instead on the GPU
+	vec4 positionScale;		// Mesh's bounds (PushMeshBounds), position = pos * scale + offset
+	vec4 positionOffset;
 } pushModel;
 
 layout(location = 0) out vec4 FragCol;
 layout(location = 1) out vec3 FragPos;
 layout(location = 2) out vec3 Normal;
 layout(location = 3) out vec2 UVs;
+layout(location = 4) out vec4 Tangent;
+
+// Unfold a unit vector from the octahedron it was flattened onto (encodeOctahedral in VertexFormat.cpp)
+vec3 decodeOctahedral(vec2 encoded)
+{
+	vec3 direction = vec3(encoded, 1.0 - abs(encoded.x) - abs(encoded.y));
+	float fold = max(-direction.z, 0.0);
+	direction.xy += vec2(direction.x >= 0.0 ? -fold : fold, direction.y >= 0.0 ? -fold : fold);
+	return normalize(direction);
+}
 
 void main()
 {
-	gl_Position = uboViewProjection.projection * uboViewProjection.view * pushModel.model * vec4(pos, 1.0);
+	vec3 position = pos.xyz * pushModel.positionScale.xyz + pushModel.positionOffset.xyz;
+	gl_Position = uboViewProjection.projection * uboViewProjection.view * pushModel.model * vec4(position, 1.0);
+#ifdef VERTEX_COLORS
 	FragCol = color;
+#else
+	FragCol = vec4(1.0);
+#endif
 	// Get fragment pos in world space
-	FragPos = vec3(pushModel.model * vec4(pos, 1.0));
+	FragPos = vec3(pushModel.model * vec4(position, 1.0));
 	// Texture coordinates
 	UVs = uvs;
 	// Yeah, I know inversing matrices per vertex is a contly operation. Yeah, someday I'll turn it into push constant
-	Normal = mat3(transpose(inverse(pushModel.model))) * normal;
+	Normal = mat3(transpose(inverse(pushModel.model))) * decodeOctahedral(normal);
+	// Tangents lie on the surface, so they're transformed like positions (handedness is kept as it is). Meshes without
+	// tangents get a zero one, so the fragment shader skips their normal maps
+	if (pos.w > 0.25)
+	{
+		Tangent = vec4(mat3(pushModel.model) * decodeOctahedral(tangent), pos.w > 0.75 ? 1.0 : -1.0);
+	}
+	else
+	{
+		Tangent = vec4(0.0);
+	}
 }
@@ -0,0 +1,188 @@
+#include "StagingRing.h"
+
+#include <limits>
+
+StagingRing::StagingRing()
+{
+}
+
+void StagingRing::init(MemoryAllocator* newAllocator, VkDevice newDevice, VkDeviceSize newRingSize)
+{
+	allocator = newAllocator;
+	device = newDevice;
+	ringSize = newRingSize;
+
+	// Allocator keeps host visible memory mapped, so the ring is mapped for its whole life
+	createBuffer(device, allocator, ringSize,
+		VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
+		VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
+		&buffer, &bufferMemory);
+}
+
+bool StagingRing::allocate(VkDeviceSize size, VkDeviceSize alignment, VkDeviceSize* offset)
+{
+	if (size > ringSize)
+	{
+		throw std::runtime_error("Staging allocation is bigger than the whole ring! Split it into chunks");
+	}
+
+	// Give back space of anything that already finished
+	reclaim();
+
+	// Nothing in use - start from the beginning again, so we don't need to wrap
+	if (usedBytes == 0)
+	{
+		head = 0;
+		tail = 0;
+	}
+
+	VkDeviceSize start = alignUp(head, alignment);
+	VkDeviceSize taken = 0;
+
+	if (head == tail && usedBytes > 0)
+	{
+		// Ring is completely full
+		return false;
+	}
+	else if (head >= tail)
+	{
+		// Free space is [head, ringSize) + [0, tail)
+		if (start + size <= ringSize)
+		{
+			taken = start + size - head;
+		}
+		else if (size <= tail)
+		{
+			// Wrap around, rest of the ring end is wasted until the tail passes it
+			taken = (ringSize - head) + size;
+			start = 0;
+		}
+		else
+		{
+			return false;
+		}
+	}
+	else
+	{
+		// Free space is [head, tail)
+		if (start + size > tail)
+		{
+			return false;
+		}
+		taken = start + size - head;
+	}
+
+	head = start + size;
+	usedBytes += taken;
+	pendingBytes += taken;
+
+	*offset = start;
+	return true;
+}
+
+void* StagingRing::getMappedData(VkDeviceSize offset)
+{
+	return static_cast<char*>(bufferMemory.mapped) + offset;
+}
+
+uint64_t StagingRing::closeSubmission(VkFence* fence)
+{
+	// Reuse a finished fence if we have one
+	if (!freeFences.empty())
+	{
+		*fence = freeFences.back();
+		freeFences.pop_back();
+		vkResetFences(device, 1, fence);
+	}
+	else
+	{
+		VkFenceCreateInfo fenceCreateInfo = {};
+		fenceCreateInfo.sType = VK_STRUCTURE_TYPE_FENCE_CREATE_INFO;
+		VkResult result = vkCreateFence(device, &fenceCreateInfo, nullptr, fence);
+		if (result != VK_SUCCESS)
+		{
+			throw std::runtime_error("Failed to create staging ring fence!");
+		}
+	}
+
+	StagingSubmission submission = {};
+	submission.id = nextSubmissionId++;
+	submission.fence = *fence;
+	submission.end = head;
+	submission.bytes = pendingBytes;
+	inFlight.push_back(submission);
+
+	pendingBytes = 0;
+	return submission.id;
+}
+
+bool StagingRing::isComplete(uint64_t submissionId)
+{
+	reclaim();
+
+	// Submissions retire in order, so anything older than the oldest in flight is done
+	return inFlight.empty() || submissionId < inFlight.front().id;
+}
+
+void StagingRing::wait(uint64_t submissionId)
+{
+	while (!isComplete(submissionId))
+	{
+		waitForOldest();
+	}
+}
+
+bool StagingRing::waitForOldest()
+{
+	if (inFlight.empty())
+	{
+		return false;
+	}
+
+	vkWaitForFences(device, 1, &inFlight.front().fence, VK_TRUE, std::numeric_limits<uint64_t>::max());
+	reclaim();
+	return true;
+}
+
+VkBuffer StagingRing::getBuffer()
+{
+	return buffer;
+}
+
+VkDeviceSize StagingRing::getSize()
+{
+	return ringSize;
+}
+
+void StagingRing::cleanup()
+{
+	// Make sure the GPU isn't reading from the ring anymore
+	while (waitForOldest())
+	{
+	}
+
+	for (auto fence : freeFences)
+	{
+		vkDestroyFence(device, fence, nullptr);
+	}
+	freeFences.clear();
+
+	destroyBuffer(device, allocator, buffer, &bufferMemory);
+}
+
+StagingRing::~StagingRing()
+{
+}
+
+void StagingRing::reclaim()
+{
+	while (!inFlight.empty() && vkGetFenceStatus(device, inFlight.front().fence) == VK_SUCCESS)
+	{
+		StagingSubmission& submission = inFlight.front();
+		tail = submission.end;
+		usedBytes -= submission.bytes;
+
+		freeFences.push_back(submission.fence);
+		inFlight.pop_front();
+	}
+}
@@ -0,0 +1,68 @@
+#pragma once
+
+#define GLFW_INCLUDE_VULKAN
+#include <GLFW/glfw3.h>
+
+#include <stdexcept>
+#include <vector>
+#include <deque>
+
+#include "Utilities.h"
+
+// One persistently mapped HOST_VISIBLE buffer used as a ring for every host -> device transfer.
+// Uploads sub-allocate from the head, and space is given back at the tail once the fence of the
+// submission that read it has signalled
+class StagingRing
+{
+public:
+	StagingRing();
+
+	void init(MemoryAllocator* newAllocator, VkDevice newDevice, VkDeviceSize newRingSize);
+
+	// Reserve size bytes, returns false if the ring has no room until some submission finishes
+	bool allocate(VkDeviceSize size, VkDeviceSize alignment, VkDeviceSize* offset);
+	void* getMappedData(VkDeviceSize offset);
+
+	// Everything allocated since the last call belongs to the returned submission, submit it with the returned fence
+	uint64_t closeSubmission(VkFence* fence);
+	// Check/wait for a submission, giving its space back to the ring
+	bool isComplete(uint64_t submissionId);
+	void wait(uint64_t submissionId);
+	// Block until the oldest submission finishes (used when the ring is full), false if nothing is in flight
+	bool waitForOldest();
+
+	VkBuffer getBuffer();
+	VkDeviceSize getSize();
+
+	void cleanup();
+
+	~StagingRing();
+
+private:
+	// Submission that still reads from the ring
+	struct StagingSubmission
+	{
+		uint64_t id;
+		VkFence fence;
+		VkDeviceSize end;	// Ring head at the time of submission (tail moves here once it's finished)
+		VkDeviceSize bytes;	// Bytes (including alignment & wrap padding) taken by the submission
+	};
+
+	VkDevice device = VK_NULL_HANDLE;
+	MemoryAllocator* allocator = nullptr;
+
+	VkBuffer buffer = VK_NULL_HANDLE;
+	MemoryAllocation bufferMemory;
+	VkDeviceSize ringSize = 0;
+
+	VkDeviceSize head = 0;			// Next free byte
+	VkDeviceSize tail = 0;			// Oldest byte still in use
+	VkDeviceSize usedBytes = 0;		// Bytes between tail and head
+	VkDeviceSize pendingBytes = 0;	// Bytes allocated since the last closeSubmission
+
+	uint64_t nextSubmissionId = 0;
+	std::deque<StagingSubmission> inFlight;
+	std::vector<VkFence> freeFences;
+
+	void reclaim();
+};
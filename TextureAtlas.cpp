@@ -0,0 +1,271 @@
+#include "TextureAtlas.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <stdexcept>
+
+static uint32_t alignUp(uint32_t value, uint32_t alignment)
+{
+	return (value + alignment - 1) / alignment * alignment;
+}
+
+SkylinePacker::SkylinePacker()
+{
+}
+
+void SkylinePacker::init(uint32_t newWidth, uint32_t newHeight)
+{
+	width = newWidth;
+	height = newHeight;
+
+	// Starts out as one flat segment along the bottom
+	skyline.clear();
+	skyline.push_back({ 0, 0, width });
+}
+
+bool SkylinePacker::pack(uint32_t rectWidth, uint32_t rectHeight, uint32_t* x, uint32_t* y)
+{
+	// Try the rectangle's left edge at the start of every segment, keep the placement whose top is lowest
+	size_t bestIndex = skyline.size();
+	uint32_t bestTop = UINT32_MAX;
+	uint32_t bestY = 0;
+	for (size_t i = 0; i < skyline.size(); i++)
+	{
+		uint32_t placedY;
+		if (findPlacement(i, rectWidth, rectHeight, &placedY) && placedY + rectHeight < bestTop)
+		{
+			bestIndex = i;
+			bestTop = placedY + rectHeight;
+			bestY = placedY;
+		}
+	}
+	if (bestIndex == skyline.size())
+	{
+		return false;
+	}
+
+	*x = skyline[bestIndex].x;
+	*y = bestY;
+
+	// Rectangle's top becomes a new segment, the segments it covers are cut back to where it ends
+	Segment placed = { *x, bestY + rectHeight, rectWidth };
+	skyline.insert(skyline.begin() + bestIndex, placed);
+	for (size_t i = bestIndex + 1; i < skyline.size();)
+	{
+		uint32_t previousEnd = skyline[i - 1].x + skyline[i - 1].width;
+		if (skyline[i].x >= previousEnd)
+		{
+			break;
+		}
+		uint32_t covered = previousEnd - skyline[i].x;
+		if (skyline[i].width <= covered)
+		{
+			skyline.erase(skyline.begin() + i);
+			continue;
+		}
+		skyline[i].x += covered;
+		skyline[i].width -= covered;
+		break;
+	}
+
+	// Neighbours at the same height are one segment
+	for (size_t i = 1; i < skyline.size();)
+	{
+		if (skyline[i - 1].y == skyline[i].y)
+		{
+			skyline[i - 1].width += skyline[i].width;
+			skyline.erase(skyline.begin() + i);
+			continue;
+		}
+		i++;
+	}
+
+	return true;
+}
+
+uint32_t SkylinePacker::getUsedHeight()
+{
+	uint32_t usedHeight = 0;
+	for (auto& segment : skyline)
+	{
+		usedHeight = std::max(usedHeight, segment.y);
+	}
+	return usedHeight;
+}
+
+bool SkylinePacker::findPlacement(size_t index, uint32_t rectWidth, uint32_t rectHeight, uint32_t* y)
+{
+	if (skyline[index].x + rectWidth > width)
+	{
+		return false;
+	}
+
+	// Rectangle rests on the highest of the segments under it (the segments always cover the whole width, so it never
+	// runs past the last one)
+	uint32_t widthLeft = rectWidth;
+	uint32_t placedY = 0;
+	for (size_t i = index; widthLeft > 0; i++)
+	{
+		placedY = std::max(placedY, skyline[i].y);
+		if (placedY + rectHeight > height)
+		{
+			return false;
+		}
+		widthLeft -= std::min(widthLeft, skyline[i].width);
+	}
+
+	*y = placedY;
+	return true;
+}
+
+SkylinePacker::~SkylinePacker()
+{
+}
+
+TextureAtlas::TextureAtlas()
+{
+}
+
+void TextureAtlas::init(uint32_t newSize, uint32_t newMipLevels)
+{
+	size = newSize;
+	mipLevels = std::max(newMipLevels, 1u);
+	alignment = 1u << (mipLevels - 1);
+	if (size < alignment || size % alignment != 0)
+	{
+		throw std::runtime_error("Texture atlas size must be a multiple of its last mip level's gutter!");
+	}
+
+	packer.init(size, size);
+	rectCount = 0;
+	levelPixels.clear();
+}
+
+bool TextureAtlas::add(uint32_t width, uint32_t height, AtlasRect* rect)
+{
+	// The texture's cell is its size rounded up to the alignment with a gutter on every side, so cells (and the
+	// textures in them) start on aligned pixels too
+	uint32_t cellX;
+	uint32_t cellY;
+	if (!packer.pack(alignUp(width, alignment) + alignment * 2, alignUp(height, alignment) + alignment * 2, &cellX, &cellY))
+	{
+		return false;
+	}
+
+	rect->x = cellX + alignment;
+	rect->y = cellY + alignment;
+	rect->width = width;
+	rect->height = height;
+	rectCount++;
+	return true;
+}
+
+void TextureAtlas::getUVTransform(const AtlasRect& rect, glm::vec2* scale, glm::vec2* offset)
+{
+	glm::vec2 atlasSize = glm::vec2(static_cast<float>(size), static_cast<float>(getHeight()));
+	*scale = glm::vec2(static_cast<float>(rect.width), static_cast<float>(rect.height)) / atlasSize;
+	*offset = glm::vec2(static_cast<float>(rect.x), static_cast<float>(rect.y)) / atlasSize;
+}
+
+void TextureAtlas::write(const AtlasRect& rect, const std::vector<AtlasLevel>& levels)
+{
+	if (levels.empty())
+	{
+		throw std::runtime_error("Texture written into an atlas has no levels!");
+	}
+
+	// Levels are kept at the full size until finish (cutting off unused rows doesn't move anything)
+	if (levelPixels.empty())
+	{
+		levelPixels.resize(mipLevels);
+		for (uint32_t level = 0; level < mipLevels; level++)
+		{
+			uint32_t levelSize = size >> level;
+			levelPixels[level].assign(static_cast<size_t>(levelSize) * levelSize * 4, 0);
+		}
+	}
+
+	std::vector<uint32_t> sourceColumns;
+	for (uint32_t level = 0; level < mipLevels; level++)
+	{
+		const AtlasLevel& source = levels[std::min<size_t>(level, levels.size() - 1)];
+		uint32_t levelSize = size >> level;
+		unsigned char* pixels = levelPixels[level].data();
+
+		// Cell and rect at this level (everything is aligned, so they're whole pixels). The rect's size is kept as a
+		// fraction, for textures whose size doesn't halve exactly
+		uint32_t cellX = (rect.x - alignment) >> level;
+		uint32_t cellY = (rect.y - alignment) >> level;
+		uint32_t cellWidth = (alignUp(rect.width, alignment) + alignment * 2) >> level;
+		uint32_t cellHeight = (alignUp(rect.height, alignment) + alignment * 2) >> level;
+		float rectX = static_cast<float>(rect.x >> level);
+		float rectY = static_cast<float>(rect.y >> level);
+		float rectWidth = static_cast<float>(rect.width) / static_cast<float>(1u << level);
+		float rectHeight = static_cast<float>(rect.height) / static_cast<float>(1u << level);
+
+		// Each atlas pixel takes the source pixel under its centre, clamped to the edges (which fills the gutter)
+		auto sourcePixel = [](float position, float rectStart, float rectSize, uint32_t sourceSize)
+		{
+			float u = (position + 0.5f - rectStart) / rectSize;
+			int pixel = static_cast<int>(std::floor(u * static_cast<float>(sourceSize)));
+			return static_cast<uint32_t>(std::min(std::max(pixel, 0), static_cast<int>(sourceSize) - 1));
+		};
+		sourceColumns.resize(cellWidth);
+		for (uint32_t x = 0; x < cellWidth; x++)
+		{
+			sourceColumns[x] = sourcePixel(static_cast<float>(cellX + x), rectX, rectWidth, source.width);
+		}
+		for (uint32_t y = 0; y < cellHeight; y++)
+		{
+			uint32_t sourceRow = sourcePixel(static_cast<float>(cellY + y), rectY, rectHeight, source.height);
+			const unsigned char* src = source.pixels + static_cast<size_t>(sourceRow) * source.width * 4;
+			unsigned char* dst = pixels + (static_cast<size_t>(cellY + y) * levelSize + cellX) * 4;
+			for (uint32_t x = 0; x < cellWidth; x++)
+			{
+				memcpy(dst + x * 4, src + sourceColumns[x] * 4, 4);
+			}
+		}
+	}
+}
+
+TextureFile TextureAtlas::finish()
+{
+	uint32_t height = getHeight();
+
+	TextureFile file;
+	file.format = TextureFormat::RGBA8;
+	file.width = size;
+	file.height = height;
+	for (uint32_t level = 0; level < mipLevels; level++)
+	{
+		uint32_t levelWidth = size >> level;
+		uint32_t levelHeight = height >> level;
+		if (levelPixels.empty())
+		{
+			addTextureFileLevel(&file, levelWidth, levelHeight,
+				std::vector<unsigned char>(static_cast<size_t>(levelWidth) * levelHeight * 4, 0));
+			continue;
+		}
+		levelPixels[level].resize(static_cast<size_t>(levelWidth) * levelHeight * 4);
+		addTextureFileLevel(&file, levelWidth, levelHeight, levelPixels[level]);
+	}
+	levelPixels.clear();
+
+	return file;
+}
+
+uint32_t TextureAtlas::getRectCount()
+{
+	return rectCount;
+}
+
+uint32_t TextureAtlas::getHeight()
+{
+	// Whole aligned rows, so every level is exactly half the one above
+	return std::max(alignUp(packer.getUsedHeight(), alignment), alignment);
+}
+
+TextureAtlas::~TextureAtlas()
+{
+}
@@ -0,0 +1,97 @@
+#pragma once
+
+#include <stdint.h>
+#include <vector>
+
+#include <glm/glm.hpp>
+
+#include "TextureFile.h"
+
+// Place of a texture in an atlas, in level 0 pixels (the gutter around it isn't included)
+struct AtlasRect
+{
+	uint32_t x;
+	uint32_t y;
+	uint32_t width;
+	uint32_t height;
+};
+
+// One mip level of a texture going into an atlas (tightly packed RGBA8)
+struct AtlasLevel
+{
+	const unsigned char* pixels;
+	uint32_t width;
+	uint32_t height;
+};
+
+// Skyline bottom-left rectangle packer: the packed area is kept as the heights of its top edge, each rectangle goes
+// wherever it ends lowest (then leftmost). Nothing is ever removed, a packer is filled once
+class SkylinePacker
+{
+public:
+	SkylinePacker();
+
+	void init(uint32_t newWidth, uint32_t newHeight);
+
+	// Find room for a width x height rectangle, returns false if it doesn't fit anywhere
+	bool pack(uint32_t width, uint32_t height, uint32_t* x, uint32_t* y);
+	// Lowest height everything packed so far fits under
+	uint32_t getUsedHeight();
+
+	~SkylinePacker();
+
+private:
+	// Part of the top edge at one height
+	struct Segment
+	{
+		uint32_t x;
+		uint32_t y;
+		uint32_t width;
+	};
+
+	uint32_t width = 0;
+	uint32_t height = 0;
+	std::vector<Segment> skyline;
+
+	// Height a rectangle placed at segment index would sit at, or false if it doesn't fit there
+	bool findPlacement(size_t index, uint32_t rectWidth, uint32_t rectHeight, uint32_t* y);
+};
+
+// Packs small RGBA8 textures into one bigger texture, so they share an image (and a descriptor array element).
+// Every texture gets a gutter of its own edge pixels around it, and rects are aligned so each of the atlas's mip levels
+// still keeps them apart: both are 2^(mipLevels - 1) pixels, so the last level has a 1 pixel gutter. That's also why the
+// atlas stops at mipLevels instead of going down to 1x1.
+// Textures' UVs (0..1, addressing modes can't repeat inside an atlas) are moved into their rect with getUVTransform
+class TextureAtlas
+{
+public:
+	TextureAtlas();
+
+	void init(uint32_t newSize, uint32_t newMipLevels);
+
+	// Reserve room for a width x height texture, returns false if the atlas is full
+	bool add(uint32_t width, uint32_t height, AtlasRect* rect);
+	// UVs of the texture at rect map to uv * scale + offset in the atlas (only final once everything is added, as unused
+	// space at the bottom is cut off)
+	void getUVTransform(const AtlasRect& rect, glm::vec2* scale, glm::vec2* offset);
+
+	// Copy a texture's levels into its rect and gutter, at every level of the atlas. Levels the texture doesn't have
+	// (or ones that aren't exactly half the size, for odd sizes) are resampled from the nearest one it does have
+	void write(const AtlasRect& rect, const std::vector<AtlasLevel>& levels);
+	// Texture holding the atlas (RGBA8, all of its levels), rects can't be added or written after this
+	TextureFile finish();
+
+	uint32_t getRectCount();
+
+	~TextureAtlas();
+
+private:
+	uint32_t size = 0;
+	uint32_t mipLevels = 1;
+	uint32_t alignment = 1;			// Of rects and their gutters, 2^(mipLevels - 1)
+	SkylinePacker packer;
+	uint32_t rectCount = 0;
+	std::vector<std::vector<unsigned char>> levelPixels;	// Made on the first write
+
+	uint32_t getHeight();
+};
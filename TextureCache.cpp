@@ -0,0 +1,183 @@
+#include "TextureCache.h"
+
+#include <stdio.h>
+#include <stdexcept>
+
+#include "TextureCompression.h"
+#include "TextureProcessing.h"
+
+#ifdef _WIN32
+#include <direct.h>
+#else
+#include <sys/stat.h>
+#endif
+
+// Bump whenever the way entries are made changes, so old entries are rebuilt
+const uint32_t TEXTURE_CACHE_VERSION = 1;
+
+// Metadata keys of an entry (KTX2 reserves keys starting with "KTX"/"ktx" for itself)
+const char* const METADATA_KEY = "VulkanPractice.key";
+const char* const METADATA_SOURCE_HASH = "VulkanPractice.sourceHash";
+const char* const METADATA_SETTINGS = "VulkanPractice.settings";
+
+TextureCache::TextureCache()
+{
+}
+
+void TextureCache::init(const std::string& newDirectory, bool newCompress)
+{
+	directory = newDirectory;
+	compress = newCompress;
+
+	// Fails if it's already there, which is fine (stores report it if it really couldn't be made)
+#ifdef _WIN32
+	_mkdir(directory.c_str());
+#else
+	mkdir(directory.c_str(), 0755);
+#endif
+}
+
+std::string TextureCache::hashData(const void* data, size_t size)
+{
+	const unsigned char* bytes = static_cast<const unsigned char*>(data);
+	uint64_t hash = 14695981039346656037ull;
+	for (size_t i = 0; i < size; i++)
+	{
+		hash ^= bytes[i];
+		hash *= 1099511628211ull;
+	}
+
+	char hashString[64];
+	snprintf(hashString, sizeof(hashString), "%016llx:%llu", static_cast<unsigned long long>(hash),
+		static_cast<unsigned long long>(size));
+	return hashString;
+}
+
+std::string TextureCache::hashFile(const std::string& fileName)
+{
+	// Mapped rather than read, hashing is the only thing done with it
+	MappedFile file;
+	if (!file.open(fileName))
+	{
+		return "";
+	}
+	return hashData(file.getData(), static_cast<size_t>(file.getSize()));
+}
+
+bool TextureCache::load(const std::string& key, const std::string& sourceHash, bool allowCompressed, TextureFile* file,
+	std::shared_ptr<MappedFile>* mapping)
+{
+	if (directory.empty() || sourceHash.empty())
+	{
+		return false;
+	}
+
+	std::shared_ptr<MappedFile> entry = std::make_shared<MappedFile>();
+	if (!entry->open(getEntryFileName(key)))
+	{
+		return false;
+	}
+
+	// Entry must be a valid file, made for this key from the same source data with the same settings
+	TextureFile entryFile;
+	if (!readKTX2Memory(entry->getData(), entry->getSize(), &entryFile) ||
+		entryFile.metadata[METADATA_KEY] != key ||
+		entryFile.metadata[METADATA_SOURCE_HASH] != sourceHash ||
+		entryFile.metadata[METADATA_SETTINGS] != getSettings(allowCompressed))
+	{
+		return false;
+	}
+
+	*file = std::move(entryFile);
+	*mapping = entry;
+	return true;
+}
+
+void TextureCache::store(const std::string& key, const std::string& sourceHash, bool allowCompressed,
+	const TextureFile& file)
+{
+	if (directory.empty() || sourceHash.empty())
+	{
+		return;
+	}
+
+	TextureFile entryFile = file;
+	entryFile.metadata[METADATA_KEY] = key;
+	entryFile.metadata[METADATA_SOURCE_HASH] = sourceHash;
+	entryFile.metadata[METADATA_SETTINGS] = getSettings(allowCompressed);
+
+	// Written under a temporary name first and then moved into place, so a crash (or a run reading it at the same time)
+	// never sees half an entry
+	std::string entryFileName = getEntryFileName(key);
+	std::string tempFileName = entryFileName + "." + std::to_string(tempFileCount++) + ".tmp";
+	try
+	{
+		writeKTX2(tempFileName, entryFile);
+
+		// rename doesn't replace existing files on Windows
+		remove(entryFileName.c_str());
+		if (rename(tempFileName.c_str(), entryFileName.c_str()) != 0)
+		{
+			throw std::runtime_error("Failed to move " + tempFileName + " to " + entryFileName + "!");
+		}
+	}
+	catch (const std::exception& e)
+	{
+		remove(tempFileName.c_str());
+		printf("ERROR: %s \n", e.what());
+	}
+}
+
+TextureFile TextureCache::bakeTexture(const unsigned char* pixels, uint32_t width, uint32_t height, uint32_t channels,
+	bool allowCompressed)
+{
+	// Same format for each channel count that the renderer would otherwise pick
+	TextureFormat format;
+	bool compressed = compress && allowCompressed;
+	switch (channels)
+	{
+	case 1: format = compressed ? TextureFormat::BC4 : TextureFormat::R8; break;
+	case 2: format = compressed ? TextureFormat::BC5 : TextureFormat::RG8; break;
+	default: format = compressed ? TextureFormat::BC7 : TextureFormat::RGBA8; break;
+	}
+
+	TextureFile file;
+	file.format = format;
+	file.width = width;
+	file.height = height;
+
+	// Textures are UNORM, so mips filter the values as they are (same as the GPU's linear blits)
+	uint32_t mipLevels = calculateMipLevels(width, height);
+	std::vector<MipLevel> mipChain = generateMipChain(pixels, width, height, mipLevels, TextureFilter::Box, false);
+	addTextureFileLevel(&file, width, height, compressImage(pixels, width, height, format));
+	for (auto& level : mipChain)
+	{
+		addTextureFileLevel(&file, level.width, level.height,
+			compressImage(level.pixels.data(), level.width, level.height, format));
+	}
+
+	return file;
+}
+
+void TextureCache::cleanup()
+{
+	directory.clear();
+}
+
+TextureCache::~TextureCache()
+{
+}
+
+std::string TextureCache::getSettings(bool allowCompressed)
+{
+	return "version=" + std::to_string(TEXTURE_CACHE_VERSION) + ";mips=box;compressed=" +
+		(compress && allowCompressed ? "1" : "0");
+}
+
+std::string TextureCache::getEntryFileName(const std::string& key)
+{
+	// Keys are paths/hashes with characters that can't be in file names, so entries are named by the key's hash (the
+	// key itself is in the metadata, to tell apart keys with the same hash)
+	std::string keyHash = hashData(key.data(), key.size());
+	return directory + keyHash.substr(0, keyHash.find(':')) + ".ktx2";
+}
@@ -0,0 +1,52 @@
+#pragma once
+
+#include <stdint.h>
+#include <string>
+#include <memory>
+#include <atomic>
+
+#include "TextureFile.h"
+#include "MappedFile.h"
+
+// Directory of textures that were already decoded, mipmapped (and optionally compressed) by an earlier run, so warm
+// starts skip all of that. Each entry is a .ktx2 file named after the texture's registry key, with the hash of its
+// source data and the settings it was made with in its metadata; an entry that doesn't match them is stale and is
+// treated as missing (and overwritten by the next store). Entries are memory mapped, so their levels are copied
+// straight from the file into the staging ring. Thread safe, loader threads use it directly
+class TextureCache
+{
+public:
+	TextureCache();
+
+	// Entries are compressed (BC4/BC5/BC7 by channel count) if compress is set, otherwise R8/RG8/RGBA8
+	void init(const std::string& newDirectory, bool newCompress);
+
+	// Hash identifying a texture's source data (64 bit FNV-1a, as hex), a file's is empty if it can't be read
+	static std::string hashData(const void* data, size_t size);
+	static std::string hashFile(const std::string& fileName);
+
+	// Find the entry for key made from sourceHash, returns false if there isn't an up to date one. file's levels point
+	// into mapping, which must be kept until they're uploaded. Entries compressed by an earlier run are skipped if
+	// allowCompressed isn't set (same as when they're out of date)
+	bool load(const std::string& key, const std::string& sourceHash, bool allowCompressed, TextureFile* file,
+		std::shared_ptr<MappedFile>* mapping);
+	// Write (or replace) the entry for key. Best effort, failures are printed and otherwise ignored
+	void store(const std::string& key, const std::string& sourceHash, bool allowCompressed, const TextureFile& file);
+
+	// Make the entry data for decoded RGBA8 pixels: full mip chain, keeping channels channels (1, 2 or 4)
+	TextureFile bakeTexture(const unsigned char* pixels, uint32_t width, uint32_t height, uint32_t channels,
+		bool allowCompressed);
+
+	void cleanup();
+
+	~TextureCache();
+
+private:
+	std::string directory;
+	bool compress = false;
+	std::atomic<uint32_t> tempFileCount{ 0 };		// Keeps temporary file names of stores running at once apart
+
+	// Everything that changes an entry's data other than its sources
+	std::string getSettings(bool allowCompressed);
+	std::string getEntryFileName(const std::string& key);
+};
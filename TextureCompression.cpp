@@ -0,0 +1,622 @@
+#include "TextureCompression.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+
+// -- Format Info -- //
+
+bool isBlockCompressed(TextureFormat format)
+{
+	return format != TextureFormat::RGBA8 && format != TextureFormat::R8 && format != TextureFormat::RG8;
+}
+
+uint32_t getTextureFormatBlockBytes(TextureFormat format)
+{
+	switch (format)
+	{
+	case TextureFormat::BC1:
+	case TextureFormat::BC4:
+		return 8;
+	case TextureFormat::BC3:
+	case TextureFormat::BC5:
+	case TextureFormat::BC7:
+		return 16;
+	case TextureFormat::R8:
+		return 1;
+	case TextureFormat::RG8:
+		return 2;
+	default:
+		return 4;
+	}
+}
+
+uint64_t getTextureLevelSize(TextureFormat format, uint32_t width, uint32_t height)
+{
+	if (!isBlockCompressed(format))
+	{
+		return static_cast<uint64_t>(width) * height * getTextureFormatBlockBytes(format);
+	}
+
+	// Partial blocks at the edges still take a whole block
+	uint64_t blocksX = (std::max(width, 1u) + 3) / 4;
+	uint64_t blocksY = (std::max(height, 1u) + 3) / 4;
+	return blocksX * blocksY * getTextureFormatBlockBytes(format);
+}
+
+const char* getTextureFormatName(TextureFormat format)
+{
+	switch (format)
+	{
+	case TextureFormat::BC1: return "BC1";
+	case TextureFormat::BC3: return "BC3";
+	case TextureFormat::BC4: return "BC4";
+	case TextureFormat::BC5: return "BC5";
+	case TextureFormat::BC7: return "BC7";
+	case TextureFormat::R8: return "R8";
+	case TextureFormat::RG8: return "RG8";
+	default: return "RGBA8";
+	}
+}
+
+// -- Helpers -- //
+
+// Main direction the block's colours spread along (power iteration on the covariance matrix)
+template <int N>
+static void principalAxis(const float (*values)[4], uint32_t count, float* mean, float* axis)
+{
+	for (int c = 0; c < N; c++)
+	{
+		mean[c] = 0.0f;
+		for (uint32_t i = 0; i < count; i++)
+		{
+			mean[c] += values[i][c];
+		}
+		mean[c] /= count;
+	}
+
+	float covariance[N][N] = {};
+	for (uint32_t i = 0; i < count; i++)
+	{
+		for (int a = 0; a < N; a++)
+		{
+			for (int b = 0; b < N; b++)
+			{
+				covariance[a][b] += (values[i][a] - mean[a]) * (values[i][b] - mean[b]);
+			}
+		}
+	}
+
+	for (int c = 0; c < N; c++)
+	{
+		axis[c] = 1.0f;
+	}
+	for (int iteration = 0; iteration < 8; iteration++)
+	{
+		float next[N] = {};
+		float length = 0.0f;
+		for (int a = 0; a < N; a++)
+		{
+			for (int b = 0; b < N; b++)
+			{
+				next[a] += covariance[a][b] * axis[b];
+			}
+			length = std::max(length, std::fabs(next[a]));
+		}
+		// Flat block, any axis will do
+		if (length < 1e-6f)
+		{
+			break;
+		}
+		for (int c = 0; c < N; c++)
+		{
+			axis[c] = next[c] / length;
+		}
+	}
+
+	float length = 0.0f;
+	for (int c = 0; c < N; c++)
+	{
+		length += axis[c] * axis[c];
+	}
+	length = std::sqrt(length);
+	for (int c = 0; c < N; c++)
+	{
+		axis[c] = length > 0.0f ? axis[c] / length : 0.0f;
+	}
+}
+
+// Ends of the line through the block's colours, along the principal axis
+template <int N>
+static void axisEndpoints(const float (*values)[4], uint32_t count, float* low, float* high)
+{
+	float mean[N];
+	float axis[N];
+	principalAxis<N>(values, count, mean, axis);
+
+	float minT = 0.0f;
+	float maxT = 0.0f;
+	for (uint32_t i = 0; i < count; i++)
+	{
+		float t = 0.0f;
+		for (int c = 0; c < N; c++)
+		{
+			t += (values[i][c] - mean[c]) * axis[c];
+		}
+		minT = std::min(minT, t);
+		maxT = std::max(maxT, t);
+	}
+	for (int c = 0; c < N; c++)
+	{
+		low[c] = std::min(std::max(mean[c] + axis[c] * minT, 0.0f), 255.0f);
+		high[c] = std::min(std::max(mean[c] + axis[c] * maxT, 0.0f), 255.0f);
+	}
+}
+
+static void toFloatPixels(const unsigned char* pixels, float (*values)[4])
+{
+	for (uint32_t i = 0; i < 16; i++)
+	{
+		for (uint32_t c = 0; c < 4; c++)
+		{
+			values[i][c] = pixels[i * 4 + c];
+		}
+	}
+}
+
+// Write count bits of value at bitPosition (least significant bit first)
+static void writeBits(unsigned char* block, uint32_t* bitPosition, uint32_t value, uint32_t count)
+{
+	for (uint32_t i = 0; i < count; i++)
+	{
+		uint32_t position = *bitPosition + i;
+		if (value & (1u << i))
+		{
+			block[position / 8] |= static_cast<unsigned char>(1u << (position % 8));
+		}
+	}
+	*bitPosition += count;
+}
+
+// -- BC1 -- //
+
+static uint16_t packRGB565(const float* colour)
+{
+	uint32_t r = static_cast<uint32_t>(std::min(std::max(colour[0], 0.0f), 255.0f) * 31.0f / 255.0f + 0.5f);
+	uint32_t g = static_cast<uint32_t>(std::min(std::max(colour[1], 0.0f), 255.0f) * 63.0f / 255.0f + 0.5f);
+	uint32_t b = static_cast<uint32_t>(std::min(std::max(colour[2], 0.0f), 255.0f) * 31.0f / 255.0f + 0.5f);
+	return static_cast<uint16_t>((r << 11) | (g << 5) | b);
+}
+
+static void unpackRGB565(uint16_t packed, float* colour)
+{
+	// Replicate the top bits into the bottom ones, same as the hardware
+	uint32_t r = (packed >> 11) & 31;
+	uint32_t g = (packed >> 5) & 63;
+	uint32_t b = packed & 31;
+	colour[0] = static_cast<float>((r << 3) | (r >> 2));
+	colour[1] = static_cast<float>((g << 2) | (g >> 4));
+	colour[2] = static_cast<float>((b << 3) | (b >> 2));
+}
+
+// Pick the nearest of the 4 palette colours for every pixel, returns the total error
+static float bc1Indices(const float (*values)[4], uint16_t colour0, uint16_t colour1, uint32_t* indices)
+{
+	float palette[4][3];
+	unpackRGB565(colour0, palette[0]);
+	unpackRGB565(colour1, palette[1]);
+	for (uint32_t c = 0; c < 3; c++)
+	{
+		palette[2][c] = (2.0f * palette[0][c] + palette[1][c]) / 3.0f;
+		palette[3][c] = (palette[0][c] + 2.0f * palette[1][c]) / 3.0f;
+	}
+
+	float totalError = 0.0f;
+	for (uint32_t i = 0; i < 16; i++)
+	{
+		float bestError = 1e30f;
+		for (uint32_t p = 0; p < 4; p++)
+		{
+			float error = 0.0f;
+			for (uint32_t c = 0; c < 3; c++)
+			{
+				float difference = values[i][c] - palette[p][c];
+				error += difference * difference;
+			}
+			if (error < bestError)
+			{
+				bestError = error;
+				indices[i] = p;
+			}
+		}
+		totalError += bestError;
+	}
+	return totalError;
+}
+
+// Best endpoints for fixed indices (least squares fit)
+static bool bc1RefineEndpoints(const float (*values)[4], const uint32_t* indices, float* high, float* low)
+{
+	static const float weights[4] = { 1.0f, 0.0f, 2.0f / 3.0f, 1.0f / 3.0f };
+
+	float aa = 0.0f, bb = 0.0f, ab = 0.0f;
+	float ax[3] = {}, bx[3] = {};
+	for (uint32_t i = 0; i < 16; i++)
+	{
+		float a = weights[indices[i]];
+		float b = 1.0f - a;
+		aa += a * a;
+		bb += b * b;
+		ab += a * b;
+		for (uint32_t c = 0; c < 3; c++)
+		{
+			ax[c] += a * values[i][c];
+			bx[c] += b * values[i][c];
+		}
+	}
+
+	float determinant = aa * bb - ab * ab;
+	if (std::fabs(determinant) < 1e-6f)
+	{
+		return false;
+	}
+	for (uint32_t c = 0; c < 3; c++)
+	{
+		high[c] = (ax[c] * bb - bx[c] * ab) / determinant;
+		low[c] = (bx[c] * aa - ax[c] * ab) / determinant;
+	}
+	return true;
+}
+
+void compressBlockBC1(const unsigned char* pixels, unsigned char* block)
+{
+	float values[16][4];
+	toFloatPixels(pixels, values);
+
+	float low[3], high[3];
+	axisEndpoints<3>(values, 16, low, high);
+
+	uint16_t colour0 = packRGB565(high);
+	uint16_t colour1 = packRGB565(low);
+	uint32_t indices[16];
+	float error = bc1Indices(values, colour0, colour1, indices);
+
+	// One least squares pass usually finds better endpoints than the bounding line
+	float refinedHigh[3], refinedLow[3];
+	if (bc1RefineEndpoints(values, indices, refinedHigh, refinedLow))
+	{
+		uint16_t refined0 = packRGB565(refinedHigh);
+		uint16_t refined1 = packRGB565(refinedLow);
+		uint32_t refinedIndices[16];
+		float refinedError = bc1Indices(values, refined0, refined1, refinedIndices);
+		if (refinedError < error)
+		{
+			colour0 = refined0;
+			colour1 = refined1;
+			memcpy(indices, refinedIndices, sizeof(indices));
+		}
+	}
+
+	// colour0 > colour1 selects the 4 colour mode (the other order means 3 colours + transparent black)
+	if (colour0 < colour1)
+	{
+		std::swap(colour0, colour1);
+		static const uint32_t swapped[4] = { 1, 0, 3, 2 };
+		for (uint32_t i = 0; i < 16; i++)
+		{
+			indices[i] = swapped[indices[i]];
+		}
+	}
+	else if (colour0 == colour1)
+	{
+		// Solid colour, every pixel uses colour0
+		for (uint32_t i = 0; i < 16; i++)
+		{
+			indices[i] = 0;
+		}
+	}
+
+	memset(block, 0, 8);
+	block[0] = static_cast<unsigned char>(colour0 & 0xFF);
+	block[1] = static_cast<unsigned char>(colour0 >> 8);
+	block[2] = static_cast<unsigned char>(colour1 & 0xFF);
+	block[3] = static_cast<unsigned char>(colour1 >> 8);
+	uint32_t bitPosition = 32;
+	for (uint32_t i = 0; i < 16; i++)
+	{
+		writeBits(block, &bitPosition, indices[i], 2);
+	}
+}
+
+// -- BC4 / BC3 / BC5 -- //
+
+void compressBlockBC4(const unsigned char* pixels, uint32_t channel, unsigned char* block)
+{
+	uint32_t minValue = 255;
+	uint32_t maxValue = 0;
+	for (uint32_t i = 0; i < 16; i++)
+	{
+		minValue = std::min<uint32_t>(minValue, pixels[i * 4 + channel]);
+		maxValue = std::max<uint32_t>(maxValue, pixels[i * 4 + channel]);
+	}
+
+	memset(block, 0, 8);
+	block[0] = static_cast<unsigned char>(maxValue);
+	block[1] = static_cast<unsigned char>(minValue);
+	if (minValue == maxValue)
+	{
+		// Solid, every index 0 is the value itself
+		return;
+	}
+
+	// max > min selects 8 interpolated values
+	uint32_t palette[8];
+	palette[0] = maxValue;
+	palette[1] = minValue;
+	for (uint32_t p = 2; p < 8; p++)
+	{
+		palette[p] = ((8 - p) * maxValue + (p - 1) * minValue + 3) / 7;
+	}
+
+	uint32_t bitPosition = 16;
+	for (uint32_t i = 0; i < 16; i++)
+	{
+		int32_t value = pixels[i * 4 + channel];
+		uint32_t bestIndex = 0;
+		int32_t bestError = 256;
+		for (uint32_t p = 0; p < 8; p++)
+		{
+			int32_t error = std::abs(value - static_cast<int32_t>(palette[p]));
+			if (error < bestError)
+			{
+				bestError = error;
+				bestIndex = p;
+			}
+		}
+		writeBits(block, &bitPosition, bestIndex, 3);
+	}
+}
+
+void compressBlockBC3(const unsigned char* pixels, unsigned char* block)
+{
+	// Alpha block first, then a BC1 colour block (always read in 4 colour mode)
+	compressBlockBC4(pixels, 3, block);
+	compressBlockBC1(pixels, block + 8);
+}
+
+void compressBlockBC5(const unsigned char* pixels, unsigned char* block)
+{
+	// Red and green as two independent single channel blocks
+	compressBlockBC4(pixels, 0, block);
+	compressBlockBC4(pixels, 1, block + 8);
+}
+
+// -- BC7 -- //
+// Only mode 6 is used: one set of RGBA endpoints (7 bits + shared p-bit) and 16 4-bit indices.
+// It's the mode that suits smooth colour and alpha best, and keeps the encoder simple
+
+static const uint32_t BC7_WEIGHTS[16] = { 0, 4, 9, 13, 17, 21, 26, 30, 34, 38, 43, 47, 51, 55, 60, 64 };
+
+struct BC7Endpoints
+{
+	uint32_t endpoint[2][4];	// 7 bit values
+	uint32_t pBit[2];
+};
+
+static float bc7Indices(const float (*values)[4], const BC7Endpoints& endpoints, uint32_t* indices)
+{
+	// Endpoints as decoded: 7 bits + p-bit
+	uint32_t decoded[2][4];
+	for (uint32_t e = 0; e < 2; e++)
+	{
+		for (uint32_t c = 0; c < 4; c++)
+		{
+			decoded[e][c] = (endpoints.endpoint[e][c] << 1) | endpoints.pBit[e];
+		}
+	}
+
+	float palette[16][4];
+	for (uint32_t p = 0; p < 16; p++)
+	{
+		for (uint32_t c = 0; c < 4; c++)
+		{
+			palette[p][c] = static_cast<float>(((64 - BC7_WEIGHTS[p]) * decoded[0][c] + BC7_WEIGHTS[p] * decoded[1][c] + 32) >> 6);
+		}
+	}
+
+	float totalError = 0.0f;
+	for (uint32_t i = 0; i < 16; i++)
+	{
+		float bestError = 1e30f;
+		for (uint32_t p = 0; p < 16; p++)
+		{
+			float error = 0.0f;
+			for (uint32_t c = 0; c < 4; c++)
+			{
+				float difference = values[i][c] - palette[p][c];
+				error += difference * difference;
+			}
+			if (error < bestError)
+			{
+				bestError = error;
+				indices[i] = p;
+			}
+		}
+		totalError += bestError;
+	}
+	return totalError;
+}
+
+// Quantise float endpoints, trying every p-bit combination, and keep the best
+static float bc7QuantiseEndpoints(const float (*values)[4], const float* low, const float* high,
+	BC7Endpoints* best, uint32_t* bestIndices)
+{
+	float bestError = 1e30f;
+	for (uint32_t p0 = 0; p0 < 2; p0++)
+	{
+		for (uint32_t p1 = 0; p1 < 2; p1++)
+		{
+			BC7Endpoints endpoints;
+			endpoints.pBit[0] = p0;
+			endpoints.pBit[1] = p1;
+			for (uint32_t c = 0; c < 4; c++)
+			{
+				float v0 = (low[c] - p0) / 2.0f;
+				float v1 = (high[c] - p1) / 2.0f;
+				endpoints.endpoint[0][c] = static_cast<uint32_t>(std::min(std::max(v0 + 0.5f, 0.0f), 127.0f));
+				endpoints.endpoint[1][c] = static_cast<uint32_t>(std::min(std::max(v1 + 0.5f, 0.0f), 127.0f));
+			}
+
+			uint32_t indices[16];
+			float error = bc7Indices(values, endpoints, indices);
+			if (error < bestError)
+			{
+				bestError = error;
+				*best = endpoints;
+				memcpy(bestIndices, indices, sizeof(indices));
+			}
+		}
+	}
+	return bestError;
+}
+
+static bool bc7RefineEndpoints(const float (*values)[4], const uint32_t* indices, float* low, float* high)
+{
+	float aa = 0.0f, bb = 0.0f, ab = 0.0f;
+	float ax[4] = {}, bx[4] = {};
+	for (uint32_t i = 0; i < 16; i++)
+	{
+		float b = BC7_WEIGHTS[indices[i]] / 64.0f;
+		float a = 1.0f - b;
+		aa += a * a;
+		bb += b * b;
+		ab += a * b;
+		for (uint32_t c = 0; c < 4; c++)
+		{
+			ax[c] += a * values[i][c];
+			bx[c] += b * values[i][c];
+		}
+	}
+
+	float determinant = aa * bb - ab * ab;
+	if (std::fabs(determinant) < 1e-6f)
+	{
+		return false;
+	}
+	for (uint32_t c = 0; c < 4; c++)
+	{
+		low[c] = std::min(std::max((ax[c] * bb - bx[c] * ab) / determinant, 0.0f), 255.0f);
+		high[c] = std::min(std::max((bx[c] * aa - ax[c] * ab) / determinant, 0.0f), 255.0f);
+	}
+	return true;
+}
+
+void compressBlockBC7(const unsigned char* pixels, unsigned char* block)
+{
+	float values[16][4];
+	toFloatPixels(pixels, values);
+
+	float low[4], high[4];
+	axisEndpoints<4>(values, 16, low, high);
+
+	BC7Endpoints endpoints;
+	uint32_t indices[16];
+	float error = bc7QuantiseEndpoints(values, low, high, &endpoints, indices);
+
+	float refinedLow[4], refinedHigh[4];
+	if (error > 0.0f && bc7RefineEndpoints(values, indices, refinedLow, refinedHigh))
+	{
+		BC7Endpoints refinedEndpoints;
+		uint32_t refinedIndices[16];
+		float refinedError = bc7QuantiseEndpoints(values, refinedLow, refinedHigh, &refinedEndpoints, refinedIndices);
+		if (refinedError < error)
+		{
+			endpoints = refinedEndpoints;
+			memcpy(indices, refinedIndices, sizeof(indices));
+		}
+	}
+
+	// First index only has 3 bits stored (its top bit must be 0), swap the endpoints if needed
+	if (indices[0] >= 8)
+	{
+		std::swap(endpoints.endpoint[0], endpoints.endpoint[1]);
+		std::swap(endpoints.pBit[0], endpoints.pBit[1]);
+		for (uint32_t i = 0; i < 16; i++)
+		{
+			indices[i] = 15 - indices[i];
+		}
+	}
+
+	memset(block, 0, 16);
+	uint32_t bitPosition = 0;
+	writeBits(block, &bitPosition, 1u << 6, 7);			// Mode 6
+	for (uint32_t c = 0; c < 4; c++)
+	{
+		writeBits(block, &bitPosition, endpoints.endpoint[0][c], 7);
+		writeBits(block, &bitPosition, endpoints.endpoint[1][c], 7);
+	}
+	writeBits(block, &bitPosition, endpoints.pBit[0], 1);
+	writeBits(block, &bitPosition, endpoints.pBit[1], 1);
+	writeBits(block, &bitPosition, indices[0], 3);
+	for (uint32_t i = 1; i < 16; i++)
+	{
+		writeBits(block, &bitPosition, indices[i], 4);
+	}
+}
+
+// -- Images -- //
+
+void compressImage(const unsigned char* pixels, uint32_t width, uint32_t height, TextureFormat format,
+	unsigned char* output, uint32_t firstBlockRow, uint32_t lastBlockRow)
+{
+	uint32_t blocksX = (width + 3) / 4;
+	uint32_t blockBytes = getTextureFormatBlockBytes(format);
+
+	for (uint32_t by = firstBlockRow; by < lastBlockRow; by++)
+	{
+		for (uint32_t bx = 0; bx < blocksX; bx++)
+		{
+			// Gather the block, repeating the last row/column for partial blocks
+			unsigned char blockPixels[16 * 4];
+			for (uint32_t y = 0; y < 4; y++)
+			{
+				uint32_t sourceY = std::min(by * 4 + y, height - 1);
+				for (uint32_t x = 0; x < 4; x++)
+				{
+					uint32_t sourceX = std::min(bx * 4 + x, width - 1);
+					memcpy(&blockPixels[(y * 4 + x) * 4], &pixels[(static_cast<size_t>(sourceY) * width + sourceX) * 4], 4);
+				}
+			}
+
+			unsigned char* block = output + (static_cast<size_t>(by) * blocksX + bx) * blockBytes;
+			switch (format)
+			{
+			case TextureFormat::BC1: compressBlockBC1(blockPixels, block); break;
+			case TextureFormat::BC3: compressBlockBC3(blockPixels, block); break;
+			case TextureFormat::BC4: compressBlockBC4(blockPixels, 0, block); break;
+			case TextureFormat::BC5: compressBlockBC5(blockPixels, block); break;
+			case TextureFormat::BC7: compressBlockBC7(blockPixels, block); break;
+			default: break;
+			}
+		}
+	}
+}
+
+std::vector<unsigned char> compressImage(const unsigned char* pixels, uint32_t width, uint32_t height, TextureFormat format)
+{
+	if (!isBlockCompressed(format))
+	{
+		uint32_t channels = getTextureFormatBlockBytes(format);
+		size_t pixelCount = static_cast<size_t>(width) * height;
+		std::vector<unsigned char> output(pixelCount * channels);
+		for (size_t i = 0; i < pixelCount; i++)
+		{
+			memcpy(&output[i * channels], &pixels[i * 4], channels);
+		}
+		return output;
+	}
+
+	std::vector<unsigned char> output(static_cast<size_t>(getTextureLevelSize(format, width, height)));
+	compressImage(pixels, width, height, format, output.data(), 0, (height + 3) / 4);
+	return output;
+}
@@ -0,0 +1,40 @@
+#pragma once
+
+#include <stdint.h>
+#include <vector>
+
+// Block compression (BCn) encoders. Images are split into 4x4 pixel blocks, each stored in 8 or 16 bytes, which the
+// GPU samples directly. Like TextureProcessing this is CPU only, so the offline encoder can use it without a GPU
+
+enum class TextureFormat
+{
+	RGBA8,		// Uncompressed, 4 bytes per pixel
+	R8,			// Uncompressed single channel, 1 byte per pixel
+	RG8,		// Uncompressed two channels, 2 bytes per pixel
+	BC1,		// RGB (1 bit alpha), 8 bytes per block
+	BC3,		// RGBA, 16 bytes per block (BC1 colour + BC4 alpha)
+	BC4,		// Single channel, 8 bytes per block
+	BC5,		// Two channels (normal map X/Y), 16 bytes per block
+	BC7			// High quality RGBA, 16 bytes per block
+};
+
+bool isBlockCompressed(TextureFormat format);
+// Bytes per 4x4 block (or per pixel for uncompressed formats)
+uint32_t getTextureFormatBlockBytes(TextureFormat format);
+// Size of an image of the given size in this format
+uint64_t getTextureLevelSize(TextureFormat format, uint32_t width, uint32_t height);
+const char* getTextureFormatName(TextureFormat format);
+
+// Encode single 4x4 blocks, pixels are 16 tightly packed RGBA8 values (row by row)
+void compressBlockBC1(const unsigned char* pixels, unsigned char* block);
+void compressBlockBC3(const unsigned char* pixels, unsigned char* block);
+void compressBlockBC4(const unsigned char* pixels, uint32_t channel, unsigned char* block);
+void compressBlockBC5(const unsigned char* pixels, unsigned char* block);
+void compressBlockBC7(const unsigned char* pixels, unsigned char* block);
+
+// Encode a whole RGBA8 image (partial blocks at the edges repeat the last row/column). Uncompressed formats just keep
+// the channels they have.
+// Rows of blocks are encoded [firstBlockRow, lastBlockRow), so big images can be split between threads
+void compressImage(const unsigned char* pixels, uint32_t width, uint32_t height, TextureFormat format,
+	unsigned char* output, uint32_t firstBlockRow, uint32_t lastBlockRow);
+std::vector<unsigned char> compressImage(const unsigned char* pixels, uint32_t width, uint32_t height, TextureFormat format);
@@ -0,0 +1,259 @@
+// Offline texture encoder: turns the source images in Textures/ into block compressed KTX2 (or DDS) files with full mip
+// chains, which the renderer loads instead of the originals.
+// Usage: TextureEncoder [--format bc1|bc3|bc5|bc7] [--container ktx2|dds] [--output file.ktx2] [image or directory ...]
+// With no inputs it converts every .jpg/.png in Textures/. Normal maps (name contains "nmap" or "normal") become BC5,
+// everything else BC7
+#define STB_IMAGE_IMPLEMENTATION
+#include "../stb_image.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <filesystem>
+#include <future>
+#include <string>
+#include <vector>
+
+#include "../TextureProcessing.h"
+#include "../TextureCompression.h"
+#include "../TextureFile.h"
+#include "../ThreadPool.h"
+
+namespace fs = std::filesystem;
+
+// How the image's values should be treated
+enum class TextureKind
+{
+	Colour,		// sRGB encoded colour, mips are filtered in linear space
+	Data,		// Linear data (roughness, metalness, AO...)
+	Normal		// Tangent space normal map, mips are renormalised
+};
+
+static std::string lowerCase(std::string text)
+{
+	std::transform(text.begin(), text.end(), text.begin(), [](unsigned char c) { return static_cast<char>(tolower(c)); });
+	return text;
+}
+
+static TextureKind guessKind(const fs::path& path)
+{
+	std::string name = lowerCase(path.stem().string());
+	if (name.find("nmap") != std::string::npos || name.find("normal") != std::string::npos)
+	{
+		return TextureKind::Normal;
+	}
+	if (name.find("rough") != std::string::npos || name.find("metal") != std::string::npos ||
+		name.find("_ao") != std::string::npos || name.find("spec") != std::string::npos)
+	{
+		return TextureKind::Data;
+	}
+	return TextureKind::Colour;
+}
+
+static bool parseFormat(const std::string& name, TextureFormat* format)
+{
+	std::string lower = lowerCase(name);
+	if (lower == "bc1") { *format = TextureFormat::BC1; return true; }
+	if (lower == "bc3") { *format = TextureFormat::BC3; return true; }
+	if (lower == "bc4") { *format = TextureFormat::BC4; return true; }
+	if (lower == "bc5") { *format = TextureFormat::BC5; return true; }
+	if (lower == "bc7") { *format = TextureFormat::BC7; return true; }
+	return false;
+}
+
+// Filtering averages normals towards shorter vectors, push them back to unit length
+static void renormalise(std::vector<unsigned char>& pixels)
+{
+	for (size_t i = 0; i < pixels.size(); i += 4)
+	{
+		float n[3];
+		for (uint32_t c = 0; c < 3; c++)
+		{
+			n[c] = pixels[i + c] / 127.5f - 1.0f;
+		}
+		float length = std::sqrt(n[0] * n[0] + n[1] * n[1] + n[2] * n[2]);
+		if (length < 1e-5f)
+		{
+			continue;
+		}
+		for (uint32_t c = 0; c < 3; c++)
+		{
+			pixels[i + c] = static_cast<unsigned char>(std::min(std::max((n[c] / length + 1.0f) * 127.5f + 0.5f, 0.0f), 255.0f));
+		}
+	}
+}
+
+// Compress one level, splitting the rows of blocks between the worker threads
+static std::vector<unsigned char> compressLevel(ThreadPool& threads, const unsigned char* pixels,
+	uint32_t width, uint32_t height, TextureFormat format)
+{
+	std::vector<unsigned char> output(static_cast<size_t>(getTextureLevelSize(format, width, height)));
+	uint32_t blockRows = (height + 3) / 4;
+	uint32_t rowsPerJob = std::max(1u, blockRows / (threads.getThreadCount() * 4));
+
+	std::vector<std::future<void>> jobs;
+	for (uint32_t row = 0; row < blockRows; row += rowsPerJob)
+	{
+		uint32_t lastRow = std::min(blockRows, row + rowsPerJob);
+		jobs.push_back(threads.submit([=, &output]() { compressImage(pixels, width, height, format, output.data(), row, lastRow); }));
+	}
+	for (auto& job : jobs)
+	{
+		job.get();
+	}
+	return output;
+}
+
+static bool encodeTexture(ThreadPool& threads, const fs::path& input, const fs::path& output, bool formatOverride, TextureFormat format)
+{
+	auto start = std::chrono::high_resolution_clock::now();
+
+	int width, height, channels;
+	stbi_uc* pixels = stbi_load(input.string().c_str(), &width, &height, &channels, STBI_rgb_alpha);
+	if (!pixels)
+	{
+		printf("ERROR: Failed to load %s \n", input.string().c_str());
+		return false;
+	}
+
+	TextureKind kind = guessKind(input);
+	if (!formatOverride)
+	{
+		format = kind == TextureKind::Normal ? TextureFormat::BC5 : TextureFormat::BC7;
+	}
+
+	// Build the mip chain from the full resolution image
+	uint32_t mipLevels = calculateMipLevels(width, height);
+	std::vector<MipLevel> mips = generateMipChain(pixels, width, height, mipLevels,
+		kind == TextureKind::Normal ? TextureFilter::Box : TextureFilter::Kaiser, kind == TextureKind::Colour);
+
+	TextureFile file;
+	file.format = format;
+	file.width = width;
+	file.height = height;
+	addTextureFileLevel(&file, width, height, compressLevel(threads, pixels, width, height, format));
+	for (auto& mip : mips)
+	{
+		if (kind == TextureKind::Normal)
+		{
+			renormalise(mip.pixels);
+		}
+		addTextureFileLevel(&file, mip.width, mip.height, compressLevel(threads, mip.pixels.data(), mip.width, mip.height, format));
+	}
+	stbi_image_free(pixels);
+
+	if (lowerCase(output.extension().string()) == ".dds")
+	{
+		writeDDS(output.string(), file);
+	}
+	else
+	{
+		writeKTX2(output.string(), file);
+	}
+
+	auto end = std::chrono::high_resolution_clock::now();
+	uint64_t sourceSize = static_cast<uint64_t>(width) * height * 4;
+	printf("%s -> %s: %dx%d %s, %u levels, %.1f MB -> %.1f MB (%.1f s)\n",
+		input.filename().string().c_str(), output.filename().string().c_str(), width, height,
+		getTextureFormatName(format), mipLevels, sourceSize / (1024.0 * 1024.0), file.data.size() / (1024.0 * 1024.0),
+		std::chrono::duration<double>(end - start).count());
+	return true;
+}
+
+int main(int argc, char** argv)
+{
+	bool formatOverride = false;
+	TextureFormat format = TextureFormat::BC7;
+	std::string outputName;
+	std::string container = "ktx2";
+	std::vector<fs::path> inputs;
+
+	for (int i = 1; i < argc; i++)
+	{
+		std::string argument = argv[i];
+		if (argument == "--format" && i + 1 < argc)
+		{
+			if (!parseFormat(argv[++i], &format))
+			{
+				printf("ERROR: Unknown format %s (use bc1, bc3, bc4, bc5 or bc7) \n", argv[i]);
+				return EXIT_FAILURE;
+			}
+			formatOverride = true;
+		}
+		else if (argument == "--container" && i + 1 < argc)
+		{
+			container = lowerCase(argv[++i]);
+			if (container != "ktx2" && container != "dds")
+			{
+				printf("ERROR: Unknown container %s (use ktx2 or dds) \n", argv[i]);
+				return EXIT_FAILURE;
+			}
+		}
+		else if (argument == "--output" && i + 1 < argc)
+		{
+			outputName = argv[++i];
+		}
+		else
+		{
+			inputs.push_back(argument);
+		}
+	}
+
+	if (inputs.empty())
+	{
+		inputs.push_back("Textures");
+	}
+
+	// Expand directories into the images inside them
+	std::vector<fs::path> images;
+	for (auto& input : inputs)
+	{
+		if (fs::is_directory(input))
+		{
+			for (auto& entry : fs::directory_iterator(input))
+			{
+				std::string extension = lowerCase(entry.path().extension().string());
+				if (extension == ".jpg" || extension == ".jpeg" || extension == ".png")
+				{
+					images.push_back(entry.path());
+				}
+			}
+		}
+		else
+		{
+			images.push_back(input);
+		}
+	}
+
+	if (!outputName.empty() && images.size() != 1)
+	{
+		printf("ERROR: --output needs exactly one input image \n");
+		return EXIT_FAILURE;
+	}
+
+	ThreadPool threads;
+	threads.init(std::max(1u, std::thread::hardware_concurrency()));
+
+	int failed = 0;
+	for (auto& image : images)
+	{
+		fs::path output = outputName.empty() ? fs::path(image).replace_extension("." + container) : fs::path(outputName);
+		try
+		{
+			if (!encodeTexture(threads, image, output, formatOverride, format))
+			{
+				failed++;
+			}
+		}
+		catch (const std::exception& e)
+		{
+			printf("ERROR: %s \n", e.what());
+			failed++;
+		}
+	}
+
+	threads.cleanup();
+	return failed == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+}
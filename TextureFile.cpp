@@ -0,0 +1,574 @@
+#include "TextureFile.h"
+
+#include <algorithm>
+#include <cstring>
+#include <fstream>
+#include <stdexcept>
+
+// -- DDS Layout -- //
+
+const uint32_t DDS_MAGIC = 0x20534444;			// "DDS "
+const uint32_t DDS_FOURCC_DX10 = 0x30315844;	// "DX10"
+const uint32_t DDS_FOURCC_DXT1 = 0x31545844;	// "DXT1"
+const uint32_t DDS_FOURCC_DXT5 = 0x35545844;	// "DXT5"
+const uint32_t DDS_FOURCC_ATI1 = 0x31495441;	// "ATI1"
+const uint32_t DDS_FOURCC_ATI2 = 0x32495441;	// "ATI2"
+
+const uint32_t DDSD_CAPS = 0x1;
+const uint32_t DDSD_HEIGHT = 0x2;
+const uint32_t DDSD_WIDTH = 0x4;
+const uint32_t DDSD_PIXELFORMAT = 0x1000;
+const uint32_t DDSD_MIPMAPCOUNT = 0x20000;
+const uint32_t DDSD_LINEARSIZE = 0x80000;
+const uint32_t DDPF_FOURCC = 0x4;
+const uint32_t DDSCAPS_COMPLEX = 0x8;
+const uint32_t DDSCAPS_TEXTURE = 0x1000;
+const uint32_t DDSCAPS_MIPMAP = 0x400000;
+const uint32_t DDS_DIMENSION_TEXTURE2D = 3;
+
+// DXGI_FORMAT values of the formats we support
+const uint32_t DXGI_FORMAT_R8G8B8A8_UNORM = 28;
+const uint32_t DXGI_FORMAT_R8G8_UNORM = 49;
+const uint32_t DXGI_FORMAT_R8_UNORM = 61;
+const uint32_t DXGI_FORMAT_BC1_UNORM = 71;
+const uint32_t DXGI_FORMAT_BC3_UNORM = 77;
+const uint32_t DXGI_FORMAT_BC4_UNORM = 80;
+const uint32_t DXGI_FORMAT_BC5_UNORM = 83;
+const uint32_t DXGI_FORMAT_BC7_UNORM = 98;
+
+struct DDSPixelFormat
+{
+	uint32_t size;
+	uint32_t flags;
+	uint32_t fourCC;
+	uint32_t rgbBitCount;
+	uint32_t rBitMask;
+	uint32_t gBitMask;
+	uint32_t bBitMask;
+	uint32_t aBitMask;
+};
+
+struct DDSHeader
+{
+	uint32_t size;
+	uint32_t flags;
+	uint32_t height;
+	uint32_t width;
+	uint32_t pitchOrLinearSize;
+	uint32_t depth;
+	uint32_t mipMapCount;
+	uint32_t reserved1[11];
+	DDSPixelFormat pixelFormat;
+	uint32_t caps;
+	uint32_t caps2;
+	uint32_t caps3;
+	uint32_t caps4;
+	uint32_t reserved2;
+};
+
+struct DDSHeaderDX10
+{
+	uint32_t dxgiFormat;
+	uint32_t resourceDimension;
+	uint32_t miscFlag;
+	uint32_t arraySize;
+	uint32_t miscFlags2;
+};
+
+static bool formatFromDXGI(uint32_t dxgiFormat, TextureFormat* format)
+{
+	switch (dxgiFormat)
+	{
+	case DXGI_FORMAT_R8G8B8A8_UNORM: *format = TextureFormat::RGBA8; return true;
+	case DXGI_FORMAT_R8G8_UNORM: *format = TextureFormat::RG8; return true;
+	case DXGI_FORMAT_R8_UNORM: *format = TextureFormat::R8; return true;
+	case DXGI_FORMAT_BC1_UNORM: *format = TextureFormat::BC1; return true;
+	case DXGI_FORMAT_BC3_UNORM: *format = TextureFormat::BC3; return true;
+	case DXGI_FORMAT_BC4_UNORM: *format = TextureFormat::BC4; return true;
+	case DXGI_FORMAT_BC5_UNORM: *format = TextureFormat::BC5; return true;
+	case DXGI_FORMAT_BC7_UNORM: *format = TextureFormat::BC7; return true;
+	default: return false;
+	}
+}
+
+// -- KTX2 Layout -- //
+
+const unsigned char KTX2_IDENTIFIER[12] = { 0xAB, 0x4B, 0x54, 0x58, 0x20, 0x32, 0x30, 0xBB, 0x0D, 0x0A, 0x1A, 0x0A };	// "«KTX 20»\r\n\x1A\n"
+
+// VkFormat values of the formats we support (sRGB variants are read as the UNORM ones, like the source images are)
+const uint32_t VK_FORMAT_VALUE_R8_UNORM = 9;
+const uint32_t VK_FORMAT_VALUE_R8G8_UNORM = 16;
+const uint32_t VK_FORMAT_VALUE_R8G8B8A8_UNORM = 37;
+const uint32_t VK_FORMAT_VALUE_R8G8B8A8_SRGB = 43;
+const uint32_t VK_FORMAT_VALUE_BC1_RGBA_UNORM = 133;
+const uint32_t VK_FORMAT_VALUE_BC1_RGBA_SRGB = 134;
+const uint32_t VK_FORMAT_VALUE_BC3_UNORM = 137;
+const uint32_t VK_FORMAT_VALUE_BC3_SRGB = 138;
+const uint32_t VK_FORMAT_VALUE_BC4_UNORM = 139;
+const uint32_t VK_FORMAT_VALUE_BC5_UNORM = 141;
+const uint32_t VK_FORMAT_VALUE_BC7_UNORM = 145;
+const uint32_t VK_FORMAT_VALUE_BC7_SRGB = 146;
+
+// Data Format Descriptor colour models, channels & transfer function (Khronos Data Format spec)
+const uint8_t KHR_DF_MODEL_RGBSDA = 1;
+const uint8_t KHR_DF_MODEL_BC1A = 128;
+const uint8_t KHR_DF_MODEL_BC3 = 130;
+const uint8_t KHR_DF_MODEL_BC4 = 131;
+const uint8_t KHR_DF_MODEL_BC5 = 132;
+const uint8_t KHR_DF_MODEL_BC7 = 134;
+const uint8_t KHR_DF_PRIMARIES_BT709 = 1;
+const uint8_t KHR_DF_TRANSFER_LINEAR = 1;
+
+struct KTX2Header
+{
+	unsigned char identifier[12];
+	uint32_t vkFormat;
+	uint32_t typeSize;
+	uint32_t pixelWidth;
+	uint32_t pixelHeight;
+	uint32_t pixelDepth;
+	uint32_t layerCount;
+	uint32_t faceCount;
+	uint32_t levelCount;
+	uint32_t supercompressionScheme;
+	uint32_t dfdByteOffset;
+	uint32_t dfdByteLength;
+	uint32_t kvdByteOffset;
+	uint32_t kvdByteLength;
+	uint64_t sgdByteOffset;
+	uint64_t sgdByteLength;
+};
+
+struct KTX2LevelIndex
+{
+	uint64_t byteOffset;
+	uint64_t byteLength;
+	uint64_t uncompressedByteLength;
+};
+
+static bool formatFromVk(uint32_t vkFormat, TextureFormat* format)
+{
+	switch (vkFormat)
+	{
+	case VK_FORMAT_VALUE_R8G8B8A8_UNORM: case VK_FORMAT_VALUE_R8G8B8A8_SRGB: *format = TextureFormat::RGBA8; return true;
+	case VK_FORMAT_VALUE_R8_UNORM: *format = TextureFormat::R8; return true;
+	case VK_FORMAT_VALUE_R8G8_UNORM: *format = TextureFormat::RG8; return true;
+	case VK_FORMAT_VALUE_BC1_RGBA_UNORM: case VK_FORMAT_VALUE_BC1_RGBA_SRGB: *format = TextureFormat::BC1; return true;
+	case VK_FORMAT_VALUE_BC3_UNORM: case VK_FORMAT_VALUE_BC3_SRGB: *format = TextureFormat::BC3; return true;
+	case VK_FORMAT_VALUE_BC4_UNORM: *format = TextureFormat::BC4; return true;
+	case VK_FORMAT_VALUE_BC5_UNORM: *format = TextureFormat::BC5; return true;
+	case VK_FORMAT_VALUE_BC7_UNORM: case VK_FORMAT_VALUE_BC7_SRGB: *format = TextureFormat::BC7; return true;
+	default: return false;
+	}
+}
+
+static uint32_t formatToVk(TextureFormat format)
+{
+	switch (format)
+	{
+	case TextureFormat::BC1: return VK_FORMAT_VALUE_BC1_RGBA_UNORM;
+	case TextureFormat::BC3: return VK_FORMAT_VALUE_BC3_UNORM;
+	case TextureFormat::BC4: return VK_FORMAT_VALUE_BC4_UNORM;
+	case TextureFormat::BC5: return VK_FORMAT_VALUE_BC5_UNORM;
+	case TextureFormat::BC7: return VK_FORMAT_VALUE_BC7_UNORM;
+	case TextureFormat::R8: return VK_FORMAT_VALUE_R8_UNORM;
+	case TextureFormat::RG8: return VK_FORMAT_VALUE_R8G8_UNORM;
+	default: return VK_FORMAT_VALUE_R8G8B8A8_UNORM;
+	}
+}
+
+// Basic Data Format Descriptor for a format (KTX2 requires one, even though the VkFormat says it all)
+static std::vector<uint32_t> buildDFD(TextureFormat format)
+{
+	struct Sample { uint8_t bitOffset; uint8_t bitLength; uint8_t channel; };
+	std::vector<Sample> samples;
+	uint8_t model;
+	switch (format)
+	{
+	case TextureFormat::BC1: model = KHR_DF_MODEL_BC1A; samples = { { 0, 64, 1 } }; break;				// Colour + 1 bit alpha
+	case TextureFormat::BC3: model = KHR_DF_MODEL_BC3; samples = { { 0, 64, 15 }, { 64, 64, 0 } }; break;	// Alpha, colour
+	case TextureFormat::BC4: model = KHR_DF_MODEL_BC4; samples = { { 0, 64, 0 } }; break;
+	case TextureFormat::BC5: model = KHR_DF_MODEL_BC5; samples = { { 0, 64, 0 }, { 64, 64, 1 } }; break;	// Red, green
+	case TextureFormat::BC7: model = KHR_DF_MODEL_BC7; samples = { { 0, 128, 0 } }; break;
+	case TextureFormat::R8: model = KHR_DF_MODEL_RGBSDA; samples = { { 0, 8, 0 } }; break;
+	case TextureFormat::RG8: model = KHR_DF_MODEL_RGBSDA; samples = { { 0, 8, 0 }, { 8, 8, 1 } }; break;
+	default: model = KHR_DF_MODEL_RGBSDA; samples = { { 0, 8, 0 }, { 8, 8, 1 }, { 16, 8, 2 }, { 24, 8, 15 } }; break;
+	}
+
+	uint32_t blockSize = 24 + 16 * static_cast<uint32_t>(samples.size());
+	uint8_t blockDimension = isBlockCompressed(format) ? 3 : 0;		// Stored as size - 1
+
+	std::vector<uint32_t> dfd;
+	dfd.push_back(4 + blockSize);								// Total size
+	dfd.push_back(0);											// Vendor (Khronos) & descriptor type (basic)
+	dfd.push_back(2 | (blockSize << 16));						// Version 1.3, block size
+	dfd.push_back(model | (KHR_DF_PRIMARIES_BT709 << 8) | (KHR_DF_TRANSFER_LINEAR << 16));
+	dfd.push_back(blockDimension | (blockDimension << 8));
+	dfd.push_back(getTextureFormatBlockBytes(format));			// Bytes in plane 0
+	dfd.push_back(0);
+	for (auto& sample : samples)
+	{
+		uint32_t upper = sample.bitLength == 8 ? 255 : 0xFFFFFFFF;
+		dfd.push_back(sample.bitOffset | ((sample.bitLength - 1) << 16) | (sample.channel << 24));
+		dfd.push_back(0);										// Sample position
+		dfd.push_back(0);										// Lower
+		dfd.push_back(upper);									// Upper
+	}
+	return dfd;
+}
+
+static uint32_t formatToDXGI(TextureFormat format)
+{
+	switch (format)
+	{
+	case TextureFormat::BC1: return DXGI_FORMAT_BC1_UNORM;
+	case TextureFormat::BC3: return DXGI_FORMAT_BC3_UNORM;
+	case TextureFormat::BC4: return DXGI_FORMAT_BC4_UNORM;
+	case TextureFormat::BC5: return DXGI_FORMAT_BC5_UNORM;
+	case TextureFormat::BC7: return DXGI_FORMAT_BC7_UNORM;
+	case TextureFormat::R8: return DXGI_FORMAT_R8_UNORM;
+	case TextureFormat::RG8: return DXGI_FORMAT_R8G8_UNORM;
+	default: return DXGI_FORMAT_R8G8B8A8_UNORM;
+	}
+}
+
+// Parse a KTX2 file in memory, level offsets are where each level is in bytes
+static bool parseKTX2(const unsigned char* bytes, uint64_t size, TextureFile* file)
+{
+	KTX2Header header = {};
+	if (size < sizeof(header))
+	{
+		return false;
+	}
+	memcpy(&header, bytes, sizeof(header));
+	if (memcmp(header.identifier, KTX2_IDENTIFIER, sizeof(KTX2_IDENTIFIER)) != 0)
+	{
+		return false;
+	}
+
+	// Only plain (not supercompressed) 2D textures without layers or faces
+	TextureFormat format;
+	if (header.supercompressionScheme != 0 || header.pixelDepth > 1 || header.layerCount > 1 || header.faceCount != 1 ||
+		!formatFromVk(header.vkFormat, &format))
+	{
+		return false;
+	}
+
+	// Level count of 0 asks the loader to generate the mips, we just use level 0
+	uint32_t levelCount = header.levelCount > 0 ? header.levelCount : 1;
+	if (sizeof(header) + levelCount * sizeof(KTX2LevelIndex) > size)
+	{
+		return false;
+	}
+	std::vector<KTX2LevelIndex> levelIndex(levelCount);
+	memcpy(levelIndex.data(), bytes + sizeof(header), levelCount * sizeof(KTX2LevelIndex));
+
+	file->format = format;
+	file->width = header.pixelWidth;
+	file->height = header.pixelHeight;
+	file->levels.clear();
+	file->metadata.clear();
+
+	uint32_t width = header.pixelWidth;
+	uint32_t height = header.pixelHeight;
+	for (uint32_t i = 0; i < levelCount; i++)
+	{
+		TextureFile::Level level;
+		level.width = width;
+		level.height = height;
+		level.offset = levelIndex[i].byteOffset;
+		level.size = getTextureLevelSize(format, width, height);
+		if (levelIndex[i].byteLength != level.size || levelIndex[i].byteOffset + levelIndex[i].byteLength > size)
+		{
+			return false;
+		}
+		file->levels.push_back(level);
+
+		width = width > 1 ? width / 2 : 1;
+		height = height > 1 ? height / 2 : 1;
+	}
+
+	// Key/value data: each entry is its length, "key\0value" and padding up to 4 bytes
+	if (static_cast<uint64_t>(header.kvdByteOffset) + header.kvdByteLength > size)
+	{
+		return false;
+	}
+	const unsigned char* kvd = bytes + header.kvdByteOffset;
+	uint32_t kvdOffset = 0;
+	while (kvdOffset + sizeof(uint32_t) <= header.kvdByteLength)
+	{
+		uint32_t entryLength;
+		memcpy(&entryLength, kvd + kvdOffset, sizeof(entryLength));
+		kvdOffset += sizeof(uint32_t);
+		if (kvdOffset + entryLength > header.kvdByteLength)
+		{
+			return false;
+		}
+
+		const char* entry = reinterpret_cast<const char*>(kvd + kvdOffset);
+		size_t keyLength = strnlen(entry, entryLength);
+		if (keyLength < entryLength)
+		{
+			// Values are byte strings, ours are text so the terminating null is dropped
+			std::string value(entry + keyLength + 1, entryLength - keyLength - 1);
+			if (!value.empty() && value.back() == '\0') value.pop_back();
+			file->metadata[std::string(entry, keyLength)] = value;
+		}
+		kvdOffset += (entryLength + 3) / 4 * 4;
+	}
+	return true;
+}
+
+// -- Functions -- //
+
+const unsigned char* getTextureFileData(const TextureFile& file)
+{
+	return file.externalData ? file.externalData : file.data.data();
+}
+
+uint64_t getTextureFileLevelsSize(const TextureFile& file)
+{
+	uint64_t size = 0;
+	for (auto& level : file.levels)
+	{
+		size += level.size;
+	}
+	return size;
+}
+
+void addTextureFileLevel(TextureFile* file, uint32_t width, uint32_t height, const std::vector<unsigned char>& levelData)
+{
+	TextureFile::Level level;
+	level.width = width;
+	level.height = height;
+	level.offset = file->data.size();
+	level.size = levelData.size();
+	file->levels.push_back(level);
+	file->data.insert(file->data.end(), levelData.begin(), levelData.end());
+}
+
+bool readDDS(const std::string& fileName, TextureFile* file)
+{
+	std::ifstream stream(fileName, std::ios::binary | std::ios::ate);
+	if (!stream.is_open())
+	{
+		return false;
+	}
+
+	uint64_t fileSize = static_cast<uint64_t>(stream.tellg());
+	stream.seekg(0);
+
+	uint32_t magic = 0;
+	DDSHeader header = {};
+	stream.read(reinterpret_cast<char*>(&magic), sizeof(magic));
+	stream.read(reinterpret_cast<char*>(&header), sizeof(header));
+	if (!stream || magic != DDS_MAGIC || header.size != sizeof(DDSHeader))
+	{
+		return false;
+	}
+
+	// Work out the format, from the DX10 header or the older FourCC codes
+	TextureFormat format;
+	if ((header.pixelFormat.flags & DDPF_FOURCC) && header.pixelFormat.fourCC == DDS_FOURCC_DX10)
+	{
+		DDSHeaderDX10 headerDX10 = {};
+		stream.read(reinterpret_cast<char*>(&headerDX10), sizeof(headerDX10));
+		if (!stream || headerDX10.resourceDimension != DDS_DIMENSION_TEXTURE2D || headerDX10.arraySize > 1 ||
+			!formatFromDXGI(headerDX10.dxgiFormat, &format))
+		{
+			return false;
+		}
+	}
+	else if (header.pixelFormat.flags & DDPF_FOURCC)
+	{
+		switch (header.pixelFormat.fourCC)
+		{
+		case DDS_FOURCC_DXT1: format = TextureFormat::BC1; break;
+		case DDS_FOURCC_DXT5: format = TextureFormat::BC3; break;
+		case DDS_FOURCC_ATI1: format = TextureFormat::BC4; break;
+		case DDS_FOURCC_ATI2: format = TextureFormat::BC5; break;
+		default: return false;
+		}
+	}
+	else
+	{
+		// Uncompressed layouts other than what we write (RGBA8/RG8/R8 through DX10) aren't supported
+		return false;
+	}
+
+	file->format = format;
+	file->width = header.width;
+	file->height = header.height;
+	file->levels.clear();
+	file->metadata.clear();
+	file->externalData = nullptr;
+
+	// Levels are stored largest first, one after another
+	uint32_t levelCount = (header.flags & DDSD_MIPMAPCOUNT) && header.mipMapCount > 0 ? header.mipMapCount : 1;
+	uint64_t dataStart = static_cast<uint64_t>(stream.tellg());
+	uint64_t offset = 0;
+	uint32_t width = header.width;
+	uint32_t height = header.height;
+	for (uint32_t i = 0; i < levelCount; i++)
+	{
+		TextureFile::Level level;
+		level.width = width;
+		level.height = height;
+		level.offset = offset;
+		level.size = getTextureLevelSize(format, width, height);
+		file->levels.push_back(level);
+
+		offset += level.size;
+		width = width > 1 ? width / 2 : 1;
+		height = height > 1 ? height / 2 : 1;
+	}
+
+	if (dataStart + offset > fileSize)
+	{
+		return false;
+	}
+
+	file->data.resize(static_cast<size_t>(offset));
+	stream.read(reinterpret_cast<char*>(file->data.data()), offset);
+	return static_cast<bool>(stream);
+}
+
+void writeDDS(const std::string& fileName, const TextureFile& file)
+{
+	std::ofstream stream(fileName, std::ios::binary);
+	if (!stream.is_open())
+	{
+		throw std::runtime_error("Failed to open " + fileName + " for writing!");
+	}
+
+	DDSHeader header = {};
+	header.size = sizeof(DDSHeader);
+	header.flags = DDSD_CAPS | DDSD_HEIGHT | DDSD_WIDTH | DDSD_PIXELFORMAT | DDSD_MIPMAPCOUNT | DDSD_LINEARSIZE;
+	header.height = file.height;
+	header.width = file.width;
+	header.pitchOrLinearSize = file.levels.empty() ? 0 : static_cast<uint32_t>(file.levels[0].size);
+	header.depth = 1;
+	header.mipMapCount = static_cast<uint32_t>(file.levels.size());
+	header.pixelFormat.size = sizeof(DDSPixelFormat);
+	header.pixelFormat.flags = DDPF_FOURCC;
+	header.pixelFormat.fourCC = DDS_FOURCC_DX10;		// Always use the DX10 header, it can describe every format
+	header.caps = DDSCAPS_TEXTURE | (file.levels.size() > 1 ? DDSCAPS_COMPLEX | DDSCAPS_MIPMAP : 0);
+
+	DDSHeaderDX10 headerDX10 = {};
+	headerDX10.dxgiFormat = formatToDXGI(file.format);
+	headerDX10.resourceDimension = DDS_DIMENSION_TEXTURE2D;
+	headerDX10.arraySize = 1;
+
+	stream.write(reinterpret_cast<const char*>(&DDS_MAGIC), sizeof(DDS_MAGIC));
+	stream.write(reinterpret_cast<const char*>(&header), sizeof(header));
+	stream.write(reinterpret_cast<const char*>(&headerDX10), sizeof(headerDX10));
+	for (auto& level : file.levels)
+	{
+		stream.write(reinterpret_cast<const char*>(getTextureFileData(file) + level.offset), level.size);
+	}
+
+	if (!stream)
+	{
+		throw std::runtime_error("Failed to write " + fileName + "!");
+	}
+}
+
+bool readKTX2(const std::string& fileName, TextureFile* file)
+{
+	std::ifstream stream(fileName, std::ios::binary | std::ios::ate);
+	if (!stream.is_open())
+	{
+		return false;
+	}
+
+	// Whole file is kept, levels are read in place where they are in it
+	uint64_t fileSize = static_cast<uint64_t>(stream.tellg());
+	stream.seekg(0);
+	file->externalData = nullptr;
+	file->data.resize(static_cast<size_t>(fileSize));
+	stream.read(reinterpret_cast<char*>(file->data.data()), fileSize);
+	if (!stream)
+	{
+		return false;
+	}
+
+	return parseKTX2(file->data.data(), fileSize, file);
+}
+
+bool readKTX2Memory(const unsigned char* bytes, uint64_t size, TextureFile* file)
+{
+	file->data.clear();
+	file->externalData = bytes;
+	return parseKTX2(bytes, size, file);
+}
+
+void writeKTX2(const std::string& fileName, const TextureFile& file)
+{
+	std::ofstream stream(fileName, std::ios::binary);
+	if (!stream.is_open())
+	{
+		throw std::runtime_error("Failed to open " + fileName + " for writing!");
+	}
+
+	uint32_t levelCount = static_cast<uint32_t>(file.levels.size());
+	std::vector<uint32_t> dfd = buildDFD(file.format);
+
+	KTX2Header header = {};
+	memcpy(header.identifier, KTX2_IDENTIFIER, sizeof(KTX2_IDENTIFIER));
+	header.vkFormat = formatToVk(file.format);
+	header.typeSize = 1;
+	header.pixelWidth = file.width;
+	header.pixelHeight = file.height;
+	header.faceCount = 1;
+	header.levelCount = levelCount;
+	header.dfdByteOffset = static_cast<uint32_t>(sizeof(KTX2Header) + levelCount * sizeof(KTX2LevelIndex));
+	header.dfdByteLength = static_cast<uint32_t>(dfd.size() * sizeof(uint32_t));
+
+	// Key/value data follows the descriptor, entries are sorted by key (std::map already is)
+	std::vector<unsigned char> kvd;
+	for (const auto& entry : file.metadata)
+	{
+		uint32_t entryLength = static_cast<uint32_t>(entry.first.size() + 1 + entry.second.size() + 1);
+		size_t entryOffset = kvd.size();
+		kvd.resize(entryOffset + sizeof(uint32_t) + (entryLength + 3) / 4 * 4, 0);
+		memcpy(kvd.data() + entryOffset, &entryLength, sizeof(entryLength));
+		memcpy(kvd.data() + entryOffset + sizeof(uint32_t), entry.first.c_str(), entry.first.size() + 1);
+		memcpy(kvd.data() + entryOffset + sizeof(uint32_t) + entry.first.size() + 1, entry.second.c_str(), entry.second.size() + 1);
+	}
+	if (!kvd.empty())
+	{
+		header.kvdByteOffset = header.dfdByteOffset + header.dfdByteLength;
+		header.kvdByteLength = static_cast<uint32_t>(kvd.size());
+	}
+
+	// Level data goes after the key/value data, smallest level first as the spec recommends (each aligned to its block size)
+	uint64_t alignment = std::max<uint64_t>(4, getTextureFormatBlockBytes(file.format));
+	uint64_t offset = header.dfdByteOffset + header.dfdByteLength + kvd.size();
+	std::vector<KTX2LevelIndex> levelIndex(levelCount);
+	for (uint32_t i = levelCount; i-- > 0;)
+	{
+		offset = (offset + alignment - 1) / alignment * alignment;
+		levelIndex[i].byteOffset = offset;
+		levelIndex[i].byteLength = file.levels[i].size;
+		levelIndex[i].uncompressedByteLength = file.levels[i].size;
+		offset += file.levels[i].size;
+	}
+
+	stream.write(reinterpret_cast<const char*>(&header), sizeof(header));
+	stream.write(reinterpret_cast<const char*>(levelIndex.data()), levelCount * sizeof(KTX2LevelIndex));
+	stream.write(reinterpret_cast<const char*>(dfd.data()), header.dfdByteLength);
+	stream.write(reinterpret_cast<const char*>(kvd.data()), kvd.size());
+	const unsigned char* data = getTextureFileData(file);
+	for (uint32_t i = levelCount; i-- > 0;)
+	{
+		// Pad up to the level's offset
+		static const char padding[16] = {};
+		stream.write(padding, levelIndex[i].byteOffset - static_cast<uint64_t>(stream.tellp()));
+		stream.write(reinterpret_cast<const char*>(data + file.levels[i].offset), file.levels[i].size);
+	}
+
+	if (!stream)
+	{
+		throw std::runtime_error("Failed to write " + fileName + "!");
+	}
+}
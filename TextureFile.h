@@ -0,0 +1,49 @@
+#pragma once
+
+#include <stdint.h>
+#include <string>
+#include <vector>
+#include <map>
+
+#include "TextureCompression.h"
+
+// Texture with all of its mip levels stored in GPU ready form, as read from/written to a texture container file
+struct TextureFile
+{
+	// One mip level, data is at offset in TextureFile::data
+	struct Level
+	{
+		uint32_t width;
+		uint32_t height;
+		uint64_t offset;
+		uint64_t size;
+	};
+
+	TextureFormat format = TextureFormat::RGBA8;
+	uint32_t width = 0;
+	uint32_t height = 0;
+	std::vector<Level> levels;
+	std::vector<unsigned char> data;
+	const unsigned char* externalData = nullptr;		// Used instead of data if set (e.g. a memory mapped file)
+	std::map<std::string, std::string> metadata;		// KTX2 key/value data (DDS files have none)
+};
+
+// Start of the data level offsets are relative to
+const unsigned char* getTextureFileData(const TextureFile& file);
+// Total size of all levels
+uint64_t getTextureFileLevelsSize(const TextureFile& file);
+
+// Add a level after the existing ones (copies the data)
+void addTextureFileLevel(TextureFile* file, uint32_t width, uint32_t height, const std::vector<unsigned char>& levelData);
+
+// DDS (DirectDraw Surface) container, returns false if the file doesn't exist or isn't a format we can use
+bool readDDS(const std::string& fileName, TextureFile* file);
+void writeDDS(const std::string& fileName, const TextureFile& file);
+
+// KTX2 (Khronos texture) container, formats are stored as VkFormat values. Supercompressed files (Basis/zstd) aren't
+// supported, as those would need decoding again
+bool readKTX2(const std::string& fileName, TextureFile* file);
+// Same for a file that's already in memory (e.g. memory mapped), levels point into bytes instead of being copied,
+// so bytes must outlive file
+bool readKTX2Memory(const unsigned char* bytes, uint64_t size, TextureFile* file);
+void writeKTX2(const std::string& fileName, const TextureFile& file);
@@ -0,0 +1,753 @@
+#include "TextureProcessing.h"
+
+#include <algorithm>
+#include <cmath>
+
+// Pick the widest instruction set this file is compiled for (AVX2 needs /arch:AVX2 or -mavx2)
+#if defined(__AVX2__)
+#define TEXTURE_SIMD_AVX2
+#define TEXTURE_SIMD_SSE2
+#include <immintrin.h>
+#elif defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define TEXTURE_SIMD_SSE2
+#include <emmintrin.h>
+#elif defined(__ARM_NEON) || defined(_M_ARM64)
+#define TEXTURE_SIMD_NEON
+#include <arm_neon.h>
+#endif
+
+// Size of the linear -> sRGB lookup (needs plenty of steps near black, where sRGB is steep)
+const uint32_t LINEAR_TO_SRGB_STEPS = 16384;
+
+// Kaiser window settings: taps either side of the centre and window shape
+const float KAISER_RADIUS = 3.0f;
+const float KAISER_BETA = 4.0f;
+
+// -- Colour Conversion -- //
+
+struct ColorTables
+{
+	float toLinear[256];								// 8 bit sRGB -> linear float
+	unsigned char toSrgb[LINEAR_TO_SRGB_STEPS];			// Quantised linear float -> 8 bit sRGB
+};
+
+static const ColorTables& getColorTables()
+{
+	// Built once, on first use (thread safe since C++11)
+	static const ColorTables tables = []()
+	{
+		ColorTables t;
+		for (uint32_t i = 0; i < 256; i++)
+		{
+			float c = i / 255.0f;
+			t.toLinear[i] = c <= 0.04045f ? c / 12.92f : std::pow((c + 0.055f) / 1.055f, 2.4f);
+		}
+		for (uint32_t i = 0; i < LINEAR_TO_SRGB_STEPS; i++)
+		{
+			float l = i / static_cast<float>(LINEAR_TO_SRGB_STEPS - 1);
+			float c = l <= 0.0031308f ? l * 12.92f : 1.055f * std::pow(l, 1.0f / 2.4f) - 0.055f;
+			t.toSrgb[i] = static_cast<unsigned char>(c * 255.0f + 0.5f);
+		}
+		return t;
+	}();
+	return tables;
+}
+
+// -- Filter Weights -- //
+
+// Modified Bessel function of the first kind, order 0 (series expansion)
+static double besselI0(double x)
+{
+	double sum = 1.0;
+	double term = 1.0;
+	double halfX = x * 0.5;
+	for (int k = 1; k < 32; k++)
+	{
+		term *= (halfX / k) * (halfX / k);
+		sum += term;
+		if (term < sum * 1e-12)
+		{
+			break;
+		}
+	}
+	return sum;
+}
+
+static float filterWeight(TextureFilter filter, float x)
+{
+	x = std::fabs(x);
+	if (filter == TextureFilter::Box)
+	{
+		return x <= 0.5f ? 1.0f : 0.0f;
+	}
+
+	// Kaiser windowed sinc
+	if (x >= KAISER_RADIUS)
+	{
+		return 0.0f;
+	}
+	float sinc = x < 1e-5f ? 1.0f : std::sin(3.14159265f * x) / (3.14159265f * x);
+	float ratio = x / KAISER_RADIUS;
+	double window = besselI0(KAISER_BETA * std::sqrt(1.0 - ratio * ratio)) / besselI0(KAISER_BETA);
+	return sinc * static_cast<float>(window);
+}
+
+// Source pixels (and their weights) each destination pixel along one axis is made from
+struct FilterTaps
+{
+	uint32_t tapCount;				// Taps per destination pixel (unused ones have weight 0)
+	std::vector<uint32_t> indices;	// dstSize * tapCount source indices, clamped to the edges
+	std::vector<float> weights;		// dstSize * tapCount weights, each pixel's sum to 1
+};
+
+static FilterTaps calculateFilterTaps(TextureFilter filter, uint32_t srcSize, uint32_t dstSize)
+{
+	// When shrinking, the filter is stretched to cover all of the source pixels under a destination pixel
+	float scale = static_cast<float>(srcSize) / dstSize;
+	float filterScale = std::max(scale, 1.0f);
+	float support = (filter == TextureFilter::Box ? 0.5f : KAISER_RADIUS) * filterScale;
+
+	FilterTaps taps;
+	taps.tapCount = static_cast<uint32_t>(std::ceil(support * 2.0f)) + 1;
+	taps.indices.resize(static_cast<size_t>(dstSize) * taps.tapCount, 0);
+	taps.weights.resize(static_cast<size_t>(dstSize) * taps.tapCount, 0.0f);
+
+	for (uint32_t i = 0; i < dstSize; i++)
+	{
+		// Centre of the destination pixel in source pixel coordinates
+		float centre = (i + 0.5f) * scale - 0.5f;
+		int32_t first = static_cast<int32_t>(std::ceil(centre - support));
+
+		uint32_t* indices = &taps.indices[static_cast<size_t>(i) * taps.tapCount];
+		float* weights = &taps.weights[static_cast<size_t>(i) * taps.tapCount];
+		float total = 0.0f;
+		for (uint32_t t = 0; t < taps.tapCount; t++)
+		{
+			int32_t j = first + static_cast<int32_t>(t);
+			indices[t] = static_cast<uint32_t>(std::min(std::max(j, 0), static_cast<int32_t>(srcSize) - 1));
+			weights[t] = filterWeight(filter, (j - centre) / filterScale);
+			total += weights[t];
+		}
+
+		// Normalise, so flat colour stays the same colour
+		if (total != 0.0f)
+		{
+			for (uint32_t t = 0; t < taps.tapCount; t++)
+			{
+				weights[t] /= total;
+			}
+		}
+	}
+
+	return taps;
+}
+
+// -- Scalar Kernels -- //
+
+// Convert 8 bit values [first, count) to floats in 0..1 (linear space if srgb)
+static void rowToFloatScalar(const unsigned char* src, float* dst, uint32_t first, uint32_t count, bool srgb)
+{
+	const ColorTables& tables = getColorTables();
+	for (uint32_t i = first; i < count; i++)
+	{
+		// Alpha (every 4th value) is never gamma encoded
+		dst[i] = srgb && (i & 3) != 3 ? tables.toLinear[src[i]] : src[i] * (1.0f / 255.0f);
+	}
+}
+
+// Convert 0..1 floats [first, count) back to 8 bit (from linear space if srgb), values are clamped
+static void rowFromFloatScalar(const float* src, unsigned char* dst, uint32_t first, uint32_t count, bool srgb)
+{
+	const ColorTables& tables = getColorTables();
+	for (uint32_t i = first; i < count; i++)
+	{
+		float v = std::min(std::max(src[i], 0.0f), 1.0f);
+		dst[i] = srgb && (i & 3) != 3 ?
+			tables.toSrgb[static_cast<uint32_t>(v * (LINEAR_TO_SRGB_STEPS - 1) + 0.5f)] :
+			static_cast<unsigned char>(v * 255.0f + 0.5f);
+	}
+}
+
+static void boxDownsampleRowScalar(const unsigned char* row0, const unsigned char* row1, uint32_t srcWidth,
+	unsigned char* out, uint32_t firstPixel, uint32_t dstWidth)
+{
+	for (uint32_t x = firstPixel; x < dstWidth; x++)
+	{
+		// Odd sizes (or a side that's already 1) reuse the last column
+		uint32_t x0 = std::min(x * 2, srcWidth - 1) * 4;
+		uint32_t x1 = std::min(x * 2 + 1, srcWidth - 1) * 4;
+		for (uint32_t c = 0; c < 4; c++)
+		{
+			// Box filter, rounded to nearest
+			uint32_t sum = row0[x0 + c] + row0[x1 + c] + row1[x0 + c] + row1[x1 + c];
+			out[x * 4 + c] = static_cast<unsigned char>((sum + 2) / 4);
+		}
+	}
+}
+
+static void boxDownsampleRowFloatScalar(const float* row0, const float* row1, uint32_t srcWidth,
+	float* out, uint32_t firstPixel, uint32_t dstWidth)
+{
+	for (uint32_t x = firstPixel; x < dstWidth; x++)
+	{
+		uint32_t x0 = std::min(x * 2, srcWidth - 1) * 4;
+		uint32_t x1 = std::min(x * 2 + 1, srcWidth - 1) * 4;
+		for (uint32_t c = 0; c < 4; c++)
+		{
+			out[x * 4 + c] = ((row0[x0 + c] + row0[x1 + c]) + (row1[x0 + c] + row1[x1 + c])) * 0.25f;
+		}
+	}
+}
+
+static void filterRowScalar(const float* src, float* out, uint32_t dstWidth, const FilterTaps& taps)
+{
+	for (uint32_t x = 0; x < dstWidth; x++)
+	{
+		const uint32_t* indices = &taps.indices[static_cast<size_t>(x) * taps.tapCount];
+		const float* weights = &taps.weights[static_cast<size_t>(x) * taps.tapCount];
+		float sum[4] = { 0.0f, 0.0f, 0.0f, 0.0f };
+		for (uint32_t t = 0; t < taps.tapCount; t++)
+		{
+			const float* pixel = src + indices[t] * 4;
+			for (uint32_t c = 0; c < 4; c++)
+			{
+				sum[c] += pixel[c] * weights[t];
+			}
+		}
+		for (uint32_t c = 0; c < 4; c++)
+		{
+			out[x * 4 + c] = sum[c];
+		}
+	}
+}
+
+static void filterColumnScalar(const float* const* rows, const float* weights, uint32_t tapCount,
+	float* out, uint32_t first, uint32_t count)
+{
+	for (uint32_t i = first; i < count; i++)
+	{
+		float sum = 0.0f;
+		for (uint32_t t = 0; t < tapCount; t++)
+		{
+			sum += rows[t][i] * weights[t];
+		}
+		out[i] = sum;
+	}
+}
+
+// -- SIMD Kernels -- //
+// Each returns how far it got, the scalar kernels finish off the rest
+
+#if defined(TEXTURE_SIMD_SSE2)
+
+static uint32_t rowToFloatSimd(const unsigned char* src, float* dst, uint32_t count, bool srgb)
+{
+	// Lookup table conversion doesn't vectorise without gathers
+	if (srgb)
+	{
+		return 0;
+	}
+
+	uint32_t i = 0;
+	__m128i zero = _mm_setzero_si128();
+	__m128 scale = _mm_set1_ps(1.0f / 255.0f);
+	for (; i + 16 <= count; i += 16)
+	{
+		__m128i bytes = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + i));
+		__m128i lo = _mm_unpacklo_epi8(bytes, zero);
+		__m128i hi = _mm_unpackhi_epi8(bytes, zero);
+		_mm_storeu_ps(dst + i, _mm_mul_ps(_mm_cvtepi32_ps(_mm_unpacklo_epi16(lo, zero)), scale));
+		_mm_storeu_ps(dst + i + 4, _mm_mul_ps(_mm_cvtepi32_ps(_mm_unpackhi_epi16(lo, zero)), scale));
+		_mm_storeu_ps(dst + i + 8, _mm_mul_ps(_mm_cvtepi32_ps(_mm_unpacklo_epi16(hi, zero)), scale));
+		_mm_storeu_ps(dst + i + 12, _mm_mul_ps(_mm_cvtepi32_ps(_mm_unpackhi_epi16(hi, zero)), scale));
+	}
+	return i;
+}
+
+static uint32_t rowFromFloatSimd(const float* src, unsigned char* dst, uint32_t count, bool srgb)
+{
+	uint32_t i = 0;
+	__m128 zero = _mm_setzero_ps();
+	__m128 one = _mm_set1_ps(1.0f);
+	__m128 half = _mm_set1_ps(0.5f);
+
+	if (srgb)
+	{
+		// Clamp and scale to table indices (alpha to its 8 bit value) a pixel at a time, then look the colours up
+		const ColorTables& tables = getColorTables();
+		__m128 scale = _mm_set_ps(255.0f, LINEAR_TO_SRGB_STEPS - 1.0f, LINEAR_TO_SRGB_STEPS - 1.0f, LINEAR_TO_SRGB_STEPS - 1.0f);
+		for (; i + 4 <= count; i += 4)
+		{
+			__m128 v = _mm_min_ps(_mm_max_ps(_mm_loadu_ps(src + i), zero), one);
+			alignas(16) int32_t values[4];
+			_mm_store_si128(reinterpret_cast<__m128i*>(values), _mm_cvttps_epi32(_mm_add_ps(_mm_mul_ps(v, scale), half)));
+			dst[i + 0] = tables.toSrgb[values[0]];
+			dst[i + 1] = tables.toSrgb[values[1]];
+			dst[i + 2] = tables.toSrgb[values[2]];
+			dst[i + 3] = static_cast<unsigned char>(values[3]);
+		}
+		return i;
+	}
+
+	__m128 scale = _mm_set1_ps(255.0f);
+	for (; i + 16 <= count; i += 16)
+	{
+		__m128i values[4];
+		for (uint32_t j = 0; j < 4; j++)
+		{
+			__m128 v = _mm_min_ps(_mm_max_ps(_mm_loadu_ps(src + i + j * 4), zero), one);
+			values[j] = _mm_cvttps_epi32(_mm_add_ps(_mm_mul_ps(v, scale), half));
+		}
+		__m128i lo = _mm_packs_epi32(values[0], values[1]);
+		__m128i hi = _mm_packs_epi32(values[2], values[3]);
+		_mm_storeu_si128(reinterpret_cast<__m128i*>(dst + i), _mm_packus_epi16(lo, hi));
+	}
+	return i;
+}
+
+// Sum horizontal pairs of pixels from two rows: 16 bytes (4 pixels) per row -> 2 pixels as 16 bit sums
+static inline __m128i boxSum4(__m128i a, __m128i b)
+{
+	__m128i zero = _mm_setzero_si128();
+	__m128i lo = _mm_add_epi16(_mm_unpacklo_epi8(a, zero), _mm_unpacklo_epi8(b, zero));	// p0, p1
+	__m128i hi = _mm_add_epi16(_mm_unpackhi_epi8(a, zero), _mm_unpackhi_epi8(b, zero));	// p2, p3
+	lo = _mm_add_epi16(lo, _mm_srli_si128(lo, 8));		// p0 + p1 in the low half
+	hi = _mm_add_epi16(hi, _mm_srli_si128(hi, 8));		// p2 + p3 in the low half
+	return _mm_unpacklo_epi64(lo, hi);
+}
+
+static uint32_t boxDownsampleRowSimd(const unsigned char* row0, const unsigned char* row1, uint32_t srcWidth,
+	unsigned char* out, uint32_t dstWidth)
+{
+	// Only pixels whose 2x2 block is fully inside the row (odd last column is left to the scalar kernel)
+	uint32_t pairs = std::min(dstWidth, srcWidth / 2);
+	uint32_t x = 0;
+	__m128i rounding = _mm_set1_epi16(2);
+
+#if defined(TEXTURE_SIMD_AVX2)
+	// 8 source pixels -> 4 destination pixels per row
+	for (; x + 4 <= pairs; x += 4)
+	{
+		__m256i a = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(row0 + x * 8));
+		__m256i b = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(row1 + x * 8));
+		__m256i zero = _mm256_setzero_si256();
+		// Unpacks work within each 128 bit lane: lane 0 holds p0..p3, lane 1 holds p4..p7
+		__m256i lo = _mm256_add_epi16(_mm256_unpacklo_epi8(a, zero), _mm256_unpacklo_epi8(b, zero));
+		__m256i hi = _mm256_add_epi16(_mm256_unpackhi_epi8(a, zero), _mm256_unpackhi_epi8(b, zero));
+		lo = _mm256_add_epi16(lo, _mm256_srli_si256(lo, 8));
+		hi = _mm256_add_epi16(hi, _mm256_srli_si256(hi, 8));
+		__m256i sum = _mm256_unpacklo_epi64(lo, hi);
+		sum = _mm256_srli_epi16(_mm256_add_epi16(sum, _mm256_set1_epi16(2)), 2);
+		__m256i packed = _mm256_packus_epi16(sum, sum);
+		// Bring the low 8 bytes of both lanes together
+		packed = _mm256_permute4x64_epi64(packed, 0x08);
+		_mm_storeu_si128(reinterpret_cast<__m128i*>(out + x * 4), _mm256_castsi256_si128(packed));
+	}
+#endif
+
+	// 4 source pixels -> 2 destination pixels per row
+	for (; x + 2 <= pairs; x += 2)
+	{
+		__m128i a = _mm_loadu_si128(reinterpret_cast<const __m128i*>(row0 + x * 8));
+		__m128i b = _mm_loadu_si128(reinterpret_cast<const __m128i*>(row1 + x * 8));
+		__m128i sum = _mm_srli_epi16(_mm_add_epi16(boxSum4(a, b), rounding), 2);
+		_mm_storel_epi64(reinterpret_cast<__m128i*>(out + x * 4), _mm_packus_epi16(sum, sum));
+	}
+	return x;
+}
+
+static uint32_t boxDownsampleRowFloatSimd(const float* row0, const float* row1, uint32_t srcWidth,
+	float* out, uint32_t dstWidth)
+{
+	// One pixel (RGBA) per register
+	uint32_t pairs = std::min(dstWidth, srcWidth / 2);
+	__m128 quarter = _mm_set1_ps(0.25f);
+	for (uint32_t x = 0; x < pairs; x++)
+	{
+		__m128 top = _mm_add_ps(_mm_loadu_ps(row0 + x * 8), _mm_loadu_ps(row0 + x * 8 + 4));
+		__m128 bottom = _mm_add_ps(_mm_loadu_ps(row1 + x * 8), _mm_loadu_ps(row1 + x * 8 + 4));
+		_mm_storeu_ps(out + x * 4, _mm_mul_ps(_mm_add_ps(top, bottom), quarter));
+	}
+	return pairs;
+}
+
+static uint32_t filterRowSimd(const float* src, float* out, uint32_t dstWidth, const FilterTaps& taps)
+{
+	for (uint32_t x = 0; x < dstWidth; x++)
+	{
+		const uint32_t* indices = &taps.indices[static_cast<size_t>(x) * taps.tapCount];
+		const float* weights = &taps.weights[static_cast<size_t>(x) * taps.tapCount];
+		__m128 sum = _mm_setzero_ps();
+		for (uint32_t t = 0; t < taps.tapCount; t++)
+		{
+			sum = _mm_add_ps(sum, _mm_mul_ps(_mm_loadu_ps(src + indices[t] * 4), _mm_set1_ps(weights[t])));
+		}
+		_mm_storeu_ps(out + x * 4, sum);
+	}
+	return dstWidth;
+}
+
+static uint32_t filterColumnSimd(const float* const* rows, const float* weights, uint32_t tapCount,
+	float* out, uint32_t count)
+{
+	uint32_t i = 0;
+#if defined(TEXTURE_SIMD_AVX2)
+	for (; i + 8 <= count; i += 8)
+	{
+		__m256 sum = _mm256_setzero_ps();
+		for (uint32_t t = 0; t < tapCount; t++)
+		{
+			sum = _mm256_add_ps(sum, _mm256_mul_ps(_mm256_loadu_ps(rows[t] + i), _mm256_set1_ps(weights[t])));
+		}
+		_mm256_storeu_ps(out + i, sum);
+	}
+#endif
+	for (; i + 4 <= count; i += 4)
+	{
+		__m128 sum = _mm_setzero_ps();
+		for (uint32_t t = 0; t < tapCount; t++)
+		{
+			sum = _mm_add_ps(sum, _mm_mul_ps(_mm_loadu_ps(rows[t] + i), _mm_set1_ps(weights[t])));
+		}
+		_mm_storeu_ps(out + i, sum);
+	}
+	return i;
+}
+
+#elif defined(TEXTURE_SIMD_NEON)
+
+static uint32_t rowToFloatSimd(const unsigned char* src, float* dst, uint32_t count, bool srgb)
+{
+	// Lookup table conversion doesn't vectorise without gathers
+	if (srgb)
+	{
+		return 0;
+	}
+
+	uint32_t i = 0;
+	for (; i + 16 <= count; i += 16)
+	{
+		uint8x16_t bytes = vld1q_u8(src + i);
+		uint16x8_t lo = vmovl_u8(vget_low_u8(bytes));
+		uint16x8_t hi = vmovl_u8(vget_high_u8(bytes));
+		vst1q_f32(dst + i, vmulq_n_f32(vcvtq_f32_u32(vmovl_u16(vget_low_u16(lo))), 1.0f / 255.0f));
+		vst1q_f32(dst + i + 4, vmulq_n_f32(vcvtq_f32_u32(vmovl_u16(vget_high_u16(lo))), 1.0f / 255.0f));
+		vst1q_f32(dst + i + 8, vmulq_n_f32(vcvtq_f32_u32(vmovl_u16(vget_low_u16(hi))), 1.0f / 255.0f));
+		vst1q_f32(dst + i + 12, vmulq_n_f32(vcvtq_f32_u32(vmovl_u16(vget_high_u16(hi))), 1.0f / 255.0f));
+	}
+	return i;
+}
+
+static uint32_t rowFromFloatSimd(const float* src, unsigned char* dst, uint32_t count, bool srgb)
+{
+	// Lookup table conversion doesn't vectorise without gathers
+	if (srgb)
+	{
+		return 0;
+	}
+
+	uint32_t i = 0;
+	float32x4_t zero = vdupq_n_f32(0.0f);
+	float32x4_t one = vdupq_n_f32(1.0f);
+	float32x4_t half = vdupq_n_f32(0.5f);
+	for (; i + 8 <= count; i += 8)
+	{
+		float32x4_t a = vminq_f32(vmaxq_f32(vld1q_f32(src + i), zero), one);
+		float32x4_t b = vminq_f32(vmaxq_f32(vld1q_f32(src + i + 4), zero), one);
+		// Separate multiply + add and truncation, so results match the scalar reference
+		uint32x4_t valuesA = vcvtq_u32_f32(vaddq_f32(vmulq_n_f32(a, 255.0f), half));
+		uint32x4_t valuesB = vcvtq_u32_f32(vaddq_f32(vmulq_n_f32(b, 255.0f), half));
+		vst1_u8(dst + i, vmovn_u16(vcombine_u16(vmovn_u32(valuesA), vmovn_u32(valuesB))));
+	}
+	return i;
+}
+
+static uint32_t boxDownsampleRowSimd(const unsigned char* row0, const unsigned char* row1, uint32_t srcWidth,
+	unsigned char* out, uint32_t dstWidth)
+{
+	uint32_t pairs = std::min(dstWidth, srcWidth / 2);
+	uint32_t x = 0;
+
+	// 4 source pixels -> 2 destination pixels per row
+	for (; x + 2 <= pairs; x += 2)
+	{
+		uint8x16_t a = vld1q_u8(row0 + x * 8);
+		uint8x16_t b = vld1q_u8(row1 + x * 8);
+		uint16x8_t lo = vaddl_u8(vget_low_u8(a), vget_low_u8(b));		// p0, p1
+		uint16x8_t hi = vaddl_u8(vget_high_u8(a), vget_high_u8(b));		// p2, p3
+		uint16x4_t sumLo = vadd_u16(vget_low_u16(lo), vget_high_u16(lo));
+		uint16x4_t sumHi = vadd_u16(vget_low_u16(hi), vget_high_u16(hi));
+		// Rounding shift does the (sum + 2) / 4
+		vst1_u8(out + x * 4, vrshrn_n_u16(vcombine_u16(sumLo, sumHi), 2));
+	}
+	return x;
+}
+
+static uint32_t boxDownsampleRowFloatSimd(const float* row0, const float* row1, uint32_t srcWidth,
+	float* out, uint32_t dstWidth)
+{
+	uint32_t pairs = std::min(dstWidth, srcWidth / 2);
+	for (uint32_t x = 0; x < pairs; x++)
+	{
+		float32x4_t top = vaddq_f32(vld1q_f32(row0 + x * 8), vld1q_f32(row0 + x * 8 + 4));
+		float32x4_t bottom = vaddq_f32(vld1q_f32(row1 + x * 8), vld1q_f32(row1 + x * 8 + 4));
+		vst1q_f32(out + x * 4, vmulq_n_f32(vaddq_f32(top, bottom), 0.25f));
+	}
+	return pairs;
+}
+
+static uint32_t filterRowSimd(const float* src, float* out, uint32_t dstWidth, const FilterTaps& taps)
+{
+	for (uint32_t x = 0; x < dstWidth; x++)
+	{
+		const uint32_t* indices = &taps.indices[static_cast<size_t>(x) * taps.tapCount];
+		const float* weights = &taps.weights[static_cast<size_t>(x) * taps.tapCount];
+		float32x4_t sum = vdupq_n_f32(0.0f);
+		for (uint32_t t = 0; t < taps.tapCount; t++)
+		{
+			// Separate multiply + add, so results match the scalar reference
+			sum = vaddq_f32(sum, vmulq_n_f32(vld1q_f32(src + indices[t] * 4), weights[t]));
+		}
+		vst1q_f32(out + x * 4, sum);
+	}
+	return dstWidth;
+}
+
+static uint32_t filterColumnSimd(const float* const* rows, const float* weights, uint32_t tapCount,
+	float* out, uint32_t count)
+{
+	uint32_t i = 0;
+	for (; i + 4 <= count; i += 4)
+	{
+		float32x4_t sum = vdupq_n_f32(0.0f);
+		for (uint32_t t = 0; t < tapCount; t++)
+		{
+			sum = vaddq_f32(sum, vmulq_n_f32(vld1q_f32(rows[t] + i), weights[t]));
+		}
+		vst1q_f32(out + i, sum);
+	}
+	return i;
+}
+
+#else
+
+// No SIMD available, everything goes through the scalar kernels
+static uint32_t rowToFloatSimd(const unsigned char*, float*, uint32_t, bool) { return 0; }
+static uint32_t rowFromFloatSimd(const float*, unsigned char*, uint32_t, bool) { return 0; }
+static uint32_t boxDownsampleRowSimd(const unsigned char*, const unsigned char*, uint32_t, unsigned char*, uint32_t) { return 0; }
+static uint32_t boxDownsampleRowFloatSimd(const float*, const float*, uint32_t, float*, uint32_t) { return 0; }
+static uint32_t filterRowSimd(const float*, float*, uint32_t, const FilterTaps&) { return 0; }
+static uint32_t filterColumnSimd(const float* const*, const float*, uint32_t, float*, uint32_t) { return 0; }
+
+#endif
+
+// -- Drivers -- //
+
+static void rowToFloat(const unsigned char* src, float* dst, uint32_t pixels, bool srgb, bool simd)
+{
+	uint32_t done = simd ? rowToFloatSimd(src, dst, pixels * 4, srgb) : 0;
+	rowToFloatScalar(src, dst, done, pixels * 4, srgb);
+}
+
+static void rowFromFloat(const float* src, unsigned char* dst, uint32_t pixels, bool srgb, bool simd)
+{
+	uint32_t done = simd ? rowFromFloatSimd(src, dst, pixels * 4, srgb) : 0;
+	rowFromFloatScalar(src, dst, done, pixels * 4, srgb);
+}
+
+static void downsample(const unsigned char* src, uint32_t srcWidth, uint32_t srcHeight,
+	unsigned char* dst, uint32_t dstWidth, uint32_t dstHeight, bool srgb, bool simd)
+{
+	std::vector<float> row0Float, row1Float, outFloat;
+	if (srgb)
+	{
+		row0Float.resize(static_cast<size_t>(srcWidth) * 4);
+		row1Float.resize(static_cast<size_t>(srcWidth) * 4);
+		outFloat.resize(static_cast<size_t>(dstWidth) * 4);
+	}
+
+	for (uint32_t y = 0; y < dstHeight; y++)
+	{
+		// Odd sizes (or a side that's already 1) reuse the last row
+		uint32_t y0 = std::min(y * 2, srcHeight - 1);
+		uint32_t y1 = std::min(y * 2 + 1, srcHeight - 1);
+		const unsigned char* row0 = src + static_cast<size_t>(y0) * srcWidth * 4;
+		const unsigned char* row1 = src + static_cast<size_t>(y1) * srcWidth * 4;
+		unsigned char* out = dst + static_cast<size_t>(y) * dstWidth * 4;
+
+		if (!srgb)
+		{
+			// Straight 8 bit averages
+			uint32_t done = simd ? boxDownsampleRowSimd(row0, row1, srcWidth, out, dstWidth) : 0;
+			boxDownsampleRowScalar(row0, row1, srcWidth, out, done, dstWidth);
+			continue;
+		}
+
+		// Average in linear space
+		rowToFloat(row0, row0Float.data(), srcWidth, true, simd);
+		rowToFloat(row1, row1Float.data(), srcWidth, true, simd);
+		uint32_t done = simd ? boxDownsampleRowFloatSimd(row0Float.data(), row1Float.data(), srcWidth, outFloat.data(), dstWidth) : 0;
+		boxDownsampleRowFloatScalar(row0Float.data(), row1Float.data(), srcWidth, outFloat.data(), done, dstWidth);
+		rowFromFloat(outFloat.data(), out, dstWidth, true, simd);
+	}
+}
+
+static void resize(const unsigned char* src, uint32_t srcWidth, uint32_t srcHeight,
+	unsigned char* dst, uint32_t dstWidth, uint32_t dstHeight, TextureFilter filter, bool srgb, bool simd)
+{
+	FilterTaps horizontal = calculateFilterTaps(filter, srcWidth, dstWidth);
+	FilterTaps vertical = calculateFilterTaps(filter, srcHeight, dstHeight);
+
+	// Horizontally filtered source rows are kept in a small ring, big enough for every row one output row needs
+	uint32_t ringRows = vertical.tapCount;
+	size_t dstRowFloats = static_cast<size_t>(dstWidth) * 4;
+	std::vector<float> ring(ringRows * dstRowFloats);
+	std::vector<int64_t> ringSourceRow(ringRows, -1);
+
+	std::vector<float> srcRow(static_cast<size_t>(srcWidth) * 4);
+	std::vector<float> outRow(dstRowFloats);
+	std::vector<const float*> tapRows(vertical.tapCount);
+
+	for (uint32_t y = 0; y < dstHeight; y++)
+	{
+		const uint32_t* indices = &vertical.indices[static_cast<size_t>(y) * vertical.tapCount];
+		const float* weights = &vertical.weights[static_cast<size_t>(y) * vertical.tapCount];
+
+		for (uint32_t t = 0; t < vertical.tapCount; t++)
+		{
+			// Rows used by one output row are consecutive (after clamping), so they never share a ring slot
+			uint32_t sourceRow = indices[t];
+			uint32_t slot = sourceRow % ringRows;
+			float* filtered = &ring[slot * dstRowFloats];
+			if (ringSourceRow[slot] != sourceRow)
+			{
+				rowToFloat(src + static_cast<size_t>(sourceRow) * srcWidth * 4, srcRow.data(), srcWidth, srgb, simd);
+				if (!simd || filterRowSimd(srcRow.data(), filtered, dstWidth, horizontal) < dstWidth)
+				{
+					filterRowScalar(srcRow.data(), filtered, dstWidth, horizontal);
+				}
+				ringSourceRow[slot] = sourceRow;
+			}
+			tapRows[t] = filtered;
+		}
+
+		uint32_t count = static_cast<uint32_t>(dstRowFloats);
+		uint32_t done = simd ? filterColumnSimd(tapRows.data(), weights, vertical.tapCount, outRow.data(), count) : 0;
+		filterColumnScalar(tapRows.data(), weights, vertical.tapCount, outRow.data(), done, count);
+
+		rowFromFloat(outRow.data(), dst + static_cast<size_t>(y) * dstRowFloats, dstWidth, srgb, simd);
+	}
+}
+
+// -- Public Functions -- //
+
+uint32_t calculateMipLevels(uint32_t width, uint32_t height)
+{
+	// Halve the biggest side until it reaches 1
+	uint32_t levels = 1;
+	uint32_t size = std::max(width, height);
+	while (size > 1)
+	{
+		size /= 2;
+		levels++;
+	}
+	return levels;
+}
+
+const char* getTextureSimdName()
+{
+#if defined(TEXTURE_SIMD_AVX2)
+	return "AVX2";
+#elif defined(TEXTURE_SIMD_SSE2)
+	return "SSE2";
+#elif defined(TEXTURE_SIMD_NEON)
+	return "NEON";
+#else
+	return "Scalar";
+#endif
+}
+
+void downsampleRGBA8(const unsigned char* src, uint32_t srcWidth, uint32_t srcHeight,
+	unsigned char* dst, uint32_t dstWidth, uint32_t dstHeight, bool srgb)
+{
+	downsample(src, srcWidth, srcHeight, dst, dstWidth, dstHeight, srgb, true);
+}
+
+void downsampleRGBA8Scalar(const unsigned char* src, uint32_t srcWidth, uint32_t srcHeight,
+	unsigned char* dst, uint32_t dstWidth, uint32_t dstHeight, bool srgb)
+{
+	downsample(src, srcWidth, srcHeight, dst, dstWidth, dstHeight, srgb, false);
+}
+
+void resizeRGBA8(const unsigned char* src, uint32_t srcWidth, uint32_t srcHeight,
+	unsigned char* dst, uint32_t dstWidth, uint32_t dstHeight, TextureFilter filter, bool srgb)
+{
+	resize(src, srcWidth, srcHeight, dst, dstWidth, dstHeight, filter, srgb, true);
+}
+
+void resizeRGBA8Scalar(const unsigned char* src, uint32_t srcWidth, uint32_t srcHeight,
+	unsigned char* dst, uint32_t dstWidth, uint32_t dstHeight, TextureFilter filter, bool srgb)
+{
+	resize(src, srcWidth, srcHeight, dst, dstWidth, dstHeight, filter, srgb, false);
+}
+
+std::vector<MipLevel> generateMipChain(const unsigned char* pixels, uint32_t width, uint32_t height, uint32_t mipLevels,
+	TextureFilter filter, bool srgb)
+{
+	std::vector<MipLevel> levels;
+	if (mipLevels > 1)
+	{
+		levels.reserve(mipLevels - 1);
+	}
+
+	const unsigned char* src = pixels;
+	uint32_t srcWidth = width;
+	uint32_t srcHeight = height;
+	for (uint32_t i = 1; i < mipLevels; i++)
+	{
+		MipLevel level;
+		level.width = std::max(1u, srcWidth / 2);
+		level.height = std::max(1u, srcHeight / 2);
+		level.pixels.resize(static_cast<size_t>(level.width) * level.height * 4);
+		if (filter == TextureFilter::Box)
+		{
+			downsampleRGBA8(src, srcWidth, srcHeight, level.pixels.data(), level.width, level.height, srgb);
+		}
+		else
+		{
+			resizeRGBA8(src, srcWidth, srcHeight, level.pixels.data(), level.width, level.height, filter, srgb);
+		}
+		levels.push_back(std::move(level));
+
+		// Each level is made from the previous one
+		src = levels.back().pixels.data();
+		srcWidth = levels.back().width;
+		srcHeight = levels.back().height;
+	}
+
+	return levels;
+}
+
+std::vector<unsigned char> packChannelsRGBA8(const unsigned char* pixels, uint32_t width, uint32_t height, uint32_t channels)
+{
+	size_t pixelCount = static_cast<size_t>(width) * height;
+	std::vector<unsigned char> packed(pixelCount * channels);
+	for (size_t i = 0; i < pixelCount; i++)
+	{
+		for (uint32_t c = 0; c < channels; c++)
+		{
+			packed[i * channels + c] = pixels[i * 4 + c];
+		}
+	}
+	return packed;
+}
+
+void copyChannelRGBA8(const unsigned char* src, uint32_t srcChannel, unsigned char* dst, uint32_t dstChannel,
+	uint32_t width, uint32_t height)
+{
+	size_t pixelCount = static_cast<size_t>(width) * height;
+	for (size_t i = 0; i < pixelCount; i++)
+	{
+		dst[i * 4 + dstChannel] = src[i * 4 + srcChannel];
+	}
+}
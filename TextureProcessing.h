@@ -0,0 +1,53 @@
+#pragma once
+
+#include <stdint.h>
+#include <vector>
+
+// CPU side texture processing: mip chains and resizing for when the GPU can't do it (e.g. no linear blit support for
+// the format), offline texture cooking and quality tier downscaling.
+// All pixel data is tightly packed RGBA8. Nothing in here touches Vulkan, so it can run headless.
+// Kernels use SSE2/AVX2 (x86) or NEON (ARM) depending on what the file is compiled for, the *Scalar versions are the
+// plain C++ reference they're checked and benchmarked against
+
+enum class TextureFilter
+{
+	Box,		// Average of the covered pixels (cheap, slightly blurry)
+	Kaiser		// Kaiser windowed sinc (sharper, keeps detail in lower mip levels)
+};
+
+// One mip level generated on the CPU
+struct MipLevel
+{
+	uint32_t width;
+	uint32_t height;
+	std::vector<unsigned char> pixels;
+};
+
+// Number of levels in a full mip chain down to 1x1
+uint32_t calculateMipLevels(uint32_t width, uint32_t height);
+
+// Name of the instruction set the kernels were built with ("AVX2", "SSE2", "NEON" or "Scalar")
+const char* getTextureSimdName();
+
+// Average 2x2 blocks of src into dst (dst is half the size, rounded down, at least 1).
+// With srgb the colour channels are averaged in linear space (alpha always is linear)
+void downsampleRGBA8(const unsigned char* src, uint32_t srcWidth, uint32_t srcHeight,
+	unsigned char* dst, uint32_t dstWidth, uint32_t dstHeight, bool srgb);
+void downsampleRGBA8Scalar(const unsigned char* src, uint32_t srcWidth, uint32_t srcHeight,
+	unsigned char* dst, uint32_t dstWidth, uint32_t dstHeight, bool srgb);
+
+// Resize src to any size with a separable filter (edges are clamped)
+void resizeRGBA8(const unsigned char* src, uint32_t srcWidth, uint32_t srcHeight,
+	unsigned char* dst, uint32_t dstWidth, uint32_t dstHeight, TextureFilter filter, bool srgb);
+void resizeRGBA8Scalar(const unsigned char* src, uint32_t srcWidth, uint32_t srcHeight,
+	unsigned char* dst, uint32_t dstWidth, uint32_t dstHeight, TextureFilter filter, bool srgb);
+
+// Generate levels 1..mipLevels-1 from level 0 (level 0 itself isn't copied)
+std::vector<MipLevel> generateMipChain(const unsigned char* pixels, uint32_t width, uint32_t height, uint32_t mipLevels,
+	TextureFilter filter, bool srgb);
+
+// Keep only the first channels channels of each pixel (e.g. X/Y of a normal map), for R8/R8G8 images
+std::vector<unsigned char> packChannelsRGBA8(const unsigned char* pixels, uint32_t width, uint32_t height, uint32_t channels);
+// Copy one channel of src into one channel of dst (same size), for packing single channel maps into one texture
+void copyChannelRGBA8(const unsigned char* src, uint32_t srcChannel, unsigned char* dst, uint32_t dstChannel,
+	uint32_t width, uint32_t height);
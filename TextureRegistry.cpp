@@ -0,0 +1,134 @@
+#include "TextureRegistry.h"
+
+#include <cctype>
+#include <cstdio>
+#include <stdexcept>
+#include <vector>
+
+TextureRegistry::TextureRegistry()
+{
+}
+
+std::string TextureRegistry::makePathKey(const std::string& path)
+{
+	// Split on either slash, dropping "." and resolving ".." where we can
+	std::vector<std::string> parts;
+	std::string part;
+	for (size_t i = 0; i <= path.size(); i++)
+	{
+		if (i == path.size() || path[i] == '/' || path[i] == '\\')
+		{
+			if (part == ".." && !parts.empty() && parts.back() != "..")
+			{
+				parts.pop_back();
+			}
+			else if (!part.empty() && part != ".")
+			{
+				parts.push_back(part);
+			}
+			part.clear();
+		}
+		else
+		{
+			// File names aren't case sensitive on Windows
+			part += static_cast<char>(std::tolower(static_cast<unsigned char>(path[i])));
+		}
+	}
+
+	std::string key = "file:";
+	for (size_t i = 0; i < parts.size(); i++)
+	{
+		key += (i > 0 ? "/" : "") + parts[i];
+	}
+	return key;
+}
+
+std::string TextureRegistry::makeContentKey(const void* data, size_t size)
+{
+	// 64 bit FNV-1a hash of the data, plus the size to make collisions even less likely
+	const unsigned char* bytes = static_cast<const unsigned char*>(data);
+	uint64_t hash = 14695981039346656037ull;
+	for (size_t i = 0; i < size; i++)
+	{
+		hash ^= bytes[i];
+		hash *= 1099511628211ull;
+	}
+
+	char key[64];
+	snprintf(key, sizeof(key), "data:%016llx:%llu", static_cast<unsigned long long>(hash), static_cast<unsigned long long>(size));
+	return key;
+}
+
+std::string TextureRegistry::makeDerivedKey(const std::string& usage, const std::vector<std::string>& sourceKeys)
+{
+	// Missing sources stay as empty entries, so the same key in another place is still a different texture
+	std::string key = usage + "(";
+	for (size_t i = 0; i < sourceKeys.size(); i++)
+	{
+		key += (i > 0 ? "|" : "") + sourceKeys[i];
+	}
+	return key + ")";
+}
+
+bool TextureRegistry::contains(const std::string& key)
+{
+	std::lock_guard<std::mutex> lock(entriesMutex);
+	return entries.count(key) > 0;
+}
+
+int TextureRegistry::acquire(const std::string& key)
+{
+	std::lock_guard<std::mutex> lock(entriesMutex);
+	auto entry = entries.find(key);
+	if (entry == entries.end())
+	{
+		return -1;
+	}
+
+	entry->second.refCount++;
+	return entry->second.textureId;
+}
+
+void TextureRegistry::add(const std::string& key, int textureId)
+{
+	std::lock_guard<std::mutex> lock(entriesMutex);
+	if (entries.count(key) > 0)
+	{
+		throw std::runtime_error("Texture registered twice! (" + key + ")");
+	}
+
+	entries[key] = { textureId, 1 };
+	keys[textureId] = key;
+}
+
+bool TextureRegistry::release(int textureId)
+{
+	std::lock_guard<std::mutex> lock(entriesMutex);
+	auto key = keys.find(textureId);
+	if (key == keys.end())
+	{
+		// Not a registered texture (e.g. the default one)
+		return false;
+	}
+
+	Entry& entry = entries[key->second];
+	if (--entry.refCount > 0)
+	{
+		return false;
+	}
+
+	entries.erase(key->second);
+	keys.erase(key);
+	return true;
+}
+
+void TextureRegistry::cleanup()
+{
+	std::lock_guard<std::mutex> lock(entriesMutex);
+	entries.clear();
+	keys.clear();
+}
+
+TextureRegistry::~TextureRegistry()
+{
+}
@@ -0,0 +1,48 @@
+#pragma once
+
+#include <stdint.h>
+#include <string>
+#include <vector>
+#include <unordered_map>
+#include <mutex>
+
+// Keeps track of which textures are already loaded, so a texture used by several materials/models is only decoded,
+// uploaded and given a descriptor set once. Textures are keyed by their canonical path (or a hash of their contents,
+// for textures embedded in model files) and reference counted; IDs are the renderer's texture descriptor indices.
+// Lookups are thread safe, so loader threads can skip decoding textures that are already there
+class TextureRegistry
+{
+public:
+	TextureRegistry();
+
+	// Same file always gives the same key, however its path was written
+	static std::string makePathKey(const std::string& path);
+	// Key for texture data without a file (e.g. embedded in a model)
+	static std::string makeContentKey(const void* data, size_t size);
+	// Key for a texture made out of others (e.g. some of their channels), by what it's made with and from
+	static std::string makeDerivedKey(const std::string& usage, const std::vector<std::string>& sourceKeys);
+
+	bool contains(const std::string& key);
+
+	// Add a reference to a registered texture, returns its ID (or -1 if it isn't registered)
+	int acquire(const std::string& key);
+	// Register a newly created texture, holding its first reference
+	void add(const std::string& key, int textureId);
+	// Drop a reference, returns true if it was the last one (the texture can be destroyed)
+	bool release(int textureId);
+
+	void cleanup();
+
+	~TextureRegistry();
+
+private:
+	struct Entry
+	{
+		int textureId;
+		uint32_t refCount;
+	};
+
+	std::mutex entriesMutex;
+	std::unordered_map<std::string, Entry> entries;
+	std::unordered_map<int, std::string> keys;		// Texture ID -> key, for releasing by ID
+};
@@ -0,0 +1,272 @@
+#include "TextureStreamer.h"
+
+#include <algorithm>
+
+#include "Utilities.h"
+
+TextureStreamer::TextureStreamer()
+{
+}
+
+void TextureStreamer::init(MemoryAllocator* newAllocator, VkDevice newDevice, uint32_t newMaxTextures,
+	uint32_t newFrameCount, VkDeviceSize newBudget, VkDeviceSize newUploadLimit, uint32_t newTailSize,
+	uint32_t newIdleFrames)
+{
+	allocator = newAllocator;
+	device = newDevice;
+	maxTextures = newMaxTextures;
+	frameCount = newFrameCount;
+	budget = newBudget;
+	uploadLimit = newUploadLimit;
+	tailSize = newTailSize;
+	idleFrames = newIdleFrames;
+
+	// Written by the CPU & GPU every frame and read back by the CPU, so it lives in host visible memory
+	createBuffer(device, allocator, getBufferSize(), VK_BUFFER_USAGE_STORAGE_BUFFER_BIT,
+		VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, &streamingBuffer, &streamingBufferMemory);
+
+	GpuTextureStreaming emptyEntry = { 0, 0, TEXTURE_FEEDBACK_NONE, 0 };
+	currentEntries.assign(maxTextures, emptyEntry);
+	staleEntries.assign(frameCount, std::vector<int>());
+	textures.resize(maxTextures);
+	for (uint32_t frame = 0; frame < frameCount; frame++)
+	{
+		std::fill(getEntries(frame), getEntries(frame) + maxTextures, emptyEntry);
+	}
+}
+
+void TextureStreamer::setTextureEntry(int textureId, uint32_t slot, uint32_t baseLevel)
+{
+	currentEntries[textureId].slot = slot;
+	currentEntries[textureId].baseLevel = baseLevel;
+	for (uint32_t frame = 0; frame < frameCount; frame++)
+	{
+		getEntries(frame)[textureId] = currentEntries[textureId];
+	}
+}
+
+void TextureStreamer::updateTextureEntry(int textureId, uint32_t slot, uint32_t baseLevel, uint32_t frame)
+{
+	currentEntries[textureId].slot = slot;
+	currentEntries[textureId].baseLevel = baseLevel;
+
+	// Frame's fence has signalled, nothing reads its copy
+	GpuTextureStreaming& entry = getEntries(frame)[textureId];
+	entry.slot = slot;
+	entry.baseLevel = baseLevel;
+
+	for (uint32_t otherFrame = 0; otherFrame < frameCount; otherFrame++)
+	{
+		if (otherFrame != frame)
+		{
+			staleEntries[otherFrame].push_back(textureId);
+		}
+	}
+}
+
+uint32_t TextureStreamer::getTailLevel(const TextureFile& file)
+{
+	uint32_t level = 0;
+	while (level + 1 < file.levels.size() && std::max(file.levels[level].width, file.levels[level].height) > tailSize)
+	{
+		level++;
+	}
+	return level;
+}
+
+void TextureStreamer::addTexture(int textureId, TextureFile file, std::shared_ptr<MappedFile> mappedFile,
+	uint32_t baseLevel)
+{
+	StreamedTexture& texture = textures[textureId];
+	texture.streamed = true;
+	texture.file = std::move(file);
+	texture.mappedFile = mappedFile;
+	texture.tailLevel = std::max(baseLevel, getTailLevel(texture.file));
+	texture.residentLevel = baseLevel;
+	texture.wantedLevel = texture.tailLevel;
+	texture.lastUsedFrame = frameNumber;
+	residentBytes += getResidentSize(texture, baseLevel);
+}
+
+void TextureStreamer::removeTexture(int textureId)
+{
+	StreamedTexture& texture = textures[textureId];
+	if (texture.streamed)
+	{
+		residentBytes -= getResidentSize(texture, texture.residentLevel);
+	}
+	texture = StreamedTexture();
+}
+
+const TextureFile& TextureStreamer::getTextureFile(int textureId)
+{
+	return textures[textureId].file;
+}
+
+void TextureStreamer::beginFrame(uint32_t frame)
+{
+	frameNumber++;
+
+	GpuTextureStreaming* entries = getEntries(frame);
+	for (int textureId : staleEntries[frame])
+	{
+		entries[textureId].slot = currentEntries[textureId].slot;
+		entries[textureId].baseLevel = currentEntries[textureId].baseLevel;
+	}
+	staleEntries[frame].clear();
+
+	// Take the levels the frame asked for, and clear them for its next use
+	for (uint32_t textureId = 0; textureId < maxTextures; textureId++)
+	{
+		uint32_t feedback = entries[textureId].feedback;
+		if (feedback == TEXTURE_FEEDBACK_NONE)
+		{
+			continue;
+		}
+		entries[textureId].feedback = TEXTURE_FEEDBACK_NONE;
+
+		StreamedTexture& texture = textures[textureId];
+		if (texture.streamed)
+		{
+			texture.wantedLevel = std::min(feedback, texture.tailLevel);
+			texture.lastUsedFrame = frameNumber;
+		}
+	}
+}
+
+std::vector<TextureResidencyChange> TextureStreamer::planChanges(uint32_t maxChanges)
+{
+	std::vector<TextureResidencyChange> changes;
+	std::vector<bool> changed(maxTextures, false);
+
+	// Textures sampled lately that want finer levels than they have, biggest difference first
+	std::vector<int> upgrades;
+	for (uint32_t textureId = 0; textureId < maxTextures; textureId++)
+	{
+		const StreamedTexture& texture = textures[textureId];
+		if (texture.streamed && texture.wantedLevel < texture.residentLevel && frameNumber - texture.lastUsedFrame <= idleFrames)
+		{
+			upgrades.push_back(textureId);
+		}
+	}
+	std::sort(upgrades.begin(), upgrades.end(), [this](int a, int b) {
+		return textures[a].residentLevel - textures[a].wantedLevel > textures[b].residentLevel - textures[b].wantedLevel;
+	});
+
+	// New images hold all their levels, so uploads are the whole new chain
+	VkDeviceSize uploadBytes = 0;
+	for (int textureId : upgrades)
+	{
+		if (changes.size() >= maxChanges)
+		{
+			break;
+		}
+
+		// As many of the wanted levels as the upload limit allows (always at least one level, for huge textures)
+		StreamedTexture& texture = textures[textureId];
+		uint32_t baseLevel = texture.wantedLevel;
+		while (baseLevel + 1 < texture.residentLevel && uploadBytes + getResidentSize(texture, baseLevel) > uploadLimit)
+		{
+			baseLevel++;
+		}
+		if (uploadBytes + getResidentSize(texture, baseLevel) > uploadLimit && !changes.empty())
+		{
+			break;
+		}
+
+		// Make room by evicting levels, least recently used textures first (only levels they don't need anymore)
+		VkDeviceSize extraBytes = getResidentSize(texture, baseLevel) - getResidentSize(texture, texture.residentLevel);
+		while (residentBytes + extraBytes > budget && changes.size() + 1 < maxChanges)
+		{
+			int victimId = -1;
+			for (uint32_t otherId = 0; otherId < maxTextures; otherId++)
+			{
+				const StreamedTexture& other = textures[otherId];
+				if (other.streamed && !changed[otherId] && static_cast<int>(otherId) != textureId &&
+					other.residentLevel < getEvictionLevel(other) &&
+					(victimId < 0 || other.lastUsedFrame < textures[victimId].lastUsedFrame))
+				{
+					victimId = otherId;
+				}
+			}
+			if (victimId < 0)
+			{
+				break;
+			}
+
+			StreamedTexture& victim = textures[victimId];
+			uint32_t victimLevel = getEvictionLevel(victim);
+			residentBytes -= getResidentSize(victim, victim.residentLevel) - getResidentSize(victim, victimLevel);
+			uploadBytes += getResidentSize(victim, victimLevel);
+			victim.residentLevel = victimLevel;
+			changed[victimId] = true;
+			changes.push_back({ victimId, victimLevel });
+		}
+		if (residentBytes + extraBytes > budget)
+		{
+			// Budget is full of textures that are all in use
+			break;
+		}
+
+		residentBytes += extraBytes;
+		uploadBytes += getResidentSize(texture, baseLevel);
+		texture.residentLevel = baseLevel;
+		changed[textureId] = true;
+		changes.push_back({ textureId, baseLevel });
+	}
+
+	return changes;
+}
+
+VkBuffer TextureStreamer::getBuffer()
+{
+	return streamingBuffer;
+}
+
+VkDeviceSize TextureStreamer::getBufferSize()
+{
+	return static_cast<VkDeviceSize>(frameCount) * maxTextures * sizeof(GpuTextureStreaming);
+}
+
+uint32_t TextureStreamer::getFrameOffset(uint32_t frame)
+{
+	return frame * maxTextures;
+}
+
+void TextureStreamer::cleanup()
+{
+	destroyBuffer(device, allocator, streamingBuffer, &streamingBufferMemory);
+	streamingBuffer = VK_NULL_HANDLE;
+	currentEntries.clear();
+	staleEntries.clear();
+	textures.clear();
+	residentBytes = 0;
+}
+
+TextureStreamer::~TextureStreamer()
+{
+}
+
+GpuTextureStreaming* TextureStreamer::getEntries(uint32_t frame)
+{
+	return static_cast<GpuTextureStreaming*>(streamingBufferMemory.mapped) + getFrameOffset(frame);
+}
+
+VkDeviceSize TextureStreamer::getResidentSize(const StreamedTexture& texture, uint32_t baseLevel)
+{
+	VkDeviceSize size = 0;
+	for (size_t i = baseLevel; i < texture.file.levels.size(); i++)
+	{
+		size += texture.file.levels[i].size;
+	}
+	return size;
+}
+
+uint32_t TextureStreamer::getEvictionLevel(const StreamedTexture& texture)
+{
+	if (frameNumber - texture.lastUsedFrame > idleFrames)
+	{
+		return texture.tailLevel;
+	}
+	return std::max(texture.wantedLevel, texture.residentLevel);
+}
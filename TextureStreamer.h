@@ -0,0 +1,109 @@
+#pragma once
+
+#define GLFW_INCLUDE_VULKAN
+#include <GLFW/glfw3.h>
+
+#include <stdexcept>
+#include <vector>
+#include <memory>
+
+#include "MemoryAllocator.h"
+#include "TextureFile.h"
+#include "MappedFile.h"
+
+// Feedback value of a texture no fragment asked for
+const uint32_t TEXTURE_FEEDBACK_NONE = 0xFFFFFFFF;
+
+// Streaming buffer entry of a texture, one per texture per frame in flight (std430 layout, keep in sync with shader.frag)
+struct GpuTextureStreaming
+{
+	uint32_t slot;			// Element of the texture descriptor array holding the texture's current image
+	uint32_t baseLevel;		// Level of the full mip chain the current image starts at
+	uint32_t feedback;		// Finest level of the full chain fragments asked for (written by the GPU)
+	uint32_t padding;
+};
+
+// New first resident level for a texture
+struct TextureResidencyChange
+{
+	int textureId;
+	uint32_t baseLevel;
+};
+
+// Decides which mip levels of each texture are on the GPU. Textures start with just their mip tail (levels no bigger
+// than the tail size); the fragment shader reports the finest level it would sample for each texture into the
+// streaming buffer, and levels are added for textures that ask for more and dropped from ones that haven't been used
+// for a while once the budget runs out.
+// Residency changes are made by swapping in a new image with the new levels under a new descriptor slot. Frames in
+// flight still use the old slot, so each frame has its own copy of the entries, brought up to date once the frame's
+// fence has signalled
+class TextureStreamer
+{
+public:
+	TextureStreamer();
+
+	void init(MemoryAllocator* newAllocator, VkDevice newDevice, uint32_t newMaxTextures, uint32_t newFrameCount,
+		VkDeviceSize newBudget, VkDeviceSize newUploadLimit, uint32_t newTailSize, uint32_t newIdleFrames);
+
+	// Point a new texture at its image in every frame (no frame uses the texture yet)
+	void setTextureEntry(int textureId, uint32_t slot, uint32_t baseLevel);
+	// Point a texture at a new image: the given frame's entry right away, the others' as each of them begins
+	void updateTextureEntry(int textureId, uint32_t slot, uint32_t baseLevel, uint32_t frame);
+
+	// Levels of a newly created texture that go on the GPU first (its mip tail)
+	uint32_t getTailLevel(const TextureFile& file);
+	// Stream a texture's levels out of file (its data must stay valid, so mappedFile is kept too)
+	void addTexture(int textureId, TextureFile file, std::shared_ptr<MappedFile> mappedFile, uint32_t baseLevel);
+	void removeTexture(int textureId);
+	const TextureFile& getTextureFile(int textureId);
+
+	// The frame's fence has signalled: bring its entries up to date and collect the levels it asked for
+	void beginFrame(uint32_t frame);
+	// Residency changes to make now (at most maxChanges), within the budget and the upload limit. They count as made
+	std::vector<TextureResidencyChange> planChanges(uint32_t maxChanges);
+
+	VkBuffer getBuffer();
+	VkDeviceSize getBufferSize();
+	// First entry of the frame's copy, pushed to the fragment shader
+	uint32_t getFrameOffset(uint32_t frame);
+
+	void cleanup();
+
+	~TextureStreamer();
+
+private:
+	struct StreamedTexture
+	{
+		bool streamed = false;
+		TextureFile file;
+		std::shared_ptr<MappedFile> mappedFile;
+		uint32_t tailLevel = 0;			// Coarsest level it's ever dropped to
+		uint32_t residentLevel = 0;		// First level on the GPU (or being uploaded)
+		uint32_t wantedLevel = 0;		// Finest level frames asked for lately
+		uint64_t lastUsedFrame = 0;		// Last frame that sampled it
+	};
+
+	VkDevice device = VK_NULL_HANDLE;
+	MemoryAllocator* allocator = nullptr;
+	uint32_t maxTextures = 0;
+	uint32_t frameCount = 0;
+	VkDeviceSize budget = 0;
+	VkDeviceSize uploadLimit = 0;
+	uint32_t tailSize = 0;
+	uint32_t idleFrames = 0;		// Frames without being sampled before a texture's levels can be evicted
+
+	// Host visible (persistently mapped) entries of every frame, frameCount copies of maxTextures entries
+	VkBuffer streamingBuffer = VK_NULL_HANDLE;
+	MemoryAllocation streamingBufferMemory;
+
+	std::vector<GpuTextureStreaming> currentEntries;		// Latest slot & base level of each texture
+	std::vector<std::vector<int>> staleEntries;				// Per frame: textures whose entry it doesn't have yet
+	std::vector<StreamedTexture> textures;					// Indexed by texture ID
+	VkDeviceSize residentBytes = 0;							// Levels of all streamed textures on the GPU
+	uint64_t frameNumber = 0;
+
+	GpuTextureStreaming* getEntries(uint32_t frame);
+	VkDeviceSize getResidentSize(const StreamedTexture& texture, uint32_t baseLevel);
+	// Coarsest level a texture may drop to: the tail if it's been idle, else the one it asked for
+	uint32_t getEvictionLevel(const StreamedTexture& texture);
+};
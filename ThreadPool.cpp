@@ -0,0 +1,73 @@
+#include "ThreadPool.h"
+
+ThreadPool::ThreadPool()
+{
+}
+
+void ThreadPool::init(uint32_t threadCount)
+{
+	stopping = false;
+	for (uint32_t i = 0; i < threadCount; i++)
+	{
+		workers.emplace_back(&ThreadPool::workerLoop, this);
+	}
+}
+
+std::future<void> ThreadPool::submit(std::function<void()> job)
+{
+	std::packaged_task<void()> task(job);
+	std::future<void> result = task.get_future();
+	{
+		std::lock_guard<std::mutex> lock(jobsMutex);
+		jobs.push_back(std::move(task));
+	}
+	jobsCondition.notify_one();
+	return result;
+}
+
+uint32_t ThreadPool::getThreadCount()
+{
+	return static_cast<uint32_t>(workers.size());
+}
+
+void ThreadPool::cleanup()
+{
+	{
+		std::lock_guard<std::mutex> lock(jobsMutex);
+		stopping = true;
+	}
+	jobsCondition.notify_all();
+
+	for (auto& worker : workers)
+	{
+		worker.join();
+	}
+	workers.clear();
+}
+
+ThreadPool::~ThreadPool()
+{
+}
+
+void ThreadPool::workerLoop()
+{
+	while (true)
+	{
+		std::packaged_task<void()> task;
+		{
+			std::unique_lock<std::mutex> lock(jobsMutex);
+			jobsCondition.wait(lock, [this] { return stopping || !jobs.empty(); });
+
+			// Queue is drained before the workers stop, so nobody waits on a job that never runs
+			if (jobs.empty())
+			{
+				return;
+			}
+			task = std::move(jobs.front());
+			jobs.pop_front();
+		}
+
+		// Exceptions are stored in the task's future
+		task();
+	}
+}
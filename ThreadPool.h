@@ -0,0 +1,38 @@
+#pragma once
+
+#include <vector>
+#include <deque>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <functional>
+#include <future>
+
+// Fixed set of worker threads running queued jobs (asset parsing, texture decoding, etc).
+// Jobs must not touch Vulkan objects that are used from the main thread
+class ThreadPool
+{
+public:
+	ThreadPool();
+
+	void init(uint32_t threadCount);
+
+	// Queue a job, the returned future becomes ready once it ran (and rethrows anything it threw)
+	std::future<void> submit(std::function<void()> job);
+
+	uint32_t getThreadCount();
+
+	// Finish all queued jobs and join the workers
+	void cleanup();
+
+	~ThreadPool();
+
+private:
+	std::vector<std::thread> workers;
+	std::deque<std::packaged_task<void()>> jobs;
+	std::mutex jobsMutex;
+	std::condition_variable jobsCondition;
+	bool stopping = false;
+
+	void workerLoop();
+};
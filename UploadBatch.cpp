@@ -0,0 +1,384 @@
+#include "UploadBatch.h"
+
+#include <algorithm>
+#include <cstring>
+#include <limits>
+
+UploadBatch::UploadBatch()
+{
+}
+
+void UploadBatch::begin(StagingRing* newStagingRing, VkDevice newDevice, UploadQueue newTransferQueue, UploadQueue newGraphicsQueue)
+{
+	if (commandBuffer != VK_NULL_HANDLE || !submittedCommandBuffers.empty())
+	{
+		throw std::runtime_error("Upload batch is already recording or hasn't been waited for!");
+	}
+
+	stagingRing = newStagingRing;
+	device = newDevice;
+	transferQueue = newTransferQueue;
+	graphicsQueue = newGraphicsQueue;
+	ownershipTransfer = transferQueue.familyIndex != graphicsQueue.familyIndex;
+	submitted = false;
+	stagedBytes = 0;
+
+	commandBuffer = beginCommandBuffer(device, transferQueue.commandPool);
+}
+
+void UploadBatch::uploadBuffer(const void* data, VkDeviceSize size, VkBuffer dstBuffer, VkDeviceSize dstOffset)
+{
+	const char* src = static_cast<const char*>(data);
+
+	// Big uploads go through the ring in chunks, so they never need the whole ring at once
+	VkDeviceSize maxChunk = stagingRing->getSize() / 4;
+	for (VkDeviceSize done = 0; done < size;)
+	{
+		VkDeviceSize chunk = std::min(size - done, maxChunk);
+		VkDeviceSize stagingOffset = allocateStaging(chunk, 16);
+
+		memcpy(stagingRing->getMappedData(stagingOffset), src + done, static_cast<size_t>(chunk));
+		recordCopyBuffer(commandBuffer, stagingRing->getBuffer(), stagingOffset, dstBuffer, dstOffset + done, chunk);
+
+		done += chunk;
+	}
+
+	if (ownershipTransfer)
+	{
+		releaseBuffer(dstBuffer, dstOffset, size);
+	}
+}
+
+void UploadBatch::uploadImage(const std::vector<ImageLevel>& levels, VkImage image, uint32_t mipLevels)
+{
+	// TRANSITION IMAGE TO THE CORRECT STATE FOR WRITING TO THE IMAGE STAGING BUFFER
+	recordImageLayoutTransition(commandBuffer, image, VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, mipLevels);
+
+	// COPY DATA TO IMAGE
+	for (uint32_t level = 0; level < levels.size(); level++)
+	{
+		const char* src = static_cast<const char*>(levels[level].data);
+		uint32_t height = levels[level].height;
+		uint32_t rowHeight = levels[level].rowHeight;
+
+		// Big images are copied in bands of whole rows (of blocks, for compressed formats)
+		uint32_t dataRows = (height + rowHeight - 1) / rowHeight;
+		VkDeviceSize rowPitch = levels[level].size / dataRows;
+		uint32_t maxRows = static_cast<uint32_t>(std::max<VkDeviceSize>(1, (stagingRing->getSize() / 4) / rowPitch));
+		for (uint32_t row = 0; row < dataRows;)
+		{
+			uint32_t rows = std::min(dataRows - row, maxRows);
+			VkDeviceSize chunk = rows * rowPitch;
+			VkDeviceSize stagingOffset = allocateStaging(chunk, 16);
+
+			// Last band of blocks may cover fewer pixel rows than it holds
+			uint32_t pixelRow = row * rowHeight;
+			uint32_t pixelRows = std::min(rows * rowHeight, height - pixelRow);
+
+			memcpy(stagingRing->getMappedData(stagingOffset), src + row * rowPitch, static_cast<size_t>(chunk));
+			recordCopyImageBuffer(commandBuffer, stagingRing->getBuffer(), stagingOffset, image,
+				levels[level].width, pixelRows, level, static_cast<int32_t>(pixelRow));
+
+			row += rows;
+		}
+	}
+
+	// Generate the missing levels from the last one we copied
+	uint32_t baseLevel = static_cast<uint32_t>(levels.size());
+	bool generateMipmaps = baseLevel < mipLevels;
+
+	// TRANSITION IMAGE TO BE SHADER READABLE FOR SHADER USAGE
+	if (ownershipTransfer)
+	{
+		if (generateMipmaps)
+		{
+			// Blits need a graphics queue, so they're done after the graphics queue takes the image over
+			releaseImage(image, mipLevels, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL);
+			acquireMipGenerations.push_back({ image, levels[0].width, levels[0].height, baseLevel, mipLevels });
+		}
+		else
+		{
+			// Transition happens as part of handing the image over to the graphics queue
+			releaseImage(image, mipLevels, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL);
+		}
+	}
+	else if (generateMipmaps)
+	{
+		// Transfer queue is the graphics queue here, so it can blit
+		recordGenerateMipmaps(commandBuffer, image, levels[0].width, levels[0].height, baseLevel, mipLevels);
+	}
+	else
+	{
+		recordImageLayoutTransition(commandBuffer, image, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL, mipLevels);
+	}
+}
+
+void UploadBatch::submit()
+{
+	if (commandBuffer == VK_NULL_HANDLE || submitted)
+	{
+		throw std::runtime_error("Upload batch has nothing to submit!");
+	}
+
+	bool acquire = !acquireBufferBarriers.empty() || !acquireImageBarriers.empty();
+	if (acquire)
+	{
+		// Graphics queue has to wait for the copies before it can take the resources over
+		VkSemaphoreCreateInfo semaphoreCreateInfo = {};
+		semaphoreCreateInfo.sType = VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO;
+		VkResult result = vkCreateSemaphore(device, &semaphoreCreateInfo, nullptr, &transferFinished);
+		if (result != VK_SUCCESS)
+		{
+			throw std::runtime_error("Failed to create upload semaphore!");
+		}
+	}
+
+	flush(transferFinished);
+	commandBuffer = VK_NULL_HANDLE;
+
+	if (acquire)
+	{
+		submitAcquire();
+	}
+
+	submitted = true;
+}
+
+bool UploadBatch::isFinished()
+{
+	if (!submitted)
+	{
+		return false;
+	}
+
+	// Already finished and released
+	if (submittedCommandBuffers.empty())
+	{
+		return true;
+	}
+
+	bool acquired = acquireFence == VK_NULL_HANDLE || vkGetFenceStatus(device, acquireFence) == VK_SUCCESS;
+	if (acquired && stagingRing->isComplete(lastSubmissionId))
+	{
+		release();
+		return true;
+	}
+	return false;
+}
+
+void UploadBatch::wait()
+{
+	if (!submitted || submittedCommandBuffers.empty())
+	{
+		return;
+	}
+
+	stagingRing->wait(lastSubmissionId);
+	if (acquireFence != VK_NULL_HANDLE)
+	{
+		vkWaitForFences(device, 1, &acquireFence, VK_TRUE, std::numeric_limits<uint64_t>::max());
+	}
+	release();
+}
+
+void UploadBatch::abort()
+{
+	if (commandBuffer != VK_NULL_HANDLE)
+	{
+		// Staging space its copies took goes back to the ring with the next submission
+		vkEndCommandBuffer(commandBuffer);
+		vkFreeCommandBuffers(device, transferQueue.commandPool, 1, &commandBuffer);
+		commandBuffer = VK_NULL_HANDLE;
+	}
+
+	// Copies already submitted may still be writing to the resources being destroyed
+	if (!submittedCommandBuffers.empty())
+	{
+		stagingRing->wait(lastSubmissionId);
+		if (acquireFence != VK_NULL_HANDLE)
+		{
+			vkWaitForFences(device, 1, &acquireFence, VK_TRUE, std::numeric_limits<uint64_t>::max());
+		}
+		release();
+	}
+	if (transferFinished != VK_NULL_HANDLE)
+	{
+		vkDestroySemaphore(device, transferFinished, nullptr);
+		transferFinished = VK_NULL_HANDLE;
+	}
+
+	acquireBufferBarriers.clear();
+	acquireImageBarriers.clear();
+	acquireMipGenerations.clear();
+	stagedBytes = 0;
+	submitted = false;
+}
+
+UploadBatch::~UploadBatch()
+{
+}
+
+VkDeviceSize UploadBatch::allocateStaging(VkDeviceSize size, VkDeviceSize alignment)
+{
+	VkDeviceSize offset;
+	while (!stagingRing->allocate(size, alignment, &offset))
+	{
+		// Ring is full. If part of it is held by our own unsubmitted copies, send them off first
+		if (stagedBytes > 0)
+		{
+			flush(VK_NULL_HANDLE);
+			commandBuffer = beginCommandBuffer(device, transferQueue.commandPool);
+		}
+
+		// Then wait for the oldest upload to free up its space
+		if (!stagingRing->waitForOldest())
+		{
+			throw std::runtime_error("Staging ring is too small for the upload!");
+		}
+	}
+
+	stagedBytes += size;
+	return offset;
+}
+
+void UploadBatch::releaseBuffer(VkBuffer buffer, VkDeviceSize offset, VkDeviceSize size)
+{
+	// Release half of the ownership transfer, recorded on the transfer queue
+	VkBufferMemoryBarrier bufferMemoryBarrier = {};
+	bufferMemoryBarrier.sType = VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER;
+	bufferMemoryBarrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;			// Make copies available...
+	bufferMemoryBarrier.dstAccessMask = 0;										// ...access on the other queue is set by the acquire
+	bufferMemoryBarrier.srcQueueFamilyIndex = transferQueue.familyIndex;		// Queue family to transfer ownership from
+	bufferMemoryBarrier.dstQueueFamilyIndex = graphicsQueue.familyIndex;		// Queue family to transfer ownership to
+	bufferMemoryBarrier.buffer = buffer;
+	bufferMemoryBarrier.offset = offset;
+	bufferMemoryBarrier.size = size;
+
+	vkCmdPipelineBarrier(commandBuffer,
+		VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT,
+		0, 0, nullptr, 1, &bufferMemoryBarrier, 0, nullptr);
+
+	// Acquire half has to match the release, recorded on the graphics queue at submit
+	bufferMemoryBarrier.srcAccessMask = 0;
+	bufferMemoryBarrier.dstAccessMask = VK_ACCESS_VERTEX_ATTRIBUTE_READ_BIT | VK_ACCESS_INDEX_READ_BIT | VK_ACCESS_SHADER_READ_BIT;
+	acquireBufferBarriers.push_back(bufferMemoryBarrier);
+}
+
+void UploadBatch::releaseImage(VkImage image, uint32_t mipLevels, VkImageLayout newLayout)
+{
+	VkImageMemoryBarrier imageMemoryBarrier = {};
+	imageMemoryBarrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+	imageMemoryBarrier.oldLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;		// Layout transition is done once, as part of the transfer
+	imageMemoryBarrier.newLayout = newLayout;
+	imageMemoryBarrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+	imageMemoryBarrier.dstAccessMask = 0;
+	imageMemoryBarrier.srcQueueFamilyIndex = transferQueue.familyIndex;
+	imageMemoryBarrier.dstQueueFamilyIndex = graphicsQueue.familyIndex;
+	imageMemoryBarrier.image = image;
+	imageMemoryBarrier.subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+	imageMemoryBarrier.subresourceRange.baseMipLevel = 0;
+	imageMemoryBarrier.subresourceRange.levelCount = mipLevels;
+	imageMemoryBarrier.subresourceRange.baseArrayLayer = 0;
+	imageMemoryBarrier.subresourceRange.layerCount = 1;
+
+	vkCmdPipelineBarrier(commandBuffer,
+		VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT,
+		0, 0, nullptr, 0, nullptr, 1, &imageMemoryBarrier);
+
+	// Image either goes straight to the shaders, or gets its mip levels blitted first
+	imageMemoryBarrier.srcAccessMask = 0;
+	imageMemoryBarrier.dstAccessMask = newLayout == VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL ?
+		VK_ACCESS_SHADER_READ_BIT : VK_ACCESS_TRANSFER_READ_BIT | VK_ACCESS_TRANSFER_WRITE_BIT;
+	acquireImageBarriers.push_back(imageMemoryBarrier);
+}
+
+void UploadBatch::flush(VkSemaphore signalSemaphore)
+{
+	vkEndCommandBuffer(commandBuffer);
+
+	// Fence is owned by the ring, it's used to reclaim the staging space these copies read from
+	VkFence fence;
+	lastSubmissionId = stagingRing->closeSubmission(&fence);
+
+	// Queue submission information
+	VkSubmitInfo submitInfo = {};
+	submitInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
+	submitInfo.commandBufferCount = 1;
+	submitInfo.pCommandBuffers = &commandBuffer;
+	submitInfo.signalSemaphoreCount = signalSemaphore != VK_NULL_HANDLE ? 1 : 0;
+	submitInfo.pSignalSemaphores = &signalSemaphore;
+
+	VkResult result = vkQueueSubmit(transferQueue.queue, 1, &submitInfo, fence);
+	if (result != VK_SUCCESS)
+	{
+		throw std::runtime_error("Failed to submit upload batch!");
+	}
+
+	submittedCommandBuffers.push_back(commandBuffer);
+	stagedBytes = 0;
+}
+
+void UploadBatch::submitAcquire()
+{
+	acquireCommandBuffer = beginCommandBuffer(device, graphicsQueue.commandPool);
+
+	// Take over everything the transfer queue released
+	vkCmdPipelineBarrier(acquireCommandBuffer,
+		VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, VK_PIPELINE_STAGE_ALL_COMMANDS_BIT,
+		0, 0, nullptr,
+		static_cast<uint32_t>(acquireBufferBarriers.size()), acquireBufferBarriers.data(),
+		static_cast<uint32_t>(acquireImageBarriers.size()), acquireImageBarriers.data());
+
+	// Fill in mip levels of images that were waiting for a graphics queue
+	for (auto& generation : acquireMipGenerations)
+	{
+		recordGenerateMipmaps(acquireCommandBuffer, generation.image, generation.width, generation.height,
+			generation.baseLevel, generation.mipLevels);
+	}
+
+	vkEndCommandBuffer(acquireCommandBuffer);
+
+	VkFenceCreateInfo fenceCreateInfo = {};
+	fenceCreateInfo.sType = VK_STRUCTURE_TYPE_FENCE_CREATE_INFO;
+	VkResult result = vkCreateFence(device, &fenceCreateInfo, nullptr, &acquireFence);
+	if (result != VK_SUCCESS)
+	{
+		throw std::runtime_error("Failed to create upload acquire fence!");
+	}
+
+	// Wait for the copies on the semaphore (GPU side only, the CPU doesn't block here)
+	VkPipelineStageFlags waitStage = VK_PIPELINE_STAGE_ALL_COMMANDS_BIT;
+	VkSubmitInfo submitInfo = {};
+	submitInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
+	submitInfo.waitSemaphoreCount = 1;
+	submitInfo.pWaitSemaphores = &transferFinished;
+	submitInfo.pWaitDstStageMask = &waitStage;
+	submitInfo.commandBufferCount = 1;
+	submitInfo.pCommandBuffers = &acquireCommandBuffer;
+
+	result = vkQueueSubmit(graphicsQueue.queue, 1, &submitInfo, acquireFence);
+	if (result != VK_SUCCESS)
+	{
+		throw std::runtime_error("Failed to submit upload acquire!");
+	}
+
+	acquireBufferBarriers.clear();
+	acquireImageBarriers.clear();
+	acquireMipGenerations.clear();
+}
+
+void UploadBatch::release()
+{
+	vkFreeCommandBuffers(device, transferQueue.commandPool, static_cast<uint32_t>(submittedCommandBuffers.size()), submittedCommandBuffers.data());
+	submittedCommandBuffers.clear();
+
+	if (acquireCommandBuffer != VK_NULL_HANDLE)
+	{
+		vkFreeCommandBuffers(device, graphicsQueue.commandPool, 1, &acquireCommandBuffer);
+		vkDestroySemaphore(device, transferFinished, nullptr);
+		vkDestroyFence(device, acquireFence, nullptr);
+		acquireCommandBuffer = VK_NULL_HANDLE;
+		transferFinished = VK_NULL_HANDLE;
+		acquireFence = VK_NULL_HANDLE;
+	}
+}
@@ -0,0 +1,101 @@
+#pragma once
+
+#define GLFW_INCLUDE_VULKAN
+#include <GLFW/glfw3.h>
+
+#include <stdexcept>
+#include <vector>
+
+#include "Utilities.h"
+#include "StagingRing.h"
+
+// Queue (and pool to allocate its command buffers from) the batch submits to
+struct UploadQueue
+{
+	VkQueue queue;
+	VkCommandPool commandPool;
+	uint32_t familyIndex;
+};
+
+// One mip level of tightly packed pixel data to upload
+struct ImageLevel
+{
+	const void* data;
+	VkDeviceSize size;
+	uint32_t width;
+	uint32_t height;
+	uint32_t rowHeight;		// Pixel rows per row of data (4 for block compressed formats, 1 otherwise)
+};
+
+// Records any number of buffer/image uploads into a single command buffer, submits them once and signals a fence,
+// instead of waiting for the queue to go idle after every copy.
+// Data is staged in the shared StagingRing; if the ring runs full the batch submits what it has so far and carries on.
+// Copies run on the transfer queue. If it's a separate family, uploaded resources are released by it and acquired
+// by the graphics queue in a small second submission that waits for the copies on a semaphore.
+// Only one batch can be recording from a ring at a time
+class UploadBatch
+{
+public:
+	UploadBatch();
+
+	// Start recording a new batch
+	void begin(StagingRing* newStagingRing, VkDevice newDevice, UploadQueue newTransferQueue, UploadQueue newGraphicsQueue);
+
+	// Copy data to the staging ring and record a copy of it into dstBuffer at dstOffset
+	void uploadBuffer(const void* data, VkDeviceSize size, VkBuffer dstBuffer, VkDeviceSize dstOffset);
+	// Copy the given mip levels to a new image with mipLevels levels, leaving it shader readable.
+	// Levels that aren't given are generated from the last given one with linear blits (recorded for the graphics queue)
+	void uploadImage(const std::vector<ImageLevel>& levels, VkImage image, uint32_t mipLevels);
+
+	// Submit everything recorded so far (fence is signalled once the GPU is done)
+	void submit();
+	// Check if the GPU finished the batch without blocking
+	bool isFinished();
+	// Block until the batch finishes
+	void wait();
+	// Drop a batch that failed halfway: the command buffer being recorded is ended and freed without being submitted,
+	// and parts already submitted (the ring ran full) are waited for and freed. The batch can begin again afterwards
+	void abort();
+
+	~UploadBatch();
+
+private:
+	StagingRing* stagingRing = nullptr;
+	VkDevice device = VK_NULL_HANDLE;
+	UploadQueue transferQueue = {};
+	UploadQueue graphicsQueue = {};
+	bool ownershipTransfer = false;						// Transfer & graphics queues are different families
+
+	VkCommandBuffer commandBuffer = VK_NULL_HANDLE;		// Transfer command buffer being recorded
+	VkDeviceSize stagedBytes = 0;						// Staging bytes used by commandBuffer
+	bool submitted = false;
+
+	// Command buffers already handed to the transfer queue and the last ring submission they belong to
+	std::vector<VkCommandBuffer> submittedCommandBuffers;
+	uint64_t lastSubmissionId = 0;
+
+	// Mip levels still to be blitted once an image has been handed over to the graphics queue
+	struct MipGeneration
+	{
+		VkImage image;
+		uint32_t width;
+		uint32_t height;
+		uint32_t baseLevel;
+		uint32_t mipLevels;
+	};
+
+	// Graphics queue side of queue family ownership transfers
+	std::vector<VkBufferMemoryBarrier> acquireBufferBarriers;
+	std::vector<VkImageMemoryBarrier> acquireImageBarriers;
+	std::vector<MipGeneration> acquireMipGenerations;
+	VkCommandBuffer acquireCommandBuffer = VK_NULL_HANDLE;
+	VkSemaphore transferFinished = VK_NULL_HANDLE;
+	VkFence acquireFence = VK_NULL_HANDLE;
+
+	VkDeviceSize allocateStaging(VkDeviceSize size, VkDeviceSize alignment);
+	void releaseBuffer(VkBuffer buffer, VkDeviceSize offset, VkDeviceSize size);
+	void releaseImage(VkImage image, uint32_t mipLevels, VkImageLayout newLayout);
+	void flush(VkSemaphore signalSemaphore);
+	void submitAcquire();
+	void release();
+};
@@ -5,8 +5,86 @@
 #include <GLFW/glfw3.h>
 #include <glm/glm.hpp>
 
+#include "MemoryAllocator.h"
+
 const int MAX_FRAME_DRAWS = 3;
 const int MAX_OBJECTS = 20;
+// Near plane of the camera's projection (meshlets are culled against it too)
+const float CAMERA_NEAR_PLANE = 0.1f;
+// Size of the bindless texture array (clamped to what the device supports)
+const uint32_t MAX_TEXTURES = 4096;
+// Size of the sampler array (distinct samplers, shared between textures)
+const uint32_t MAX_SAMPLERS = 32;
+// Size of the material buffer (materials of every loaded model)
+const uint32_t MAX_MATERIALS = 4096;
+// Print how much of each memory heap is in use after every model load (debugging)
+const bool PRINT_MEMORY_STATS = false;
+
+// Sizes of the shared geometry buffers all meshes are sub-allocated from
+const VkDeviceSize VERTEX_POOL_SIZE = 64 * 1024 * 1024;
+const VkDeviceSize INDEX_POOL_SIZE = 32 * 1024 * 1024;
+const VkDeviceSize MESHLET_POOL_SIZE = 8 * 1024 * 1024;
+// Size of the persistently mapped staging ring all uploads go through (bigger uploads are split into chunks)
+const VkDeviceSize STAGING_RING_SIZE = 32 * 1024 * 1024;
+// Where decoded textures are kept between runs, and whether they're stored block compressed (smaller and faster to
+// load, but the first run has to compress them)
+const std::string TEXTURE_CACHE_DIRECTORY = "TextureCache/";
+const bool TEXTURE_CACHE_COMPRESSED = false;
+// Where imported models are kept between runs (binary vertex & index streams, read in place instead of importing again)
+const std::string MESH_CACHE_DIRECTORY = "MeshCache/";
+// Imported meshes are reordered for the vertex cache, overdraw & vertex fetch (MeshOptimizer.h) before they're cached.
+// Overdraw ordering may give up the threshold's share of vertex cache efficiency (1.05 = 5%)
+const bool MESH_OPTIMIZATION = true;
+const float MESH_OVERDRAW_THRESHOLD = 1.05f;
+// Imported meshes get up to MESH_LOD_COUNT levels of detail (the first is the full mesh), each simplified to the
+// reduction of the level before's triangles while its error stays under the max (relative to the mesh's bounding
+// sphere radius). Levels that can't get below the min reduction are left out. Draws use the coarsest level whose error
+// covers at most the error pixels on screen, and only go coarser once it's under that times the hysteresis
+const uint32_t MESH_LOD_COUNT = 5;
+const float MESH_LOD_REDUCTION = 0.5f;
+const float MESH_LOD_MIN_REDUCTION = 0.85f;
+const float MESH_LOD_MAX_ERROR = 0.05f;
+const float MESH_LOD_ERROR_PIXELS = 1.0f;
+const float MESH_LOD_HYSTERESIS = 0.75f;
+// Each level of detail is cut into meshlets (runs of its triangles touching at most the max vertices) with a bounding
+// sphere & normal cone. With culling on, a compute pass drops the meshlets outside the view, facing away (closed meshes
+// only, the rest are drawn two-sided) or (with occlusion culling) behind last frame's depth, and draws get just the
+// indices of the rest. Each frame culls at most the max draws, with room for the given number of indices (draws past
+// either are drawn in full)
+const uint32_t MESHLET_MAX_VERTICES = 64;
+const uint32_t MESHLET_MAX_TRIANGLES = 124;
+const bool MESHLET_CULLING = true;
+const bool MESHLET_OCCLUSION_CULLING = true;
+const uint32_t MESHLET_CULL_MAX_DRAWS = 4096;
+const uint32_t MESHLET_CULL_MAX_INDICES = 8 * 1024 * 1024;
+
+// Resolution textures are loaded at. Lower tiers drop the biggest mip levels before they're uploaded, Auto picks the
+// tier from the size of the device's VRAM
+enum class TextureQuality
+{
+	Auto,
+	Full,
+	Half,		// Top mip level dropped
+	Quarter		// Top two mip levels dropped
+};
+const TextureQuality TEXTURE_QUALITY = TextureQuality::Auto;
+
+// Mip streaming: textures are loaded with just their mip tail (levels up to the tail size), finer levels are added as
+// the fragment shader asks for them and evicted again from textures that go unused for the idle frames, keeping every
+// streamed texture within the budget. Each frame uploads at most the upload limit (the first texture always goes)
+const bool TEXTURE_STREAMING = true;
+const VkDeviceSize TEXTURE_STREAMING_BUDGET = 256 * 1024 * 1024;
+const VkDeviceSize TEXTURE_STREAMING_UPLOAD_LIMIT = 16 * 1024 * 1024;
+const uint32_t TEXTURE_STREAMING_TAIL_SIZE = 128;
+const uint32_t TEXTURE_STREAMING_IDLE_FRAMES = 120;
+
+// Small albedo textures of a model (no bigger than the max texture size) are packed into shared atlases of the atlas
+// size, so they need fewer images & descriptors. Atlases only have the given mip levels, every extra level doubles the
+// gutter around each texture
+const bool TEXTURE_ATLAS = true;
+const uint32_t TEXTURE_ATLAS_SIZE = 1024;
+const uint32_t TEXTURE_ATLAS_MAX_TEXTURE_SIZE = 256;
+const uint32_t TEXTURE_ATLAS_MIP_LEVELS = 4;
 
 const std::vector<const char*> validationLayers =
 {
@@ -14,16 +92,28 @@ const std::vector<const char*> validationLayers =
 };
 
 const std::vector<const char*> deviceExtensions = {
-	VK_KHR_SWAPCHAIN_EXTENSION_NAME //define for swapchain extension
+	VK_KHR_SWAPCHAIN_EXTENSION_NAME, //define for swapchain extension
+	VK_EXT_DESCRIPTOR_INDEXING_EXTENSION_NAME //all textures in one descriptor array
 };
 
-//Vertex data layout representation
-struct Vertex
+//Vertex data layout representation, as it's loaded & processed on the CPU (full precision)
+struct SourceVertex
 {
 	glm::vec3 pos;		// Vertex Position (x, y, z)
 	glm::vec4 col;		// Vertex Color (r, g, b, a)
 	glm::vec3 normal;	// Vertex Normals (x, y, z)
 	glm::vec2 UVs;		// Vertex texture coordinates (u, v)
+	glm::vec4 tangent;	// Vertex Tangent (x, y, z) & bitangent sign (w), zero if the mesh has none (no normal mapping)
+};
+
+//Vertex data layout as it's stored in the vertex buffer (20 bytes, packed by VertexFormat.h & decoded in shader.vert).
+//Colours aren't in it, meshes that have them get a second stream of RGBA8 colours
+struct Vertex
+{
+	uint16_t pos[4];		// Position quantized to the mesh's bounding box (UNORM16 x, y, z), w holds the tangent's handedness
+	int16_t normal[2];		// Octahedral encoded unit normal (SNORM16)
+	int16_t tangent[2];		// Octahedral encoded unit tangent (SNORM16)
+	uint16_t UVs[2];		// Texture coordinates as half floats
 };
 
 //Indices (locations) of Queue Families (if they exist)
@@ -79,30 +169,9 @@ static std::vector<char> readFile(const std::string& filename)
 	return fileBuffer;
 }
 
-static uint32_t findMemoryTypeIndex(VkPhysicalDevice physicalDevice, uint32_t allowedTypes, VkMemoryPropertyFlags properties)
-{
-	//Get properties of physical device memory
-	VkPhysicalDeviceMemoryProperties memoryProps;
-	vkGetPhysicalDeviceMemoryProperties(physicalDevice, &memoryProps);
-
-	for (uint32_t i = 0; i < memoryProps.memoryTypeCount; i++)
-	{
-		//use bit shifting to check the allowed type
-		if ((allowedTypes & (1 << i))									//Index of memory type must match corresponding bit in allowedTypes
-			&& (memoryProps.memoryTypes[i].propertyFlags & properties) == properties)	//check if ALL properties are presented at this memory index
-		{
-			//this memory type is valied, so return its index
-			return i;
-		}
-	}
-
-	return uint32_t();
-}
-
-
-static VkResult createBuffer(VkPhysicalDevice physicalDevice, VkDevice device, 
+static VkResult createBuffer(VkDevice device, MemoryAllocator* allocator,
 	VkDeviceSize bufferSize, VkBufferUsageFlags bufferUsage,
-	VkMemoryPropertyFlags bufferProperties, VkBuffer *buffer, VkDeviceMemory *bufferMemory)
+	VkMemoryPropertyFlags bufferProperties, VkBuffer *buffer, MemoryAllocation *bufferMemory)
 {
 	//CREATE VERTEX BUFFER
 	//Information to create a buffer (doesn't include assigning memory)
@@ -118,32 +187,22 @@ static VkResult createBuffer(VkPhysicalDevice physicalDevice, VkDevice device,
 		throw std::runtime_error("Failed to create a Buffer");
 	}
 
-	//GET BUFFER REQUIREMENTS
-	VkMemoryRequirements memRequirements = {};
-	vkGetBufferMemoryRequirements(device, *buffer, &memRequirements);
-
 	//ALLOCATE MEMORY TO BUFFER
-	VkMemoryAllocateInfo memoryAllocInfo = {};
-	memoryAllocInfo.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
-	memoryAllocInfo.allocationSize = memRequirements.size;
-	memoryAllocInfo.memoryTypeIndex = findMemoryTypeIndex(physicalDevice, 
-		memRequirements.memoryTypeBits,													//Index of memory type based on Physical Device that has required bit flags
+	//Sub-allocate from one of the allocator's memory blocks and bind it to the buffer
+	*bufferMemory = allocator->allocateBufferMemory(*buffer,
 		bufferProperties);																//Vk_MEMORY_PROPERTY_HOST_VISIBLE_BIT: CPU can interact with memory
 																						//VK_MEMORY_PROPERTY_HOST_COHERENT_BIT: Allows placement of data straight into buffer after mapping
 																						//VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT: ONLY GPU can interact with memory\data
 																						//(otherwise we've have to specify manually with flushMemotyRanges\invalidateMemoryRanges
-	//Allocate memory to VkDeviceMemory
-	result = vkAllocateMemory(device, &memoryAllocInfo, nullptr, bufferMemory);
-	if (result != VK_SUCCESS)
-	{
-		throw std::runtime_error("Failed to allocate memory for buffer!");
-	}
-
-	//Allocate(Bind) memory to given vertex buffer
-	vkBindBufferMemory(device, *buffer, *bufferMemory, 0);
-
 	return result;
 }
+
+static void destroyBuffer(VkDevice device, MemoryAllocator* allocator, VkBuffer buffer, MemoryAllocation* bufferMemory)
+{
+	vkDestroyBuffer(device, buffer, nullptr);
+	allocator->free(*bufferMemory);
+}
+
 static VkCommandBuffer beginCommandBuffer(VkDevice device, VkCommandPool commandPool)
 {
 	//Command buffer to hold transfer command
@@ -170,74 +229,44 @@ static VkCommandBuffer beginCommandBuffer(VkDevice device, VkCommandPool command
 	return commandBuffer;
 }
 
-static void endAndSubmitCommandBuffer(VkDevice device, VkCommandPool commandPool, VkQueue queue, VkCommandBuffer commandBuffer)
-{
-	// End commands
-	vkEndCommandBuffer(commandBuffer);
-
-	// Queue submission information
-	VkSubmitInfo submitInfo = {};
-	submitInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
-	submitInfo.commandBufferCount = 1;
-	submitInfo.pCommandBuffers = &commandBuffer;
-
-	// Submit transfer command to transfer queue (graphics queue) and wait until it finishes
-	vkQueueSubmit(queue, 1, &submitInfo, VK_NULL_HANDLE);
-	vkQueueWaitIdle(queue);
-
-	// Free temp command buffer back to pool
-	vkFreeCommandBuffers(device, commandPool, 1, &commandBuffer);
-}
-
-static void copyImageBuffer(
-	VkDevice device, VkQueue transferQueue, VkCommandPool transferCommandPool, 
-	VkBuffer srcBuffer, VkImage image, uint32_t width, uint32_t height)
+// Record functions only add commands to a command buffer, submission is up to the caller (see UploadBatch)
+static void recordCopyImageBuffer(VkCommandBuffer transferCommandBuffer,
+	VkBuffer srcBuffer, VkDeviceSize bufferOffset, VkImage image, uint32_t width, uint32_t height, uint32_t mipLevel, int32_t yOffset = 0)
 {
-	VkCommandBuffer transferCommandBuffer = beginCommandBuffer(device, transferCommandPool);
 	// Region of data to copy from and to
 
 	VkBufferImageCopy imageRegion = {};
-	imageRegion.bufferOffset = 0;											// Offset into data
+	imageRegion.bufferOffset = bufferOffset;								// Offset into data
 	imageRegion.bufferRowLength = 0;										// Row length of data to calculate data spacing
 	imageRegion.bufferImageHeight = 0;										// Image Height to calculate data spacing
 	imageRegion.imageSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;	// Which aspect of image to copy
-	imageRegion.imageSubresource.mipLevel = 0;								// Mipmap level to copy
+	imageRegion.imageSubresource.mipLevel = mipLevel;						// Mipmap level to copy
 	imageRegion.imageSubresource.baseArrayLayer = 0;						// Starting array layer (if array)
 	imageRegion.imageSubresource.layerCount = 1;							// Number of layers to copy starting at baseArrayLayer
 
 	imageRegion.imageExtent = { width, height, 1 };							// Size of data to copy as (x, y, z) values
-	imageRegion.imageOffset = {0, 0, 0};									// Offset into image (as opposed to raw data in bufferOffset)
+	imageRegion.imageOffset = {0, yOffset, 0};								// Offset into image (as opposed to raw data in bufferOffset)
 	
 	// Command to copy buffer to given image
 	vkCmdCopyBufferToImage(transferCommandBuffer, srcBuffer, image, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, 1, &imageRegion);
-
-	// End & submit
-	endAndSubmitCommandBuffer(device, transferCommandPool, transferQueue, transferCommandBuffer);
 }
-static void copyBuffer(
-	VkDevice device, VkQueue transferQueue, VkCommandPool transferCommandPool,
-	VkBuffer srcBuffer, VkBuffer dstBuffer, VkDeviceSize bufferSize)
+
+static void recordCopyBuffer(VkCommandBuffer transferCommandBuffer,
+	VkBuffer srcBuffer, VkDeviceSize srcOffset, VkBuffer dstBuffer, VkDeviceSize dstOffset, VkDeviceSize bufferSize)
 {
-	
-	VkCommandBuffer transferCommandBuffer = beginCommandBuffer(device, transferCommandPool);
 	// Region of data to copy from and to
 	VkBufferCopy bufferCopyRegion = {};
-	bufferCopyRegion.srcOffset = 0;
-	bufferCopyRegion.dstOffset = 0;
+	bufferCopyRegion.srcOffset = srcOffset;
+	bufferCopyRegion.dstOffset = dstOffset;
 	bufferCopyRegion.size = bufferSize;
 
 	// Command to copy src buffer to dst buffer
 	vkCmdCopyBuffer(transferCommandBuffer, srcBuffer, dstBuffer, 1, &bufferCopyRegion);
-
-	// End & submit
-	endAndSubmitCommandBuffer(device, transferCommandPool, transferQueue, transferCommandBuffer);
 }
 
-static void transitionImageLayout(VkDevice device, VkQueue queue, VkCommandPool commandPool,
-	VkImage image, VkImageLayout currentLayout, VkImageLayout newLayout)
+static void recordImageLayoutTransition(VkCommandBuffer commandBuffer,
+	VkImage image, VkImageLayout currentLayout, VkImageLayout newLayout, uint32_t mipLevels)
 {
-	VkCommandBuffer commandBuffer = beginCommandBuffer(device, commandPool);
-
 	VkImageMemoryBarrier imageMemoryBarrier = {};
 	imageMemoryBarrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
 	imageMemoryBarrier.oldLayout = currentLayout;								// Layout to transition from
@@ -247,7 +276,7 @@ static void transitionImageLayout(VkDevice device, VkQueue queue, VkCommandPool
 	imageMemoryBarrier.image = image;											// Image being accessed and modified as part of barrier
 	imageMemoryBarrier.subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;	// Aspect of image begin altered
 	imageMemoryBarrier.subresourceRange.baseMipLevel = 0;						// First mipmap layer to start alteration on
-	imageMemoryBarrier.subresourceRange.levelCount = 1;							// Number of mipmap levels to alter stating from baseMipLevel
+	imageMemoryBarrier.subresourceRange.levelCount = mipLevels;					// Number of mipmap levels to alter stating from baseMipLevel
 	imageMemoryBarrier.subresourceRange.baseArrayLayer = 0;						// First array layer to start alterations on
 	imageMemoryBarrier.subresourceRange.layerCount = 1;							// Number of layers to alter starting from baseArrayLayer
 	
@@ -280,6 +309,99 @@ static void transitionImageLayout(VkDevice device, VkQueue queue, VkCommandPool
 		0, nullptr,			// Buffer Memory Barrier count + data
 		1, &imageMemoryBarrier	// Image Memory Barrier count + data
 	);
+}
+
+// Fill mip levels [baseLevel, mipLevels) by blitting each level from the one above it.
+// Expects all levels in TRANSFER_DST layout (with levels below baseLevel already filled), leaves all of them shader readable.
+// Needs a graphics queue and a format that supports linear blits
+static void recordGenerateMipmaps(VkCommandBuffer commandBuffer,
+	VkImage image, uint32_t width, uint32_t height, uint32_t baseLevel, uint32_t mipLevels)
+{
+	VkImageMemoryBarrier barrier = {};
+	barrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+	barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+	barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+	barrier.image = image;
+	barrier.subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+	barrier.subresourceRange.levelCount = 1;
+	barrier.subresourceRange.baseArrayLayer = 0;
+	barrier.subresourceRange.layerCount = 1;
+
+	// Levels above the one we blit from are only read by shaders
+	if (baseLevel > 1)
+	{
+		barrier.subresourceRange.baseMipLevel = 0;
+		barrier.subresourceRange.levelCount = baseLevel - 1;
+		barrier.oldLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
+		barrier.newLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+		barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+		barrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
+		vkCmdPipelineBarrier(commandBuffer,
+			VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT,
+			0, 0, nullptr, 0, nullptr, 1, &barrier);
+		barrier.subresourceRange.levelCount = 1;
+	}
+
+	// Size of the level we blit from
+	int32_t mipWidth = static_cast<int32_t>(width >> (baseLevel - 1));
+	int32_t mipHeight = static_cast<int32_t>(height >> (baseLevel - 1));
+	mipWidth = mipWidth > 0 ? mipWidth : 1;
+	mipHeight = mipHeight > 0 ? mipHeight : 1;
+
+	for (uint32_t i = baseLevel; i < mipLevels; i++)
+	{
+		// Wait for the previous level to be written, then read from it
+		barrier.subresourceRange.baseMipLevel = i - 1;
+		barrier.oldLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
+		barrier.newLayout = VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL;
+		barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+		barrier.dstAccessMask = VK_ACCESS_TRANSFER_READ_BIT;
+		vkCmdPipelineBarrier(commandBuffer,
+			VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT,
+			0, 0, nullptr, 0, nullptr, 1, &barrier);
+
+		int32_t nextWidth = mipWidth > 1 ? mipWidth / 2 : 1;
+		int32_t nextHeight = mipHeight > 1 ? mipHeight / 2 : 1;
+
+		// Scale the whole previous level down into this one
+		VkImageBlit blit = {};
+		blit.srcOffsets[0] = { 0, 0, 0 };
+		blit.srcOffsets[1] = { mipWidth, mipHeight, 1 };
+		blit.srcSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+		blit.srcSubresource.mipLevel = i - 1;
+		blit.srcSubresource.baseArrayLayer = 0;
+		blit.srcSubresource.layerCount = 1;
+		blit.dstOffsets[0] = { 0, 0, 0 };
+		blit.dstOffsets[1] = { nextWidth, nextHeight, 1 };
+		blit.dstSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+		blit.dstSubresource.mipLevel = i;
+		blit.dstSubresource.baseArrayLayer = 0;
+		blit.dstSubresource.layerCount = 1;
+		vkCmdBlitImage(commandBuffer,
+			image, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL,
+			image, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
+			1, &blit, VK_FILTER_LINEAR);
+
+		// Previous level is done
+		barrier.oldLayout = VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL;
+		barrier.newLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+		barrier.srcAccessMask = VK_ACCESS_TRANSFER_READ_BIT;
+		barrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
+		vkCmdPipelineBarrier(commandBuffer,
+			VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT,
+			0, 0, nullptr, 0, nullptr, 1, &barrier);
+
+		mipWidth = nextWidth;
+		mipHeight = nextHeight;
+	}
 
-	endAndSubmitCommandBuffer(device, commandPool, queue, commandBuffer);
+	// Last level was only ever written to
+	barrier.subresourceRange.baseMipLevel = mipLevels - 1;
+	barrier.oldLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
+	barrier.newLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+	barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+	barrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
+	vkCmdPipelineBarrier(commandBuffer,
+		VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT,
+		0, 0, nullptr, 0, nullptr, 1, &barrier);
 }
\ No newline at end of file
@@ -0,0 +1,153 @@
+#include "VertexFormat.h"
+
+#include <cmath>
+#include <cstddef>
+
+#include <glm/gtc/packing.hpp>
+
+static int16_t packSnorm16(float value)
+{
+	return static_cast<int16_t>(std::round(glm::clamp(value, -1.0f, 1.0f) * 32767.0f));
+}
+
+static uint16_t packUnorm16(float value)
+{
+	return static_cast<uint16_t>(std::round(glm::clamp(value, 0.0f, 1.0f) * 65535.0f));
+}
+
+void encodeOctahedral(glm::vec3 direction, int16_t* encoded)
+{
+	// Project onto the octahedron |x| + |y| + |z| = 1, the lower half is folded over the upper one
+	float length = std::abs(direction.x) + std::abs(direction.y) + std::abs(direction.z);
+	glm::vec2 octahedral = length > 0.0f ? glm::vec2(direction) / length : glm::vec2(0.0f);
+	if (length > 0.0f && direction.z < 0.0f)
+	{
+		glm::vec2 sign = glm::vec2(octahedral.x >= 0.0f ? 1.0f : -1.0f, octahedral.y >= 0.0f ? 1.0f : -1.0f);
+		octahedral = (1.0f - glm::abs(glm::vec2(octahedral.y, octahedral.x))) * sign;
+	}
+	encoded[0] = packSnorm16(octahedral.x);
+	encoded[1] = packSnorm16(octahedral.y);
+}
+
+glm::vec3 decodeOctahedral(const int16_t* encoded)
+{
+	// Same as shader.vert
+	glm::vec2 octahedral = glm::max(glm::vec2(encoded[0], encoded[1]) / 32767.0f, -1.0f);
+	glm::vec3 direction = glm::vec3(octahedral, 1.0f - std::abs(octahedral.x) - std::abs(octahedral.y));
+	float fold = glm::max(-direction.z, 0.0f);
+	direction.x += direction.x >= 0.0f ? -fold : fold;
+	direction.y += direction.y >= 0.0f ? -fold : fold;
+	return glm::normalize(direction);
+}
+
+Vertex packVertex(const SourceVertex& vertex, glm::vec3 boundsMin, glm::vec3 boundsMax)
+{
+	Vertex packed;
+
+	// Flat bounds (e.g. a plane) have nothing to quantize on that axis
+	glm::vec3 extent = boundsMax - boundsMin;
+	for (int i = 0; i < 3; i++)
+	{
+		packed.pos[i] = extent[i] > 0.0f ? packUnorm16((vertex.pos[i] - boundsMin[i]) / extent[i]) : 0;
+	}
+
+	encodeOctahedral(vertex.normal, packed.normal);
+
+	// Meshes without tangents keep a zero tangent, so the fragment shader still knows to skip their normal maps
+	if (vertex.tangent.w == 0.0f)
+	{
+		packed.pos[3] = VERTEX_TANGENT_NONE;
+		packed.tangent[0] = 0;
+		packed.tangent[1] = 0;
+	}
+	else
+	{
+		packed.pos[3] = vertex.tangent.w < 0.0f ? VERTEX_TANGENT_NEGATIVE : VERTEX_TANGENT_POSITIVE;
+		encodeOctahedral(glm::vec3(vertex.tangent), packed.tangent);
+	}
+
+	setVertexUVs(&packed, vertex.UVs);
+	return packed;
+}
+
+uint32_t packVertexColor(glm::vec4 color)
+{
+	// R in the lowest byte, so it's R8G8B8A8 in memory
+	return glm::packUnorm4x8(color);
+}
+
+SourceVertex unpackVertex(const Vertex& vertex, glm::vec3 boundsMin, glm::vec3 boundsMax)
+{
+	SourceVertex unpacked;
+	unpacked.pos = getVertexPosition(vertex, boundsMin, boundsMax);
+	unpacked.col = glm::vec4(1.0f);
+	unpacked.normal = decodeOctahedral(vertex.normal);
+	unpacked.UVs = getVertexUVs(vertex);
+	if (vertex.pos[3] == VERTEX_TANGENT_NONE)
+	{
+		unpacked.tangent = glm::vec4(0.0f);
+	}
+	else
+	{
+		unpacked.tangent = glm::vec4(decodeOctahedral(vertex.tangent), vertex.pos[3] == VERTEX_TANGENT_POSITIVE ? 1.0f : -1.0f);
+	}
+	return unpacked;
+}
+
+glm::vec3 getVertexPosition(const Vertex& vertex, glm::vec3 boundsMin, glm::vec3 boundsMax)
+{
+	return boundsMin + glm::vec3(vertex.pos[0], vertex.pos[1], vertex.pos[2]) / 65535.0f * (boundsMax - boundsMin);
+}
+
+glm::vec2 getVertexUVs(const Vertex& vertex)
+{
+	return glm::vec2(glm::unpackHalf1x16(vertex.UVs[0]), glm::unpackHalf1x16(vertex.UVs[1]));
+}
+
+void setVertexUVs(Vertex* vertex, glm::vec2 uvs)
+{
+	vertex->UVs[0] = glm::packHalf1x16(uvs.x);
+	vertex->UVs[1] = glm::packHalf1x16(uvs.y);
+}
+
+std::vector<VkVertexInputBindingDescription> getVertexBindingDescriptions(bool vertexColors)
+{
+	//How the data for a single vertex is laid out in each stream
+	std::vector<VkVertexInputBindingDescription> bindingDescriptions;
+
+	VkVertexInputBindingDescription vertexBinding = {};
+	vertexBinding.binding = 0;
+	vertexBinding.stride = sizeof(Vertex);
+	vertexBinding.inputRate = VK_VERTEX_INPUT_RATE_VERTEX;
+	bindingDescriptions.push_back(vertexBinding);
+
+	if (vertexColors)
+	{
+		VkVertexInputBindingDescription colorBinding = {};
+		colorBinding.binding = 1;
+		colorBinding.stride = sizeof(uint32_t);
+		colorBinding.inputRate = VK_VERTEX_INPUT_RATE_VERTEX;
+		bindingDescriptions.push_back(colorBinding);
+	}
+
+	return bindingDescriptions;
+}
+
+std::vector<VkVertexInputAttributeDescription> getVertexAttributeDescriptions(bool vertexColors)
+{
+	//Location, binding, format & offset of each attribute, decoded to floats by the formats (UNORM/SNORM/SFLOAT)
+	std::vector<VkVertexInputAttributeDescription> attributeDescriptions =
+	{
+		{ 0, 0, VK_FORMAT_R16G16B16A16_UNORM, static_cast<uint32_t>(offsetof(Vertex, pos)) },
+		{ 1, 0, VK_FORMAT_R16G16_SNORM, static_cast<uint32_t>(offsetof(Vertex, normal)) },
+		{ 2, 0, VK_FORMAT_R16G16_SNORM, static_cast<uint32_t>(offsetof(Vertex, tangent)) },
+		{ 3, 0, VK_FORMAT_R16G16_SFLOAT, static_cast<uint32_t>(offsetof(Vertex, UVs)) }
+	};
+
+	if (vertexColors)
+	{
+		attributeDescriptions.push_back({ 4, 1, VK_FORMAT_R8G8B8A8_UNORM, 0 });
+	}
+
+	return attributeDescriptions;
+}
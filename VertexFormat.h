@@ -0,0 +1,33 @@
+#pragma once
+
+#include <stdint.h>
+#include <vector>
+
+#define GLFW_INCLUDE_VULKAN
+#include <GLFW/glfw3.h>
+#include <glm/glm.hpp>
+
+#include "Utilities.h"
+
+// Tangent handedness in Vertex::pos[3] (read as UNORM: 0, ~0.5 & 1 in the shader)
+const uint16_t VERTEX_TANGENT_NONE = 0;
+const uint16_t VERTEX_TANGENT_NEGATIVE = 0x8000;
+const uint16_t VERTEX_TANGENT_POSITIVE = 0xFFFF;
+
+// Unit vector folded onto an octahedron and flattened to 2 values (a zero vector comes out as +Z)
+void encodeOctahedral(glm::vec3 direction, int16_t* encoded);
+glm::vec3 decodeOctahedral(const int16_t* encoded);
+
+// Pack a vertex, its position is quantized to where it is in the bounds (every vertex of the mesh must be inside them)
+Vertex packVertex(const SourceVertex& vertex, glm::vec3 boundsMin, glm::vec3 boundsMax);
+uint32_t packVertexColor(glm::vec4 color);
+// Full precision copy of a packed vertex (white, colours aren't in it)
+SourceVertex unpackVertex(const Vertex& vertex, glm::vec3 boundsMin, glm::vec3 boundsMax);
+glm::vec3 getVertexPosition(const Vertex& vertex, glm::vec3 boundsMin, glm::vec3 boundsMax);
+glm::vec2 getVertexUVs(const Vertex& vertex);
+void setVertexUVs(Vertex* vertex, glm::vec2 uvs);
+
+// Vertex input of the main pipeline: packed vertices at binding 0, with vertexColors colours at binding 1 too (same
+// locations as shader.vert)
+std::vector<VkVertexInputBindingDescription> getVertexBindingDescriptions(bool vertexColors);
+std::vector<VkVertexInputAttributeDescription> getVertexAttributeDescriptions(bool vertexColors);
@@ -16,6 +16,16 @@ int VulkanRenderer::init(GLFWwindow* newWindow)
 		createSurface();
 		getPhysicalDevice();
 		createLogicalDevice();
+		memoryAllocator.init(mainDevice.physicalDevice, mainDevice.logicalDevice);
+		geometryPool.init(&memoryAllocator, mainDevice.logicalDevice, VERTEX_POOL_SIZE, INDEX_POOL_SIZE, MESHLET_POOL_SIZE);
+		materialTable.init(&memoryAllocator, mainDevice.logicalDevice, MAX_MATERIALS);
+		textureStreamer.init(&memoryAllocator, mainDevice.logicalDevice, maxTextures, MAX_FRAME_DRAWS,
+			TEXTURE_STREAMING_BUDGET, TEXTURE_STREAMING_UPLOAD_LIMIT, TEXTURE_STREAMING_TAIL_SIZE, TEXTURE_STREAMING_IDLE_FRAMES);
+		stagingRing.init(&memoryAllocator, mainDevice.logicalDevice, STAGING_RING_SIZE);
+		// Leave one core for the main (render) thread
+		loaderThreads.init(std::max(1u, std::thread::hardware_concurrency() - 1));
+		textureCache.init(TEXTURE_CACHE_DIRECTORY, TEXTURE_CACHE_COMPRESSED);
+		meshCache.init(MESH_CACHE_DIRECTORY, MODEL_IMPORT_FLAGS);
 		createSwapChain();
 		createRenderPass();
 		createDescriptorSetLayout();
@@ -26,25 +36,32 @@ int VulkanRenderer::init(GLFWwindow* newWindow)
 		createFramebuffers();
 		createCommandPool();
 		createCommandBuffers();
-		createTextureSampler();
 		createUniformBuffers();
 		createDescriptorPool();
 		createDescriptorSets();
+		createTextureSampler();
 		createInputDescriptorSets();
 		createSynchronization();
+		meshletCuller.init(&memoryAllocator, mainDevice.logicalDevice, MAX_FRAME_DRAWS, MESHLET_CULL_MAX_DRAWS,
+			MESHLET_CULL_MAX_INDICES);
+		createMeshletCulling();
 
 		// Data used to create objects on a scene
 
 		// Set up Matrices for camera
 		uboViewProjection.projection = glm::perspective(glm::radians(45.0f),
 			(float)swapchainExtent.width / (float)swapchainExtent.height,
-			0.1f, 100.0f);
+			CAMERA_NEAR_PLANE, 100.0f);
 		uboViewProjection.view = glm::lookAt(glm::vec3(0, 0.0f, 10.0f), glm::vec3(0.0f, 0.0f, -2.0f), glm::vec3(0.0f, 1.0f, 0.0f));
 
 		uboViewProjection.projection[1][1] *= -1;
 
 		// Create default "no texture" texture
-		createTexture("plain.png");
+		UploadBatch uploadBatch;
+		beginUploadBatch(&uploadBatch);
+		createTexture("plain.png", &uploadBatch);
+		uploadBatch.submit();
+		uploadBatch.wait();
 	}
 	catch (const std::runtime_error &e)
 	{
@@ -68,12 +85,19 @@ void VulkanRenderer::draw()
 	vkWaitForFences(mainDevice.logicalDevice, 1, &drawFences[currentFrame], VK_TRUE, std::numeric_limits<uint64_t>::max());
 	//Manually reset (unsignal) closed fences
 	vkResetFences(mainDevice.logicalDevice, 1, &drawFences[currentFrame]);
+	frameCount++;
+
+	// Read what the finished frame sampled and stream texture levels in/out accordingly
+	updateTextureStreaming();
 
 	// - GET NEXT IMAGE -- //
 	//Get index of next image to be drawn to, and signal semaphore when ready to be drawn to
 	uint32_t imageIndex;
 	vkAcquireNextImageKHR(mainDevice.logicalDevice, swapchain, std::numeric_limits<uint64_t>::max(), imageAvailable[currentFrame], VK_NULL_HANDLE, &imageIndex);
 	
+	// Pick up models that finished loading in the background
+	updateModelLoads(false);
+
 	//Re-record commands
 	recordCommands(imageIndex);
 	// Update Uniform Values
@@ -122,7 +146,10 @@ void VulkanRenderer::draw()
 
 void VulkanRenderer::cleanup()
 {
-	
+	// Let background loads finish, so nothing is uploading while we destroy things
+	updateModelLoads(true);
+	loaderThreads.cleanup();
+
 	//wait till the device become idle to safely destroy semaphores & pools
 	vkDeviceWaitIdle(mainDevice.logicalDevice);
 	//same for queue
@@ -135,14 +162,54 @@ void VulkanRenderer::cleanup()
 	{
 		models[i].destroyMeshModel();
 	}
-	vkDestroySampler(mainDevice.logicalDevice, textureSampler, nullptr);
+	geometryPool.cleanup();
+	materialTable.cleanup();
+
+	// Meshlet culling & its depth pyramid
+	meshletCuller.cleanup();
+	vkDestroyPipeline(mainDevice.logicalDevice, depthPyramidPipeline, nullptr);
+	vkDestroyPipelineLayout(mainDevice.logicalDevice, depthPyramidPipelineLayout, nullptr);
+	vkDestroyPipeline(mainDevice.logicalDevice, cullPipeline, nullptr);
+	vkDestroyPipelineLayout(mainDevice.logicalDevice, cullPipelineLayout, nullptr);
+	vkDestroyDescriptorPool(mainDevice.logicalDevice, cullDescriptorPool, nullptr);
+	vkDestroyDescriptorSetLayout(mainDevice.logicalDevice, depthPyramidDescriptorSetLayout, nullptr);
+	vkDestroyDescriptorSetLayout(mainDevice.logicalDevice, cullDescriptorSetLayout, nullptr);
+	for (auto& levelView : depthPyramidLevelViews)
+	{
+		vkDestroyImageView(mainDevice.logicalDevice, levelView, nullptr);
+	}
+	vkDestroyImageView(mainDevice.logicalDevice, depthPyramidImageView, nullptr);
+	vkDestroyImage(mainDevice.logicalDevice, depthPyramidImage, nullptr);
+	memoryAllocator.free(depthPyramidImageMemory);
 
-	// Cleanup textures
+	// Streamed images still uploading, or waiting to be destroyed
+	if (streamingUploading)
+	{
+		streamingBatch.wait();
+		installStreamedTextures();
+	}
+	for (auto& retired : retiredTextureImages)
+	{
+		vkDestroyImageView(mainDevice.logicalDevice, retired.imageView, nullptr);
+		vkDestroyImage(mainDevice.logicalDevice, retired.image, nullptr);
+		memoryAllocator.free(retired.imageMemory);
+	}
+	retiredTextureImages.clear();
+	textureStreamer.cleanup();
+
+	stagingRing.cleanup();
+	samplerCache.cleanup();
+
+	// Cleanup textures (skipping ones already released)
+	textureRegistry.cleanup();
+	textureCache.cleanup();
+	meshCache.cleanup();
 	for (size_t i = 0; i < textureImages.size(); i++)
 	{
+		if (textureImages[i] == VK_NULL_HANDLE) continue;
 		vkDestroyImageView(mainDevice.logicalDevice, textureImageViews[i], nullptr);
 		vkDestroyImage(mainDevice.logicalDevice, textureImages[i], nullptr);
-		vkFreeMemory(mainDevice.logicalDevice, textureImageMemory[i], nullptr);
+		memoryAllocator.free(textureImageMemory[i]);
 	}
 
 	// Cleanup Depth Buffer
@@ -150,7 +217,7 @@ void VulkanRenderer::cleanup()
 	{
 		vkDestroyImageView(mainDevice.logicalDevice, depthBufferImageView[i], nullptr);
 		vkDestroyImage(mainDevice.logicalDevice, depthBufferImage[i], nullptr);
-		vkFreeMemory(mainDevice.logicalDevice, depthBufferImageMemory[i], nullptr);
+		memoryAllocator.free(depthBufferImageMemory[i]);
 	}
 	
 	// Cleanup Color Buffer
@@ -158,7 +225,7 @@ void VulkanRenderer::cleanup()
 	{
 		vkDestroyImageView(mainDevice.logicalDevice, colorBufferImageView[i], nullptr);
 		vkDestroyImage(mainDevice.logicalDevice, colorBufferImage[i], nullptr);
-		vkFreeMemory(mainDevice.logicalDevice, colorBufferImageMemory[i], nullptr);
+		memoryAllocator.free(colorBufferImageMemory[i]);
 	}
 
 	//don't need to free Descriptor Sets because they're be automatically released after Descriptor Pool destroy
@@ -178,8 +245,7 @@ void VulkanRenderer::cleanup()
 		/*vkDestroyBuffer(mainDevice.logicalDevice, modelUniformBufferDynamic[i], nullptr);
 		vkFreeMemory(mainDevice.logicalDevice, modelUniformBufferMemoryDynamic[i], nullptr);*/
 
-		vkDestroyBuffer(mainDevice.logicalDevice, vpUniformBuffer[i], nullptr);
-		vkFreeMemory(mainDevice.logicalDevice, vpUniformBufferMemory[i], nullptr);
+		destroyBuffer(mainDevice.logicalDevice, &memoryAllocator, vpUniformBuffer[i], &vpUniformBufferMemory[i]);
 	}
 
 	for (size_t i = 0; i < MAX_FRAME_DRAWS; i++)
@@ -194,6 +260,7 @@ void VulkanRenderer::cleanup()
 	/*vkFreeCommandBuffers(mainDevice.logicalDevice, graphicsCommandPool, static_cast<uint32_t>(commandBuffers.size()), commandBuffers.data());
 	commandBuffers.clear();*/
 
+	vkDestroyCommandPool(mainDevice.logicalDevice, transferCommandPool, nullptr);
 	vkDestroyCommandPool(mainDevice.logicalDevice, graphicsCommandPool, nullptr);
 
 	for (auto &frameBuffer : swapchainFramebuffers)
@@ -205,6 +272,9 @@ void VulkanRenderer::cleanup()
 	vkDestroyPipeline(mainDevice.logicalDevice, secondPipeline, nullptr);
 	vkDestroyPipelineLayout(mainDevice.logicalDevice, secondPipelineLayout, nullptr);
 
+	vkDestroyPipeline(mainDevice.logicalDevice, closedVertexColorPipeline, nullptr);
+	vkDestroyPipeline(mainDevice.logicalDevice, closedPipeline, nullptr);
+	vkDestroyPipeline(mainDevice.logicalDevice, vertexColorPipeline, nullptr);
 	vkDestroyPipeline(mainDevice.logicalDevice, graphicsPipeline, nullptr);
 	vkDestroyPipelineLayout(mainDevice.logicalDevice, pipelineLayout, nullptr);
 
@@ -224,6 +294,9 @@ void VulkanRenderer::cleanup()
 		DestroyDebugUtilsMessengerEXT(instance, debugMessenger, nullptr);
 	}
 
+	// All resources are gone by now, so release the memory blocks themselves
+	memoryAllocator.cleanup();
+
 	vkDestroyDevice(mainDevice.logicalDevice, nullptr);
 	vkDestroyInstance(instance, nullptr);
 	
@@ -332,7 +405,7 @@ void VulkanRenderer::createLogicalDevice()
 	std::vector<VkDeviceQueueCreateInfo> queueCreateInfos;
 	//set for queue family indices. it's only for unique ints, 
 	//so we're sure there won't be duplicate queue family indices, which will result into app crash
-	std::set<int> queueFamilyIndices = {indices.graphicsFamily, indices.presentationFamily};
+	std::set<int> queueFamilyIndices = {indices.graphicsFamily, indices.presentationFamily, indices.transferFamily};
 
 	for (int queueFamilyIndex : queueFamilyIndices)
 	{
@@ -347,14 +420,29 @@ void VulkanRenderer::createLogicalDevice()
 	}
 	
 
+	VkPhysicalDeviceFeatures supportedFeatures;
+	vkGetPhysicalDeviceFeatures(mainDevice.physicalDevice, &supportedFeatures);
+
 	VkPhysicalDeviceFeatures deviceFeatures = {};
 	deviceFeatures.samplerAnisotropy = VK_TRUE; //Enable Anisotropy
+	deviceFeatures.textureCompressionBC = supportedFeatures.textureCompressionBC; //Enable BCn textures if we have them
+	deviceFeatures.shaderSampledImageArrayDynamicIndexing = VK_TRUE; //Index the texture array with the push constant
+	deviceFeatures.fragmentStoresAndAtomics = VK_TRUE; //Fragment shader writes texture streaming feedback
+
+	// Descriptor indexing: one partially bound texture array that can be added to while frames use it
+	VkPhysicalDeviceDescriptorIndexingFeaturesEXT descriptorIndexingFeatures = {};
+	descriptorIndexingFeatures.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_DESCRIPTOR_INDEXING_FEATURES_EXT;
+	descriptorIndexingFeatures.runtimeDescriptorArray = VK_TRUE;
+	descriptorIndexingFeatures.descriptorBindingPartiallyBound = VK_TRUE;
+	descriptorIndexingFeatures.descriptorBindingSampledImageUpdateAfterBind = VK_TRUE;
+	descriptorIndexingFeatures.descriptorBindingUpdateUnusedWhilePending = VK_TRUE;
 
 	//TMP: no device features
 	//vkGetPhysicalDeviceFeatures(mainDevice.physicalDevice, &deviceFeatures);
 
 	VkDeviceCreateInfo deviceCreateInfo = {};
 	deviceCreateInfo.sType = VK_STRUCTURE_TYPE_DEVICE_CREATE_INFO;
+	deviceCreateInfo.pNext = &descriptorIndexingFeatures;
 	deviceCreateInfo.queueCreateInfoCount = static_cast<uint32_t>(queueCreateInfos.size());
 	deviceCreateInfo.pQueueCreateInfos = queueCreateInfos.data();
 	deviceCreateInfo.enabledExtensionCount = static_cast<uint32_t>(deviceExtensions.size());
@@ -376,6 +464,34 @@ void VulkanRenderer::createLogicalDevice()
 		//from given logical device, given queue family, given queue index, place reference in given VkQueue instance
 		vkGetDeviceQueue(mainDevice.logicalDevice, indices.graphicsFamily, 0, &graphicsQueue);
 		vkGetDeviceQueue(mainDevice.logicalDevice, indices.presentationFamily, 0, &presentationQueue);
+		vkGetDeviceQueue(mainDevice.logicalDevice, indices.transferFamily, 0, &transferQueue);
+
+		// Pre-compressed textures are only used if every format they can come in works
+		compressedTextureSupport = deviceFeatures.textureCompressionBC && checkCompressedTextureSupport();
+		printf("Compressed (BCn) textures %s \n", compressedTextureSupport ? "supported" : "not supported, using source images");
+
+		textureMipSkip = getTextureMipSkip(TEXTURE_QUALITY);
+		printf("Texture quality: 1/%u resolution \n", 1u << textureMipSkip);
+
+		// Texture & sampler arrays can't be bigger than the device allows for update after bind descriptors
+		VkPhysicalDeviceDescriptorIndexingPropertiesEXT descriptorIndexingProperties = {};
+		descriptorIndexingProperties.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_DESCRIPTOR_INDEXING_PROPERTIES_EXT;
+		VkPhysicalDeviceProperties2 deviceProperties = {};
+		deviceProperties.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_PROPERTIES_2;
+		deviceProperties.pNext = &descriptorIndexingProperties;
+		vkGetPhysicalDeviceProperties2(mainDevice.physicalDevice, &deviceProperties);
+		maxTextures = std::min({ MAX_TEXTURES,
+			descriptorIndexingProperties.maxPerStageDescriptorUpdateAfterBindSampledImages,
+			descriptorIndexingProperties.maxDescriptorSetUpdateAfterBindSampledImages });
+		maxSamplers = std::min({ MAX_SAMPLERS,
+			descriptorIndexingProperties.maxPerStageDescriptorUpdateAfterBindSamplers,
+			descriptorIndexingProperties.maxDescriptorSetUpdateAfterBindSamplers,
+			deviceProperties.properties.limits.maxSamplerAllocationCount });
+
+		if (indices.transferFamily != indices.graphicsFamily)
+		{
+			printf("SUCCESS: Using dedicated transfer queue family %d for uploads\n", indices.transferFamily);
+		}
 	}
 }
 
@@ -494,7 +610,7 @@ void VulkanRenderer::createSwapChain()
 			SwapchainImage swapchainImage = {};
 			swapchainImage.image = image;
 			//create image view & store it
-			swapchainImage.imageView = createImageView(image, swapchainImageFormat, VK_IMAGE_ASPECT_COLOR_BIT);
+			swapchainImage.imageView = createImageView(image, swapchainImageFormat, VK_IMAGE_ASPECT_COLOR_BIT, 1);
 
 			swapchainImages.push_back(swapchainImage);
 			
@@ -539,12 +655,12 @@ void VulkanRenderer::createRenderPass()
 	depthAttachment.format = depthImageFormat;
 	depthAttachment.samples = VK_SAMPLE_COUNT_1_BIT;
 	depthAttachment.loadOp = VK_ATTACHMENT_LOAD_OP_CLEAR;
-	depthAttachment.storeOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
+	depthAttachment.storeOp = VK_ATTACHMENT_STORE_OP_STORE;		// Kept for the depth pyramid the meshlet cull pass reads
 	depthAttachment.stencilLoadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE;
 	depthAttachment.stencilStoreOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
 
 	depthAttachment.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
-	depthAttachment.finalLayout = VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL;
+	depthAttachment.finalLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;		// Same as subpass 2 reads it in, then sampled by the depth pyramid
 
 	// Color Attachment (Input) Reference
 	VkAttachmentReference colorAttachmentReference = {};
@@ -606,7 +722,7 @@ void VulkanRenderer::createRenderPass()
 	// SUBPASS DEPENDENCIES
 
 	// Need to determine when layout transitions occur using subpass dependencies
-	std::array<VkSubpassDependency, 3> subpassDeps;
+	std::array<VkSubpassDependency, 4> subpassDeps;
 
 	// 1. Conversion from VK_IMAGE_LAYOUT_UNDEFINED to VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL
 	// Must happen after the END of external subpass
@@ -615,8 +731,10 @@ void VulkanRenderer::createRenderPass()
 	subpassDeps[0].srcAccessMask = VK_ACCESS_MEMORY_READ_BIT; // Stage memory mask. (VK_ACCESS_MEMORY_READ_BIT = memory stage must happen before conversion to be able to read it)
 	// BUT must happen before the color output of our main subpass (at 0)
 	subpassDeps[0].dstSubpass = 0;
-	subpassDeps[0].dstStageMask = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT;
-	subpassDeps[0].dstAccessMask = VK_ACCESS_COLOR_ATTACHMENT_READ_BIT | VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT; //and before when can read\write from this thing
+	subpassDeps[0].dstStageMask = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT |
+		VK_PIPELINE_STAGE_EARLY_FRAGMENT_TESTS_BIT | VK_PIPELINE_STAGE_LATE_FRAGMENT_TESTS_BIT;	// Depth too, the depth pyramid read it last frame
+	subpassDeps[0].dstAccessMask = VK_ACCESS_COLOR_ATTACHMENT_READ_BIT | VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT |
+		VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT; //and before when can read\write from this thing
 	subpassDeps[0].dependencyFlags = 0;
 
 	// 2. Subpass 1 layout (color/depth) to Subpass 2 (Shader read)
@@ -639,6 +757,15 @@ void VulkanRenderer::createRenderPass()
 	subpassDeps[2].dstAccessMask = VK_ACCESS_MEMORY_READ_BIT; // and before when can read\write from this thing
 	subpassDeps[2].dependencyFlags = 0;
 
+	// 4. Depth written by subpass 1 (and read by subpass 2), to the depth pyramid's compute shader after the render pass
+	subpassDeps[3].srcSubpass = 1;
+	subpassDeps[3].srcStageMask = VK_PIPELINE_STAGE_LATE_FRAGMENT_TESTS_BIT | VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT;
+	subpassDeps[3].srcAccessMask = VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT;
+	subpassDeps[3].dstSubpass = VK_SUBPASS_EXTERNAL;
+	subpassDeps[3].dstStageMask = VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT;
+	subpassDeps[3].dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
+	subpassDeps[3].dependencyFlags = 0;
+
 	std::vector<VkAttachmentDescription> attachments = {swapchainColorAttachment, colorAttachment, depthAttachment};
 	// Create Info for Render Pass
 	VkRenderPassCreateInfo renderPassCreateInfo = {};
@@ -694,18 +821,52 @@ void VulkanRenderer::createDescriptorSetLayout()
 	}
 
 	// SAMPLER DESCRIPTOR SET LAYOUT
-	// Texture binding info
+	// Texture binding info: array of every texture, picked per draw by texture ID
+	VkDescriptorSetLayoutBinding textureLayoutBinding = {};
+	textureLayoutBinding.binding = 0;
+	textureLayoutBinding.descriptorType = VK_DESCRIPTOR_TYPE_SAMPLED_IMAGE;
+	textureLayoutBinding.descriptorCount = maxTextures;
+	textureLayoutBinding.stageFlags = VK_SHADER_STAGE_FRAGMENT_BIT;
+	textureLayoutBinding.pImmutableSamplers = nullptr;
+	// Sampler binding info: array of every distinct sampler, picked per draw by sampler ID
 	VkDescriptorSetLayoutBinding samplerLayoutBinding = {};
-	samplerLayoutBinding.binding = 0;
-	samplerLayoutBinding.descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
-	samplerLayoutBinding.descriptorCount = 1;
+	samplerLayoutBinding.binding = 1;
+	samplerLayoutBinding.descriptorType = VK_DESCRIPTOR_TYPE_SAMPLER;
+	samplerLayoutBinding.descriptorCount = maxSamplers;
 	samplerLayoutBinding.stageFlags = VK_SHADER_STAGE_FRAGMENT_BIT;
 	samplerLayoutBinding.pImmutableSamplers = nullptr;
+	// Material binding info: buffer of every material, picked per draw by material ID
+	VkDescriptorSetLayoutBinding materialLayoutBinding = {};
+	materialLayoutBinding.binding = 2;
+	materialLayoutBinding.descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+	materialLayoutBinding.descriptorCount = 1;
+	materialLayoutBinding.stageFlags = VK_SHADER_STAGE_FRAGMENT_BIT;
+	materialLayoutBinding.pImmutableSamplers = nullptr;
+	// Texture streaming binding info: each texture's current descriptor element, and the feedback of which levels it needs
+	VkDescriptorSetLayoutBinding streamingLayoutBinding = {};
+	streamingLayoutBinding.binding = 3;
+	streamingLayoutBinding.descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+	streamingLayoutBinding.descriptorCount = 1;
+	streamingLayoutBinding.stageFlags = VK_SHADER_STAGE_FRAGMENT_BIT;
+	streamingLayoutBinding.pImmutableSamplers = nullptr;
+	std::vector<VkDescriptorSetLayoutBinding> textureBindings = { textureLayoutBinding, samplerLayoutBinding, materialLayoutBinding,
+		streamingLayoutBinding };
+	// Unused elements can stay empty, and new ones are written while frames using the arrays are in flight
+	// (the material & streaming buffer descriptors never change, only the buffers' contents do)
+	VkDescriptorBindingFlagsEXT arrayBindingFlags = VK_DESCRIPTOR_BINDING_PARTIALLY_BOUND_BIT_EXT |
+		VK_DESCRIPTOR_BINDING_UPDATE_AFTER_BIND_BIT_EXT | VK_DESCRIPTOR_BINDING_UPDATE_UNUSED_WHILE_PENDING_BIT_EXT;
+	std::vector<VkDescriptorBindingFlagsEXT> textureBindingFlags = { arrayBindingFlags, arrayBindingFlags, 0, 0 };
+	VkDescriptorSetLayoutBindingFlagsCreateInfoEXT textureBindingFlagsInfo = {};
+	textureBindingFlagsInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_BINDING_FLAGS_CREATE_INFO_EXT;
+	textureBindingFlagsInfo.bindingCount = static_cast<uint32_t>(textureBindingFlags.size());
+	textureBindingFlagsInfo.pBindingFlags = textureBindingFlags.data();
 	// Texture create info
 	VkDescriptorSetLayoutCreateInfo textureLayoutCreateInfo = {};
 	textureLayoutCreateInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
-	textureLayoutCreateInfo.bindingCount = 1;
-	textureLayoutCreateInfo.pBindings = &samplerLayoutBinding;
+	textureLayoutCreateInfo.pNext = &textureBindingFlagsInfo;
+	textureLayoutCreateInfo.flags = VK_DESCRIPTOR_SET_LAYOUT_CREATE_UPDATE_AFTER_BIND_POOL_BIT_EXT;
+	textureLayoutCreateInfo.bindingCount = static_cast<uint32_t>(textureBindings.size());
+	textureLayoutCreateInfo.pBindings = textureBindings.data();
 
 	result = vkCreateDescriptorSetLayout(mainDevice.logicalDevice, &textureLayoutCreateInfo, nullptr, &samplerDescriptorSetLayout);
 	if (result != VK_SUCCESS)
@@ -749,17 +910,24 @@ void VulkanRenderer::createPushConstantRange()
 	// Define push constant values (no 'create' needed)
 	pushConstantRange.stageFlags = VK_SHADER_STAGE_VERTEX_BIT;	// Shader stage push constant will go to
 	pushConstantRange.offset = 0;								// Offset into given data to pass to push constant
-	pushConstantRange.size = sizeof(Model);						// Size of data being passed to push constant
+	pushConstantRange.size = sizeof(Model) + sizeof(PushMeshBounds);	// Size of data being passed to push constant
+
+	// Material ID follows the model matrix & mesh bounds
+	materialPushConstantRange.stageFlags = VK_SHADER_STAGE_FRAGMENT_BIT;
+	materialPushConstantRange.offset = sizeof(Model) + sizeof(PushMeshBounds);
+	materialPushConstantRange.size = sizeof(PushMaterial);
 }
 
 void VulkanRenderer::createGraphicsPipeline()
 {
 	//read the SPIR-V code of shaders
 	auto vertexShaderCode = readFile("Shaders/vert.spv");
+	auto colorVertexShaderCode = readFile("Shaders/vert_color.spv");	// Same shader, built with VERTEX_COLORS
 	auto fragmentShaderCode = readFile("Shaders/frag.spv");
 
 	//Build Shader Modules to link to Graphics Pipeline
 	VkShaderModule vertexShaderModule = createShaderModule(vertexShaderCode);
+	VkShaderModule colorVertexShaderModule = createShaderModule(colorVertexShaderCode);
 	VkShaderModule fragmentShaderModule = createShaderModule(fragmentShaderCode);
 
 	// -- SHADER STATE CREATION INFORMATION --
@@ -777,6 +945,10 @@ void VulkanRenderer::createGraphicsPipeline()
 	fragmentShaderCreateInfo.stage = VK_SHADER_STAGE_FRAGMENT_BIT;
 	fragmentShaderCreateInfo.pName = "main";
 	VkPipelineShaderStageCreateInfo shaderStages[] = { vertexShaderCreateInfo, fragmentShaderCreateInfo };
+	//Meshes with vertex colours use the vertex shader that reads them
+	VkPipelineShaderStageCreateInfo colorVertexShaderCreateInfo = vertexShaderCreateInfo;
+	colorVertexShaderCreateInfo.module = colorVertexShaderModule;
+	VkPipelineShaderStageCreateInfo colorShaderStages[] = { colorVertexShaderCreateInfo, fragmentShaderCreateInfo };
 	//Geometry stage creation information
 	VkPipelineShaderStageCreateInfo geometryShaderCreateInfo = {};
 	geometryShaderCreateInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
@@ -784,45 +956,29 @@ void VulkanRenderer::createGraphicsPipeline()
 	geometryShaderCreateInfo.stage = VK_SHADER_STAGE_GEOMETRY_BIT;
 	geometryShaderCreateInfo.pName = "main";
 
-	//How the data for a single vertex (including info such as pos, color, text coords, normals, etc) is as a whole
-	VkVertexInputBindingDescription bindingDescription = {};
-	bindingDescription.binding = 0;								//Can bind multiple streams of data, so define each one
-	bindingDescription.stride = sizeof(Vertex);					//Size of a single vertex object
-	bindingDescription.inputRate = VK_VERTEX_INPUT_RATE_VERTEX;	//How to move between data after each vertex
-																//VK_VERTEX_INPUT_RATE_VERTEX	: move on to the next vertex (draw object by object)
-																//VK_VERTEX_INPUT_RATE_INSTANCE : move on to a vertex of the next instance (draw all 1st vertices in all instances, then 2nd vertices and so on
-
-	//How the data for an attribute is defined withing a vertex
-	std::array<VkVertexInputAttributeDescription, 4> attributeDescriptions;
-	//Position attribute
-	attributeDescriptions[0].binding = 0;							//Which binding the data is at (should be same as above, unless you have multiple streams of data)
-	attributeDescriptions[0].location = 0;							//Location in shader where data will be read from
-	attributeDescriptions[0].format = VK_FORMAT_R32G32B32_SFLOAT;	//Format the data will take (also helps define size of data)
-	attributeDescriptions[0].offset = offsetof(Vertex, pos);		//Where this attribute is defined in the data for a single vertex
-	//Color attribute
-	attributeDescriptions[1].binding = 0;							
-	attributeDescriptions[1].location = 1;							
-	attributeDescriptions[1].format = VK_FORMAT_R32G32B32A32_SFLOAT;		//VK_FORMAT_R8G8B8A8_SRGB
-	attributeDescriptions[1].offset = offsetof(Vertex, col);
-	//Normal attribute
-	attributeDescriptions[2].binding = 0;
-	attributeDescriptions[2].location = 2;
-	attributeDescriptions[2].format = VK_FORMAT_R32G32B32_SFLOAT;
-	attributeDescriptions[2].offset = offsetof(Vertex, normal);
-	//UVs attribute
-	attributeDescriptions[3].binding = 0;
-	attributeDescriptions[3].location = 3;
-	attributeDescriptions[3].format = VK_FORMAT_R32G32_SFLOAT;
-	attributeDescriptions[3].offset = offsetof(Vertex, UVs);
-
-	// -- 1. VERTEX INPUT (TODO: Put in vertex descriptions when resources created) --
+	//How the data for a single vertex (including info such as pos, color, text coords, normals, etc) is as a whole:
+	//packed vertices (see VertexFormat.h), and a second stream with the colours of meshes that have them
+	std::vector<VkVertexInputBindingDescription> bindingDescriptions = getVertexBindingDescriptions(false);
+	std::vector<VkVertexInputBindingDescription> colorBindingDescriptions = getVertexBindingDescriptions(true);
+
+	//How the data for an attribute is defined withing a vertex (location, binding, format & offset of each one)
+	std::vector<VkVertexInputAttributeDescription> attributeDescriptions = getVertexAttributeDescriptions(false);
+	std::vector<VkVertexInputAttributeDescription> colorAttributeDescriptions = getVertexAttributeDescriptions(true);
+
+	// -- 1. VERTEX INPUT --
 	VkPipelineVertexInputStateCreateInfo vertexInputCreateInfo = {};
 	vertexInputCreateInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_VERTEX_INPUT_STATE_CREATE_INFO;
-	vertexInputCreateInfo.vertexBindingDescriptionCount = 1;
-	vertexInputCreateInfo.pVertexBindingDescriptions = &bindingDescription;											//List of Vertex BInding Descriptions (data spacing/stride info)
+	vertexInputCreateInfo.vertexBindingDescriptionCount = static_cast<uint32_t>(bindingDescriptions.size());
+	vertexInputCreateInfo.pVertexBindingDescriptions = bindingDescriptions.data();									//List of Vertex BInding Descriptions (data spacing/stride info)
 	vertexInputCreateInfo.vertexAttributeDescriptionCount = static_cast<uint32_t>(attributeDescriptions.size());
 	vertexInputCreateInfo.pVertexAttributeDescriptions = attributeDescriptions.data();								//List of Vertex Attribute Descriptions (data format, where to bind to\from)
 
+	VkPipelineVertexInputStateCreateInfo colorVertexInputCreateInfo = vertexInputCreateInfo;
+	colorVertexInputCreateInfo.vertexBindingDescriptionCount = static_cast<uint32_t>(colorBindingDescriptions.size());
+	colorVertexInputCreateInfo.pVertexBindingDescriptions = colorBindingDescriptions.data();
+	colorVertexInputCreateInfo.vertexAttributeDescriptionCount = static_cast<uint32_t>(colorAttributeDescriptions.size());
+	colorVertexInputCreateInfo.pVertexAttributeDescriptions = colorAttributeDescriptions.data();
+
 	// -- 2. INPUT ASSEMBLY --
 	VkPipelineInputAssemblyStateCreateInfo inputAssemblyCreateInfo = {};
 	inputAssemblyCreateInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_INPUT_ASSEMBLY_STATE_CREATE_INFO;
@@ -921,8 +1077,9 @@ void VulkanRenderer::createGraphicsPipeline()
 	pipelineLayoutCreateInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
 	pipelineLayoutCreateInfo.setLayoutCount = static_cast<uint32_t>(descriptorSetLayouts.size());
 	pipelineLayoutCreateInfo.pSetLayouts = descriptorSetLayouts.data();
-	pipelineLayoutCreateInfo.pushConstantRangeCount = 1;
-	pipelineLayoutCreateInfo.pPushConstantRanges = &pushConstantRange;
+	std::vector<VkPushConstantRange> pushConstantRanges = { pushConstantRange, materialPushConstantRange };
+	pipelineLayoutCreateInfo.pushConstantRangeCount = static_cast<uint32_t>(pushConstantRanges.size());
+	pipelineLayoutCreateInfo.pPushConstantRanges = pushConstantRanges.data();
 
 	VkResult result = vkCreatePipelineLayout(mainDevice.logicalDevice, &pipelineLayoutCreateInfo, nullptr, &pipelineLayout);
 	if (result != VK_SUCCESS)
@@ -960,14 +1117,36 @@ void VulkanRenderer::createGraphicsPipeline()
 	pipelineCreateInfo.basePipelineHandle = VK_NULL_HANDLE;				//Existing pipeline to derive from...
 	pipelineCreateInfo.basePipelineIndex = -1;							//or index of base pipeline other pipelines should be derived from (in case creating multiple at once)
 
-	result = vkCreateGraphicsPipelines(mainDevice.logicalDevice, VK_NULL_HANDLE, 1, &pipelineCreateInfo, nullptr, &graphicsPipeline);
+	//Vertex colour variant: only the vertex shader & input differ
+	VkGraphicsPipelineCreateInfo colorPipelineCreateInfo = pipelineCreateInfo;
+	colorPipelineCreateInfo.pStages = colorShaderStages;
+	colorPipelineCreateInfo.pVertexInputState = &colorVertexInputCreateInfo;
+
+	//Closed mesh variants: back faces are always hidden behind front ones, so they're culled
+	VkPipelineRasterizationStateCreateInfo closedRasterizationCreateInfo = rasterizationCreateInfo;
+	closedRasterizationCreateInfo.cullMode = VK_CULL_MODE_BACK_BIT;
+	VkGraphicsPipelineCreateInfo closedPipelineCreateInfo = pipelineCreateInfo;
+	closedPipelineCreateInfo.pRasterizationState = &closedRasterizationCreateInfo;
+	VkGraphicsPipelineCreateInfo closedColorPipelineCreateInfo = colorPipelineCreateInfo;
+	closedColorPipelineCreateInfo.pRasterizationState = &closedRasterizationCreateInfo;
+
+	std::array<VkGraphicsPipelineCreateInfo, 4> pipelineCreateInfos = { pipelineCreateInfo, colorPipelineCreateInfo,
+		closedPipelineCreateInfo, closedColorPipelineCreateInfo };
+	std::array<VkPipeline, 4> pipelines;
+	result = vkCreateGraphicsPipelines(mainDevice.logicalDevice, VK_NULL_HANDLE, static_cast<uint32_t>(pipelineCreateInfos.size()),
+		pipelineCreateInfos.data(), nullptr, pipelines.data());
 	if (result != VK_SUCCESS)
 	{
 		throw std::runtime_error("Unable to create pipeline(-s)!");
 	}
+	graphicsPipeline = pipelines[0];
+	vertexColorPipeline = pipelines[1];
+	closedPipeline = pipelines[2];
+	closedVertexColorPipeline = pipelines[3];
 
 	//we don't need shader modules anymore after pipeline creation -> delete 'em
 	vkDestroyShaderModule(mainDevice.logicalDevice, fragmentShaderModule, nullptr);
+	vkDestroyShaderModule(mainDevice.logicalDevice, colorVertexShaderModule, nullptr);
 	vkDestroyShaderModule(mainDevice.logicalDevice, vertexShaderModule, nullptr);
 	
 	// CREATE SECOND PASS PIPELINE
@@ -1034,13 +1213,13 @@ void VulkanRenderer::createColorBufferImage()
 	for (size_t i = 0; i < swapchainImages.size(); i++)
 	{
 		// Create Color Buffer Image
-		colorBufferImage[i] = createImage(swapchainExtent.width, swapchainExtent.height, colorImageFormat,
+		colorBufferImage[i] = createImage(swapchainExtent.width, swapchainExtent.height, 1, colorImageFormat,
 			VK_IMAGE_TILING_OPTIMAL, VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT | VK_IMAGE_USAGE_INPUT_ATTACHMENT_BIT, 
 			VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
 			&colorBufferImageMemory[i]);
 
 		// Create Color Buffer Image View
-		colorBufferImageView[i] = createImageView(colorBufferImage[i], colorImageFormat, VK_IMAGE_ASPECT_COLOR_BIT);
+		colorBufferImageView[i] = createImageView(colorBufferImage[i], colorImageFormat, VK_IMAGE_ASPECT_COLOR_BIT, 1);
 	}
 }
 
@@ -1049,15 +1228,25 @@ void VulkanRenderer::createDepthBufferImage()
 	depthBufferImage.resize(swapchainImages.size());
 	depthBufferImageMemory.resize(swapchainImages.size());
 	depthBufferImageView.resize(swapchainImages.size());
+
+	// Meshlets are tested for occlusion against a pyramid built from the depth buffer, if its format can be sampled
+	occlusionCulling = MESHLET_CULLING && MESHLET_OCCLUSION_CULLING &&
+		checkFormatSupport(depthImageFormat, VK_IMAGE_TILING_OPTIMAL, VK_FORMAT_FEATURE_SAMPLED_IMAGE_BIT);
+	VkImageUsageFlags depthUsage = VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT | VK_IMAGE_USAGE_INPUT_ATTACHMENT_BIT;
+	if (occlusionCulling)
+	{
+		depthUsage |= VK_IMAGE_USAGE_SAMPLED_BIT;
+	}
+
 	for (size_t i = 0; i < swapchainImages.size(); i++)
 	{
 		// Create Depth Buffer Image
-		depthBufferImage[i] = createImage(swapchainExtent.width, swapchainExtent.height, depthImageFormat,
-			VK_IMAGE_TILING_OPTIMAL, VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT | VK_IMAGE_USAGE_INPUT_ATTACHMENT_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
+		depthBufferImage[i] = createImage(swapchainExtent.width, swapchainExtent.height, 1, depthImageFormat,
+			VK_IMAGE_TILING_OPTIMAL, depthUsage, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
 			&depthBufferImageMemory[i]);
 
 		// Create Depth Buffer Image View
-		depthBufferImageView[i] = createImageView(depthBufferImage[i], depthImageFormat, VK_IMAGE_ASPECT_DEPTH_BIT);
+		depthBufferImageView[i] = createImageView(depthBufferImage[i], depthImageFormat, VK_IMAGE_ASPECT_DEPTH_BIT, 1);
 	}
 	
 }
@@ -1104,6 +1293,15 @@ void VulkanRenderer::createCommandPool()
 	{
 		throw std::runtime_error("Unable to create graphics command pool");
 	}
+
+	// Separate pool for upload command buffers, they're submitted to the transfer queue
+	createInfo.flags = VK_COMMAND_POOL_CREATE_TRANSIENT_BIT;			//Upload command buffers are short lived
+	createInfo.queueFamilyIndex = queueFamilyIndices.transferFamily;
+	result = vkCreateCommandPool(mainDevice.logicalDevice, &createInfo, nullptr, &transferCommandPool);
+	if (result != VK_SUCCESS)
+	{
+		throw std::runtime_error("Unable to create transfer command pool");
+	}
 }
 
 void VulkanRenderer::createCommandBuffers()
@@ -1160,6 +1358,14 @@ void VulkanRenderer::createSynchronization()
 }
 
 void VulkanRenderer::createTextureSampler()
+{
+	samplerCache.init(mainDevice.logicalDevice, maxSamplers);
+
+	// Sampler for textures that don't ask for anything else
+	defaultSamplerId = createSampler(getDefaultSamplerCreateInfo());
+}
+
+VkSamplerCreateInfo VulkanRenderer::getDefaultSamplerCreateInfo()
 {
 	// Sapmler Create Info
 	VkSamplerCreateInfo samplerCreateInfo = {};
@@ -1174,16 +1380,63 @@ void VulkanRenderer::createTextureSampler()
 	samplerCreateInfo.mipmapMode = VK_SAMPLER_MIPMAP_MODE_LINEAR;		// Mipmap interpolation mode
 	samplerCreateInfo.mipLodBias = 0.0f;								// Level of Details bias for mip level
 	samplerCreateInfo.minLod = 0;										// Minimum Level of Detail to pick mip level
-	samplerCreateInfo.maxLod = 0;										// Maximum Level of Detail to pick mip level
+	samplerCreateInfo.maxLod = VK_LOD_CLAMP_NONE;						// Maximum Level of Detail to pick mip level (no limit, use all of the image's levels)
 	samplerCreateInfo.anisotropyEnable = VK_TRUE;						// Enable Anisotropy
 	samplerCreateInfo.maxAnisotropy = 16;								// Anisotropy sample level
 
-	VkResult result = vkCreateSampler(mainDevice.logicalDevice, &samplerCreateInfo, nullptr, &textureSampler);
-	if (result != VK_SUCCESS)
+	return samplerCreateInfo;
+}
+
+uint32_t VulkanRenderer::createSampler(const VkSamplerCreateInfo& samplerCreateInfo)
+{
+	// Same settings give the same (shared) sampler
+	bool created;
+	uint32_t samplerId = samplerCache.getSamplerId(samplerCreateInfo, &created);
+
+	// New ones are added to the sampler array
+	if (created)
+	{
+		VkDescriptorImageInfo samplerInfo = {};
+		samplerInfo.sampler = samplerCache.getSampler(samplerId);
+
+		VkWriteDescriptorSet descriptorWrite = {};
+		descriptorWrite.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+		descriptorWrite.dstSet = textureDescriptorSet;
+		descriptorWrite.dstBinding = 1;
+		descriptorWrite.dstArrayElement = samplerId;
+		descriptorWrite.descriptorType = VK_DESCRIPTOR_TYPE_SAMPLER;
+		descriptorWrite.descriptorCount = 1;
+		descriptorWrite.pImageInfo = &samplerInfo;
+
+		vkUpdateDescriptorSets(mainDevice.logicalDevice, 1, &descriptorWrite, 0, nullptr);
+	}
+
+	return samplerId;
+}
+
+uint32_t VulkanRenderer::createMaterialSampler(const TextureAddressing& addressing)
+{
+	auto toAddressMode = [](aiTextureMapMode mode)
+	{
+		switch (mode)
+		{
+		case aiTextureMapMode_Clamp: return VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+		case aiTextureMapMode_Mirror: return VK_SAMPLER_ADDRESS_MODE_MIRRORED_REPEAT;
+		case aiTextureMapMode_Decal: return VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_BORDER;	// Nothing outside the texture
+		default: return VK_SAMPLER_ADDRESS_MODE_REPEAT;
+		}
+	};
+
+	// Default settings with the material's addressing
+	VkSamplerCreateInfo samplerCreateInfo = getDefaultSamplerCreateInfo();
+	samplerCreateInfo.addressModeU = toAddressMode(addressing.modeU);
+	samplerCreateInfo.addressModeV = toAddressMode(addressing.modeV);
+	if (addressing.modeU == aiTextureMapMode_Decal || addressing.modeV == aiTextureMapMode_Decal)
 	{
-		throw std::runtime_error("Failed to create sampler!");
+		samplerCreateInfo.borderColor = VK_BORDER_COLOR_FLOAT_TRANSPARENT_BLACK;
 	}
 
+	return createSampler(samplerCreateInfo);
 }
 
 void VulkanRenderer::createUniformBuffers()
@@ -1204,7 +1457,7 @@ void VulkanRenderer::createUniformBuffers()
 	// Create Uniform Buffers
 	for (size_t i = 0; i < swapchainImages.size(); i++)
 	{
-		createBuffer(mainDevice.physicalDevice, mainDevice.logicalDevice, vpBufferSize,
+		createBuffer(mainDevice.logicalDevice, &memoryAllocator, vpBufferSize,
 			VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT,
 			VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
 			&vpUniformBuffer[i], &vpUniformBufferMemory[i]);
@@ -1248,17 +1501,27 @@ void VulkanRenderer::createDescriptorPool()
 	}
 	
 	// CREATE SAMPLER DESCRIPTOR POOL //
-	// Texture sampler pool
+	// Texture sampler pool: just the one set holding the whole texture & sampler arrays and the material & streaming buffers
+	VkDescriptorPoolSize texturePoolSize = {};
+	texturePoolSize.type = VK_DESCRIPTOR_TYPE_SAMPLED_IMAGE;
+	texturePoolSize.descriptorCount = maxTextures;
+
 	VkDescriptorPoolSize samplerPoolSize = {};
-	samplerPoolSize.type = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
-	samplerPoolSize.descriptorCount = MAX_OBJECTS; // Totally messes up the logic if we want to 
-	//swap textures for object or use multipler textures 
+	samplerPoolSize.type = VK_DESCRIPTOR_TYPE_SAMPLER;
+	samplerPoolSize.descriptorCount = maxSamplers;
+
+	VkDescriptorPoolSize materialPoolSize = {};
+	materialPoolSize.type = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+	materialPoolSize.descriptorCount = 2;		// Material & texture streaming buffers
+
+	std::vector<VkDescriptorPoolSize> samplerPoolSizes = { texturePoolSize, samplerPoolSize, materialPoolSize };
 
 	VkDescriptorPoolCreateInfo samplerPoolCreateInfo = {};
 	samplerPoolCreateInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
-	samplerPoolCreateInfo.maxSets = MAX_OBJECTS;
-	samplerPoolCreateInfo.poolSizeCount = 1;
-	samplerPoolCreateInfo.pPoolSizes = &samplerPoolSize;
+	samplerPoolCreateInfo.flags = VK_DESCRIPTOR_POOL_CREATE_UPDATE_AFTER_BIND_BIT_EXT;	// Needed for the update after bind layout
+	samplerPoolCreateInfo.maxSets = 1;
+	samplerPoolCreateInfo.poolSizeCount = static_cast<uint32_t>(samplerPoolSizes.size());
+	samplerPoolCreateInfo.pPoolSizes = samplerPoolSizes.data();
 
 	result = vkCreateDescriptorPool(mainDevice.logicalDevice, &samplerPoolCreateInfo, nullptr, &samplerDescriptorPool);
 	if (result != VK_SUCCESS)
@@ -1353,7 +1616,47 @@ void VulkanRenderer::createDescriptorSets()
 		// Update the descriptor sets with new buffer/binding info
 		vkUpdateDescriptorSets(mainDevice.logicalDevice, static_cast<uint32_t>(setWrites.size()), setWrites.data(), 0, nullptr);
 	}
-	 
+
+	// Texture array set (filled in as textures are created, the material buffer is bound right away)
+	VkDescriptorSetAllocateInfo textureAllocateInfo = {};
+	textureAllocateInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
+	textureAllocateInfo.descriptorPool = samplerDescriptorPool;
+	textureAllocateInfo.descriptorSetCount = 1;
+	textureAllocateInfo.pSetLayouts = &samplerDescriptorSetLayout;
+
+	result = vkAllocateDescriptorSets(mainDevice.logicalDevice, &textureAllocateInfo, &textureDescriptorSet);
+	if (result != VK_SUCCESS)
+	{
+		throw std::runtime_error("Failed to allocate texture descriptor set!");
+	}
+
+	VkDescriptorBufferInfo materialBufferInfo = {};
+	materialBufferInfo.buffer = materialTable.getBuffer();
+	materialBufferInfo.offset = 0;
+	materialBufferInfo.range = materialTable.getBufferSize();
+
+	VkWriteDescriptorSet materialSetWrite = {};
+	materialSetWrite.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+	materialSetWrite.dstSet = textureDescriptorSet;
+	materialSetWrite.dstBinding = 2;
+	materialSetWrite.dstArrayElement = 0;
+	materialSetWrite.descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+	materialSetWrite.descriptorCount = 1;
+	materialSetWrite.pBufferInfo = &materialBufferInfo;
+
+	// Streaming buffer holds every frame's entries, frames pick theirs with a push constant
+	VkDescriptorBufferInfo streamingBufferInfo = {};
+	streamingBufferInfo.buffer = textureStreamer.getBuffer();
+	streamingBufferInfo.offset = 0;
+	streamingBufferInfo.range = textureStreamer.getBufferSize();
+
+	VkWriteDescriptorSet streamingSetWrite = materialSetWrite;
+	streamingSetWrite.dstBinding = 3;
+	streamingSetWrite.pBufferInfo = &streamingBufferInfo;
+
+	std::vector<VkWriteDescriptorSet> textureSetWrites = { materialSetWrite, streamingSetWrite };
+	vkUpdateDescriptorSets(mainDevice.logicalDevice, static_cast<uint32_t>(textureSetWrites.size()), textureSetWrites.data(),
+		0, nullptr);
 }
 
 void VulkanRenderer::createInputDescriptorSets()
@@ -1424,16 +1727,280 @@ void VulkanRenderer::createInputDescriptorSets()
 	}
 }
 
-void VulkanRenderer::updateUniformBuffers(uint32_t imageIndex)
+void VulkanRenderer::createMeshletCulling()
 {
-	// Copy VP Data
-	void* data;
-	VkResult result = vkMapMemory(mainDevice.logicalDevice, vpUniformBufferMemory[imageIndex], 0, sizeof(UboViewProjection), 0, &data);
-	if (result == VK_SUCCESS)
+	// DEPTH PYRAMID IMAGE
+	// Level 0 is half the depth buffer (rounded up, so every depth texel is under one of its texels), then a full mip chain
+	depthPyramidExtent.width = (swapchainExtent.width + 1) / 2;
+	depthPyramidExtent.height = (swapchainExtent.height + 1) / 2;
+	depthPyramidLevels = calculateMipLevels(depthPyramidExtent.width, depthPyramidExtent.height);
+
+	depthPyramidImage = createImage(depthPyramidExtent.width, depthPyramidExtent.height, depthPyramidLevels, VK_FORMAT_R32_SFLOAT,
+		VK_IMAGE_TILING_OPTIMAL, VK_IMAGE_USAGE_STORAGE_BIT | VK_IMAGE_USAGE_SAMPLED_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
+		&depthPyramidImageMemory);
+	// Whole pyramid for the cull pass, and a view of each level for the pass building it
+	depthPyramidImageView = createImageView(depthPyramidImage, VK_FORMAT_R32_SFLOAT, VK_IMAGE_ASPECT_COLOR_BIT, depthPyramidLevels);
+	depthPyramidLevelViews.resize(depthPyramidLevels);
+	for (uint32_t i = 0; i < depthPyramidLevels; i++)
 	{
-		memcpy(data, &uboViewProjection, sizeof(UboViewProjection));
-		vkUnmapMemory(mainDevice.logicalDevice, vpUniformBufferMemory[imageIndex]);
+		VkImageViewCreateInfo levelViewCreateInfo = {};
+		levelViewCreateInfo.sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO;
+		levelViewCreateInfo.image = depthPyramidImage;
+		levelViewCreateInfo.viewType = VK_IMAGE_VIEW_TYPE_2D;
+		levelViewCreateInfo.format = VK_FORMAT_R32_SFLOAT;
+		levelViewCreateInfo.subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+		levelViewCreateInfo.subresourceRange.baseMipLevel = i;
+		levelViewCreateInfo.subresourceRange.levelCount = 1;
+		levelViewCreateInfo.subresourceRange.baseArrayLayer = 0;
+		levelViewCreateInfo.subresourceRange.layerCount = 1;
+
+		VkResult result = vkCreateImageView(mainDevice.logicalDevice, &levelViewCreateInfo, nullptr, &depthPyramidLevelViews[i]);
+		if (result != VK_SUCCESS)
+		{
+			throw std::runtime_error("Failed to create a depth pyramid level view!");
+		}
+	}
+
+	// Texels are fetched (never filtered), so a nearest sampler that stays in the image
+	VkSamplerCreateInfo pyramidSamplerCreateInfo = getDefaultSamplerCreateInfo();
+	pyramidSamplerCreateInfo.magFilter = VK_FILTER_NEAREST;
+	pyramidSamplerCreateInfo.minFilter = VK_FILTER_NEAREST;
+	pyramidSamplerCreateInfo.mipmapMode = VK_SAMPLER_MIPMAP_MODE_NEAREST;
+	pyramidSamplerCreateInfo.addressModeU = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+	pyramidSamplerCreateInfo.addressModeV = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+	pyramidSamplerCreateInfo.addressModeW = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+	pyramidSamplerCreateInfo.anisotropyEnable = VK_FALSE;
+	pyramidSamplerCreateInfo.maxAnisotropy = 1;
+	depthPyramidSamplerId = createSampler(pyramidSamplerCreateInfo);
+	VkSampler pyramidSampler = samplerCache.getSampler(depthPyramidSamplerId);
+
+	// DESCRIPTOR SET LAYOUTS
+	// Cull pass: meshlets, draws, the shared index buffer, culled indices & the depth pyramid
+	std::vector<VkDescriptorSetLayoutBinding> cullBindings(5);
+	for (uint32_t i = 0; i < cullBindings.size(); i++)
+	{
+		cullBindings[i].binding = i;
+		cullBindings[i].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+		cullBindings[i].descriptorCount = 1;
+		cullBindings[i].stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+		cullBindings[i].pImmutableSamplers = nullptr;
+	}
+	cullBindings[4].descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+
+	VkDescriptorSetLayoutCreateInfo cullLayoutCreateInfo = {};
+	cullLayoutCreateInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
+	cullLayoutCreateInfo.bindingCount = static_cast<uint32_t>(cullBindings.size());
+	cullLayoutCreateInfo.pBindings = cullBindings.data();
+
+	VkResult result = vkCreateDescriptorSetLayout(mainDevice.logicalDevice, &cullLayoutCreateInfo, nullptr, &cullDescriptorSetLayout);
+	if (result != VK_SUCCESS)
+	{
+		throw std::runtime_error("Failed to create cull descriptor set layout!");
+	}
+
+	// Depth pyramid level: the level before it (or the depth buffer) to read, and the level to write
+	std::array<VkDescriptorSetLayoutBinding, 2> pyramidBindings = {};
+	pyramidBindings[0].binding = 0;
+	pyramidBindings[0].descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+	pyramidBindings[0].descriptorCount = 1;
+	pyramidBindings[0].stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+	pyramidBindings[1].binding = 1;
+	pyramidBindings[1].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_IMAGE;
+	pyramidBindings[1].descriptorCount = 1;
+	pyramidBindings[1].stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+
+	VkDescriptorSetLayoutCreateInfo pyramidLayoutCreateInfo = {};
+	pyramidLayoutCreateInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
+	pyramidLayoutCreateInfo.bindingCount = static_cast<uint32_t>(pyramidBindings.size());
+	pyramidLayoutCreateInfo.pBindings = pyramidBindings.data();
+
+	result = vkCreateDescriptorSetLayout(mainDevice.logicalDevice, &pyramidLayoutCreateInfo, nullptr, &depthPyramidDescriptorSetLayout);
+	if (result != VK_SUCCESS)
+	{
+		throw std::runtime_error("Failed to create depth pyramid descriptor set layout!");
+	}
+
+	// DESCRIPTOR POOL & SETS
+	uint32_t pyramidSetCount = static_cast<uint32_t>(swapchainImages.size()) + depthPyramidLevels - 1;
+
+	VkDescriptorPoolSize bufferPoolSize = {};
+	bufferPoolSize.type = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+	bufferPoolSize.descriptorCount = 4;
+
+	VkDescriptorPoolSize samplerPoolSize = {};
+	samplerPoolSize.type = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+	samplerPoolSize.descriptorCount = 1 + pyramidSetCount;
+
+	VkDescriptorPoolSize storageImagePoolSize = {};
+	storageImagePoolSize.type = VK_DESCRIPTOR_TYPE_STORAGE_IMAGE;
+	storageImagePoolSize.descriptorCount = pyramidSetCount;
+
+	std::array<VkDescriptorPoolSize, 3> cullPoolSizes = { bufferPoolSize, samplerPoolSize, storageImagePoolSize };
+
+	VkDescriptorPoolCreateInfo cullPoolCreateInfo = {};
+	cullPoolCreateInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
+	cullPoolCreateInfo.maxSets = 1 + pyramidSetCount;
+	cullPoolCreateInfo.poolSizeCount = static_cast<uint32_t>(cullPoolSizes.size());
+	cullPoolCreateInfo.pPoolSizes = cullPoolSizes.data();
+
+	result = vkCreateDescriptorPool(mainDevice.logicalDevice, &cullPoolCreateInfo, nullptr, &cullDescriptorPool);
+	if (result != VK_SUCCESS)
+	{
+		throw std::runtime_error("Failed to create cull descriptor pool!");
+	}
+
+	VkDescriptorSetAllocateInfo cullSetAllocInfo = {};
+	cullSetAllocInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
+	cullSetAllocInfo.descriptorPool = cullDescriptorPool;
+	cullSetAllocInfo.descriptorSetCount = 1;
+	cullSetAllocInfo.pSetLayouts = &cullDescriptorSetLayout;
+
+	result = vkAllocateDescriptorSets(mainDevice.logicalDevice, &cullSetAllocInfo, &cullDescriptorSet);
+	if (result != VK_SUCCESS)
+	{
+		throw std::runtime_error("Failed to allocate cull descriptor set!");
 	}
+
+	depthPyramidDescriptorSets.resize(pyramidSetCount);
+	std::vector<VkDescriptorSetLayout> pyramidSetLayouts(pyramidSetCount, depthPyramidDescriptorSetLayout);
+
+	VkDescriptorSetAllocateInfo pyramidSetAllocInfo = {};
+	pyramidSetAllocInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
+	pyramidSetAllocInfo.descriptorPool = cullDescriptorPool;
+	pyramidSetAllocInfo.descriptorSetCount = pyramidSetCount;
+	pyramidSetAllocInfo.pSetLayouts = pyramidSetLayouts.data();
+
+	result = vkAllocateDescriptorSets(mainDevice.logicalDevice, &pyramidSetAllocInfo, depthPyramidDescriptorSets.data());
+	if (result != VK_SUCCESS)
+	{
+		throw std::runtime_error("Failed to allocate depth pyramid descriptor sets!");
+	}
+
+	// Cull set (the buffers are fixed, only their contents change)
+	std::array<VkDescriptorBufferInfo, 4> cullBufferInfos = {};
+	cullBufferInfos[0].buffer = geometryPool.getMeshletBuffer();
+	cullBufferInfos[1].buffer = meshletCuller.getDrawBuffer();
+	cullBufferInfos[2].buffer = geometryPool.getIndexBuffer();
+	cullBufferInfos[3].buffer = meshletCuller.getIndexBuffer();
+	for (auto& bufferInfo : cullBufferInfos)
+	{
+		bufferInfo.offset = 0;
+		bufferInfo.range = VK_WHOLE_SIZE;
+	}
+
+	VkDescriptorImageInfo cullPyramidInfo = {};
+	cullPyramidInfo.sampler = pyramidSampler;
+	cullPyramidInfo.imageView = depthPyramidImageView;
+	cullPyramidInfo.imageLayout = VK_IMAGE_LAYOUT_GENERAL;
+
+	std::vector<VkWriteDescriptorSet> setWrites;
+	for (uint32_t i = 0; i < cullBufferInfos.size(); i++)
+	{
+		VkWriteDescriptorSet bufferWrite = {};
+		bufferWrite.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+		bufferWrite.dstSet = cullDescriptorSet;
+		bufferWrite.dstBinding = i;
+		bufferWrite.dstArrayElement = 0;
+		bufferWrite.descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+		bufferWrite.descriptorCount = 1;
+		bufferWrite.pBufferInfo = &cullBufferInfos[i];
+		setWrites.push_back(bufferWrite);
+	}
+
+	VkWriteDescriptorSet pyramidWrite = {};
+	pyramidWrite.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+	pyramidWrite.dstSet = cullDescriptorSet;
+	pyramidWrite.dstBinding = 4;
+	pyramidWrite.dstArrayElement = 0;
+	pyramidWrite.descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+	pyramidWrite.descriptorCount = 1;
+	pyramidWrite.pImageInfo = &cullPyramidInfo;
+	setWrites.push_back(pyramidWrite);
+
+	vkUpdateDescriptorSets(mainDevice.logicalDevice, static_cast<uint32_t>(setWrites.size()), setWrites.data(), 0, nullptr);
+
+	// Depth pyramid sets (level 0's read the depth buffers, which can only be sampled with occlusion culling on)
+	std::vector<VkDescriptorImageInfo> sourceInfos(pyramidSetCount);
+	std::vector<VkDescriptorImageInfo> destinationInfos(pyramidSetCount);
+	setWrites.clear();
+	for (uint32_t i = 0; i < pyramidSetCount; i++)
+	{
+		uint32_t level = i < swapchainImages.size() ? 0 : i - static_cast<uint32_t>(swapchainImages.size()) + 1;
+		if (level == 0 && !occlusionCulling) continue;
+
+		sourceInfos[i].sampler = pyramidSampler;
+		sourceInfos[i].imageView = level == 0 ? depthBufferImageView[i] : depthPyramidLevelViews[level - 1];
+		sourceInfos[i].imageLayout = level == 0 ? VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL : VK_IMAGE_LAYOUT_GENERAL;
+
+		destinationInfos[i].sampler = VK_NULL_HANDLE;
+		destinationInfos[i].imageView = depthPyramidLevelViews[level];
+		destinationInfos[i].imageLayout = VK_IMAGE_LAYOUT_GENERAL;
+
+		VkWriteDescriptorSet sourceWrite = {};
+		sourceWrite.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+		sourceWrite.dstSet = depthPyramidDescriptorSets[i];
+		sourceWrite.dstBinding = 0;
+		sourceWrite.dstArrayElement = 0;
+		sourceWrite.descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+		sourceWrite.descriptorCount = 1;
+		sourceWrite.pImageInfo = &sourceInfos[i];
+		setWrites.push_back(sourceWrite);
+
+		VkWriteDescriptorSet destinationWrite = sourceWrite;
+		destinationWrite.dstBinding = 1;
+		destinationWrite.descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_IMAGE;
+		destinationWrite.pImageInfo = &destinationInfos[i];
+		setWrites.push_back(destinationWrite);
+	}
+
+	vkUpdateDescriptorSets(mainDevice.logicalDevice, static_cast<uint32_t>(setWrites.size()), setWrites.data(), 0, nullptr);
+
+	// PIPELINES
+	VkPushConstantRange cullPushConstantRange = {};
+	cullPushConstantRange.stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+	cullPushConstantRange.offset = 0;
+	cullPushConstantRange.size = sizeof(PushCullParams);
+
+	VkPipelineLayoutCreateInfo cullPipelineLayoutCreateInfo = {};
+	cullPipelineLayoutCreateInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
+	cullPipelineLayoutCreateInfo.setLayoutCount = 1;
+	cullPipelineLayoutCreateInfo.pSetLayouts = &cullDescriptorSetLayout;
+	cullPipelineLayoutCreateInfo.pushConstantRangeCount = 1;
+	cullPipelineLayoutCreateInfo.pPushConstantRanges = &cullPushConstantRange;
+
+	result = vkCreatePipelineLayout(mainDevice.logicalDevice, &cullPipelineLayoutCreateInfo, nullptr, &cullPipelineLayout);
+	if (result != VK_SUCCESS)
+	{
+		throw std::runtime_error("Failed to create cull pipeline layout!");
+	}
+
+	VkPushConstantRange pyramidPushConstantRange = {};
+	pyramidPushConstantRange.stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+	pyramidPushConstantRange.offset = 0;
+	pyramidPushConstantRange.size = sizeof(PushDepthPyramidLevel);
+
+	VkPipelineLayoutCreateInfo pyramidPipelineLayoutCreateInfo = {};
+	pyramidPipelineLayoutCreateInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
+	pyramidPipelineLayoutCreateInfo.setLayoutCount = 1;
+	pyramidPipelineLayoutCreateInfo.pSetLayouts = &depthPyramidDescriptorSetLayout;
+	pyramidPipelineLayoutCreateInfo.pushConstantRangeCount = 1;
+	pyramidPipelineLayoutCreateInfo.pPushConstantRanges = &pyramidPushConstantRange;
+
+	result = vkCreatePipelineLayout(mainDevice.logicalDevice, &pyramidPipelineLayoutCreateInfo, nullptr, &depthPyramidPipelineLayout);
+	if (result != VK_SUCCESS)
+	{
+		throw std::runtime_error("Failed to create depth pyramid pipeline layout!");
+	}
+
+	cullPipeline = createComputePipeline("Shaders/meshlet_cull.spv", cullPipelineLayout);
+	depthPyramidPipeline = createComputePipeline("Shaders/depth_pyramid.spv", depthPyramidPipelineLayout);
+}
+
+void VulkanRenderer::updateUniformBuffers(uint32_t imageIndex)
+{
+	// Copy VP Data
+	// Uniform buffers live in persistently mapped host visible memory, so no need to map/unmap every frame
+	memcpy(vpUniformBufferMemory[imageIndex].mapped, &uboViewProjection, sizeof(UboViewProjection));
 	//DYNAMIC UNIFORM BUFFER: TEMPORARY NOT IN USE
 	// Copy Model Data
 	/*for (size_t i = 0; i < meshes.size(); i++)
@@ -1482,57 +2049,119 @@ void VulkanRenderer::recordCommands(uint32_t currentImage)
 	{
 		throw std::runtime_error("Failed to start recording a Command Buufer");
 	}
+
+	// Pick each mesh's level of detail, and hand the ones with meshlets to the cull pass
+	meshDraws.clear();
+	meshletCuller.beginFrame(currentFrame);
+	for (size_t j = 0; j < models.size(); j++)
+	{
+		// Models still loading in the background aren't drawn
+		if (!models[j].isReady()) continue;
+
+		// By reference, meshes keep the level of detail they picked for the next frame
+		MeshModel& thisModel = models[j];
+		glm::mat4 modelMatrix = thisModel.getModel();
+		for (size_t k = 0; k < thisModel.getMeshCount(); k++)
+		{
+			MeshDraw meshDraw;
+			meshDraw.mesh = thisModel.getMesh(k);
+			meshDraw.model = modelMatrix;
+			// Level of detail by how big the mesh is on screen (levels are ranges of the mesh's indices)
+			meshDraw.lod = meshDraw.mesh->getLod(meshDraw.mesh->selectLod(
+				getProjectedRadius(modelMatrix, meshDraw.mesh->getBoundingSphere())));
+			meshDraw.cullDraw = MESHLET_CULLING ? meshletCuller.addDraw(modelMatrix, meshDraw.mesh, meshDraw.lod) : -1;
+			meshDraws.push_back(meshDraw);
+		}
+	}
+	recordMeshletCulling(commandBuffers[currentImage]);
 		
 	//Begin render pass
 	vkCmdBeginRenderPass(commandBuffers[currentImage], &renderBeginInfo, VK_SUBPASS_CONTENTS_INLINE);
 
-		//Bind pipeline to be used in render pass
+		//Bind pipeline to be used in render pass (meshes with vertex colours switch to the variant that reads them, closed
+		//meshes to the variants that cull back faces)
 		vkCmdBindPipeline(commandBuffers[currentImage], VK_PIPELINE_BIND_POINT_GRAPHICS, graphicsPipeline);
+		VkPipeline boundPipeline = graphicsPipeline;
+
+		// All meshes live in the shared geometry buffers, so bind them once for the whole scene
+		VkBuffer vertexBuffers[] = { geometryPool.getVertexBuffer() };								//Buffers to bind
+		VkDeviceSize vertexOffsets[] = { 0 };														//Offsets into buffers being bound
+		vkCmdBindVertexBuffers(commandBuffers[currentImage], 0, 1, vertexBuffers, vertexOffsets);	//Command to bind vertex buffer before drawing
+		vkCmdBindIndexBuffer(commandBuffers[currentImage], geometryPool.getIndexBuffer(), 0, VK_INDEX_TYPE_UINT32);
+		VkIndexType boundIndexType = VK_INDEX_TYPE_UINT32;		// Meshes use 16 or 32-bit indices, rebound when it (or the buffer) changes
+
+		// Bind Descriptor Sets (once, meshes pick their material out of the buffer with a push constant)
+		std::array<VkDescriptorSet, 2> descriptorSetGroup = { descriptorSets[currentImage], textureDescriptorSet };
+		vkCmdBindDescriptorSets(commandBuffers[currentImage], VK_PIPELINE_BIND_POINT_GRAPHICS, pipelineLayout,
+			0, static_cast<uint32_t>(descriptorSetGroup.size()), descriptorSetGroup.data(), /*1*/0, /*&dynamicOffset*/nullptr);
 
 		//record drawing all meshes
-		for (size_t j = 0; j < models.size(); j++)
+		const glm::mat4* pushedModel = nullptr;
+		VkBuffer boundIndexBuffer = geometryPool.getIndexBuffer();
+		for (const MeshDraw& meshDraw : meshDraws)
 		{
-			MeshModel thisModel = models[j];
 			// Push constants are the same for each model
-			vkCmdPushConstants(
-				commandBuffers[currentImage],
-				pipelineLayout,
-				VK_SHADER_STAGE_VERTEX_BIT,	// State to push constants to
-				0,							//	Offset of push constant to update
-				sizeof(Model),				//	Size if data being pushed
-				&thisModel.getModel());		//	Actual data to push (can be array)
-			for (size_t k = 0; k < thisModel.getMeshCount(); k++)
+			if (pushedModel == nullptr || *pushedModel != meshDraw.model)
 			{
-			// Use vertex buffer
-			VkBuffer vertexBuffers[] = { thisModel.getMesh(k)->getVertexBuffer() };									//Buffers to bind
-			VkDeviceSize vertexOffsets[] = { 0 };														//Offsets into buffers being bound
-			vkCmdBindVertexBuffers(commandBuffers[currentImage], 0, 1, vertexBuffers, vertexOffsets);	//Command to bind vertex buffer before drawing
-
-			// Use index buffer
-			//VkBuffer indexBuffers[] = { thisModel.getMesh(k)->getIndexBuffer() };
-			//VkDeviceSize indexOffsets[] = { 0 };
-			vkCmdBindIndexBuffer(commandBuffers[currentImage], thisModel.getMesh(k)->getIndexBuffer(), 0, VK_INDEX_TYPE_UINT32);
-
+				vkCmdPushConstants(
+					commandBuffers[currentImage],
+					pipelineLayout,
+					VK_SHADER_STAGE_VERTEX_BIT,	// State to push constants to
+					0,							//	Offset of push constant to update
+					sizeof(Model),				//	Size if data being pushed
+					&meshDraw.model);			//	Actual data to push (can be array)
+				pushedModel = &meshDraw.model;
+			}
 			//DYNAMIC UNIFORM BUFFER: TEMPORARY NOT IN USE
 			//Dynamic offset amount
 			/*uint32_t dynamicOffset = static_cast<uint32_t>(modelUniformAlignment) * j;*/
-			// "Push" constants to given stage directly (no buffer)
-		
-			// Bind Descriptor Sets
-			std::array<VkDescriptorSet, 2> descriptorSetGroup = 
-			{ 
-				descriptorSets[currentImage], 
-				samplerDescriptorSets[thisModel.getMesh(k)->getTextureId()]
-			};
+			Mesh* mesh = meshDraw.mesh;
+			VkPipeline meshPipeline = mesh->isClosed() ?
+				(mesh->hasVertexColors() ? closedVertexColorPipeline : closedPipeline) :
+				(mesh->hasVertexColors() ? vertexColorPipeline : graphicsPipeline);
+			if (meshPipeline != boundPipeline)
+			{
+				// Same layout, so descriptor sets & push constants stay bound
+				vkCmdBindPipeline(commandBuffers[currentImage], VK_PIPELINE_BIND_POINT_GRAPHICS, meshPipeline);
+				boundPipeline = meshPipeline;
+			}
+			// Culled meshes are drawn from the cull pass's (32-bit) indices, the rest from their own
+			VkBuffer meshIndexBuffer = meshDraw.cullDraw >= 0 ? meshletCuller.getIndexBuffer() : geometryPool.getIndexBuffer();
+			VkIndexType meshIndexType = meshDraw.cullDraw >= 0 ? VK_INDEX_TYPE_UINT32 : mesh->getIndexType();
+			if (meshIndexBuffer != boundIndexBuffer || meshIndexType != boundIndexType)
+			{
+				vkCmdBindIndexBuffer(commandBuffers[currentImage], meshIndexBuffer, 0, meshIndexType);
+				boundIndexBuffer = meshIndexBuffer;
+				boundIndexType = meshIndexType;
+			}
+			if (mesh->hasVertexColors())
+			{
+				VkDeviceSize colorOffset = mesh->getColorBindingOffset();
+				vkCmdBindVertexBuffers(commandBuffers[currentImage], 1, 1, vertexBuffers, &colorOffset);
+			}
 
-			vkCmdBindDescriptorSets(commandBuffers[currentImage], VK_PIPELINE_BIND_POINT_GRAPHICS, pipelineLayout,
-				0, static_cast<uint32_t>(descriptorSetGroup.size()), descriptorSetGroup.data(), /*1*/0, /*&dynamicOffset*/nullptr);
+			// "Push" constants to given stage directly (no buffer)
+			PushMeshBounds pushBounds = mesh->getBounds();
+			vkCmdPushConstants(commandBuffers[currentImage], pipelineLayout, VK_SHADER_STAGE_VERTEX_BIT,
+				sizeof(Model), sizeof(PushMeshBounds), &pushBounds);
+			PushMaterial pushMaterial = { mesh->getMaterialId(), textureStreamer.getFrameOffset(currentFrame) };
+			vkCmdPushConstants(commandBuffers[currentImage], pipelineLayout, VK_SHADER_STAGE_FRAGMENT_BIT,
+				sizeof(Model) + sizeof(PushMeshBounds), sizeof(PushMaterial), &pushMaterial);
 
 			// Execute Pipeline
 			// Without index buffers
 			// vkCmdDraw(commandBuffers[i], static_cast<uint32_t>(firstMesh.getVertexCount()), 1, 0, 0);
-			// With index buffers
-			vkCmdDrawIndexed(commandBuffers[currentImage], thisModel.getMesh(k)->getIndexCount(), 1, 0, 0, 0);
+			if (meshDraw.cullDraw >= 0)
+			{
+				// Index count of the meshlets the cull pass kept is in the draw's indirect command
+				vkCmdDrawIndexedIndirect(commandBuffers[currentImage], meshletCuller.getDrawBuffer(),
+					sizeof(GpuCullDraw) * meshDraw.cullDraw, 1, sizeof(GpuCullDraw));
+			}
+			else
+			{
+				// With index buffers (mesh's range of the shared buffers is selected by firstIndex & vertexOffset)
+				vkCmdDrawIndexed(commandBuffers[currentImage], meshDraw.lod.indexCount, 1,
+					mesh->getFirstIndex() + meshDraw.lod.firstIndex, mesh->getVertexOffset(), 0);
 			}
 		}
 		// Start second subpass
@@ -1547,6 +2176,20 @@ void VulkanRenderer::recordCommands(uint32_t currentImage)
 
 	//End render pass
 	vkCmdEndRenderPass(commandBuffers[currentImage]);
+
+	// Make the texture streaming feedback readable on the CPU once the frame's fence signals
+	VkMemoryBarrier feedbackBarrier = {};
+	feedbackBarrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+	feedbackBarrier.srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
+	feedbackBarrier.dstAccessMask = VK_ACCESS_HOST_READ_BIT;
+	vkCmdPipelineBarrier(commandBuffers[currentImage], VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT, VK_PIPELINE_STAGE_HOST_BIT, 0,
+		1, &feedbackBarrier, 0, nullptr, 0, nullptr);
+
+	// Next frame's meshlets are tested for occlusion against this frame's depth
+	if (occlusionCulling)
+	{
+		recordDepthPyramid(currentImage);
+	}
 	//stop recording to command buffer
 	result = vkEndCommandBuffer(commandBuffers[currentImage]);
 	if (result != VK_SUCCESS)
@@ -1555,6 +2198,121 @@ void VulkanRenderer::recordCommands(uint32_t currentImage)
 	}
 }
 
+void VulkanRenderer::recordMeshletCulling(VkCommandBuffer commandBuffer)
+{
+	uint32_t drawCount = meshletCuller.getDrawCount();
+	if (drawCount == 0) return;
+
+	// Last frame's draws, culled indices & depth pyramid must be done with before they're written/read again
+	VkMemoryBarrier reuseBarrier = {};
+	reuseBarrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+	reuseBarrier.srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
+	reuseBarrier.dstAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT | VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT;
+	vkCmdPipelineBarrier(commandBuffer,
+		VK_PIPELINE_STAGE_DRAW_INDIRECT_BIT | VK_PIPELINE_STAGE_VERTEX_INPUT_BIT | VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+		VK_PIPELINE_STAGE_TRANSFER_BIT | VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, 0,
+		1, &reuseBarrier, 0, nullptr, 0, nullptr);
+
+	// Frame's draw list to the draw buffer, where the cull shader counts the indices it keeps into them
+	VkBufferCopy drawCopy = {};
+	drawCopy.srcOffset = meshletCuller.getUploadOffset();
+	drawCopy.dstOffset = 0;
+	drawCopy.size = sizeof(GpuCullDraw) * drawCount;
+	vkCmdCopyBuffer(commandBuffer, meshletCuller.getUploadBuffer(), meshletCuller.getDrawBuffer(), 1, &drawCopy);
+
+	VkMemoryBarrier copyBarrier = {};
+	copyBarrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+	copyBarrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+	copyBarrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT;
+	vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, 0,
+		1, &copyBarrier, 0, nullptr, 0, nullptr);
+
+	// Camera to cull against. Side planes go through the camera, their normals come from the projection's scale
+	const glm::mat4& projection = uboViewProjection.projection;
+	float scaleX = projection[0][0];
+	float scaleY = std::abs(projection[1][1]);		// Y is flipped for Vulkan
+	PushCullParams cullParams = {};
+	cullParams.view = uboViewProjection.view;
+	cullParams.frustum = glm::vec4(scaleX / std::sqrt(scaleX * scaleX + 1.0f), 1.0f / std::sqrt(scaleX * scaleX + 1.0f),
+		scaleY / std::sqrt(scaleY * scaleY + 1.0f), 1.0f / std::sqrt(scaleY * scaleY + 1.0f));
+	cullParams.projection = glm::vec4(scaleX, scaleY, projection[2][2], projection[3][2]);
+	cullParams.pyramid = glm::vec4(static_cast<float>(swapchainExtent.width), static_cast<float>(swapchainExtent.height),
+		occlusionCulling && depthPyramidValid ? static_cast<float>(depthPyramidLevels) : 0.0f, CAMERA_NEAR_PLANE);
+
+	vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, cullPipeline);
+	vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, cullPipelineLayout, 0, 1, &cullDescriptorSet, 0, nullptr);
+	vkCmdPushConstants(commandBuffer, cullPipelineLayout, VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(PushCullParams), &cullParams);
+
+	// A workgroup per meshlet (draws with more than the dispatch is wide loop over the rest) of each draw
+	vkCmdDispatch(commandBuffer, std::min(meshletCuller.getMaxMeshletCount(), 65535u), drawCount, 1);
+
+	// Culled indices & counts are read by the draws
+	VkMemoryBarrier cullBarrier = {};
+	cullBarrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+	cullBarrier.srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
+	cullBarrier.dstAccessMask = VK_ACCESS_INDIRECT_COMMAND_READ_BIT | VK_ACCESS_INDEX_READ_BIT;
+	vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+		VK_PIPELINE_STAGE_DRAW_INDIRECT_BIT | VK_PIPELINE_STAGE_VERTEX_INPUT_BIT, 0,
+		1, &cullBarrier, 0, nullptr, 0, nullptr);
+}
+
+void VulkanRenderer::recordDepthPyramid(uint32_t currentImage)
+{
+	VkCommandBuffer commandBuffer = commandBuffers[currentImage];
+
+	// Pyramid stays in GENERAL (written & sampled by compute shaders), it only needs moving there the first time
+	if (!depthPyramidValid)
+	{
+		VkImageMemoryBarrier layoutBarrier = {};
+		layoutBarrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+		layoutBarrier.oldLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+		layoutBarrier.newLayout = VK_IMAGE_LAYOUT_GENERAL;
+		layoutBarrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+		layoutBarrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+		layoutBarrier.image = depthPyramidImage;
+		layoutBarrier.subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+		layoutBarrier.subresourceRange.baseMipLevel = 0;
+		layoutBarrier.subresourceRange.levelCount = depthPyramidLevels;
+		layoutBarrier.subresourceRange.baseArrayLayer = 0;
+		layoutBarrier.subresourceRange.layerCount = 1;
+		layoutBarrier.srcAccessMask = 0;
+		layoutBarrier.dstAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
+		vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, 0,
+			0, nullptr, 0, nullptr, 1, &layoutBarrier);
+	}
+
+	vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, depthPyramidPipeline);
+
+	// Each level reads the one before it (level 0 reads this image's depth buffer)
+	VkMemoryBarrier levelBarrier = {};
+	levelBarrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+	levelBarrier.srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
+	levelBarrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
+
+	PushDepthPyramidLevel pushLevel;
+	pushLevel.sourceSize = glm::ivec2(swapchainExtent.width, swapchainExtent.height);
+	for (uint32_t level = 0; level < depthPyramidLevels; level++)
+	{
+		pushLevel.destinationSize = glm::ivec2(std::max(depthPyramidExtent.width >> level, 1u),
+			std::max(depthPyramidExtent.height >> level, 1u));
+
+		VkDescriptorSet levelSet = level == 0 ? depthPyramidDescriptorSets[currentImage] :
+			depthPyramidDescriptorSets[swapchainImages.size() + level - 1];
+		vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, depthPyramidPipelineLayout, 0, 1, &levelSet, 0, nullptr);
+		vkCmdPushConstants(commandBuffer, depthPyramidPipelineLayout, VK_SHADER_STAGE_COMPUTE_BIT, 0,
+			sizeof(PushDepthPyramidLevel), &pushLevel);
+		vkCmdDispatch(commandBuffer, (pushLevel.destinationSize.x + 7) / 8, (pushLevel.destinationSize.y + 7) / 8, 1);
+
+		// Also covers the cull pass of the next frame reading the finished pyramid
+		vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, 0,
+			1, &levelBarrier, 0, nullptr, 0, nullptr);
+
+		pushLevel.sourceSize = pushLevel.destinationSize;
+	}
+
+	depthPyramidValid = true;
+}
+
 //best format is subjective but let's use 
 //Format: VK_FORMAT_R8G8B8A8_UNORM (8bit RGBA unsigned normalized) Format  VK_FORMAT_B8G8R8A8_UNORM as backup
 //Color Space: VK_COLOR_SPACE_SRGB_NONLINEAR_KHR
@@ -1622,16 +2380,7 @@ VkFormat VulkanRenderer::chooseSupportedFormat(const std::vector<VkFormat>& form
 	// Loop throught options and pick up compatible one
 	for (VkFormat format : formats)
 	{
-		// Get properties for given format on this device
-		VkFormatProperties properties;
-		vkGetPhysicalDeviceFormatProperties(mainDevice.physicalDevice, format, &properties);
-
-		// Depending of tiling choice, need to check for different bit flag
-		if (tiling == VK_IMAGE_TILING_LINEAR && (properties.linearTilingFeatures & featureFlags) == featureFlags)
-		{
-			return format;
-		}
-		else if (tiling == VK_IMAGE_TILING_OPTIMAL && (properties.optimalTilingFeatures & featureFlags) == featureFlags)
+		if (checkFormatSupport(format, tiling, featureFlags))
 		{
 			return format;
 		}
@@ -1640,7 +2389,7 @@ VkFormat VulkanRenderer::chooseSupportedFormat(const std::vector<VkFormat>& form
 	throw std::runtime_error("Failed to find a matching format!");
 }
 
-VkImage VulkanRenderer::createImage(uint32_t width, uint32_t height, VkFormat format, VkImageTiling tiling, VkImageUsageFlags useFlags, VkMemoryPropertyFlags propFlags, VkDeviceMemory* imageMemory)
+VkImage VulkanRenderer::createImage(uint32_t width, uint32_t height, uint32_t mipLevels, VkFormat format, VkImageTiling tiling, VkImageUsageFlags useFlags, VkMemoryPropertyFlags propFlags, MemoryAllocation* imageMemory)
 {
 	// Create Image
 	VkImageCreateInfo imageCreateInfo = {};
@@ -1649,7 +2398,7 @@ VkImage VulkanRenderer::createImage(uint32_t width, uint32_t height, VkFormat fo
 	imageCreateInfo.extent.width = width;						// Width of image extent
 	imageCreateInfo.extent.height = height;						// Height of image extent
 	imageCreateInfo.extent.depth = 1;							// Depth of image (just 1, no 3D aspect)
-	imageCreateInfo.mipLevels = 1;								// Nubmer of mipmap levels
+	imageCreateInfo.mipLevels = mipLevels;						// Nubmer of mipmap levels
 	imageCreateInfo.arrayLayers = 1;							// Number of levels in image array
 	imageCreateInfo.format = format;							// Format type of image
 	imageCreateInfo.tiling = tiling;							// How image data should be "tiled" (Arranged for optimal reading speed)
@@ -1665,29 +2414,13 @@ VkImage VulkanRenderer::createImage(uint32_t width, uint32_t height, VkFormat fo
 		throw std::runtime_error("Failed to create an Image!");
 	}
 	// CREATE MEMORY FOR IMAGE
-	// Get memory requirements for a type of image
-	VkMemoryRequirements memoryRequirements;
-	vkGetImageMemoryRequirements(mainDevice.logicalDevice, image, &memoryRequirements);
-
-	// Allocate memory using image requirements and user defined properties
-	VkMemoryAllocateInfo memoryAllocateInfo = {};
-	memoryAllocateInfo.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
-	memoryAllocateInfo.allocationSize = memoryRequirements.size;
-	memoryAllocateInfo.memoryTypeIndex = findMemoryTypeIndex(mainDevice.physicalDevice, memoryRequirements.memoryTypeBits, propFlags);
-
-	result = vkAllocateMemory(mainDevice.logicalDevice, &memoryAllocateInfo, nullptr, imageMemory);
-	if (result != VK_SUCCESS)
-	{
-		throw std::runtime_error("Failed to allocate memory for an Image!");
-	}
-
-	//Bind the image to the memory
-	vkBindImageMemory(mainDevice.logicalDevice, image, *imageMemory, 0);
+	// Sub-allocate memory using image requirements and user defined properties, and bind the image to it
+	*imageMemory = memoryAllocator.allocateImageMemory(image, propFlags, tiling);
 
 	return image;
 }
 
-VkImageView VulkanRenderer::createImageView(VkImage image, VkFormat format, VkImageAspectFlags aspectFlags)
+VkImageView VulkanRenderer::createImageView(VkImage image, VkFormat format, VkImageAspectFlags aspectFlags, uint32_t mipLevels)
 {
 	VkImageViewCreateInfo createInfo = {};
 	createInfo.sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO;
@@ -1701,7 +2434,7 @@ VkImageView VulkanRenderer::createImageView(VkImage image, VkFormat format, VkIm
 	// subresources allow the view to view only a part of an image
 	createInfo.subresourceRange.aspectMask = aspectFlags;			// Which aspect of image to view e.g. COLOR_BIT for viewing color
 	createInfo.subresourceRange.baseMipLevel = 0;					// Start mapmap level to view from
-	createInfo.subresourceRange.levelCount = 1;						// number of mipmap levels to view
+	createInfo.subresourceRange.levelCount = mipLevels;				// number of mipmap levels to view
 	createInfo.subresourceRange.baseArrayLayer = 0;					// start array layer to view
 	createInfo.subresourceRange.layerCount = 1;						// number of array levels to view
 
@@ -1734,202 +2467,1011 @@ VkShaderModule VulkanRenderer::createShaderModule(const std::vector<char>& code)
 	return module;
 }
 
-int VulkanRenderer::createTextureImage(std::string fileName)
+VkPipeline VulkanRenderer::createComputePipeline(const std::string& fileName, VkPipelineLayout layout)
+{
+	auto shaderCode = readFile(fileName);
+	VkShaderModule shaderModule = createShaderModule(shaderCode);
+
+	VkComputePipelineCreateInfo pipelineCreateInfo = {};
+	pipelineCreateInfo.sType = VK_STRUCTURE_TYPE_COMPUTE_PIPELINE_CREATE_INFO;
+	pipelineCreateInfo.stage.sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
+	pipelineCreateInfo.stage.stage = VK_SHADER_STAGE_COMPUTE_BIT;
+	pipelineCreateInfo.stage.module = shaderModule;
+	pipelineCreateInfo.stage.pName = "main";
+	pipelineCreateInfo.layout = layout;
+
+	VkPipeline pipeline;
+	VkResult result = vkCreateComputePipelines(mainDevice.logicalDevice, VK_NULL_HANDLE, 1, &pipelineCreateInfo, nullptr, &pipeline);
+
+	// Not needed once the pipeline is made, whether it worked or not
+	vkDestroyShaderModule(mainDevice.logicalDevice, shaderModule, nullptr);
+	if (result != VK_SUCCESS)
+	{
+		throw std::runtime_error("Failed to create compute pipeline!");
+	}
+	return pipeline;
+}
+
+void VulkanRenderer::beginUploadBatch(UploadBatch* uploadBatch)
 {
-	// Load image file
-	int width, height;
-	VkDeviceSize imageSize;
-	stbi_uc * imageData = loadTexture(fileName, &width, &height, &imageSize);
+	// Copies go to the transfer queue, the graphics queue takes the results over (if it's a different family)
+	UploadQueue transfer = { transferQueue, transferCommandPool, static_cast<uint32_t>(queueFamilyIndices.transferFamily) };
+	UploadQueue graphics = { graphicsQueue, graphicsCommandPool, static_cast<uint32_t>(queueFamilyIndices.graphicsFamily) };
+	uploadBatch->begin(&stagingRing, mainDevice.logicalDevice, transfer, graphics);
+}
+
+int VulkanRenderer::createTextureImage(LoadedTexture* texture, UploadBatch* uploadBatch)
+{
+	// Pre-baked textures already have all their mip levels in a GPU format, they're just copied in. Streamed ones only
+	// get their mip tail for now
+	if (!texture->baked.levels.empty())
+	{
+		TextureFile* file = &texture->baked;
+		texture->baseLevel = TEXTURE_STREAMING ? textureStreamer.getTailLevel(*file) : 0;
+		texture->mipLevels = static_cast<uint32_t>(file->levels.size()) - texture->baseLevel;
+
+		MemoryAllocation texImageMemory;
+		VkImage texImage = createTextureFileImage(*file, texture->baseLevel, uploadBatch, &texture->format, &texImageMemory);
+		int textureId = storeTextureImage(texImage, texImageMemory);
+
+		// Streamed textures keep the file (and its mapping) for the rest of their levels, other files are freed (or
+		// unmapped) now that they're in the staging buffer
+		if (TEXTURE_STREAMING)
+		{
+			textureStreamer.addTexture(textureId, std::move(*file), texture->mappedFile, texture->baseLevel);
+		}
+		*file = TextureFile();
+		texture->mappedFile.reset();
 
-	// Create staging buffer to hold loaded data, ready to copy to device
-	VkBuffer imageStagingBuffer;
-	VkDeviceMemory imageStagingBufferMemory;
-	createBuffer(mainDevice.physicalDevice, mainDevice.logicalDevice,
-		imageSize, VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
-		VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
-		&imageStagingBuffer, &imageStagingBufferMemory);
-	// Copy Image Data to staging buffer
-	void *data;
-	vkMapMemory(mainDevice.logicalDevice, imageStagingBufferMemory, 0, imageSize, 0, &data);
-	memcpy(data, imageData, static_cast<size_t>(imageSize));
-	vkUnmapMemory(mainDevice.logicalDevice, imageStagingBufferMemory);
+		return textureId;
+	}
 
-	//Free original iamge data
-	stbi_image_free(imageData);
+	// Full mip chain down to 1x1
+	uint32_t mipLevels = calculateMipLevels(texture->width, texture->height);
+	texture->format = getUncompressedVkFormat(texture->channels);
+	texture->mipLevels = mipLevels;
 
-	// Create image to hold final texture
+	// Create image to hold final texture (transfer source too, as mip levels are blitted from each other)
 	VkImage texImage;
-	VkDeviceMemory texImageMemory;
-	texImage = createImage(width, height, VK_FORMAT_R8G8B8A8_UNORM,
-		VK_IMAGE_TILING_OPTIMAL, VK_IMAGE_USAGE_TRANSFER_DST_BIT | VK_IMAGE_USAGE_SAMPLED_BIT,
+	MemoryAllocation texImageMemory;
+	texImage = createImage(texture->width, texture->height, mipLevels, texture->format,
+		VK_IMAGE_TILING_OPTIMAL, VK_IMAGE_USAGE_TRANSFER_SRC_BIT | VK_IMAGE_USAGE_TRANSFER_DST_BIT | VK_IMAGE_USAGE_SAMPLED_BIT,
 		VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, &texImageMemory);
 
-	// TRANSITION IMAGE TO THE CORRECT STATE FOR WRITING TO THE IMAGE STAGING BUFFER
-	transitionImageLayout(mainDevice.logicalDevice, graphicsQueue, graphicsCommandPool, 
-		texImage, VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL);
-
-	// COPY DATA TO IMAGE
-	// Copy image data
-	copyImageBuffer(mainDevice.logicalDevice, graphicsQueue, graphicsCommandPool, imageStagingBuffer, texImage, width, height);
+	// GPU makes the mip levels from level 0 if it can blit the format, otherwise do them on the CPU and upload them all
+	std::vector<MipLevel> cpuMipLevels;
+	if (!checkLinearBlitSupport(texture->format))
+	{
+		// Texture images are UNORM, so filter the values as they are (same as a linear blit would)
+		cpuMipLevels = generateMipChain(texture->pixels, texture->width, texture->height, mipLevels, TextureFilter::Box, false);
+	}
 
-	// TRANSITION IMAGE TO BE SHADER READABLE FOR SHADER USAGE
-	transitionImageLayout(mainDevice.logicalDevice, graphicsQueue, graphicsCommandPool,
-		texImage, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL);
+	// Decoded pixels are always RGBA8, textures with fewer channels only keep the ones they use
+	std::vector<std::vector<unsigned char>> packedLevels;
+	std::vector<ImageLevel> levels;
+	auto addLevel = [&](const unsigned char* pixels, uint32_t width, uint32_t height)
+	{
+		if (texture->channels == 4)
+		{
+			levels.push_back({ pixels, static_cast<VkDeviceSize>(width) * height * 4, width, height, 1 });
+			return;
+		}
+		packedLevels.push_back(packChannelsRGBA8(pixels, width, height, texture->channels));
+		levels.push_back({ packedLevels.back().data(), packedLevels.back().size(), width, height, 1 });
+	};
+	packedLevels.reserve(cpuMipLevels.size() + 1);		// Levels point into it, so it mustn't reallocate
+	addLevel(texture->pixels, static_cast<uint32_t>(texture->width), static_cast<uint32_t>(texture->height));
+	for (auto& mipLevel : cpuMipLevels)
+	{
+		addLevel(mipLevel.pixels.data(), mipLevel.width, mipLevel.height);
+	}
 
-	// Add texture data to vector for reference
-	textureImages.push_back(texImage);
-	textureImageMemory.push_back(texImageMemory);
+	// Stage image data and record transitions + copy to the image (executed when the batch is submitted)
+	uploadBatch->uploadImage(levels, texImage, mipLevels);
 
-	// Destroy staging buffer
-	vkDestroyBuffer(mainDevice.logicalDevice, imageStagingBuffer, nullptr);
-	vkFreeMemory(mainDevice.logicalDevice, imageStagingBufferMemory, nullptr);
+	//Free original iamge data (it's already in the staging buffer)
+	stbi_image_free(texture->pixels);
+	texture->pixels = nullptr;
 
-	//return index fo new texture image
-	return textureImages.size() - 1;
+	// Add texture data to vector for reference, return index fo new texture image
+	return storeTextureImage(texImage, texImageMemory);
 }
 
-int VulkanRenderer::createTexture(std::string fileName)
+VkImage VulkanRenderer::createTextureFileImage(const TextureFile& file, uint32_t baseLevel, UploadBatch* uploadBatch,
+	VkFormat* format, MemoryAllocation* imageMemory)
 {
-	// Create Texture Image and get its location in array
-	int textureImageLoc = createTextureImage(fileName);
+	// Image holds the file's levels from baseLevel down
+	*format = chooseSupportedFormat({ getTextureVkFormat(file.format) }, VK_IMAGE_TILING_OPTIMAL,
+		VK_FORMAT_FEATURE_SAMPLED_IMAGE_BIT);
+	uint32_t mipLevels = static_cast<uint32_t>(file.levels.size()) - baseLevel;
+	VkImage image = createImage(file.levels[baseLevel].width, file.levels[baseLevel].height, mipLevels, *format,
+		VK_IMAGE_TILING_OPTIMAL, VK_IMAGE_USAGE_TRANSFER_DST_BIT | VK_IMAGE_USAGE_SAMPLED_BIT,
+		VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, imageMemory);
+
+	// Each row of data is one row of 4x4 blocks (or pixels, for uncompressed files). Mapped files are copied from
+	// straight into the staging buffer
+	uint32_t rowHeight = isBlockCompressed(file.format) ? 4 : 1;
+	const unsigned char* fileData = getTextureFileData(file);
+	std::vector<ImageLevel> levels;
+	for (size_t i = baseLevel; i < file.levels.size(); i++)
+	{
+		const TextureFile::Level& level = file.levels[i];
+		levels.push_back({ fileData + level.offset, level.size, level.width, level.height, rowHeight });
+	}
+	uploadBatch->uploadImage(levels, image, mipLevels);
+
+	return image;
+}
 
-	// Create ImageView and add it to the lsit
-	VkImageView imageView = createImageView(textureImages[textureImageLoc], VK_FORMAT_R8G8B8A8_UNORM, VK_IMAGE_ASPECT_COLOR_BIT);
-	textureImageViews.push_back(imageView);
+int VulkanRenderer::storeTextureImage(VkImage image, MemoryAllocation imageMemory)
+{
+	// Reuse the slot of a released texture if there is one, so texture IDs stay inside the descriptor array
+	if (!freeTextureIds.empty())
+	{
+		int textureId = freeTextureIds.back();
+		freeTextureIds.pop_back();
+		textureImages[textureId] = image;
+		textureImageMemory[textureId] = imageMemory;
+		return textureId;
+	}
 
-	// Create Texture Descriptor Set and get its location in array
-	int descriptorLoc = createTextureDescriptor(imageView);
+	textureImages.push_back(image);
+	textureImageMemory.push_back(imageMemory);
+	textureImageViews.push_back(VK_NULL_HANDLE);
+	textureSlots.push_back(0);
+	return textureImages.size() - 1;
+}
 
-	//Return location of set with texture
-	return descriptorLoc;
+uint32_t VulkanRenderer::allocateTextureSlot()
+{
+	if (!freeTextureSlots.empty())
+	{
+		uint32_t slot = freeTextureSlots.back();
+		freeTextureSlots.pop_back();
+		return slot;
+	}
+	if (textureSlotCount >= maxTextures)
+	{
+		throw std::runtime_error("Too many textures!");
+	}
+	return textureSlotCount++;
 }
 
-int VulkanRenderer::createTextureDescriptor(VkImageView textureImage)
+int VulkanRenderer::createTexture(LoadedTexture* texture, UploadBatch* uploadBatch)
 {
-	VkDescriptorSet descriptorSet;
+	// Share the texture if it's already loaded
+	int existing = texture->key.empty() ? -1 : textureRegistry.acquire(texture->key);
+	if (existing >= 0)
+	{
+		stbi_image_free(texture->pixels);
+		texture->pixels = nullptr;
+		texture->baked = TextureFile();
+		texture->mappedFile.reset();
+		return existing;
+	}
 
-	// Descriptor Set Allocation Info
-	VkDescriptorSetAllocateInfo allocateInfo = {};
-	allocateInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
-	allocateInfo.descriptorPool = samplerDescriptorPool;
-	allocateInfo.descriptorSetCount = 1;
-	allocateInfo.pSetLayouts = &samplerDescriptorSetLayout;
+	if (texture->pixels == nullptr && texture->baked.levels.empty())
+	{
+		throw std::runtime_error("Texture has no data! (" + texture->fileName + ")");
+	}
 
-	// Allocate 
-	VkResult result = vkAllocateDescriptorSets(mainDevice.logicalDevice, &allocateInfo, &descriptorSet);
-	if (result != VK_SUCCESS)
+	if ((freeTextureIds.empty() && textureImages.size() >= maxTextures) ||
+		(freeTextureSlots.empty() && textureSlotCount >= maxTextures))
 	{
-		throw std::runtime_error("Failed to allocate texture descriptor sets!");
+		throw std::runtime_error("Too many textures! (" + texture->fileName + ")");
 	}
 
-	// Texture Image Info
-	VkDescriptorImageInfo imageInfo = {};
-	imageInfo.sampler = textureSampler;									// Sampler to use for set
-	imageInfo.imageLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;	// Image layout when in use
-	imageInfo.imageView = textureImage;									// Image to bind to set
-	// Descriptor Write Info
-	VkWriteDescriptorSet descriptorWrite = {};
-	descriptorWrite.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
-	descriptorWrite.dstSet = descriptorSet;
-	descriptorWrite.dstBinding = 0;
-	descriptorWrite.dstArrayElement = 0;
-	descriptorWrite.descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
-	descriptorWrite.descriptorCount = 1;
-	descriptorWrite.pImageInfo = &imageInfo;
+	// Create Texture Image and get its location in array (its texture ID)
+	int textureId = createTextureImage(texture, uploadBatch);
 
-	// Update new descriptor set
-	vkUpdateDescriptorSets(mainDevice.logicalDevice, 1, &descriptorWrite, 0, nullptr);
+	// Create ImageView (over all mip levels) and add it to the lsit
+	VkImageView imageView = createImageView(textureImages[textureId], texture->format, VK_IMAGE_ASPECT_COLOR_BIT,
+		texture->mipLevels);
+	textureImageViews[textureId] = imageView;
 
-	// Add descriptor Set to list
-	samplerDescriptorSets.push_back(descriptorSet);
+	// Put it in the texture array, and point frames' streaming entries at it
+	textureSlots[textureId] = allocateTextureSlot();
+	createTextureDescriptor(textureSlots[textureId], imageView);
+	textureStreamer.setTextureEntry(textureId, textureSlots[textureId], texture->baseLevel);
+
+	if (!texture->key.empty())
+	{
+		textureRegistry.add(texture->key, textureId);
+	}
 
-	// Return descriptor set location
-	return samplerDescriptorSets.size() - 1;
+	//Return ID of the texture
+	return textureId;
 }
 
-int VulkanRenderer::createMeshModel(std::string modelFile)
+int VulkanRenderer::createTexture(std::string fileName, UploadBatch* uploadBatch)
 {
-	// Import model "scene"
-	Assimp::Importer importer;
-	//In case shoulkd need normals
-	//importer.SetPropertyFloat("PP_GSN_MAX_SMOOTHING_ANGLE", 90); // flag to respect "real" edges
-	
-	const aiScene* scene = importer.ReadFile(modelFile, 
-		aiProcess_Triangulate | aiProcess_FlipUVs | aiProcess_JoinIdenticalVertices /*| aiProcess_GenSmoothNormals*/);
-
-	if (!scene)
+	// Only load the image file if it isn't loaded already
+	std::string key = TextureRegistry::makePathKey("Textures/" + fileName);
+	int existing = textureRegistry.acquire(key);
+	if (existing >= 0)
 	{
-		throw std::runtime_error("Failed to load model! (" + modelFile + ")\n");
+		return existing;
 	}
 
-	// Get vector of all materials with 1:1 ID placement
-	std::vector<std::string> textureNames = MeshModel::LoadMaterials(scene);
-
-	// Conversion from the materials list IDs to our Descriptor Array IDs
-	std::vector<int> matToTex(textureNames.size());
+	TextureSource source;
+	source.name = fileName;
+	LoadedTexture texture = loadCachedTexture(&textureCache, key, { source }, 4, compressedTextureSupport, textureMipSkip);
+	texture.key = key;
+	return createTexture(&texture, uploadBatch);
+}
 
-	// Loop over textureNames and create textures for them
-	for (size_t i = 0; i < textureNames.size(); i++)
+void VulkanRenderer::releaseTexture(int textureId)
+{
+	// Only destroyed once nothing references it (GPU must be done with it too)
+	if (!textureRegistry.release(textureId))
+	{
+		return;
+	}
+
+	// A new image of it may still be streaming in
+	if (streamingUploading)
+	{
+		streamingBatch.wait();
+		installStreamedTextures();
+	}
+
+	vkDestroyImageView(mainDevice.logicalDevice, textureImageViews[textureId], nullptr);
+	vkDestroyImage(mainDevice.logicalDevice, textureImages[textureId], nullptr);
+	memoryAllocator.free(textureImageMemory[textureId]);
+	textureStreamer.removeTexture(textureId);
+
+	// ID & slot are reused by the next texture (the array is partially bound, so the stale descriptor is never read until then)
+	textureImageViews[textureId] = VK_NULL_HANDLE;
+	textureImages[textureId] = VK_NULL_HANDLE;
+	freeTextureIds.push_back(textureId);
+	freeTextureSlots.push_back(textureSlots[textureId]);
+}
+
+void VulkanRenderer::createTextureDescriptor(uint32_t slot, VkImageView textureImage)
+{
+	// Texture Image Info
+	VkDescriptorImageInfo imageInfo = {};
+	imageInfo.imageLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;	// Image layout when in use
+	imageInfo.imageView = textureImage;									// Image to bind to set
+	// Descriptor Write Info
+	VkWriteDescriptorSet descriptorWrite = {};
+	descriptorWrite.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+	descriptorWrite.dstSet = textureDescriptorSet;
+	descriptorWrite.dstBinding = 0;
+	descriptorWrite.dstArrayElement = slot;								// Image's element of the array
+	descriptorWrite.descriptorType = VK_DESCRIPTOR_TYPE_SAMPLED_IMAGE;
+	descriptorWrite.descriptorCount = 1;
+	descriptorWrite.pImageInfo = &imageInfo;
+
+	// Update the array element (frames in flight don't use it yet, so no need to wait for them)
+	vkUpdateDescriptorSets(mainDevice.logicalDevice, 1, &descriptorWrite, 0, nullptr);
+}
+
+void VulkanRenderer::updateTextureStreaming()
+{
+	// Entries of the frame about to be recorded are brought up to date, and what it sampled last time is collected
+	textureStreamer.beginFrame(currentFrame);
+
+	// Replaced images can go once every frame that could still be using them has finished
+	for (size_t i = 0; i < retiredTextureImages.size();)
 	{
-		// If material had no texture, set '0' to indicate no texture, texture 0 will be reserved for a default texture (e.g. Diffuse)
-		if (textureNames[i].empty())
+		RetiredTextureImage& retired = retiredTextureImages[i];
+		if (frameCount < retired.retiredFrame + MAX_FRAME_DRAWS)
 		{
-			matToTex[i] = 0;
+			i++;
+			continue;
+		}
+		vkDestroyImageView(mainDevice.logicalDevice, retired.imageView, nullptr);
+		vkDestroyImage(mainDevice.logicalDevice, retired.image, nullptr);
+		memoryAllocator.free(retired.imageMemory);
+		freeTextureSlots.push_back(retired.slot);
+		retiredTextureImages.erase(retiredTextureImages.begin() + i);
+	}
+
+	// Only one batch of streamed levels at a time, the next one is planned once it's in
+	if (streamingUploading)
+	{
+		if (!streamingBatch.isFinished())
+		{
+			return;
+		}
+		installStreamedTextures();
+	}
+
+	if (!TEXTURE_STREAMING)
+	{
+		return;
+	}
+
+	// Each change needs a free descriptor element for its new image
+	uint32_t freeSlots = static_cast<uint32_t>(freeTextureSlots.size()) + (maxTextures - textureSlotCount);
+	std::vector<TextureResidencyChange> changes = textureStreamer.planChanges(freeSlots);
+	if (changes.empty())
+	{
+		return;
+	}
+
+	// New images with the new set of levels (all re-uploaded, they're read from the texture files), swapped in once
+	// the batch has finished
+	beginUploadBatch(&streamingBatch);
+	for (auto& change : changes)
+	{
+		StreamedTextureImage streamed;
+		streamed.textureId = change.textureId;
+		streamed.baseLevel = change.baseLevel;
+
+		const TextureFile& file = textureStreamer.getTextureFile(change.textureId);
+		VkFormat format;
+		streamed.image = createTextureFileImage(file, change.baseLevel, &streamingBatch, &format, &streamed.imageMemory);
+		streamed.imageView = createImageView(streamed.image, format, VK_IMAGE_ASPECT_COLOR_BIT,
+			static_cast<uint32_t>(file.levels.size()) - change.baseLevel);
+
+		// Element isn't used by anything yet, so it can be written while frames are in flight
+		streamed.slot = allocateTextureSlot();
+		createTextureDescriptor(streamed.slot, streamed.imageView);
+
+		streamingImages.push_back(streamed);
+	}
+	streamingBatch.submit();
+	streamingUploading = true;
+}
+
+void VulkanRenderer::installStreamedTextures()
+{
+	for (auto& streamed : streamingImages)
+	{
+		int textureId = streamed.textureId;
+
+		// Frames in flight keep using the old image until their entries are updated
+		RetiredTextureImage retired = { textureImages[textureId], textureImageViews[textureId], textureImageMemory[textureId],
+			textureSlots[textureId], frameCount };
+		retiredTextureImages.push_back(retired);
+
+		textureImages[textureId] = streamed.image;
+		textureImageViews[textureId] = streamed.imageView;
+		textureImageMemory[textureId] = streamed.imageMemory;
+		textureSlots[textureId] = streamed.slot;
+		textureStreamer.updateTextureEntry(textureId, streamed.slot, streamed.baseLevel, currentFrame);
+	}
+	streamingImages.clear();
+	streamingUploading = false;
+}
+
+int VulkanRenderer::createMeshModel(std::string modelFile)
+{
+	int modelId = createMeshModelAsync(modelFile);
+
+	// Finish it (and anything else still loading) right away
+	updateModelLoads(true);
+
+	if (models[modelId].getState() == MeshModelState::Failed)
+	{
+		throw std::runtime_error("Failed to load model! (" + modelFile + ")\n");
+	}
+
+	return modelId;
+}
+
+int VulkanRenderer::createMeshModelAsync(std::string modelFile)
+{
+	// Add an empty model straight away, so the caller gets an ID it can already use
+	models.push_back(MeshModel());
+	int modelId = models.size() - 1;
+
+	std::unique_ptr<ModelLoad> load(new ModelLoad());
+	load->modelId = modelId;
+	load->modelFile = modelFile;
+	load->compressedTextures = compressedTextureSupport;
+	load->textureMipSkip = textureMipSkip;
+	load->textureRegistry = &textureRegistry;
+	load->textureCache = &textureCache;
+	load->meshCache = &meshCache;
+	load->loaderThreads = &loaderThreads;
+
+	// Parsing the file and decoding textures happens on a loader thread
+	ModelLoad* loadPtr = load.get();
+	load->parsed = loaderThreads.submit([loadPtr]() { loadModelData(loadPtr); });
+
+	modelLoads.push_back(std::move(load));
+
+	return modelId;
+}
+
+bool VulkanRenderer::isModelReady(int modelId)
+{
+	if (modelId < 0 || static_cast<size_t>(modelId) >= models.size()) return false;
+
+	return models[modelId].isReady();
+}
+
+void VulkanRenderer::destroyMeshModel(int modelId)
+{
+	if (modelId < 0 || static_cast<size_t>(modelId) >= models.size()) return;
+
+	// A model can't be destroyed halfway through loading, so let it finish
+	if (models[modelId].getState() == MeshModelState::Pending)
+	{
+		updateModelLoads(true);
+	}
+
+	// Frames in flight may still be drawing it
+	vkDeviceWaitIdle(mainDevice.logicalDevice);
+
+	for (int textureId : models[modelId].getTextureIds())
+	{
+		releaseTexture(textureId);
+	}
+	for (uint32_t materialId : models[modelId].getMaterialIds())
+	{
+		materialTable.releaseMaterial(materialId);
+	}
+	models[modelId].destroyMeshModel();
+	models[modelId].setState(MeshModelState::Destroyed);
+}
+
+void VulkanRenderer::loadModelData(ModelLoad* load)
+{
+	// Warm starts read the model straight out of the mesh cache, otherwise it's imported and cached for the next run
+	ModelFileData modelData;
+	if (!load->meshCache->load(load->modelFile, &modelData, &load->meshMapping))
+	{
+		// Import model "scene", keeping track of every file read for it (owned by the importer)
+		Assimp::Importer importer;
+		RecordingIOSystem* ioSystem = new RecordingIOSystem();
+		importer.SetIOHandler(ioSystem);
+		//In case shoulkd need normals
+		//importer.SetPropertyFloat("PP_GSN_MAX_SMOOTHING_ANGLE", 90); // flag to respect "real" edges
+
+		const aiScene* scene = importer.ReadFile(load->modelFile, MODEL_IMPORT_FLAGS);
+
+		if (!scene)
+		{
+			throw std::runtime_error("Failed to load model! (" + load->modelFile + ")");
+		}
+
+		MeshOptimizationReport report;
+		modelData = MeshModel::LoadScene(scene, &report);
+		if (MESH_OPTIMIZATION)
+		{
+			printf("Optimized model %s: ACMR %.3f -> %.3f, ATVR %.3f -> %.3f \n", load->modelFile.c_str(),
+				report.before.getACMR(), report.after.getACMR(), report.before.getATVR(), report.after.getATVR());
+		}
+		load->meshCache->store(load->modelFile, ioSystem->getOpenedFiles(), modelData);
+	}
+
+	// Get vector of all materials with 1:1 ID placement
+	std::vector<MaterialData>& materials = modelData.materials;
+
+	// Where each texture comes from and its registry key. Embedded textures are named "*<index>" and keyed by their
+	// contents (they get a copy of the data, modelData is gone once this function returns), files by their path
+	auto getTextureSource = [&](const std::string& name, std::string* key)
+	{
+		TextureSource source;
+		source.name = name;
+		if (name.empty())
+		{
+			key->clear();
+			return source;
+		}
+		if (name[0] == '*')
+		{
+			unsigned int index = static_cast<unsigned int>(atoi(name.c_str() + 1));
+			if (index >= modelData.embeddedTextures.size())
+			{
+				throw std::runtime_error("Invalid embedded texture! (" + name + " in " + load->modelFile + ")");
+			}
+			const EmbeddedTextureData& embedded = modelData.embeddedTextures[index];
+			source.embedded = true;
+			source.embeddedData = embedded.data;
+			source.embeddedWidth = embedded.width;
+			source.embeddedHeight = embedded.height;
+			*key = TextureRegistry::makeContentKey(embedded.data.data(), embedded.data.size());
 		}
 		else
 		{
-			// Otherwise, create texture and set value to index of new texture
-			matToTex[i] = createTexture(textureNames[i]);
+			*key = TextureRegistry::makePathKey("Textures/" + name);
+		}
+		return source;
+	};
+
+	// Decode all textures of all materials (textures a material doesn't have keep an empty key). Each texture is only
+	// decoded once, and not at all if it's already loaded; those entries just get their key, for the upload to find the
+	// existing texture (held by the load until then). Decodes run as separate jobs, in parallel with each other and the
+	// mesh loading below. Nothing waits for them here (a worker waiting on jobs queued behind it could deadlock the pool),
+	// the main thread checks them instead
+	load->materials.resize(materials.size());
+	std::unordered_set<std::string> decodedKeys;
+	bool allowCompressed = load->compressedTextures;
+	uint32_t mipSkip = load->textureMipSkip;
+	TextureCache* textureCache = load->textureCache;
+	auto needsDecode = [&](LoadedTexture* texture, const std::string& name, const std::string& key)
+	{
+		texture->fileName = name;
+		texture->key = key;
+		if (key.empty())
+		{
+			return false;
+		}
+		// Already loaded: hold a reference until the upload has taken its own, so another model can't release it meanwhile
+		int existing = load->textureRegistry->acquire(key);
+		if (existing >= 0)
+		{
+			load->heldTextureIds.push_back(existing);
+			return false;
+		}
+		return decodedKeys.insert(key).second;
+	};
+
+	for (size_t i = 0; i < materials.size(); i++)
+	{
+		LoadedMaterial* material = &load->materials[i];
+		material->data = materials[i];
+
+		// ALBEDO: as it is
+		std::string albedoKey;
+		TextureSource albedoSource = getTextureSource(materials[i].albedoMap, &albedoKey);
+		if (needsDecode(&material->albedo, albedoSource.name, albedoKey))
+		{
+			LoadedTexture* texture = &material->albedo;
+			load->decodes.push_back(load->loaderThreads->submit([texture, textureCache, albedoKey, albedoSource, allowCompressed, mipSkip]() {
+				*texture = loadCachedTexture(textureCache, albedoKey, { albedoSource }, 4, allowCompressed, mipSkip);
+				texture->key = albedoKey;
+			}));
+		}
+
+		// NORMAL: X/Y only, Z is rebuilt in the shader (BC5 files are two channels already)
+		std::string normalKey;
+		TextureSource normalSource = getTextureSource(materials[i].normalMap, &normalKey);
+		if (!normalKey.empty())
+		{
+			normalKey = TextureRegistry::makeDerivedKey("rg", { normalKey });
+		}
+		if (needsDecode(&material->normal, normalSource.name, normalKey))
+		{
+			LoadedTexture* texture = &material->normal;
+			load->decodes.push_back(load->loaderThreads->submit([texture, textureCache, normalKey, normalSource, allowCompressed, mipSkip]() {
+				*texture = loadCachedTexture(textureCache, normalKey, { normalSource }, 2, allowCompressed, mipSkip);
+				texture->key = normalKey;
+			}));
+		}
+
+		// ROUGHNESS/METALNESS/OCCLUSION: single channel maps packed together into one texture
+		std::vector<std::string> packedKeys(3);
+		std::vector<TextureSource> packedSources = {
+			getTextureSource(materials[i].roughnessMap, &packedKeys[0]),
+			getTextureSource(materials[i].metalnessMap, &packedKeys[1]),
+			getTextureSource(materials[i].occlusionMap, &packedKeys[2]) };
+		std::string packedKey;
+		if (!packedKeys[0].empty() || !packedKeys[1].empty() || !packedKeys[2].empty())
+		{
+			packedKey = TextureRegistry::makeDerivedKey("rma", packedKeys);
+		}
+		if (needsDecode(&material->packed, materials[i].roughnessMap, packedKey))
+		{
+			LoadedTexture* texture = &material->packed;
+			load->decodes.push_back(load->loaderThreads->submit([texture, textureCache, packedKey, packedSources, allowCompressed, mipSkip]() {
+				*texture = loadCachedTexture(textureCache, packedKey, packedSources, getPackedTextureChannels(packedSources),
+					allowCompressed, mipSkip);
+				texture->key = packedKey;
+			}));
 		}
 	}
 
-	// Load in all out meshes
-	std::vector<Mesh> modelMeshes = MeshModel::LoadNode(
-		mainDevice.physicalDevice, mainDevice.logicalDevice, graphicsQueue,
-		graphicsCommandPool, scene->mRootNode, scene, matToTex);
+	// Meshes go on to the upload (still in the cache entry's mapping, if they came from one)
+	load->meshes = std::move(modelData.meshes);
+}
 
-	// Create mesh model and add to list
-	MeshModel meshModel = MeshModel(modelMeshes);
-	models.push_back(meshModel);
+bool VulkanRenderer::isModelLoadDecoded(ModelLoad* load, bool wait)
+{
+	if (!wait && load->parsed.wait_for(std::chrono::seconds(0)) != std::future_status::ready)
+	{
+		return false;
+	}
+	load->parsed.wait();
 
-	return models.size() - 1;
+	// Texture decodes are only all started once the parse job is done
+	for (auto& decode : load->decodes)
+	{
+		if (!wait && decode.wait_for(std::chrono::seconds(0)) != std::future_status::ready)
+		{
+			return false;
+		}
+		decode.wait();
+	}
+	return true;
+}
+
+void VulkanRenderer::packTextureAtlases(ModelLoad* load)
+{
+	load->materialAtlases.assign(load->materials.size(), -1);
+	if (!TEXTURE_ATLAS)
+	{
+		return;
+	}
+
+	// Albedo textures that can go in an atlas: only used by materials without other maps, on meshes whose UVs stay
+	// inside 0..1, and small & uncompressed. Its data is on whichever of the materials decoded it (none of them has it
+	// if it was already loaded on its own, then it stays that way)
+	struct AtlasCandidate
+	{
+		LoadedTexture* texture = nullptr;
+		bool usable = true;
+		std::vector<size_t> materials;
+		AtlasRect rect;
+	};
+	std::vector<bool> unitUVs(load->materials.size(), true);
+	for (auto& mesh : load->meshes)
+	{
+		if (mesh.materialIndex < unitUVs.size() && !MeshModel::HasUnitUVs(mesh))
+		{
+			unitUVs[mesh.materialIndex] = false;
+		}
+	}
+	std::map<std::string, AtlasCandidate> candidates;
+	for (size_t i = 0; i < load->materials.size(); i++)
+	{
+		LoadedMaterial& material = load->materials[i];
+		if (material.albedo.key.empty()) continue;
+
+		AtlasCandidate& candidate = candidates[material.albedo.key];
+		candidate.materials.push_back(i);
+		candidate.usable = candidate.usable && unitUVs[i] && material.normal.key.empty() && material.packed.key.empty();
+		if (material.albedo.pixels || !material.albedo.baked.levels.empty())
+		{
+			candidate.texture = &material.albedo;
+		}
+	}
+
+	std::vector<std::pair<std::string, AtlasCandidate*>> packing;
+	for (auto& candidate : candidates)
+	{
+		LoadedTexture* texture = candidate.second.texture;
+		if (!candidate.second.usable || !texture ||
+			(!texture->baked.levels.empty() && texture->baked.format != TextureFormat::RGBA8) ||
+			static_cast<uint32_t>(std::max(texture->width, texture->height)) > TEXTURE_ATLAS_MAX_TEXTURE_SIZE)
+		{
+			continue;
+		}
+		packing.push_back({ candidate.first, &candidate.second });
+	}
+
+	// Tallest first packs tightest. Ties stay in key order, so a model always packs the same way (and a second copy of
+	// it finds the atlas the first one made in the registry)
+	std::stable_sort(packing.begin(), packing.end(), [](const std::pair<std::string, AtlasCandidate*>& a,
+		const std::pair<std::string, AtlasCandidate*>& b)
+		{
+			if (a.second->texture->height != b.second->texture->height)
+			{
+				return a.second->texture->height > b.second->texture->height;
+			}
+			return a.second->texture->width > b.second->texture->width;
+		});
+
+	// Each texture goes in the first atlas with room left, or a new one
+	std::vector<TextureAtlas> pages;
+	std::vector<std::vector<std::pair<std::string, AtlasCandidate*>>> pageMembers;
+	for (auto& entry : packing)
+	{
+		LoadedTexture* texture = entry.second->texture;
+		size_t page = 0;
+		while (page < pages.size() && !pages[page].add(texture->width, texture->height, &entry.second->rect))
+		{
+			page++;
+		}
+		if (page == pages.size())
+		{
+			pages.push_back(TextureAtlas());
+			pages.back().init(TEXTURE_ATLAS_SIZE, TEXTURE_ATLAS_MIP_LEVELS);
+			pageMembers.push_back({});
+			if (!pages.back().add(texture->width, texture->height, &entry.second->rect))
+			{
+				throw std::runtime_error("Texture atlas is too small for its textures! (" + texture->fileName + ")");
+			}
+		}
+		pageMembers[page].push_back(entry);
+	}
+
+	std::vector<glm::vec2> uvScales(load->materials.size());
+	std::vector<glm::vec2> uvOffsets(load->materials.size());
+	for (size_t page = 0; page < pages.size(); page++)
+	{
+		// A texture alone would just be a bigger copy of itself
+		if (pages[page].getRectCount() < 2) continue;
+
+		// Atlas is its own texture, keyed by what's in it
+		std::vector<std::string> memberKeys;
+		for (auto& member : pageMembers[page])
+		{
+			memberKeys.push_back(member.first);
+		}
+		LoadedTexture atlas;
+		atlas.fileName = load->modelFile + " atlas " + std::to_string(page);
+		atlas.key = TextureRegistry::makeDerivedKey("atlas", memberKeys);
+		atlas.channels = 4;
+
+		// Fill it in, unless it's already loaded. Members give it their levels up to the atlas's last one (decoded ones
+		// have only level 0, the rest are made now)
+		if (!load->textureRegistry->contains(atlas.key))
+		{
+			for (auto& member : pageMembers[page])
+			{
+				LoadedTexture* texture = member.second->texture;
+				std::vector<AtlasLevel> levels;
+				std::vector<MipLevel> mipLevels;
+				if (texture->pixels)
+				{
+					levels.push_back({ texture->pixels, static_cast<uint32_t>(texture->width), static_cast<uint32_t>(texture->height) });
+					uint32_t levelCount = std::min(TEXTURE_ATLAS_MIP_LEVELS, calculateMipLevels(texture->width, texture->height));
+					mipLevels = generateMipChain(texture->pixels, texture->width, texture->height, levelCount,
+						TextureFilter::Box, false);
+					for (auto& mipLevel : mipLevels)
+					{
+						levels.push_back({ mipLevel.pixels.data(), mipLevel.width, mipLevel.height });
+					}
+				}
+				else
+				{
+					const unsigned char* fileData = getTextureFileData(texture->baked);
+					for (size_t i = 0; i < texture->baked.levels.size() && i < TEXTURE_ATLAS_MIP_LEVELS; i++)
+					{
+						const TextureFile::Level& level = texture->baked.levels[i];
+						levels.push_back({ fileData + level.offset, level.width, level.height });
+					}
+				}
+				pages[page].write(member.second->rect, levels);
+			}
+			atlas.baked = pages[page].finish();
+			atlas.width = atlas.baked.width;
+			atlas.height = atlas.baked.height;
+			atlas.imageSize = getTextureFileLevelsSize(atlas.baked);
+		}
+
+		// Materials use the atlas instead, and their meshes' UVs are moved into the member's rect. The member's own
+		// data isn't needed anymore
+		int atlasIndex = static_cast<int>(load->atlases.size());
+		for (auto& member : pageMembers[page])
+		{
+			glm::vec2 scale;
+			glm::vec2 offset;
+			pages[page].getUVTransform(member.second->rect, &scale, &offset);
+			for (size_t materialIndex : member.second->materials)
+			{
+				load->materialAtlases[materialIndex] = atlasIndex;
+				uvScales[materialIndex] = scale;
+				uvOffsets[materialIndex] = offset;
+			}
+
+			LoadedTexture* texture = member.second->texture;
+			stbi_image_free(texture->pixels);
+			texture->pixels = nullptr;
+			texture->baked = TextureFile();
+			texture->mappedFile.reset();
+		}
+		load->atlases.push_back(std::move(atlas));
+	}
+
+	for (auto& mesh : load->meshes)
+	{
+		if (mesh.materialIndex < load->materialAtlases.size() && load->materialAtlases[mesh.materialIndex] >= 0)
+		{
+			MeshModel::RemapUVs(&mesh, uvScales[mesh.materialIndex], uvOffsets[mesh.materialIndex]);
+		}
+	}
+}
+
+void VulkanRenderer::uploadModelData(ModelLoad* load)
+{
+	// Conversion from the materials list IDs to our material buffer IDs
+	std::vector<uint32_t> matToMaterial(load->materials.size());
+
+	// Small textures share atlases (moving their meshes' UVs), before any of them are created
+	packTextureAtlases(load);
+
+	// Record all textures, materials & meshes of the model into one batch, so the whole model is uploaded in a single
+	// submission
+	beginUploadBatch(&load->uploadBatch);
+
+	// Create (or share) a texture, keeping a reference to it for the model
+	auto createMaterialTexture = [&](LoadedTexture* texture)
+	{
+		int textureId = createTexture(texture, &load->uploadBatch);
+		load->uploadedTextureIds.push_back(textureId);
+		return static_cast<uint32_t>(textureId);
+	};
+
+	// Loop over materials and create their textures, then the material itself
+	for (size_t i = 0; i < load->materials.size(); i++)
+	{
+		LoadedMaterial& material = load->materials[i];
+
+		GpuMaterial gpuMaterial = {};
+		gpuMaterial.baseColor = material.data.baseColor;
+		gpuMaterial.roughness = material.data.roughness;
+		gpuMaterial.metalness = material.data.metalness;
+		gpuMaterial.samplerId = createMaterialSampler(material.data.addressing);
+
+		// If material had no texture, use texture 0, it's reserved for a default texture (e.g. Diffuse)
+		gpuMaterial.albedoTextureId = 0;
+		if (load->materialAtlases[i] >= 0)
+		{
+			gpuMaterial.albedoTextureId = createMaterialTexture(&load->atlases[load->materialAtlases[i]]);
+		}
+		else if (!material.albedo.key.empty())
+		{
+			gpuMaterial.albedoTextureId = createMaterialTexture(&material.albedo);
+		}
+
+		// Other maps are only read if the flags say they're there
+		if (!material.normal.key.empty())
+		{
+			gpuMaterial.normalTextureId = createMaterialTexture(&material.normal);
+			gpuMaterial.flags |= MATERIAL_NORMAL_MAP;
+		}
+		if (!material.packed.key.empty())
+		{
+			gpuMaterial.packedTextureId = createMaterialTexture(&material.packed);
+			if (!material.data.roughnessMap.empty()) gpuMaterial.flags |= MATERIAL_ROUGHNESS_MAP;
+			if (!material.data.metalnessMap.empty()) gpuMaterial.flags |= MATERIAL_METALNESS_MAP;
+			if (!material.data.occlusionMap.empty()) gpuMaterial.flags |= MATERIAL_OCCLUSION_MAP;
+		}
+
+		matToMaterial[i] = materialTable.createMaterial(gpuMaterial, &load->uploadBatch);
+		load->uploadedMaterialIds.push_back(matToMaterial[i]);
+	}
+
+	load->uploadedMeshes = MeshModel::UploadMeshes(&geometryPool, &load->uploadBatch, &load->meshes, matToMaterial);
+
+	// CPU copies (and the mapping) aren't needed anymore, they're in the staging ring
+	load->meshes.clear();
+	load->meshMapping.reset();
+
+	// Textures that were already loaded are referenced by the model now, so the references taken while parsing can go
+	releaseHeldTextures(load);
+
+	load->uploadBatch.submit();
+	load->uploading = true;
+}
+
+void VulkanRenderer::releaseHeldTextures(ModelLoad* load)
+{
+	for (int textureId : load->heldTextureIds)
+	{
+		releaseTexture(textureId);
+	}
+	load->heldTextureIds.clear();
+}
+
+void VulkanRenderer::updateModelLoads(bool waitForAll)
+{
+	for (size_t i = 0; i < modelLoads.size();)
+	{
+		ModelLoad* load = modelLoads[i].get();
+		bool finished = false;
+
+		if (!load->uploading)
+		{
+			// Check if the loader threads are done with the file and its textures
+			if (isModelLoadDecoded(load, waitForAll))
+			{
+				try
+				{
+					// Rethrows anything that went wrong on the loader threads
+					load->parsed.get();
+					for (auto& decode : load->decodes)
+					{
+						decode.get();
+					}
+					uploadModelData(load);
+				}
+				catch (const std::exception &e)
+				{
+					printf("ERROR: %s \n", e.what());
+					// Decodes still running would write into the load after it's gone
+					for (auto& decode : load->decodes)
+					{
+						if (decode.valid()) decode.wait();
+					}
+					// Batch may have failed halfway through recording, with parts of it already submitted
+					load->uploadBatch.abort();
+					for (auto& material : load->materials)
+					{
+						stbi_image_free(material.albedo.pixels);
+						stbi_image_free(material.normal.pixels);
+						stbi_image_free(material.packed.pixels);
+					}
+					// Give back textures & materials created before the failure (nothing can be using them yet), and the
+					// references held on textures that were already loaded
+					if (!load->uploadedTextureIds.empty() || !load->uploadedMaterialIds.empty() || !load->heldTextureIds.empty())
+					{
+						vkDeviceWaitIdle(mainDevice.logicalDevice);
+						for (int textureId : load->uploadedTextureIds)
+						{
+							releaseTexture(textureId);
+						}
+						releaseHeldTextures(load);
+						for (uint32_t materialId : load->uploadedMaterialIds)
+						{
+							materialTable.releaseMaterial(materialId);
+						}
+					}
+					models[load->modelId].setState(MeshModelState::Failed);
+					finished = true;
+				}
+			}
+		}
+
+		if (load->uploading)
+		{
+			if (waitForAll)
+			{
+				load->uploadBatch.wait();
+			}
+
+			if (load->uploadBatch.isFinished())
+			{
+				// Swap the finished model in, keeping any transform set while it was loading
+				MeshModel meshModel = MeshModel(load->uploadedMeshes);
+				meshModel.setModel(models[load->modelId].getModel());
+				meshModel.setTextureIds(load->uploadedTextureIds);
+				meshModel.setMaterialIds(load->uploadedMaterialIds);
+				models[load->modelId] = meshModel;
+
+				printf("Loaded model %s \n", load->modelFile.c_str());
+				// Report how much memory the loaded assets took
+				if (PRINT_MEMORY_STATS)
+				{
+					memoryAllocator.printStats();
+				}
+				finished = true;
+			}
+		}
+
+		if (finished)
+		{
+			modelLoads.erase(modelLoads.begin() + i);
+		}
+		else
+		{
+			i++;
+		}
+	}
 }
 
 int VulkanRenderer::createCube(std::string texture)
 {
-	std::vector<Vertex> meshVertices =
+	std::vector<SourceVertex> meshVertices =
 	{
 		// FRONT FACE
-		{{-0.5, 0.5, 0.5f}, {0.1f, 0.3f, 0.5f, 1.0f}, {0.0f, 0.0f, 1.0f}, {0.0f, 0.0f}},	// 0
-		{{-0.5, -0.5, 0.5f}, {0.5f, 0.3f, 0.1f, 1.0f}, {0.0f, 0.0f, 1.0f}, {0.0f, 1.0f}},	// 1
-		{{0.5, -0.5, 0.5f}, {0.3f, 0.5f, 0.1f, 1.0f}, {0.0f, 0.0f, 1.0f}, {1.0f, 1.0f}},	// 2
-		{{0.5, 0.5, 0.5f}, {0.3f, 0.1f, 0.5f, 1.0f}, {0.0f, 0.0f, 1.0f}, {1.0f, 0.0f}},		// 3
+		{{-0.5, 0.5, 0.5f}, {0.1f, 0.3f, 0.5f, 1.0f}, {0.0f, 0.0f, 1.0f}, {0.0f, 0.0f}, {0.0f, 0.0f, 0.0f, 0.0f}},	// 0
+		{{-0.5, -0.5, 0.5f}, {0.5f, 0.3f, 0.1f, 1.0f}, {0.0f, 0.0f, 1.0f}, {0.0f, 1.0f}, {0.0f, 0.0f, 0.0f, 0.0f}},	// 1
+		{{0.5, -0.5, 0.5f}, {0.3f, 0.5f, 0.1f, 1.0f}, {0.0f, 0.0f, 1.0f}, {1.0f, 1.0f}, {0.0f, 0.0f, 0.0f, 0.0f}},	// 2
+		{{0.5, 0.5, 0.5f}, {0.3f, 0.1f, 0.5f, 1.0f}, {0.0f, 0.0f, 1.0f}, {1.0f, 0.0f}, {0.0f, 0.0f, 0.0f, 0.0f}},		// 3
 		//// BACK FACE
-		{{-0.5, 0.5, -0.5f}, {0.1f, 0.3f, 0.5f, 1.0f}, {0.0f, 0.0f, -1.0f}, {1.0f, 0.0f}},	// 4
-		{{-0.5, -0.5, -0.5f}, {0.5f, 0.3f, 0.1f, 1.0f}, {0.0f, 0.0f, -1.0f}, {1.0f, 1.0f}},	// 5
-		{{0.5, -0.5, -0.5f},  {0.3f, 0.5f, 0.1f, 1.0f}, {0.0f, 0.0f, -1.0f}, {0.0f, 1.0f}},	// 6
-		{{0.5, 0.5, -0.5f}, {0.3f, 0.1f, 0.5f, 1.0f}, {0.0f, 0.0f, -1.0f}, {0.0f, 0.0f}},	// 7
+		{{-0.5, 0.5, -0.5f}, {0.1f, 0.3f, 0.5f, 1.0f}, {0.0f, 0.0f, -1.0f}, {1.0f, 0.0f}, {0.0f, 0.0f, 0.0f, 0.0f}},	// 4
+		{{-0.5, -0.5, -0.5f}, {0.5f, 0.3f, 0.1f, 1.0f}, {0.0f, 0.0f, -1.0f}, {1.0f, 1.0f}, {0.0f, 0.0f, 0.0f, 0.0f}},	// 5
+		{{0.5, -0.5, -0.5f},  {0.3f, 0.5f, 0.1f, 1.0f}, {0.0f, 0.0f, -1.0f}, {0.0f, 1.0f}, {0.0f, 0.0f, 0.0f, 0.0f}},	// 6
+		{{0.5, 0.5, -0.5f}, {0.3f, 0.1f, 0.5f, 1.0f}, {0.0f, 0.0f, -1.0f}, {0.0f, 0.0f}, {0.0f, 0.0f, 0.0f, 0.0f}},	// 7
 		//EXTRA FOR LIGHTING TEST
 		//LEFT FACE
-		{{-0.5, 0.5, -0.5f}, {0.1f, 0.3f, 0.5f, 1.0f}, {-1.0f, 0.0f, 0.0f}, {0.0f, 0.0f}},	// 8
-		{{-0.5, -0.5, -0.5f}, {0.5f, 0.3f, 0.1f, 1.0f}, {-1.0f, 0.0f, 0.0f}, {0.0f, 1.0f}},	// 9
-		{{-0.5, -0.5, 0.5f},  {0.3f, 0.5f, 0.1f, 1.0f}, {-1.0f, 0.0f, 0.0f}, {1.0f, 1.0f}},	// 10
-		{{-0.5, 0.5, 0.5f}, {0.3f, 0.1f, 0.5f, 1.0f}, {-1.0f, 0.0f, 0.0f}, {1.0f, 0.0f}},	// 11
+		{{-0.5, 0.5, -0.5f}, {0.1f, 0.3f, 0.5f, 1.0f}, {-1.0f, 0.0f, 0.0f}, {0.0f, 0.0f}, {0.0f, 0.0f, 0.0f, 0.0f}},	// 8
+		{{-0.5, -0.5, -0.5f}, {0.5f, 0.3f, 0.1f, 1.0f}, {-1.0f, 0.0f, 0.0f}, {0.0f, 1.0f}, {0.0f, 0.0f, 0.0f, 0.0f}},	// 9
+		{{-0.5, -0.5, 0.5f},  {0.3f, 0.5f, 0.1f, 1.0f}, {-1.0f, 0.0f, 0.0f}, {1.0f, 1.0f}, {0.0f, 0.0f, 0.0f, 0.0f}},	// 10
+		{{-0.5, 0.5, 0.5f}, {0.3f, 0.1f, 0.5f, 1.0f}, {-1.0f, 0.0f, 0.0f}, {1.0f, 0.0f}, {0.0f, 0.0f, 0.0f, 0.0f}},	// 11
 		//RIGHT FACE
-		{{0.5, 0.5, 0.5f},{0.1f, 0.3f, 0.5f, 1.0f}, {1.0f, 0.0f, 0.0f}, {0.0f, 0.0f}},		// 12
-		{{0.5, -0.5, 0.5f}, {0.5f, 0.3f, 0.1f, 1.0f}, {1.0f, 0.0f, 0.0f}, {0.0f, 1.0f}},	// 13
-		{{0.5, -0.5, -0.5f}, {0.3f, 0.5f, 0.1f, 1.0f}, {1.0f, 0.0f, 0.0f}, {1.0f, 1.0f}},	// 14
-		{{0.5, 0.5, -0.5f}, {0.3f, 0.1f, 0.5f, 1.0f}, {1.0f, 0.0f, 0.0f}, {1.0f, 0.0f}},	// 15
+		{{0.5, 0.5, 0.5f},{0.1f, 0.3f, 0.5f, 1.0f}, {1.0f, 0.0f, 0.0f}, {0.0f, 0.0f}, {0.0f, 0.0f, 0.0f, 0.0f}},		// 12
+		{{0.5, -0.5, 0.5f}, {0.5f, 0.3f, 0.1f, 1.0f}, {1.0f, 0.0f, 0.0f}, {0.0f, 1.0f}, {0.0f, 0.0f, 0.0f, 0.0f}},	// 13
+		{{0.5, -0.5, -0.5f}, {0.3f, 0.5f, 0.1f, 1.0f}, {1.0f, 0.0f, 0.0f}, {1.0f, 1.0f}, {0.0f, 0.0f, 0.0f, 0.0f}},	// 14
+		{{0.5, 0.5, -0.5f}, {0.3f, 0.1f, 0.5f, 1.0f}, {1.0f, 0.0f, 0.0f}, {1.0f, 0.0f}, {0.0f, 0.0f, 0.0f, 0.0f}},	// 15
 		//TOP FACE
-		{{-0.5, 0.5, -0.5f}, {0.1f, 0.3f, 0.5f, 1.0f}, {0.0f, 1.0f, 0.0f}, {0.0f, 0.0f}},	// 16
-		{{-0.5, 0.5, 0.5f}, {0.5f, 0.3f, 0.1f, 1.0f}, {0.0f, 1.0f, 0.0f}, {0.0f, 1.0f}},	// 17
-		{{0.5, 0.5, 0.5f},  {0.3f, 0.5f, 0.1f, 1.0f}, {0.0f, 1.0f, 0.0f}, {1.0f, 1.0f}},	// 18
-		{{0.5, 0.5, -0.5f},{0.3f, 0.1f, 0.5f, 1.0f}, {0.0f, 1.0f, 0.0f}, {1.0f, 0.0f}},		// 19
+		{{-0.5, 0.5, -0.5f}, {0.1f, 0.3f, 0.5f, 1.0f}, {0.0f, 1.0f, 0.0f}, {0.0f, 0.0f}, {0.0f, 0.0f, 0.0f, 0.0f}},	// 16
+		{{-0.5, 0.5, 0.5f}, {0.5f, 0.3f, 0.1f, 1.0f}, {0.0f, 1.0f, 0.0f}, {0.0f, 1.0f}, {0.0f, 0.0f, 0.0f, 0.0f}},	// 17
+		{{0.5, 0.5, 0.5f},  {0.3f, 0.5f, 0.1f, 1.0f}, {0.0f, 1.0f, 0.0f}, {1.0f, 1.0f}, {0.0f, 0.0f, 0.0f, 0.0f}},	// 18
+		{{0.5, 0.5, -0.5f},{0.3f, 0.1f, 0.5f, 1.0f}, {0.0f, 1.0f, 0.0f}, {1.0f, 0.0f}, {0.0f, 0.0f, 0.0f, 0.0f}},		// 19
 		//BOTTOM FACE
-		{{-0.5, -0.5, -0.5f}, {0.1f, 0.3f, 0.5f, 1.0f}, {0.0f, -1.0f, 0.0f}, {0.0f, 1.0f}},	// 20
-		{{-0.5, -0.5, 0.5f}, {0.5f, 0.3f, 0.1f, 1.0f}, {0.0f, -1.0f, 0.0f}, {0.0f, 0.0f}},	// 21
-		{{0.5, -0.5, 0.5f},  {0.3f, 0.5f, 0.1f, 1.0f}, {0.0f, -1.0f, 0.0f}, {1.0f, 0.0f}},	// 22
-		{{0.5, -0.5, -0.5f},{0.3f, 0.1f, 0.5f, 1.0f}, {0.0f, -1.0f, 0.0f}, {1.0f, 1.0f}},	// 23
+		{{-0.5, -0.5, -0.5f}, {0.1f, 0.3f, 0.5f, 1.0f}, {0.0f, -1.0f, 0.0f}, {0.0f, 1.0f}, {0.0f, 0.0f, 0.0f, 0.0f}},	// 20
+		{{-0.5, -0.5, 0.5f}, {0.5f, 0.3f, 0.1f, 1.0f}, {0.0f, -1.0f, 0.0f}, {0.0f, 0.0f}, {0.0f, 0.0f, 0.0f, 0.0f}},	// 21
+		{{0.5, -0.5, 0.5f},  {0.3f, 0.5f, 0.1f, 1.0f}, {0.0f, -1.0f, 0.0f}, {1.0f, 0.0f}, {0.0f, 0.0f, 0.0f, 0.0f}},	// 22
+		{{0.5, -0.5, -0.5f},{0.3f, 0.1f, 0.5f, 1.0f}, {0.0f, -1.0f, 0.0f}, {1.0f, 1.0f}, {0.0f, 0.0f, 0.0f, 0.0f}},	// 23
 
 	};
 	std::vector<uint32_t> meshIndices1 =
@@ -1953,30 +3495,352 @@ int VulkanRenderer::createCube(std::string texture)
 		2, 6, 5,
 		5, 1, 2
 	};
-	Mesh newMesh(mainDevice.physicalDevice, mainDevice.logicalDevice,
-		graphicsQueue, graphicsCommandPool, &meshVertices, &meshIndices1,
-		createTexture(texture));
-	models.push_back(MeshModel(std::vector<Mesh>{ newMesh }));
+	UploadBatch uploadBatch;
+	beginUploadBatch(&uploadBatch);
+	int textureId = createTexture(texture, &uploadBatch);
+	// Plain material with just the texture
+	GpuMaterial material = {};
+	material.baseColor = glm::vec4(1.0f);
+	material.roughness = 1.0f;
+	material.samplerId = defaultSamplerId;
+	material.albedoTextureId = static_cast<uint32_t>(textureId);
+	uint32_t materialId = materialTable.createMaterial(material, &uploadBatch);
+	// Packed like a loaded mesh (with its colours)
+	std::vector<MeshData> meshData(1);
+	meshData[0].indices = meshIndices1;
+	meshData[0].materialIndex = 0;
+	MeshModel::PackVertices(meshVertices, true, &meshData[0]);
+	MeshModel::BuildMeshlets(&meshData[0]);
+	std::vector<Mesh> meshList = MeshModel::UploadMeshes(&geometryPool, &uploadBatch, &meshData, { materialId });
+	uploadBatch.submit();
+	uploadBatch.wait();
+	models.push_back(MeshModel(meshList));
+	models.back().setTextureIds({ textureId });
+	models.back().setMaterialIds({ materialId });
 	return models.size() - 1;
 }
 
-stbi_uc * VulkanRenderer::loadTexture(std::string fileName, int * width, int * height, VkDeviceSize * imageSize)
+VulkanRenderer::LoadedTexture VulkanRenderer::loadEmbeddedTexture(const std::vector<unsigned char>& data,
+	unsigned int width, unsigned int height, std::string name)
 {
+	LoadedTexture texture;
+	texture.fileName = name;
+
+	// Width & height as Assimp gives them (aiTexture)
+	if (height == 0)
+	{
+		// Compressed image file (width bytes of PNG/JPG/etc) stored in the model
+		int channels;
+		texture.pixels = stbi_load_from_memory(data.data(), static_cast<int>(data.size()),
+			&texture.width, &texture.height, &channels, STBI_rgb_alpha);
+	}
+	else
+	{
+		// Raw BGRA texels, swizzle to RGBA (malloc'd, so it's freed with stbi_image_free like decoded images)
+		texture.width = width;
+		texture.height = height;
+		texture.pixels = static_cast<stbi_uc*>(malloc(texture.width * texture.height * 4));
+		for (int i = 0; texture.pixels && i < texture.width * texture.height; i++)
+		{
+			texture.pixels[i * 4 + 0] = data[i * 4 + 2];
+			texture.pixels[i * 4 + 1] = data[i * 4 + 1];
+			texture.pixels[i * 4 + 2] = data[i * 4 + 0];
+			texture.pixels[i * 4 + 3] = data[i * 4 + 3];
+		}
+	}
+
+	if (!texture.pixels)
+	{
+		throw std::runtime_error("Failed to load an embedded texture! (" + name + ")");
+	}
+
+	texture.imageSize = texture.width * texture.height * 4;
+
+	return texture;
+}
+
+VulkanRenderer::LoadedTexture VulkanRenderer::loadCachedTexture(TextureCache* cache, const std::string& key,
+	const std::vector<TextureSource>& sources, uint32_t channels, bool allowCompressed, uint32_t mipSkip)
+{
+	// Files & cache entries always have every level, the quality tier's top levels are dropped from what's loaded
+
+	// A texture made from one file (in R, for packed ones) can use its pre-baked version as it is
+	size_t sourceCount = 0;
+	LoadedTexture texture;
+	for (auto& source : sources)
+	{
+		if (source.name.empty()) continue;
+		if (sourceCount++ == 0) texture.fileName = source.name;
+	}
+	if (sourceCount == 1 && !sources[0].name.empty() && !sources[0].embedded &&
+		loadBakedTexture(sources[0].name, allowCompressed, &texture))
+	{
+		texture.channels = channels;
+		skipTopMipLevels(&texture, mipSkip);
+		return texture;
+	}
+
+	// Next best is the cache, entries are only used if they were made from exactly the same source data (missing
+	// sources still count, as their place in the texture matters)
+	std::string sourceHash;
+	for (auto& source : sources)
+	{
+		std::string hash;
+		if (!source.name.empty())
+		{
+			hash = source.embedded ? TextureCache::hashData(source.embeddedData.data(), source.embeddedData.size())
+				: TextureCache::hashFile("Textures/" + source.name);
+			if (hash.empty())
+			{
+				// Source can't be read, the decode below reports it
+				sourceHash.clear();
+				break;
+			}
+		}
+		sourceHash += hash + "|";
+	}
+	if (cache && cache->load(key, sourceHash, allowCompressed, &texture.baked, &texture.mappedFile))
+	{
+		texture.width = texture.baked.width;
+		texture.height = texture.baked.height;
+		texture.imageSize = getTextureFileLevelsSize(texture.baked);
+		texture.channels = channels;
+		skipTopMipLevels(&texture, mipSkip);
+		return texture;
+	}
+
+	// Otherwise decode it
+	texture = sources.size() == 1 ? loadTextureSource(sources[0]) : loadPackedTexture(sources);
+	texture.channels = channels;
+	if (!cache)
+	{
+		skipTopMipLevels(&texture, mipSkip);
+		return texture;
+	}
+
+	// Make the mip levels now & keep them for the next run. The texture is uploaded from them too, the same as a
+	// cache hit would be (from the stored entry if it can be mapped, so streamed levels aren't held in memory)
+	TextureFile file = cache->bakeTexture(texture.pixels, texture.width, texture.height, channels, allowCompressed);
+	cache->store(key, sourceHash, allowCompressed, file);
+	stbi_image_free(texture.pixels);
+	texture.pixels = nullptr;
+	if (!cache->load(key, sourceHash, allowCompressed, &texture.baked, &texture.mappedFile))
+	{
+		texture.baked = std::move(file);
+	}
+	texture.imageSize = getTextureFileLevelsSize(texture.baked);
+	skipTopMipLevels(&texture, mipSkip);
+	return texture;
+}
+
+void VulkanRenderer::skipTopMipLevels(LoadedTexture* texture, uint32_t mipSkip)
+{
+	// Always keep at least the 1x1 level
+	if (!texture->baked.levels.empty())
+	{
+		// Levels are just left out, so they're never copied (or, for mapped files, even read)
+		TextureFile* file = &texture->baked;
+		uint32_t skip = std::min(mipSkip, static_cast<uint32_t>(file->levels.size()) - 1);
+		file->levels.erase(file->levels.begin(), file->levels.begin() + skip);
+		file->width = file->levels[0].width;
+		file->height = file->levels[0].height;
+		texture->width = file->width;
+		texture->height = file->height;
+		texture->imageSize = getTextureFileLevelsSize(*file);
+		return;
+	}
+
+	// Decoded pixels are halved once per skipped level (malloc'd, so it's freed with stbi_image_free like decoded images)
+	uint32_t skip = std::min(mipSkip, calculateMipLevels(texture->width, texture->height) - 1);
+	for (uint32_t i = 0; i < skip; i++)
+	{
+		uint32_t width = std::max(1, texture->width / 2);
+		uint32_t height = std::max(1, texture->height / 2);
+		stbi_uc* pixels = static_cast<stbi_uc*>(malloc(static_cast<size_t>(width) * height * 4));
+		if (!pixels)
+		{
+			throw std::runtime_error("Failed to allocate a texture mip level! (" + texture->fileName + ")");
+		}
+		downsampleRGBA8(texture->pixels, texture->width, texture->height, pixels, width, height, false);
+		stbi_image_free(texture->pixels);
+		texture->pixels = pixels;
+		texture->width = width;
+		texture->height = height;
+	}
+	texture->imageSize = static_cast<VkDeviceSize>(texture->width) * texture->height * 4;
+}
+
+bool VulkanRenderer::loadBakedTexture(std::string fileName, bool allowCompressed, LoadedTexture* texture)
+{
+	// Use the pre-baked version (made by TextureEncoder) if there is one, KTX2 first. Its levels are read as they are,
+	// so there's nothing to decode. Block compressed files are skipped if the device can't sample them.
+	// KTX2 files are mapped, so levels that are never streamed in are never read
+	std::string bakedLoc = "Textures/" + fileName.substr(0, fileName.find_last_of('.'));
+	std::shared_ptr<MappedFile> mappedFile = std::make_shared<MappedFile>();
+	bool baked = mappedFile->open(bakedLoc + ".ktx2") &&
+		readKTX2Memory(mappedFile->getData(), mappedFile->getSize(), &texture->baked);
+	if (baked && (allowCompressed || !isBlockCompressed(texture->baked.format)))
+	{
+		texture->mappedFile = mappedFile;
+	}
+	else
+	{
+		baked = allowCompressed && readDDS(bakedLoc + ".dds", &texture->baked);
+	}
+	if (!baked)
+	{
+		texture->baked = TextureFile();
+		return false;
+	}
+
+	texture->fileName = fileName;
+	texture->width = texture->baked.width;
+	texture->height = texture->baked.height;
+	texture->imageSize = getTextureFileLevelsSize(texture->baked);
+	return true;
+}
+
+VulkanRenderer::LoadedTexture VulkanRenderer::loadTexturePixels(std::string fileName)
+{
+	LoadedTexture texture;
+	texture.fileName = fileName;
+
 	// Number of channels image uses
 	int channels;
 	
 	// Load pixel data for image
 	std::string fileLoc = "Textures/" + fileName;
-	stbi_uc * image = stbi_load(fileLoc.c_str(), width, height, &channels, STBI_rgb_alpha);
+	texture.pixels = stbi_load(fileLoc.c_str(), &texture.width, &texture.height, &channels, STBI_rgb_alpha);
 
-	if (!image)
+	if (!texture.pixels)
 	{
 		throw std::runtime_error("Failed to load a Texture file! (" + fileName + ")");
 	}
 
-	*imageSize = *width * *height * 4;
+	texture.imageSize = texture.width * texture.height * 4;
 
-	return image;
+	return texture;
+}
+
+VulkanRenderer::LoadedTexture VulkanRenderer::loadTextureSource(const TextureSource& source)
+{
+	if (source.embedded)
+	{
+		return loadEmbeddedTexture(source.embeddedData, source.embeddedWidth, source.embeddedHeight, source.name);
+	}
+	return loadTexturePixels(source.name);
+}
+
+uint32_t VulkanRenderer::getPackedTextureChannels(const std::vector<TextureSource>& sources)
+{
+	// Maps go to the channel matching their place in sources, the texture keeps channels up to the last map it has
+	// (so a lone roughness map is a single channel texture). No 3 channel formats, RGB is stored as RGBA
+	uint32_t channels = 0;
+	for (uint32_t i = 0; i < sources.size(); i++)
+	{
+		if (!sources[i].name.empty()) channels = i + 1;
+	}
+	return channels < 3 ? channels : 4;
+}
+
+VulkanRenderer::LoadedTexture VulkanRenderer::loadPackedTexture(const std::vector<TextureSource>& sources)
+{
+	uint32_t channels = getPackedTextureChannels(sources);
+	if (channels == 0)
+	{
+		throw std::runtime_error("Packed texture has no maps!");
+	}
+
+	// Decode all maps, the packed texture is as big as the biggest one
+	std::vector<LoadedTexture> maps(sources.size());
+	LoadedTexture texture;
+	try
+	{
+		for (size_t i = 0; i < sources.size(); i++)
+		{
+			if (sources[i].name.empty()) continue;
+
+			maps[i] = loadTextureSource(sources[i]);
+			if (maps[i].width * maps[i].height > texture.width * texture.height)
+			{
+				texture.fileName = maps[i].fileName;
+				texture.width = maps[i].width;
+				texture.height = maps[i].height;
+			}
+		}
+	}
+	catch (...)
+	{
+		// Don't leak the maps decoded before the one that failed
+		for (auto& map : maps)
+		{
+			stbi_image_free(map.pixels);
+		}
+		throw;
+	}
+
+	// Channels without a map are left white (the shader doesn't read them anyway). Malloc'd, so it's freed with
+	// stbi_image_free like decoded images
+	texture.imageSize = texture.width * texture.height * 4;
+	texture.pixels = static_cast<stbi_uc*>(malloc(static_cast<size_t>(texture.imageSize)));
+	if (texture.pixels)
+	{
+		memset(texture.pixels, 255, static_cast<size_t>(texture.imageSize));
+	}
+
+	std::vector<unsigned char> resized;
+	for (uint32_t i = 0; i < maps.size(); i++)
+	{
+		if (!maps[i].pixels) continue;
+
+		// Grey maps decode to the same value in R, G & B, so R is the map's value
+		const unsigned char* src = maps[i].pixels;
+		if (texture.pixels && (maps[i].width != texture.width || maps[i].height != texture.height))
+		{
+			resized.resize(static_cast<size_t>(texture.imageSize));
+			resizeRGBA8(maps[i].pixels, maps[i].width, maps[i].height, resized.data(), texture.width, texture.height,
+				TextureFilter::Box, false);
+			src = resized.data();
+		}
+		if (texture.pixels)
+		{
+			copyChannelRGBA8(src, 0, texture.pixels, i, texture.width, texture.height);
+		}
+		stbi_image_free(maps[i].pixels);
+	}
+
+	if (!texture.pixels)
+	{
+		throw std::runtime_error("Failed to allocate a packed texture! (" + texture.fileName + ")");
+	}
+
+	texture.channels = channels;
+	return texture;
+}
+
+VkFormat VulkanRenderer::getUncompressedVkFormat(uint32_t channels)
+{
+	switch (channels)
+	{
+	case 1: return VK_FORMAT_R8_UNORM;
+	case 2: return VK_FORMAT_R8G8_UNORM;
+	default: return VK_FORMAT_R8G8B8A8_UNORM;
+	}
+}
+
+VkFormat VulkanRenderer::getTextureVkFormat(TextureFormat format)
+{
+	switch (format)
+	{
+	case TextureFormat::BC1: return VK_FORMAT_BC1_RGBA_UNORM_BLOCK;
+	case TextureFormat::BC3: return VK_FORMAT_BC3_UNORM_BLOCK;
+	case TextureFormat::BC4: return VK_FORMAT_BC4_UNORM_BLOCK;
+	case TextureFormat::BC5: return VK_FORMAT_BC5_UNORM_BLOCK;
+	case TextureFormat::BC7: return VK_FORMAT_BC7_UNORM_BLOCK;
+	case TextureFormat::R8: return VK_FORMAT_R8_UNORM;
+	case TextureFormat::RG8: return VK_FORMAT_R8G8_UNORM;
+	default: return VK_FORMAT_R8G8B8A8_UNORM;
+	}
 }
 
 void VulkanRenderer::getPhysicalDevice()
@@ -2139,7 +4003,24 @@ bool VulkanRenderer::checkDeviceSuitable(VkPhysicalDevice device)
 		swapChainValid = !swapChainDeltails.presentationModes.empty() && !swapChainDeltails.surfaceFormats.empty();
 	}
 
-	return indices.isValid() && extensionsSupported && swapChainValid && deviceFeatures.samplerAnisotropy;
+	return indices.isValid() && extensionsSupported && swapChainValid && deviceFeatures.samplerAnisotropy &&
+		deviceFeatures.shaderSampledImageArrayDynamicIndexing && deviceFeatures.fragmentStoresAndAtomics &&
+		checkDescriptorIndexingSupport(device);
+}
+
+bool VulkanRenderer::checkDescriptorIndexingSupport(VkPhysicalDevice device)
+{
+	// Features the bindless texture array needs
+	VkPhysicalDeviceDescriptorIndexingFeaturesEXT descriptorIndexingFeatures = {};
+	descriptorIndexingFeatures.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_DESCRIPTOR_INDEXING_FEATURES_EXT;
+	VkPhysicalDeviceFeatures2 deviceFeatures = {};
+	deviceFeatures.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_FEATURES_2;
+	deviceFeatures.pNext = &descriptorIndexingFeatures;
+	vkGetPhysicalDeviceFeatures2(device, &deviceFeatures);
+
+	return descriptorIndexingFeatures.runtimeDescriptorArray && descriptorIndexingFeatures.descriptorBindingPartiallyBound &&
+		descriptorIndexingFeatures.descriptorBindingSampledImageUpdateAfterBind &&
+		descriptorIndexingFeatures.descriptorBindingUpdateUnusedWhilePending;
 }
 
 bool VulkanRenderer::checkValidationLayerSupport(const std::vector<const char*>* checkLayers) const
@@ -2171,6 +4052,85 @@ bool VulkanRenderer::checkValidationLayerSupport(const std::vector<const char*>*
 
 }
 
+bool VulkanRenderer::checkLinearBlitSupport(VkFormat format)
+{
+	// Mip generation blits each level from the previous one with linear filtering
+	return checkFormatSupport(format, VK_IMAGE_TILING_OPTIMAL,
+		VK_FORMAT_FEATURE_BLIT_SRC_BIT | VK_FORMAT_FEATURE_BLIT_DST_BIT | VK_FORMAT_FEATURE_SAMPLED_IMAGE_FILTER_LINEAR_BIT);
+}
+
+bool VulkanRenderer::checkFormatSupport(VkFormat format, VkImageTiling tiling, VkFormatFeatureFlags featureFlags)
+{
+	// Get properties for given format on this device
+	VkFormatProperties properties;
+	vkGetPhysicalDeviceFormatProperties(mainDevice.physicalDevice, format, &properties);
+
+	// Depending of tiling choice, need to check for different bit flag
+	if (tiling == VK_IMAGE_TILING_LINEAR)
+	{
+		return (properties.linearTilingFeatures & featureFlags) == featureFlags;
+	}
+	return (properties.optimalTilingFeatures & featureFlags) == featureFlags;
+}
+
+bool VulkanRenderer::checkCompressedTextureSupport()
+{
+	std::vector<TextureFormat> formats = { TextureFormat::BC1, TextureFormat::BC3, TextureFormat::BC4, TextureFormat::BC5, TextureFormat::BC7 };
+	for (TextureFormat format : formats)
+	{
+		if (!checkFormatSupport(getTextureVkFormat(format), VK_IMAGE_TILING_OPTIMAL,
+			VK_FORMAT_FEATURE_SAMPLED_IMAGE_BIT | VK_FORMAT_FEATURE_SAMPLED_IMAGE_FILTER_LINEAR_BIT))
+		{
+			return false;
+		}
+	}
+	return true;
+}
+
+float VulkanRenderer::getProjectedRadius(const glm::mat4& model, glm::vec4 sphere)
+{
+	// Scaled by the model's largest axis, so the sphere still holds the whole mesh
+	glm::vec3 center = glm::vec3(uboViewProjection.view * model * glm::vec4(glm::vec3(sphere), 1.0f));
+	float scale = std::max(glm::length(glm::vec3(model[0])), std::max(glm::length(glm::vec3(model[1])), glm::length(glm::vec3(model[2]))));
+	float radius = sphere.w * scale;
+	float distance = glm::length(center);
+	if (distance <= radius)
+	{
+		return FLT_MAX;
+	}
+
+	// projection[1][1] is cot(fov / 2) (flipped for Vulkan), which maps to half the screen's height
+	return radius / distance * std::abs(uboViewProjection.projection[1][1]) * 0.5f * static_cast<float>(swapchainExtent.height);
+}
+
+uint32_t VulkanRenderer::getTextureMipSkip(TextureQuality quality)
+{
+	switch (quality)
+	{
+	case TextureQuality::Full: return 0;
+	case TextureQuality::Half: return 1;
+	case TextureQuality::Quarter: return 2;
+	default: break;
+	}
+
+	// Auto: go by the biggest device local heap (integrated GPUs report shared system memory, which is fine as a guess)
+	VkPhysicalDeviceMemoryProperties memoryProperties;
+	vkGetPhysicalDeviceMemoryProperties(mainDevice.physicalDevice, &memoryProperties);
+	VkDeviceSize vramSize = 0;
+	for (uint32_t i = 0; i < memoryProperties.memoryHeapCount; i++)
+	{
+		if (memoryProperties.memoryHeaps[i].flags & VK_MEMORY_HEAP_DEVICE_LOCAL_BIT)
+		{
+			vramSize = std::max(vramSize, memoryProperties.memoryHeaps[i].size);
+		}
+	}
+
+	const VkDeviceSize gigabyte = 1024ull * 1024 * 1024;
+	if (vramSize >= 4 * gigabyte) return 0;
+	if (vramSize >= 2 * gigabyte) return 1;
+	return 2;
+}
+
 QueueFamilyIndices VulkanRenderer::getQueueFamilies(VkPhysicalDevice device)
 {
 	QueueFamilyIndices indices;
@@ -2188,37 +4148,60 @@ QueueFamilyIndices VulkanRenderer::getQueueFamilies(VkPhysicalDevice device)
 	for (const auto& queueFamily : queueFamilyList)
 	{
 		// get through each queue family an check if it has at least one type of queue (it can have 0 queues in it).
-		
+		if (queueFamily.queueCount == 0)
+		{
+			i++;
+			continue;
+		}
+
 		// queue can be multiple types due to bitField. use BITWISE_AND with VK_QUEUE_*_BIT to check its presence
-		if (queueFamily.queueCount > 0 && queueFamily.queueFlags & VK_QUEUE_GRAPHICS_BIT)
+		bool graphics = queueFamily.queueFlags & VK_QUEUE_GRAPHICS_BIT;
+		bool compute = queueFamily.queueFlags & VK_QUEUE_COMPUTE_BIT;
+		bool transfer = queueFamily.queueFlags & VK_QUEUE_TRANSFER_BIT;
+		// Images are copied in bands of rows at any offset, so a transfer family has to copy single texels (families
+		// without graphics & compute may only copy whole blocks of the granularity, or whole mip levels for 0,0,0)
+		VkExtent3D granularity = queueFamily.minImageTransferGranularity;
+		bool texelCopies = granularity.width == 1 && granularity.height == 1 && granularity.depth == 1;
+
+		if (graphics && indices.graphicsFamily < 0)
 		{
 			indices.graphicsFamily = i;
 		}
-		if (queueFamily.queueCount > 0 && queueFamily.queueFlags & VK_QUEUE_COMPUTE_BIT)
+		// prefer async compute family (without graphics)
+		if (compute && (indices.computeFamily < 0 || !graphics))
 		{
 			indices.computeFamily = i;
 		}
-		if (queueFamily.queueCount > 0 && queueFamily.queueFlags & VK_QUEUE_TRANSFER_BIT)
+		// prefer dedicated transfer family (DMA engine, without graphics & compute), then any family without graphics
+		// (that can copy single texels, otherwise the graphics family does the copies)
+		if (transfer && !graphics && !compute && texelCopies)
 		{
 			indices.transferFamily = i;
 		}
+		else if (transfer && !graphics && texelCopies &&
+			(indices.transferFamily < 0 || indices.transferFamily == indices.graphicsFamily))
+		{
+			indices.transferFamily = i;
+		}
+
 		// check if queue family supports presentation
 		VkBool32 presentationSupport = false;
 		vkGetPhysicalDeviceSurfaceSupportKHR(device, i, surface, &presentationSupport);
-		// check is queue if presentation type (can be both graphics & presentation thou)
-		if (queueFamily.queueCount > 0 && presentationSupport)
+		// check is queue if presentation type (can be both graphics & presentation thou), prefer the graphics one
+		if (presentationSupport && (indices.presentationFamily < 0 || i == indices.graphicsFamily))
 		{
 			indices.presentationFamily = i;
 		}
 
-		if (indices.isValid())
-		{
-			break;
-		}
-
 		i++;
 	}
 
+	// Graphics queues can always do transfers, so use them if there's nothing better
+	if (indices.transferFamily < 0)
+	{
+		indices.transferFamily = indices.graphicsFamily;
+	}
+
 	return indices;
 }
 
@@ -12,16 +12,33 @@
 #include <stdexcept> //pass exceptions
 #include <vector>
 #include <algorithm>
+#include <cfloat>
 #include <iostream>
 #include <set>
+#include <map>
 #include <array>
 #include <string>
+#include <memory>
+#include <future>
+#include <unordered_set>
 
 #include "stb_image.h"
 
 #include "Mesh.h"
 #include "MeshModel.h"
+#include "VertexFormat.h"
 #include "Utilities.h"
+#include "ThreadPool.h"
+#include "TextureProcessing.h"
+#include "TextureFile.h"
+#include "TextureRegistry.h"
+#include "TextureCache.h"
+#include "TextureStreamer.h"
+#include "TextureAtlas.h"
+#include "MeshCache.h"
+#include "SamplerCache.h"
+#include "MaterialTable.h"
+#include "MeshletCuller.h"
 
 class VulkanRenderer
 {
@@ -30,7 +47,13 @@ public:
 
 	int init(GLFWwindow * newWindow);
 
+	// Load a model and wait for it
 	int createMeshModel(std::string modelFile);
+	// Start loading a model in the background, it's drawn once all of its data is on the GPU
+	int createMeshModelAsync(std::string modelFile);
+	bool isModelReady(int modelId);
+	// Free a model's meshes and drop its texture references (waits for the GPU to be idle)
+	void destroyMeshModel(int modelId);
 	//TODO:: Create Primitive factory for creating primitives such as cube, sphere, etc
 	int createCube(std::string texture);
 	void updateModel(int modelId, glm::mat4 newModel);
@@ -43,10 +66,77 @@ private:
 	GLFWwindow* window;
 	//use to control the maximum number of images being drawn on a queue.
 	int currentFrame = 0;
+	uint64_t frameCount = 0;		// Frames drawn so far
 
 	// -- Scene Objects -- //
 	std::vector<MeshModel> models;
 
+	// -- Asset Loading -- //
+	// Decoded texture pixels (or pre-baked mip levels), ready to be copied to the GPU
+	struct LoadedTexture
+	{
+		std::string fileName;
+		std::string key;								// TextureRegistry key, empty for no texture
+		int width = 0;
+		int height = 0;
+		VkDeviceSize imageSize = 0;
+		stbi_uc* pixels = nullptr;
+		TextureFile baked;								// Levels are empty unless loaded from a .ktx2/.dds file
+		std::shared_ptr<MappedFile> mappedFile;			// Memory the baked levels are in, if it's mapped (cache entries)
+		uint32_t channels = 4;							// Channels of pixels kept on the GPU (1 = R8, 2 = R8G8, 4 = RGBA8)
+		VkFormat format = VK_FORMAT_UNDEFINED;			// Image format and mip levels, set once the image is created
+		uint32_t mipLevels = 1;
+		uint32_t baseLevel = 0;							// Level of baked the image starts at (streamed textures start at their mip tail)
+	};
+
+	// Where a texture comes from: a file in Textures/, or a copy of a texture embedded in the model file
+	struct TextureSource
+	{
+		std::string name;
+		bool embedded = false;
+		std::vector<unsigned char> embeddedData;
+		unsigned int embeddedWidth = 0;
+		unsigned int embeddedHeight = 0;
+	};
+
+	// A model material and its textures (textures with an empty key aren't used)
+	struct LoadedMaterial
+	{
+		MaterialData data;
+		LoadedTexture albedo;
+		LoadedTexture normal;		// X/Y in two channels
+		LoadedTexture packed;		// Roughness/metalness/occlusion maps packed into R/G/B
+	};
+
+	// Model being loaded in the background
+	// Worker thread fills textures + meshes, main thread uploads them and swaps the finished model in
+	struct ModelLoad
+	{
+		int modelId;
+		std::string modelFile;
+		std::future<void> parsed;					// Ready once the worker has finished with the file
+		std::vector<std::future<void>> decodes;		// One per texture being decoded, started by the parse job
+		std::vector<LoadedMaterial> materials;		// 1:1 with the model's materials
+		std::vector<MeshData> meshes;
+		std::shared_ptr<MappedFile> meshMapping;	// Mesh cache entry the meshes' data is in, if they came from one
+		std::vector<LoadedTexture> atlases;			// Atlases the model's small albedo textures were packed into
+		std::vector<int> materialAtlases;			// Atlas each material's albedo is in, -1 if it isn't in one
+		UploadBatch uploadBatch;
+		std::vector<Mesh> uploadedMeshes;
+		std::vector<int> uploadedTextureIds;		// Texture references the finished model will hold
+		std::vector<int> heldTextureIds;			// References the parse took on textures already loaded (until the upload)
+		std::vector<uint32_t> uploadedMaterialIds;	// Materials the finished model will own
+		bool uploading = false;
+		bool compressedTextures = false;			// Pre-compressed textures can be used
+		uint32_t textureMipSkip = 0;				// Top mip levels dropped from each texture
+		TextureRegistry* textureRegistry = nullptr;	// Textures already loaded don't need decoding again
+		TextureCache* textureCache = nullptr;		// Textures decoded by an earlier run don't need decoding either
+		MeshCache* meshCache = nullptr;				// Nor does a model imported by an earlier run need importing
+		ThreadPool* loaderThreads = nullptr;		// Textures are decoded in parallel on the same threads
+	};
+	std::vector<std::unique_ptr<ModelLoad>> modelLoads;
+	ThreadPool loaderThreads;
+
 	// -- Scene Settings -- //
 	struct UboViewProjection
 	{
@@ -65,8 +155,16 @@ private:
 	// -- Queues -- //
 	VkQueue graphicsQueue;
 	VkQueue presentationQueue;
+	VkQueue transferQueue;		// Same as graphicsQueue if the device has no separate transfer family
+	bool compressedTextureSupport = false;		// Device can sample all BCn formats
+	uint32_t textureMipSkip = 0;				// Top mip levels of every texture that aren't loaded (texture quality tier)
 	QueueFamilyIndices queueFamilyIndices;
 
+	// -- Memory -- //
+	MemoryAllocator memoryAllocator;
+	GeometryPool geometryPool;
+	StagingRing stagingRing;
+
 	VkDebugUtilsMessengerEXT debugMessenger;
 	VkSurfaceKHR surface;
 	VkSwapchainKHR swapchain;
@@ -77,13 +175,13 @@ private:
 
 	// -- Color Buffer -- //
 	std::vector<VkImage> colorBufferImage;
-	std::vector<VkDeviceMemory> colorBufferImageMemory;
+	std::vector<MemoryAllocation> colorBufferImageMemory;
 	std::vector<VkImageView> colorBufferImageView;
 	VkFormat colorImageFormat;
 
 	// -- Depth Buffer -- //
 	std::vector<VkImage> depthBufferImage;
-	std::vector<VkDeviceMemory> depthBufferImageMemory;
+	std::vector<MemoryAllocation> depthBufferImageMemory;
 	std::vector<VkImageView> depthBufferImageView;
 	VkFormat depthImageFormat;
 
@@ -95,16 +193,17 @@ private:
 	VkDescriptorSetLayout inputDescriptorSetLayout;
 	//Push Constants
 	VkPushConstantRange pushConstantRange;
+	VkPushConstantRange materialPushConstantRange;		// Material of each draw (fragment shader)
 
 	VkDescriptorPool descriptorPool;
 	VkDescriptorPool samplerDescriptorPool;
 	VkDescriptorPool inputDescriptorPool;
 	std::vector<VkDescriptorSet> descriptorSets;
-	std::vector<VkDescriptorSet> samplerDescriptorSets;
+	VkDescriptorSet textureDescriptorSet;				// Every texture, sampler & material, indexed by their IDs (bindless)
 	std::vector<VkDescriptorSet> inputDescriptorSets;
 
 	std::vector<VkBuffer> vpUniformBuffer;
-	std::vector<VkDeviceMemory> vpUniformBufferMemory;
+	std::vector<MemoryAllocation> vpUniformBufferMemory;
 
 	//DYNAMIC UNIFORM BUFFER: TEMPORARY NOT IN USE
 	/*std::vector<VkBuffer> modelUniformBufferDynamic;
@@ -116,20 +215,93 @@ private:
 	//Model* modelTransferSpace;*/
 
 	// -- Assets -- //
-	VkSampler textureSampler;
+	SamplerCache samplerCache;
+	uint32_t defaultSamplerId = 0;
 	std::vector<VkImage> textureImages;
-	std::vector<VkDeviceMemory> textureImageMemory;
-	std::vector<VkImageView> textureImageViews;
+	std::vector<MemoryAllocation> textureImageMemory;
+	std::vector<VkImageView> textureImageViews;		// Indexed by texture ID
+	std::vector<int> freeTextureIds;				// IDs of released textures, reused before growing the array
+	std::vector<uint32_t> textureSlots;				// Texture ID -> descriptor array element of its current image
+	std::vector<uint32_t> freeTextureSlots;			// Descriptor array elements not in use, reused before new ones
+	uint32_t textureSlotCount = 0;					// Descriptor array elements handed out so far
+	uint32_t maxTextures = MAX_TEXTURES;
+	uint32_t maxSamplers = MAX_SAMPLERS;
+	TextureRegistry textureRegistry;
+	TextureCache textureCache;
+	MeshCache meshCache;
+	TextureStreamer textureStreamer;
+	MaterialTable materialTable;
+
+	// -- Texture Streaming -- //
+	// Image with a new set of a streamed texture's levels
+	struct StreamedTextureImage
+	{
+		int textureId;
+		uint32_t baseLevel;
+		VkImage image;
+		MemoryAllocation imageMemory;
+		VkImageView imageView;
+		uint32_t slot;
+	};
+	std::vector<StreamedTextureImage> streamingImages;	// Being uploaded by the streaming batch
+	UploadBatch streamingBatch;
+	bool streamingUploading = false;
+	// Images replaced by streamed ones, destroyed once no frame in flight can be using them
+	struct RetiredTextureImage
+	{
+		VkImage image;
+		VkImageView imageView;
+		MemoryAllocation imageMemory;
+		uint32_t slot;
+		uint64_t retiredFrame;
+	};
+	std::vector<RetiredTextureImage> retiredTextureImages;
+
+	// -- Meshlet Culling -- //
+	// Mesh drawn this frame, with the level it picked and its draw in the cull pass (-1 if it's drawn whole)
+	struct MeshDraw
+	{
+		Mesh* mesh;
+		glm::mat4 model;
+		MeshLod lod;
+		int32_t cullDraw;
+	};
+	std::vector<MeshDraw> meshDraws;				// Reused every frame
+	MeshletCuller meshletCuller;
+	VkDescriptorSetLayout cullDescriptorSetLayout;
+	VkDescriptorSetLayout depthPyramidDescriptorSetLayout;
+	VkDescriptorPool cullDescriptorPool;
+	VkDescriptorSet cullDescriptorSet;
+	// Level 0 reads the depth buffer, so it has a set per swapchain image, then there's one per level after it
+	std::vector<VkDescriptorSet> depthPyramidDescriptorSets;
+	VkPipelineLayout cullPipelineLayout;
+	VkPipeline cullPipeline;
+	VkPipelineLayout depthPyramidPipelineLayout;
+	VkPipeline depthPyramidPipeline;
+	// Farthest depth of the last frame, half the depth buffer's size at level 0, down to 1x1 (kept in GENERAL)
+	VkImage depthPyramidImage;
+	MemoryAllocation depthPyramidImageMemory;
+	VkImageView depthPyramidImageView;
+	std::vector<VkImageView> depthPyramidLevelViews;
+	VkExtent2D depthPyramidExtent;
+	uint32_t depthPyramidLevels = 0;
+	uint32_t depthPyramidSamplerId = 0;
+	bool depthPyramidValid = false;					// Built at least once (nothing to test occlusion against before)
+	bool occlusionCulling = false;					// Turned on, and the depth buffer can be sampled
 
 	// -- Pipeline -- //
 	VkPipelineLayout pipelineLayout;
 	VkPipeline graphicsPipeline;
+	VkPipeline vertexColorPipeline;		// Same as graphicsPipeline, for meshes with a vertex colour stream
+	VkPipeline closedPipeline;			// Both again with back faces culled, for closed meshes
+	VkPipeline closedVertexColorPipeline;
 
 	VkPipeline secondPipeline;
 	VkPipelineLayout secondPipelineLayout;
 
 	// -- Pools -- //
 	VkCommandPool graphicsCommandPool;
+	VkCommandPool transferCommandPool;
 
 	// -- Utility -- //
 	VkFormat swapchainImageFormat;
@@ -169,10 +341,13 @@ private:
 	void createDescriptorPool();
 	void createDescriptorSets();
 	void createInputDescriptorSets();
+	void createMeshletCulling();
 	void updateUniformBuffers(uint32_t imageIndex);
 
 	// -- Record Functions -- //
 	void recordCommands(uint32_t currentImage);
+	void recordMeshletCulling(VkCommandBuffer commandBuffer);
+	void recordDepthPyramid(uint32_t currentImage);
 
 	// -- Get Functions -- //
 	void getPhysicalDevice();
@@ -189,9 +364,17 @@ private:
 	bool checkDeviceExtensionSupport(VkPhysicalDevice device);
 	bool checkDeviceSuitable(VkPhysicalDevice device);
 	bool checkValidationLayerSupport(const std::vector<const char*>* checkLayers) const;
+	bool checkLinearBlitSupport(VkFormat format);
+	bool checkFormatSupport(VkFormat format, VkImageTiling tiling, VkFormatFeatureFlags featureFlags);
+	bool checkCompressedTextureSupport();
+	bool checkDescriptorIndexingSupport(VkPhysicalDevice device);
 
 	// -- Getter Functions -- //
 	QueueFamilyIndices getQueueFamilies(VkPhysicalDevice device);
+	uint32_t getTextureMipSkip(TextureQuality quality);
+	// Radius in pixels of a bounding sphere (object space centre & radius) seen through the camera, FLT_MAX if the camera
+	// is inside it
+	float getProjectedRadius(const glm::mat4& model, glm::vec4 sphere);
 	SwapchainDetails getSwapChainDetails(VkPhysicalDevice device);
 
 	// -- Callback Functions -- //
@@ -223,17 +406,49 @@ private:
 
 	// -- Create funcs -- //
 	VkImage createImage(
-		uint32_t width, uint32_t height, VkFormat format, 
+		uint32_t width, uint32_t height, uint32_t mipLevels, VkFormat format, 
 		VkImageTiling tiling, VkImageUsageFlags useFlags, VkMemoryPropertyFlags propFlags,
-		VkDeviceMemory *imageMemory);
-	VkImageView createImageView(VkImage image, VkFormat format, VkImageAspectFlags aspectFlags);
+		MemoryAllocation *imageMemory);
+	VkImageView createImageView(VkImage image, VkFormat format, VkImageAspectFlags aspectFlags, uint32_t mipLevels);
 	VkShaderModule createShaderModule(const std::vector<char>& code);
+	VkPipeline createComputePipeline(const std::string& fileName, VkPipelineLayout layout);
 	
-	int createTextureImage(std::string fileName);
-	int createTexture(std::string fileName);
-	int createTextureDescriptor(VkImageView textureImage);
+	void beginUploadBatch(UploadBatch* uploadBatch);
+	int createTextureImage(LoadedTexture* texture, UploadBatch* uploadBatch);
+	int createTexture(LoadedTexture* texture, UploadBatch* uploadBatch);
+	int createTexture(std::string fileName, UploadBatch* uploadBatch);
+	VkImage createTextureFileImage(const TextureFile& file, uint32_t baseLevel, UploadBatch* uploadBatch,
+		VkFormat* format, MemoryAllocation* imageMemory);
+	int storeTextureImage(VkImage image, MemoryAllocation imageMemory);
+	uint32_t allocateTextureSlot();
+	void createTextureDescriptor(uint32_t slot, VkImageView textureImage);
+	void updateTextureStreaming();
+	void installStreamedTextures();
+	void releaseTexture(int textureId);
+	uint32_t createSampler(const VkSamplerCreateInfo& samplerCreateInfo);
+	uint32_t createMaterialSampler(const TextureAddressing& addressing);
+	VkSamplerCreateInfo getDefaultSamplerCreateInfo();
 
 	// -- Loader Functions -- //
-	stbi_uc * loadTexture(std::string fileName, int * width, int * height, VkDeviceSize * imageSize);
+	// Safe to call from loader threads (CPU work only)
+	static LoadedTexture loadCachedTexture(TextureCache* cache, const std::string& key,
+		const std::vector<TextureSource>& sources, uint32_t channels, bool allowCompressed, uint32_t mipSkip);
+	static void skipTopMipLevels(LoadedTexture* texture, uint32_t mipSkip);
+	static bool loadBakedTexture(std::string fileName, bool allowCompressed, LoadedTexture* texture);
+	static LoadedTexture loadTexturePixels(std::string fileName);
+	static LoadedTexture loadEmbeddedTexture(const std::vector<unsigned char>& data, unsigned int width, unsigned int height,
+		std::string name);
+	static LoadedTexture loadTextureSource(const TextureSource& source);
+	static LoadedTexture loadPackedTexture(const std::vector<TextureSource>& sources);
+	static uint32_t getPackedTextureChannels(const std::vector<TextureSource>& sources);
+	static VkFormat getUncompressedVkFormat(uint32_t channels);
+	static VkFormat getTextureVkFormat(TextureFormat format);
+	static void loadModelData(ModelLoad* load);
+	// Main thread side of background loads
+	static bool isModelLoadDecoded(ModelLoad* load, bool wait);
+	static void packTextureAtlases(ModelLoad* load);
+	void uploadModelData(ModelLoad* load);
+	void releaseHeldTextures(ModelLoad* load);
+	void updateModelLoads(bool waitForAll);
 };
 